@@ -1,8 +1,13 @@
 #pragma once
 
 #include "maltime.h"
+#include "threadPool.h"
+#include "profiler.h"
+#include "componentObservers.h"
+#include "resourceManager.h"
 
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace malachite
@@ -11,7 +16,7 @@ namespace malachite
 
   struct appArgs
   {
-    int argCount;
+    int argCount = 0;
     char** args = nullptr;
   };
 
@@ -33,13 +38,44 @@ namespace malachite
     {
       s_instance->close();
     }
+
+    static componentObservers& getComponentObservers()
+    {
+      return s_instance->m_componentObservers;
+    }
+
+    static threadPool& getThreadPool()
+    {
+      return s_instance->m_threadPool;
+    }
+
+    static resourceManager& getResourceManager()
+    {
+      return s_instance->m_resourceManager;
+    }
+
+    static profiler& getProfiler()
+    {
+      return s_instance->m_profiler;
+    }
+
+    //Command line flags such as --benchmark-draws or --trace, the value is the argument following the flag.
+    static bool hasArg(std::string_view flag);
+
+    //Null when the flag isn't given or is followed by another flag.
+    static const char* getArgValue(std::string_view flag);
   private:
     void start();
     void update();
 
+    appArgs m_args;
     maltime m_time;
     bool m_isRunning;
     std::vector<layer*> m_layers;
+    componentObservers m_componentObservers;
+    profiler m_profiler;
+    threadPool m_threadPool;
+    resourceManager m_resourceManager;
   };
 
   application* createApplication(appArgs args);
@@ -0,0 +1,61 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cassert>
+#include <vector>
+
+namespace malachite
+{
+  //Non-owning view over contiguous memory, whoever hands one out keeps the memory alive.
+  template <typename T>
+  struct arrayView
+  {
+    const T* data = nullptr;
+    size_t size = 0;
+
+    arrayView() = default;
+
+    arrayView(const T* data, size_t size)
+      : data(data), size(size)
+    {
+    }
+
+    arrayView(const std::vector<T>& vector)
+      : data(vector.data()), size(vector.size())
+    {
+    }
+
+    bool empty() const
+    {
+      return size == 0;
+    }
+
+    size_t sizeBytes() const
+    {
+      return size * sizeof(T);
+    }
+
+    const T* begin() const
+    {
+      return data;
+    }
+
+    const T* end() const
+    {
+      return data + size;
+    }
+
+    const T& operator[](size_t index) const
+    {
+      return data[index];
+    }
+
+    //Same memory seen as another type, the caller guarantees the alignment of U.
+    template <typename U>
+    arrayView<U> as() const
+    {
+      assert(reinterpret_cast<uintptr_t>(data) % alignof(U) == 0 && "arrayView reinterpreted at a misaligned address");
+      return arrayView<U>(reinterpret_cast<const U*>(data), sizeBytes() / sizeof(U));
+    }
+  };
+}
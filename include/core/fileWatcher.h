@@ -0,0 +1,62 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <filesystem>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace malachite
+{
+  //Watches directories through inotify on its own thread. Files that finished writing
+  //(or were moved in, which is how most editors save) are queued until pollChanges.
+  class fileWatcher
+  {
+    public:
+      fileWatcher() = default;
+      ~fileWatcher();
+
+      fileWatcher(const fileWatcher&) = delete;
+      fileWatcher& operator=(const fileWatcher&) = delete;
+
+      //Starts the watch thread on first use. Watching a directory twice is a no op.
+      //Recursive watches also pick up subdirectories created later.
+      bool watchDirectory(const std::filesystem::path& directory, bool isRecursive = true);
+
+      //Every file changed since the last call, once each, as absolute paths.
+      //Errors the watch thread ran into are logged here too, call it from the main thread.
+      std::vector<std::filesystem::path> pollChanges();
+
+      void stop();
+
+      bool isWatching() const
+      {
+        return m_inotifyDescriptor >= 0;
+      }
+
+    private:
+      struct watchedDirectory
+      {
+        std::filesystem::path path;
+        bool isRecursive = false;
+      };
+
+      bool start();
+      bool addWatch(const std::filesystem::path& directory, bool isRecursive);
+      void watchLoop();
+
+      //The logger isn't thread safe, the watch thread queues its errors with the changes.
+      void queueError(std::string message);
+      void logErrors();
+
+      int m_inotifyDescriptor = -1;
+      int m_wakeDescriptor = -1;
+      std::thread m_watchThread;
+
+      std::mutex m_mutex;
+      std::unordered_map<int, watchedDirectory> m_watches;
+      std::unordered_set<std::string> m_changedFiles;
+      std::vector<std::string> m_errors;
+  };
+}
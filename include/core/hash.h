@@ -0,0 +1,28 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <string_view>
+
+namespace malachite
+{
+  constexpr uint64_t c_fnv1a64Offset = 14695981039346656037ull;
+  constexpr uint64_t c_fnv1a64Prime = 1099511628211ull;
+
+  //FNV-1a, pass a previous result as seed to hash several pieces as one.
+  constexpr uint64_t fnv1a64(const char* data, size_t size, uint64_t seed = c_fnv1a64Offset)
+  {
+    uint64_t hash = seed;
+    for (size_t i = 0; i < size; i++)
+    {
+      hash ^= (uint8_t) data[i];
+      hash *= c_fnv1a64Prime;
+    }
+
+    return hash;
+  }
+
+  constexpr uint64_t fnv1a64(std::string_view text, uint64_t seed = c_fnv1a64Offset)
+  {
+    return fnv1a64(text.data(), text.size(), seed);
+  }
+}
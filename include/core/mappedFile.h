@@ -0,0 +1,57 @@
+#pragma once
+#include <cstddef>
+#include <string_view>
+#include <filesystem>
+
+#include "arrayView.h"
+
+namespace malachite
+{
+  //Read only memory mapping of a whole file, pages are faulted in on first touch.
+  class mappedFile
+  {
+    public:
+      mappedFile() = default;
+      ~mappedFile();
+
+      mappedFile(mappedFile&& other) noexcept;
+      mappedFile& operator=(mappedFile&& other) noexcept;
+
+      mappedFile(const mappedFile&) = delete;
+      mappedFile& operator=(const mappedFile&) = delete;
+
+      //Returns false when the file can't be opened or mapped. Empty files open with no data.
+      bool open(const std::filesystem::path& path);
+      void close();
+
+      bool isOpen() const
+      {
+        return m_isOpen;
+      }
+
+      const char* getData() const
+      {
+        return m_data;
+      }
+
+      size_t getSize() const
+      {
+        return m_size;
+      }
+
+      arrayView<char> getBytes() const
+      {
+        return arrayView<char>(m_data, m_size);
+      }
+
+      std::string_view getText() const
+      {
+        return std::string_view(m_data, m_size);
+      }
+
+    private:
+      const char* m_data = nullptr;
+      size_t m_size = 0;
+      bool m_isOpen = false;
+  };
+}
@@ -0,0 +1,115 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <string>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <filesystem>
+
+#define MAL_PROFILE_CONCAT_INNER(a, b) a##b
+#define MAL_PROFILE_CONCAT(a, b) MAL_PROFILE_CONCAT_INNER(a, b)
+
+//Times the rest of the enclosing block on the calling thread's track.
+#define MAL_PROFILE_SCOPE(name) ::malachite::profileScope MAL_PROFILE_CONCAT(profileScope, __LINE__)(name)
+
+namespace malachite
+{
+  using profileTrack = uint32_t;
+
+  //Timing of one scope name on one track.
+  struct profileTiming
+  {
+    std::string track;
+    std::string name;
+    double lastMilliseconds = 0.0;
+
+    //Exponential moving average, steady enough to read while still following changes.
+    double averageMilliseconds = 0.0;
+    uint64_t count = 0;
+  };
+
+  //Collects timed scopes from CPU threads and other timelines such as GPU queues on the one
+  //steady_clock timeline, so everything recorded lines up in an exported trace. The last maxEvents
+  //events are kept for the trace, timings are kept per track and name for as long as the profiler.
+  //Thread safe.
+  class profiler
+  {
+    public:
+      using clock = std::chrono::steady_clock;
+
+      profiler(size_t maxEvents = 1 << 16);
+
+      profiler(const profiler&) = delete;
+      profiler& operator=(const profiler&) = delete;
+
+      //Track of the calling thread, created the first time the thread records something.
+      profileTrack getThreadTrack();
+
+      //Timeline that isn't a CPU thread.
+      profileTrack addTrack(const std::string& name);
+
+      void addEvent(profileTrack track, const std::string& name, clock::time_point begin, clock::time_point end);
+
+      std::vector<profileTiming> getTimings() const;
+
+      //False when nothing was recorded under that track and name yet.
+      bool getTiming(const std::string& track, const std::string& name, profileTiming& timing) const;
+
+      //Chrome trace event JSON of the kept events, opens in chrome://tracing and Perfetto.
+      bool writeTrace(const std::filesystem::path& path) const;
+
+    private:
+      struct event
+      {
+        profileTrack track;
+        uint32_t name;
+        clock::time_point begin;
+        clock::time_point end;
+      };
+
+      struct timing
+      {
+        double lastMilliseconds = 0.0;
+        double averageMilliseconds = 0.0;
+        uint64_t count = 0;
+      };
+
+      uint32_t internName(const std::string& name);
+
+      mutable std::mutex m_mutex;
+      clock::time_point m_epoch;
+
+      std::vector<std::string> m_trackNames;
+      std::map<std::thread::id, profileTrack> m_threadTracks;
+
+      //Names are stored once, events refer to them by index.
+      std::vector<std::string> m_names;
+      std::map<std::string, uint32_t> m_nameIds;
+
+      //Ring of the most recent events, m_nextEvent wraps once it is full.
+      std::vector<event> m_events;
+      size_t m_maxEvents;
+      size_t m_nextEvent = 0;
+
+      //Keyed by track then name.
+      std::map<std::pair<profileTrack, uint32_t>, timing> m_timings;
+  };
+
+  //Adds an event to the application's profiler when it goes out of scope, see MAL_PROFILE_SCOPE.
+  class profileScope
+  {
+    public:
+      profileScope(const char* name);
+      ~profileScope();
+
+      profileScope(const profileScope&) = delete;
+      profileScope& operator=(const profileScope&) = delete;
+
+    private:
+      const char* m_name;
+      profiler::clock::time_point m_begin;
+  };
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+
+namespace malachite
+{
+  //Fixed set of worker threads pulling jobs from one shared queue.
+  class threadPool
+  {
+    public:
+      //0 uses one worker per hardware thread minus the calling thread.
+      threadPool(uint32_t threadCount = 0);
+      ~threadPool();
+
+      threadPool(const threadPool&) = delete;
+      threadPool& operator=(const threadPool&) = delete;
+
+      void submit(std::function<void()> job);
+
+      template <typename Func>
+      auto submitTask(Func func) -> std::future<decltype(func())>
+      {
+        using resultType = decltype(func());
+
+        auto task = std::make_shared<std::packaged_task<resultType()>>(std::move(func));
+        std::future<resultType> result = task->get_future();
+
+        submit([task]() { (*task)(); });
+
+        return result;
+      }
+
+      //Splits [0, count) into chunks of grainSize and runs them across the workers.
+      //The calling thread works on chunks too and returns once every chunk is done,
+      //so it is safe to call from inside a job.
+      void parallelFor(size_t count, size_t grainSize, const std::function<void(size_t begin, size_t end)>& func);
+
+      uint32_t getThreadCount() const
+      {
+        return static_cast<uint32_t>(m_workers.size());
+      }
+
+    private:
+      void workerLoop();
+
+      std::vector<std::thread> m_workers;
+      std::deque<std::function<void()>> m_jobs;
+      std::mutex m_jobMutex;
+      std::condition_variable m_jobCondition;
+      bool m_isStopping = false;
+  };
+}
@@ -0,0 +1,123 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <functional>
+
+namespace malachite
+{
+  using entityID = uint32_t;
+  using componentTypeID = uint32_t;
+  using componentObserverID = uint32_t;
+
+  //Hands out a dense id per component type, used to index per type event lists.
+  class componentTypes
+  {
+    public:
+      template <typename T>
+      static componentTypeID getID()
+      {
+        static const componentTypeID id = s_nextComponentTypeID++;
+        return id;
+      }
+
+    private:
+      static componentTypeID s_nextComponentTypeID;
+  };
+
+  //Everything that happened to one component type since the last flush, as the net change per entity.
+  //An entity that got the component and lost it again is in neither list, one that lost it and got it
+  //again is in both, handle removals first. Pointers are only valid for the duration of the observer call.
+  struct componentEventBatch
+  {
+    componentTypeID componentType;
+
+    const entityID* addedEntities = nullptr;
+    size_t addedCount = 0;
+
+    const entityID* removedEntities = nullptr;
+    size_t removedCount = 0;
+  };
+
+  using componentObserverFunc = std::function<void(const componentEventBatch&)>;
+
+  //Collects component add/remove events into contiguous per type lists during the frame
+  //and hands each observer one batch when flush is called, instead of a callback per entity.
+  //Recording and flushing are expected to happen on the main thread.
+  class componentObservers
+  {
+    public:
+      template <typename T>
+      componentObserverID observe(componentObserverFunc func)
+      {
+        return observe(componentTypes::getID<T>(), func);
+      }
+
+      template <typename T>
+      void notifyAdded(entityID entity)
+      {
+        notifyAdded(componentTypes::getID<T>(), entity);
+      }
+
+      template <typename T>
+      void notifyRemoved(entityID entity)
+      {
+        notifyRemoved(componentTypes::getID<T>(), entity);
+      }
+
+      componentObserverID observe(componentTypeID componentType, componentObserverFunc func);
+      void removeObserver(componentObserverID observerID);
+
+      void notifyAdded(componentTypeID componentType, entityID entity);
+      void notifyRemoved(componentTypeID componentType, entityID entity);
+
+      //Delivers the pending batch of every component type to its observers.
+      //Events recorded while observers run are delivered on the next flush, observers added
+      //while observers run only see those.
+      void flush();
+
+    private:
+      //Removed observers keep their slot with id 0 until the flush running them ends.
+      struct observer
+      {
+        componentObserverID id;
+        componentObserverFunc func;
+      };
+
+      struct componentEvent
+      {
+        entityID entity;
+        bool isAdded;
+      };
+
+      struct componentEventList
+      {
+        //In the order they were recorded.
+        std::vector<componentEvent> events;
+        bool hasAdded = false;
+        bool hasRemoved = false;
+
+        std::vector<observer> observers;
+
+        //Observed during a flush, joins observers once it ends.
+        std::vector<observer> pendingObservers;
+        uint32_t observerCount = 0;
+      };
+
+      componentEventList& getEventList(componentTypeID componentType);
+      void record(componentTypeID componentType, entityID entity, bool isAdded);
+
+      //Fills the dispatch lists with the net change of every entity in the list.
+      void buildBatch(componentEventList& eventList);
+
+      std::vector<componentEventList> m_eventLists;
+      bool m_isFlushing = false;
+
+      //Swapped with a type's events during flush so observers can record new events safely.
+      std::vector<componentEvent> m_dispatchEvents;
+      std::vector<entityID> m_dispatchAdded;
+      std::vector<entityID> m_dispatchRemoved;
+
+      componentObserverID m_nextObserverID = 1;
+  };
+}
@@ -0,0 +1,358 @@
+#pragma once
+#include <cstdint>
+#include <array>
+#include <cassert>
+#include <limits>
+#include <type_traits>
+
+namespace malachite
+{
+  namespace math
+  {
+    //Signed fixed point number, FractionBits of fraction stored in T with products and quotients
+    //widened to WideT. Everything is integer arithmetic, so a simulation step gives the same bits
+    //on every compiler, flag set and CPU, which lockstep and replays rely on.
+    template <typename T, typename WideT, int FractionBits>
+    struct fixed
+    {
+      static constexpr int fractionBits = FractionBits;
+      static constexpr T oneRaw = T(1) << FractionBits;
+
+      T raw = 0;
+
+      constexpr fixed() = default;
+
+      //Explicit, mixing in a float would silently truncate it. Floats go through fromDouble.
+      explicit constexpr fixed(int value) : raw(T(value) * oneRaw) {}
+      fixed(float) = delete;
+      fixed(double) = delete;
+
+      static constexpr fixed fromRaw(T raw)
+      {
+        fixed result;
+        result.raw = raw;
+        return result;
+      }
+
+      //Meant for constants and tooling only, simulation code should stay in fixed point.
+      static constexpr fixed fromDouble(double value)
+      {
+        return fromRaw(T(value * double(oneRaw) + (value < 0.0 ? -0.5 : 0.5)));
+      }
+
+      constexpr double toDouble() const { return double(raw) / double(oneRaw); }
+      constexpr float toFloat() const { return float(toDouble()); }
+
+      //Rounds toward negative infinity.
+      constexpr T toInt() const { return raw >> FractionBits; }
+
+      friend constexpr fixed operator+(fixed a, fixed b) { return fromRaw(a.raw + b.raw); }
+      friend constexpr fixed operator-(fixed a, fixed b) { return fromRaw(a.raw - b.raw); }
+      friend constexpr fixed operator-(fixed a) { return fromRaw(-a.raw); }
+
+      //Rounds to nearest. The product has to fit the range of the type, fixed16 30000 * 2 would wrap
+      //around to -5536, debug builds assert instead.
+      friend constexpr fixed operator*(fixed a, fixed b)
+      {
+        WideT product = (WideT(a.raw) * b.raw + (WideT(1) << (FractionBits - 1))) >> FractionBits;
+        assert(product >= WideT(std::numeric_limits<T>::min()) && product <= WideT(std::numeric_limits<T>::max()) && "fixed point multiplication overflow");
+
+        return fromRaw(T(product));
+      }
+
+      //Rounds toward zero.
+      friend constexpr fixed operator/(fixed a, fixed b)
+      {
+        assert(b.raw != 0 && "fixed point division by zero");
+        return fromRaw(T((WideT(a.raw) * oneRaw) / b.raw));
+      }
+
+      constexpr fixed& operator+=(fixed other) { return *this = *this + other; }
+      constexpr fixed& operator-=(fixed other) { return *this = *this - other; }
+      constexpr fixed& operator*=(fixed other) { return *this = *this * other; }
+      constexpr fixed& operator/=(fixed other) { return *this = *this / other; }
+
+      friend constexpr bool operator==(fixed a, fixed b) { return a.raw == b.raw; }
+      friend constexpr bool operator!=(fixed a, fixed b) { return a.raw != b.raw; }
+      friend constexpr bool operator<(fixed a, fixed b) { return a.raw < b.raw; }
+      friend constexpr bool operator<=(fixed a, fixed b) { return a.raw <= b.raw; }
+      friend constexpr bool operator>(fixed a, fixed b) { return a.raw > b.raw; }
+      friend constexpr bool operator>=(fixed a, fixed b) { return a.raw >= b.raw; }
+    };
+
+    //Q16.16, range of +-32768 with a resolution of ~1.5e-5.
+    using fixed16 = fixed<int32_t, int64_t, 16>;
+
+    //Q32.32, range of +-2^31 with a resolution of ~2.3e-10.
+    using fixed32 = fixed<int64_t, __int128, 32>;
+
+    template <typename F>
+    struct isFixed : std::false_type {};
+
+    template <typename T, typename WideT, int FractionBits>
+    struct isFixed<fixed<T, WideT, FractionBits>> : std::true_type {};
+
+    template <typename F, typename = std::enable_if_t<isFixed<F>::value>>
+    constexpr F pi() { return F::fromDouble(3.14159265358979323846); }
+
+    template <typename F, typename = std::enable_if_t<isFixed<F>::value>>
+    constexpr F halfPi() { return F::fromDouble(1.57079632679489661923); }
+
+    template <typename T, typename WideT, int FractionBits>
+    constexpr fixed<T, WideT, FractionBits> abs(fixed<T, WideT, FractionBits> value)
+    {
+      return value.raw < 0 ? -value : value;
+    }
+
+    namespace fixedDetail
+    {
+      //Quarter sine wave sampled at compile time, stored as Q2.30.
+      constexpr int sineStepsPerQuarter = 1024;
+      constexpr int sineStepsPerTurn = sineStepsPerQuarter * 4;
+      constexpr int sineTableFractionBits = 30;
+
+      constexpr double sineTaylor(double x)
+      {
+        double term = x;
+        double sum = x;
+
+        for (int n = 1; n < 14; n++)
+        {
+          term *= -x * x / double((2 * n) * (2 * n + 1));
+          sum += term;
+        }
+
+        return sum;
+      }
+
+      constexpr std::array<int32_t, sineStepsPerQuarter + 1> makeSineTable()
+      {
+        std::array<int32_t, sineStepsPerQuarter + 1> table{};
+
+        for (int i = 0; i <= sineStepsPerQuarter; i++)
+        {
+          double x = 1.57079632679489661923 * double(i) / double(sineStepsPerQuarter);
+          table[i] = int32_t(sineTaylor(x) * double(1 << sineTableFractionBits) + 0.5);
+        }
+
+        return table;
+      }
+
+      inline constexpr std::array<int32_t, sineStepsPerQuarter + 1> sineTable = makeSineTable();
+
+      //sin of a whole step around the turn, folded onto the quarter table.
+      constexpr int64_t sineAtStep(int32_t step)
+      {
+        step &= sineStepsPerTurn - 1;
+
+        int32_t quadrant = step / sineStepsPerQuarter;
+        int32_t index = step % sineStepsPerQuarter;
+
+        switch (quadrant)
+        {
+          case 0: return sineTable[index];
+          case 1: return sineTable[sineStepsPerQuarter - index];
+          case 2: return -int64_t(sineTable[index]);
+          default: return -int64_t(sineTable[sineStepsPerQuarter - index]);
+        }
+      }
+
+      //phase is measured in table steps with 2 * FractionBits of fraction.
+      template <typename F, typename WideT>
+      constexpr F sineFromPhase(WideT phase)
+      {
+        constexpr int fractionBits = F::fractionBits;
+
+        int32_t step = int32_t((phase >> (2 * fractionBits)) & (sineStepsPerTurn - 1));
+        WideT weight = (phase >> fractionBits) & (WideT(F::oneRaw) - 1);
+
+        int64_t a = sineAtStep(step);
+        int64_t b = sineAtStep(step + 1);
+        int64_t value = a + int64_t((WideT(b - a) * weight) >> fractionBits);
+
+        if constexpr (fractionBits < sineTableFractionBits)
+        {
+          constexpr int shift = sineTableFractionBits - fractionBits;
+          return F::fromRaw(decltype(F::raw)((value + (int64_t(1) << (shift - 1))) >> shift));
+        }
+        else
+        {
+          return F::fromRaw(decltype(F::raw)(value) * (decltype(F::raw)(1) << (fractionBits - sineTableFractionBits)));
+        }
+      }
+
+      template <typename T, typename WideT, int FractionBits>
+      constexpr WideT anglePhase(fixed<T, WideT, FractionBits> angle)
+      {
+        using F = fixed<T, WideT, FractionBits>;
+        constexpr T stepsPerRadian = F::fromDouble(double(sineStepsPerTurn) / 6.28318530717958647692).raw;
+
+        return WideT(angle.raw) * stepsPerRadian;
+      }
+
+      //Abramowitz and Stegun 4.4.49, |error| <= 1e-5 over [0, 1].
+      template <typename F>
+      constexpr F atanUnit(F z)
+      {
+        const F z2 = z * z;
+
+        F result = F::fromDouble(0.0208351);
+        result = result * z2 - F::fromDouble(0.0851330);
+        result = result * z2 + F::fromDouble(0.1801410);
+        result = result * z2 - F::fromDouble(0.3302995);
+        result = result * z2 + F::fromDouble(0.9998660);
+
+        return result * z;
+      }
+    }
+
+    //Interpolated table lookup. The table is off by ~3e-7, rounding the angle and the result to the
+    //type adds to that, ~8e-6 in total for fixed16.
+    template <typename T, typename WideT, int FractionBits>
+    constexpr fixed<T, WideT, FractionBits> sin(fixed<T, WideT, FractionBits> angle)
+    {
+      using F = fixed<T, WideT, FractionBits>;
+      return fixedDetail::sineFromPhase<F>(fixedDetail::anglePhase(angle));
+    }
+
+    template <typename T, typename WideT, int FractionBits>
+    constexpr fixed<T, WideT, FractionBits> cos(fixed<T, WideT, FractionBits> angle)
+    {
+      using F = fixed<T, WideT, FractionBits>;
+      constexpr WideT quarterTurn = WideT(fixedDetail::sineStepsPerQuarter) << (2 * FractionBits);
+
+      return fixedDetail::sineFromPhase<F>(fixedDetail::anglePhase(angle) + quarterTurn);
+    }
+
+    //Polynomial with octant folding, accurate to ~1.2e-5 radians plus the rounding of the type
+    //(~6e-5 for fixed16). atan2(0, 0) returns 0.
+    template <typename T, typename WideT, int FractionBits>
+    constexpr fixed<T, WideT, FractionBits> atan2(fixed<T, WideT, FractionBits> y, fixed<T, WideT, FractionBits> x)
+    {
+      using F = fixed<T, WideT, FractionBits>;
+
+      if (x.raw == 0 && y.raw == 0)
+      {
+        return F();
+      }
+
+      const F absX = abs(x);
+      const F absY = abs(y);
+
+      F angle = absY <= absX
+        ? fixedDetail::atanUnit(absY / absX)
+        : halfPi<F>() - fixedDetail::atanUnit(absX / absY);
+
+      if (x.raw < 0)
+      {
+        angle = pi<F>() - angle;
+      }
+
+      return y.raw < 0 ? -angle : angle;
+    }
+
+    //Digit by digit integer square root, rounds down so it is less than a step of the type low.
+    //Negative input returns 0.
+    template <typename T, typename WideT, int FractionBits>
+    constexpr fixed<T, WideT, FractionBits> sqrt(fixed<T, WideT, FractionBits> value)
+    {
+      using F = fixed<T, WideT, FractionBits>;
+
+      if (value.raw <= 0)
+      {
+        return F();
+      }
+
+      //sqrt(raw / 2^F) * 2^F == sqrt(raw * 2^F)
+      WideT remainder = WideT(value.raw) * WideT(F::oneRaw);
+      WideT result = 0;
+      WideT bit = WideT(1) << (sizeof(WideT) * 8 - 2);
+
+      while (bit > remainder)
+      {
+        bit >>= 2;
+      }
+
+      while (bit != 0)
+      {
+        if (remainder >= result + bit)
+        {
+          remainder -= result + bit;
+          result = (result >> 1) + bit;
+        }
+        else
+        {
+          result >>= 1;
+        }
+
+        bit >>= 2;
+      }
+
+      return F::fromRaw(T(result));
+    }
+
+    ///
+    /// Fixed point vectors
+    ///
+
+    template <typename F>
+    struct fixedVec2
+    {
+      F x;
+      F y;
+
+      constexpr fixedVec2() = default;
+      constexpr fixedVec2(F x, F y) : x(x), y(y) {}
+
+      friend constexpr fixedVec2 operator+(const fixedVec2& a, const fixedVec2& b) { return {a.x + b.x, a.y + b.y}; }
+      friend constexpr fixedVec2 operator-(const fixedVec2& a, const fixedVec2& b) { return {a.x - b.x, a.y - b.y}; }
+      friend constexpr fixedVec2 operator-(const fixedVec2& a) { return {-a.x, -a.y}; }
+      friend constexpr fixedVec2 operator*(const fixedVec2& a, F s) { return {a.x * s, a.y * s}; }
+      friend constexpr fixedVec2 operator/(const fixedVec2& a, F s) { return {a.x / s, a.y / s}; }
+      friend constexpr bool operator==(const fixedVec2& a, const fixedVec2& b) { return a.x == b.x && a.y == b.y; }
+      friend constexpr bool operator!=(const fixedVec2& a, const fixedVec2& b) { return !(a == b); }
+    };
+
+    template <typename F>
+    struct fixedVec3
+    {
+      F x;
+      F y;
+      F z;
+
+      constexpr fixedVec3() = default;
+      constexpr fixedVec3(F x, F y, F z) : x(x), y(y), z(z) {}
+
+      friend constexpr fixedVec3 operator+(const fixedVec3& a, const fixedVec3& b) { return {a.x + b.x, a.y + b.y, a.z + b.z}; }
+      friend constexpr fixedVec3 operator-(const fixedVec3& a, const fixedVec3& b) { return {a.x - b.x, a.y - b.y, a.z - b.z}; }
+      friend constexpr fixedVec3 operator-(const fixedVec3& a) { return {-a.x, -a.y, -a.z}; }
+      friend constexpr fixedVec3 operator*(const fixedVec3& a, F s) { return {a.x * s, a.y * s, a.z * s}; }
+      friend constexpr fixedVec3 operator/(const fixedVec3& a, F s) { return {a.x / s, a.y / s, a.z / s}; }
+      friend constexpr bool operator==(const fixedVec3& a, const fixedVec3& b) { return a.x == b.x && a.y == b.y && a.z == b.z; }
+      friend constexpr bool operator!=(const fixedVec3& a, const fixedVec3& b) { return !(a == b); }
+    };
+
+    template <typename F>
+    constexpr F dot(const fixedVec2<F>& a, const fixedVec2<F>& b) { return a.x * b.x + a.y * b.y; }
+
+    template <typename F>
+    constexpr F dot(const fixedVec3<F>& a, const fixedVec3<F>& b) { return (a.x * b.x + a.y * b.y) + a.z * b.z; }
+
+    template <typename F>
+    constexpr fixedVec3<F> cross(const fixedVec3<F>& a, const fixedVec3<F>& b)
+    {
+      return {a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x};
+    }
+
+    template <typename F>
+    constexpr F length(const fixedVec2<F>& v) { return sqrt(dot(v, v)); }
+
+    template <typename F>
+    constexpr F length(const fixedVec3<F>& v) { return sqrt(dot(v, v)); }
+
+    using fixed16Vec2 = fixedVec2<fixed16>;
+    using fixed16Vec3 = fixedVec3<fixed16>;
+    using fixed32Vec2 = fixedVec2<fixed32>;
+    using fixed32Vec3 = fixedVec3<fixed32>;
+  }
+}
@@ -0,0 +1,8 @@
+#pragma once
+
+//Single include for the malachite::math module.
+#include "mathSimd.h"
+#include "vec.h"
+#include "mat.h"
+#include "quat.h"
+#include "fixed.h"
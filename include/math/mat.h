@@ -0,0 +1,149 @@
+#pragma once
+#include "vec.h"
+
+namespace malachite
+{
+  namespace math
+  {
+    struct quat;
+
+    //Column major, matching GLSL and what the shaders expect in uniform data.
+    struct mat3
+    {
+      vec3 columns[3];
+
+      mat3() = default;
+      constexpr mat3(const vec3& c0, const vec3& c1, const vec3& c2) : columns{c0, c1, c2} {}
+
+      static mat3 identity()
+      {
+        return mat3({1.0f, 0.0f, 0.0f}, {0.0f, 1.0f, 0.0f}, {0.0f, 0.0f, 1.0f});
+      }
+
+      vec3& operator[](int i) { return columns[i]; }
+      const vec3& operator[](int i) const { return columns[i]; }
+    };
+
+    struct alignas(16) mat4
+    {
+      vec4 columns[4];
+
+      mat4() = default;
+      constexpr mat4(const vec4& c0, const vec4& c1, const vec4& c2, const vec4& c3) : columns{c0, c1, c2, c3} {}
+
+      static mat4 identity()
+      {
+        return mat4
+        (
+          {1.0f, 0.0f, 0.0f, 0.0f},
+          {0.0f, 1.0f, 0.0f, 0.0f},
+          {0.0f, 0.0f, 1.0f, 0.0f},
+          {0.0f, 0.0f, 0.0f, 1.0f}
+        );
+      }
+
+      vec4& operator[](int i) { return columns[i]; }
+      const vec4& operator[](int i) const { return columns[i]; }
+    };
+
+    ///
+    /// mat3
+    ///
+
+    inline vec3 operator*(const mat3& m, const vec3& v)
+    {
+      return (m[0] * v.x + m[1] * v.y) + m[2] * v.z;
+    }
+
+    inline mat3 operator*(const mat3& a, const mat3& b)
+    {
+      return mat3(a * b[0], a * b[1], a * b[2]);
+    }
+
+    mat3 transpose(const mat3& m);
+    mat3 inverse(const mat3& m);
+    float determinant(const mat3& m);
+
+    ///
+    /// mat4
+    /// Every column is computed as ((c0 * x + c1 * y) + c2 * z) + c3 * w on all backends.
+    ///
+
+#if MAL_MATH_SIMD
+    inline __m128 transformColumn(const mat4& m, __m128 v)
+    {
+      __m128 r = _mm_mul_ps(load(m[0]), _mm_shuffle_ps(v, v, _MM_SHUFFLE(0, 0, 0, 0)));
+      r = _mm_add_ps(r, _mm_mul_ps(load(m[1]), _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1))));
+      r = _mm_add_ps(r, _mm_mul_ps(load(m[2]), _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 2, 2))));
+      r = _mm_add_ps(r, _mm_mul_ps(load(m[3]), _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3))));
+      return r;
+    }
+
+    inline vec4 operator*(const mat4& m, const vec4& v)
+    {
+      return store(transformColumn(m, load(v)));
+    }
+
+    inline mat4 operator*(const mat4& a, const mat4& b)
+    {
+      mat4 result;
+#if MAL_MATH_AVX2
+      //Two result columns per iteration, each 128 bit lane does the same work as the SSE path.
+      //A mat4 is only 16 byte aligned, so column pairs are loaded and stored unaligned.
+      __m256 a0 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&a[0].x));
+      __m256 a1 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&a[1].x));
+      __m256 a2 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&a[2].x));
+      __m256 a3 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&a[3].x));
+
+      for (int i = 0; i < 4; i += 2)
+      {
+        __m256 bb = _mm256_loadu_ps(&b[i].x);
+
+        __m256 r = _mm256_mul_ps(a0, _mm256_permute_ps(bb, _MM_SHUFFLE(0, 0, 0, 0)));
+        r = _mm256_add_ps(r, _mm256_mul_ps(a1, _mm256_permute_ps(bb, _MM_SHUFFLE(1, 1, 1, 1))));
+        r = _mm256_add_ps(r, _mm256_mul_ps(a2, _mm256_permute_ps(bb, _MM_SHUFFLE(2, 2, 2, 2))));
+        r = _mm256_add_ps(r, _mm256_mul_ps(a3, _mm256_permute_ps(bb, _MM_SHUFFLE(3, 3, 3, 3))));
+
+        _mm256_storeu_ps(&result[i].x, r);
+      }
+#else
+      for (int i = 0; i < 4; i++)
+      {
+        _mm_store_ps(&result[i].x, transformColumn(a, load(b[i])));
+      }
+#endif
+      return result;
+    }
+#else
+    inline vec4 operator*(const mat4& m, const vec4& v)
+    {
+      return ((m[0] * v.x + m[1] * v.y) + m[2] * v.z) + m[3] * v.w;
+    }
+
+    inline mat4 operator*(const mat4& a, const mat4& b)
+    {
+      return mat4(a * b[0], a * b[1], a * b[2], a * b[3]);
+    }
+#endif
+
+    inline vec3 transformPoint(const mat4& m, const vec3& p)
+    {
+      return toVec3(m * vec4(p, 1.0f));
+    }
+
+    inline vec3 transformDirection(const mat4& m, const vec3& d)
+    {
+      return toVec3(m * vec4(d, 0.0f));
+    }
+
+    mat4 transpose(const mat4& m);
+    mat4 inverse(const mat4& m);
+
+    mat4 translation(const vec3& t);
+    mat4 scaling(const vec3& s);
+
+    //Right handed, depth mapped to [0, 1] and Y flipped for Vulkan clip space.
+    mat4 perspective(float fovY, float aspect, float nearPlane, float farPlane);
+    mat4 lookAt(const vec3& eye, const vec3& target, const vec3& up);
+  }
+}
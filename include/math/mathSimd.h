@@ -0,0 +1,43 @@
+#pragma once
+
+//Backend selection for malachite::math, picked at compile time from the target flags.
+//Define MAL_MATH_FORCE_SCALAR to build the portable fallback on any target.
+//
+//Every vector backend performs the same IEEE operations in the same order as the scalar
+//code (no fused multiply-add, no reciprocal approximations), so results match bit for bit.
+
+#if defined(MAL_MATH_FORCE_SCALAR)
+  #define MAL_MATH_SIMD 0
+  #define MAL_MATH_AVX2 0
+#elif defined(__AVX2__)
+  #define MAL_MATH_SIMD 1
+  #define MAL_MATH_AVX2 1
+#elif defined(__SSE4_1__)
+  #define MAL_MATH_SIMD 1
+  #define MAL_MATH_AVX2 0
+#else
+  #define MAL_MATH_SIMD 0
+  #define MAL_MATH_AVX2 0
+#endif
+
+#if MAL_MATH_SIMD
+  #include <immintrin.h>
+#endif
+
+namespace malachite
+{
+  namespace math
+  {
+    //Name of the backend compiled in, useful when logging or comparing results.
+    inline const char* getMathBackendName()
+    {
+#if MAL_MATH_AVX2
+      return "avx2";
+#elif MAL_MATH_SIMD
+      return "sse4";
+#else
+      return "scalar";
+#endif
+    }
+  }
+}
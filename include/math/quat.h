@@ -0,0 +1,58 @@
+#pragma once
+#include "vec.h"
+#include "mat.h"
+
+namespace malachite
+{
+  namespace math
+  {
+    //Unit quaternion, laid out as a vec4 (x, y, z, w) so it shares the vec4 primitives.
+    struct alignas(16) quat
+    {
+      float x = 0.0f;
+      float y = 0.0f;
+      float z = 0.0f;
+      float w = 1.0f;
+
+      quat() = default;
+      constexpr quat(float x, float y, float z, float w) : x(x), y(y), z(z), w(w) {}
+      explicit quat(const vec4& v) : x(v.x), y(v.y), z(v.z), w(v.w) {}
+
+      vec4 toVec4() const { return {x, y, z, w}; }
+
+      static quat identity() { return quat(0.0f, 0.0f, 0.0f, 1.0f); }
+    };
+
+    //Hamilton product, written with vec4 primitives so every backend rounds identically.
+    inline quat operator*(const quat& a, const quat& b)
+    {
+      const vec4 va = a.toVec4();
+      const vec4 vb = b.toVec4();
+      const vec4 signs(1.0f, 1.0f, 1.0f, -1.0f);
+
+      vec4 r = shuffle<3, 3, 3, 3>(va, va) * vb;
+      r = r + (shuffle<0, 1, 2, 0>(va, va) * shuffle<3, 3, 3, 0>(vb, vb)) * signs;
+      r = r + (shuffle<1, 2, 0, 1>(va, va) * shuffle<2, 0, 1, 1>(vb, vb)) * signs;
+      r = r - (shuffle<2, 0, 1, 2>(va, va) * shuffle<1, 2, 0, 2>(vb, vb));
+
+      return quat(r);
+    }
+
+    inline float dot(const quat& a, const quat& b) { return dot(a.toVec4(), b.toVec4()); }
+    inline quat normalize(const quat& q) { return quat(normalize(q.toVec4())); }
+    inline quat conjugate(const quat& q) { return quat(-q.x, -q.y, -q.z, q.w); }
+
+    inline vec3 rotate(const quat& q, const vec3& v)
+    {
+      const vec3 u(q.x, q.y, q.z);
+      const vec3 t = cross(u, v) * 2.0f;
+      return (v + t * q.w) + cross(u, t);
+    }
+
+    quat fromAxisAngle(const vec3& axis, float angle);
+    quat slerp(const quat& a, const quat& b, float t);
+
+    mat3 toMat3(const quat& q);
+    mat4 toMat4(const quat& q);
+  }
+}
@@ -0,0 +1,153 @@
+#pragma once
+#include <cmath>
+
+#include "mathSimd.h"
+
+namespace malachite
+{
+  namespace math
+  {
+    struct vec2
+    {
+      float x = 0.0f;
+      float y = 0.0f;
+
+      vec2() = default;
+      constexpr vec2(float scalar) : x(scalar), y(scalar) {}
+      constexpr vec2(float x, float y) : x(x), y(y) {}
+
+      float& operator[](int i) { return (&x)[i]; }
+      const float& operator[](int i) const { return (&x)[i]; }
+    };
+
+    struct vec3
+    {
+      float x = 0.0f;
+      float y = 0.0f;
+      float z = 0.0f;
+
+      vec3() = default;
+      constexpr vec3(float scalar) : x(scalar), y(scalar), z(scalar) {}
+      constexpr vec3(float x, float y, float z) : x(x), y(y), z(z) {}
+
+      float& operator[](int i) { return (&x)[i]; }
+      const float& operator[](int i) const { return (&x)[i]; }
+    };
+
+    //16 byte aligned so it can be moved in and out of a vector register directly.
+    struct alignas(16) vec4
+    {
+      float x = 0.0f;
+      float y = 0.0f;
+      float z = 0.0f;
+      float w = 0.0f;
+
+      vec4() = default;
+      constexpr vec4(float scalar) : x(scalar), y(scalar), z(scalar), w(scalar) {}
+      constexpr vec4(float x, float y, float z, float w) : x(x), y(y), z(z), w(w) {}
+      constexpr vec4(const vec3& v, float w) : x(v.x), y(v.y), z(v.z), w(w) {}
+
+      float& operator[](int i) { return (&x)[i]; }
+      const float& operator[](int i) const { return (&x)[i]; }
+    };
+
+    ///
+    /// vec2
+    ///
+
+    inline vec2 operator+(const vec2& a, const vec2& b) { return {a.x + b.x, a.y + b.y}; }
+    inline vec2 operator-(const vec2& a, const vec2& b) { return {a.x - b.x, a.y - b.y}; }
+    inline vec2 operator*(const vec2& a, const vec2& b) { return {a.x * b.x, a.y * b.y}; }
+    inline vec2 operator/(const vec2& a, const vec2& b) { return {a.x / b.x, a.y / b.y}; }
+    inline vec2 operator*(const vec2& a, float s) { return {a.x * s, a.y * s}; }
+    inline vec2 operator-(const vec2& a) { return {-a.x, -a.y}; }
+
+    inline float dot(const vec2& a, const vec2& b) { return a.x * b.x + a.y * b.y; }
+    inline float length(const vec2& v) { return std::sqrt(dot(v, v)); }
+    inline vec2 normalize(const vec2& v) { return v * (1.0f / length(v)); }
+
+    ///
+    /// vec3
+    ///
+
+    inline vec3 operator+(const vec3& a, const vec3& b) { return {a.x + b.x, a.y + b.y, a.z + b.z}; }
+    inline vec3 operator-(const vec3& a, const vec3& b) { return {a.x - b.x, a.y - b.y, a.z - b.z}; }
+    inline vec3 operator*(const vec3& a, const vec3& b) { return {a.x * b.x, a.y * b.y, a.z * b.z}; }
+    inline vec3 operator/(const vec3& a, const vec3& b) { return {a.x / b.x, a.y / b.y, a.z / b.z}; }
+    inline vec3 operator*(const vec3& a, float s) { return {a.x * s, a.y * s, a.z * s}; }
+    inline vec3 operator-(const vec3& a) { return {-a.x, -a.y, -a.z}; }
+
+    inline float dot(const vec3& a, const vec3& b) { return (a.x * b.x + a.y * b.y) + a.z * b.z; }
+
+    inline vec3 cross(const vec3& a, const vec3& b)
+    {
+      return 
+      {
+        a.y * b.z - a.z * b.y,
+        a.z * b.x - a.x * b.z,
+        a.x * b.y - a.y * b.x
+      };
+    }
+
+    inline float length(const vec3& v) { return std::sqrt(dot(v, v)); }
+    inline vec3 normalize(const vec3& v) { return v * (1.0f / length(v)); }
+
+    ///
+    /// vec4
+    /// These are the primitives every other type builds on, each has a scalar and a SIMD
+    /// implementation performing the same operations in the same order.
+    ///
+
+#if MAL_MATH_SIMD
+    inline __m128 load(const vec4& v) { return _mm_load_ps(&v.x); }
+    inline vec4 store(__m128 r) { vec4 v; _mm_store_ps(&v.x, r); return v; }
+
+    inline vec4 operator+(const vec4& a, const vec4& b) { return store(_mm_add_ps(load(a), load(b))); }
+    inline vec4 operator-(const vec4& a, const vec4& b) { return store(_mm_sub_ps(load(a), load(b))); }
+    inline vec4 operator*(const vec4& a, const vec4& b) { return store(_mm_mul_ps(load(a), load(b))); }
+    inline vec4 operator/(const vec4& a, const vec4& b) { return store(_mm_div_ps(load(a), load(b))); }
+    inline vec4 operator*(const vec4& a, float s) { return store(_mm_mul_ps(load(a), _mm_set1_ps(s))); }
+    inline vec4 operator-(const vec4& a) { return store(_mm_xor_ps(load(a), _mm_set1_ps(-0.0f))); }
+
+    //Same semantic as _mm_shuffle_ps: (a[i0], a[i1], b[i2], b[i3])
+    template <int i0, int i1, int i2, int i3>
+    inline vec4 shuffle(const vec4& a, const vec4& b)
+    {
+      return store(_mm_shuffle_ps(load(a), load(b), _MM_SHUFFLE(i3, i2, i1, i0)));
+    }
+
+    //Summed as (x + y) + (z + w), which is also the order the scalar path uses.
+    inline float dot(const vec4& a, const vec4& b)
+    {
+      __m128 m = _mm_mul_ps(load(a), load(b));
+      __m128 t = _mm_add_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(2, 3, 0, 1)));
+      t = _mm_add_ps(t, _mm_shuffle_ps(t, t, _MM_SHUFFLE(1, 0, 3, 2)));
+      return _mm_cvtss_f32(t);
+    }
+#else
+    inline vec4 operator+(const vec4& a, const vec4& b) { return {a.x + b.x, a.y + b.y, a.z + b.z, a.w + b.w}; }
+    inline vec4 operator-(const vec4& a, const vec4& b) { return {a.x - b.x, a.y - b.y, a.z - b.z, a.w - b.w}; }
+    inline vec4 operator*(const vec4& a, const vec4& b) { return {a.x * b.x, a.y * b.y, a.z * b.z, a.w * b.w}; }
+    inline vec4 operator/(const vec4& a, const vec4& b) { return {a.x / b.x, a.y / b.y, a.z / b.z, a.w / b.w}; }
+    inline vec4 operator*(const vec4& a, float s) { return {a.x * s, a.y * s, a.z * s, a.w * s}; }
+    inline vec4 operator-(const vec4& a) { return {-a.x, -a.y, -a.z, -a.w}; }
+
+    template <int i0, int i1, int i2, int i3>
+    inline vec4 shuffle(const vec4& a, const vec4& b)
+    {
+      return {a[i0], a[i1], b[i2], b[i3]};
+    }
+
+    inline float dot(const vec4& a, const vec4& b)
+    {
+      return (a.x * b.x + a.y * b.y) + (a.z * b.z + a.w * b.w);
+    }
+#endif
+
+    inline float length(const vec4& v) { return std::sqrt(dot(v, v)); }
+    inline vec4 normalize(const vec4& v) { return v * (1.0f / length(v)); }
+    inline vec4 lerp(const vec4& a, const vec4& b, float t) { return a + (b - a) * t; }
+
+    inline vec3 toVec3(const vec4& v) { return {v.x, v.y, v.z}; }
+  }
+}
@@ -0,0 +1,97 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <limits>
+
+#include "mat.h"
+
+namespace malachite
+{
+  class threadPool;
+
+  //Six inward facing planes (normal.xyz, distance), normalized so distances are in world units.
+  struct frustum
+  {
+    math::vec4 planes[6];
+  };
+
+  //Extracts the planes from a Vulkan style view projection with depth mapped to [0, 1].
+  frustum extractFrustum(const math::mat4& viewProjection);
+
+  //Bounding spheres of every object, structure of arrays so 8 (AVX2) or 4 (SSE4.1) can be tested per step.
+  struct boundingSpheres
+  {
+    std::vector<float> centerXs;
+    std::vector<float> centerYs;
+    std::vector<float> centerZs;
+    std::vector<float> radii;
+
+    uint32_t add(const math::vec3& center, float radius);
+    void set(uint32_t index, const math::vec3& center, float radius);
+    void clear();
+
+    size_t size() const
+    {
+      return radii.size();
+    }
+  };
+
+  //Axis aligned boxes stored as center and half extents.
+  struct boundingBoxes
+  {
+    std::vector<float> centerXs;
+    std::vector<float> centerYs;
+    std::vector<float> centerZs;
+    std::vector<float> extentXs;
+    std::vector<float> extentYs;
+    std::vector<float> extentZs;
+
+    uint32_t add(const math::vec3& center, const math::vec3& extents);
+    void set(uint32_t index, const math::vec3& center, const math::vec3& extents);
+    void clear();
+
+    size_t size() const
+    {
+      return extentXs.size();
+    }
+  };
+
+  struct cullingParams
+  {
+    frustum viewFrustum;
+    math::vec3 cameraPosition;
+
+    //Objects whose bounds lie entirely further away than this are culled as well.
+    float maxDrawDistance = std::numeric_limits<float>::infinity();
+  };
+
+  //Tests the range [begin, end) and writes the indices that survive to outVisible.
+  //Returns how many were written, outVisible needs room for end - begin entries.
+  size_t cullSpheres(const cullingParams& params, const boundingSpheres& bounds, size_t begin, size_t end, uint32_t* outVisible);
+  size_t cullBoxes(const cullingParams& params, const boundingBoxes& bounds, size_t begin, size_t end, uint32_t* outVisible);
+
+  //Visibility step run before command recording. Splits the bounds across the thread pool
+  //and gathers a compact visible list, ordered by object index regardless of thread timing.
+  class cullingStage
+  {
+    public:
+      void cull(threadPool& pool, const cullingParams& params, const boundingSpheres& bounds);
+      void cull(threadPool& pool, const cullingParams& params, const boundingBoxes& bounds);
+
+      const std::vector<uint32_t>& getVisible() const
+      {
+        return m_visible;
+      }
+
+    private:
+      template <typename Bounds, typename CullFunc>
+      void cullChunks(threadPool& pool, const cullingParams& params, const Bounds& bounds, CullFunc cullFunc);
+
+      std::vector<uint32_t> m_visible;
+
+      //Scratch per chunk, kept between frames to avoid reallocating.
+      std::vector<std::vector<uint32_t>> m_chunkVisible;
+      std::vector<size_t> m_chunkVisibleCounts;
+  };
+}
@@ -0,0 +1,110 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+#include "mat.h"
+#include "arrayView.h"
+#include "gpuAllocator.h"
+#include "meshBufferPool.h"
+
+namespace malachite
+{
+  //Per instance vertex data in binding 1, instance inputs of the scene shader start at
+  //c_firstInstanceInputLocation with the model matrix columns followed by the object index.
+  struct drawInstance
+  {
+    math::mat4 model;
+    uint32_t objectIndex;
+    uint32_t padding[3];
+  };
+
+  struct drawBatchStats
+  {
+    //Meshes drawn instanced, objects without a mesh count as one more.
+    uint32_t batchCount = 0;
+    uint32_t instanceCount = 0;
+  };
+
+  //Merges the visible objects sharing a mesh into one instanced draw each. Instances are written to a
+  //mapped buffer per frame in flight and the draws go out through vkCmdDrawIndexedIndirect, a single
+  //call per index type where the device supports multiDrawIndirect.
+  //The draw count is known on the CPU, so vkCmdDrawIndexedIndirectCount would only add a buffer read.
+  class drawBatcher
+  {
+    public:
+      //Turns on what the batcher can use out of supported, call it while creating the logical device.
+      static void enableDeviceFeatures(const VkPhysicalDeviceFeatures& supported, VkPhysicalDeviceFeatures& enabled);
+
+      void initalize(gpuAllocator& allocator, VkPhysicalDevice physicalDevice, uint32_t framesInFlight, VkDeviceSize frameBytes = 16 * 1024 * 1024);
+      void cleanup();
+
+      //Sorts the visible objects into draws for the frame, the previous contents of its buffer have to be done.
+      //Objects with a mesh still uploading are skipped, objects without one draw the shader's built in triangle.
+      //Unbatched gives every object an instance and draw of its own.
+      //Returns false when the frame buffer is full, nothing is drawn then.
+      bool build
+      (
+        uint32_t frameIndex,
+        arrayView<uint32_t> visibleObjects,
+        arrayView<meshId> objectMeshes,
+        arrayView<math::mat4> objectTransforms,
+        const meshBufferPool& meshes,
+        bool isBatched = true
+      );
+
+      //Draws of the last build, the range passed to record indexes into these.
+      uint32_t getDrawCount() const;
+
+      //Draws [firstDraw, firstDraw + drawCount) of the last build, inside the render pass with the scene
+      //pipeline bound. Returns the draw calls it recorded. Safe to call from several threads at once
+      //into different command buffers.
+      uint32_t record(VkCommandBuffer commandBuffer, const meshBufferPool& meshes, uint32_t firstDraw = 0, uint32_t drawCount = ~0u) const;
+
+      const drawBatchStats& getStats() const { return m_stats; }
+
+    private:
+      enum class e_drawPath
+      {
+        multiDrawIndirect,
+        indirect,
+        direct //firstInstance has to be 0 in indirect draws without drawIndirectFirstInstance
+      };
+
+      //Draws sharing an index type, their commands are consecutive in the frame buffer.
+      struct drawGroup
+      {
+        VkIndexType indexType = VK_INDEX_TYPE_UINT16;
+        VkDeviceSize commandOffset = 0;
+        uint32_t commandCount = 0;
+        uint32_t firstCommand = 0;
+      };
+
+      //Instanced triangles for the objects without a mesh, one per object unbatched.
+      uint32_t getMeshlessDrawCount() const;
+
+      void addInstance(drawInstance* instances, uint32_t slot, uint32_t objectIndex, arrayView<math::mat4> objectTransforms) const;
+
+      e_drawPath m_drawPath = e_drawPath::direct;
+      uint32_t m_maxDrawIndirectCount = 1;
+
+      std::vector<gpuLinearPool> m_framePools;
+      gpuLinearPool* m_pool = nullptr;
+      VkDeviceSize m_instanceOffset = 0;
+
+      //Built for the current frame, commands are also kept on the CPU for the direct path.
+      std::vector<VkDrawIndexedIndirectCommand> m_commands;
+      drawGroup m_groups[2];
+      bool m_isBatched = true;
+
+      //Objects without a mesh, their instances come first.
+      uint32_t m_meshlessCount = 0;
+
+      //Scratch of the counting sort, instances per mesh and then where each mesh's instances start.
+      std::vector<uint32_t> m_meshInstanceCounts;
+      std::vector<VkDrawIndexedIndirectCommand> m_meshCommands[2];
+
+      drawBatchStats m_stats;
+  };
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <functional>
+
+namespace malachite
+{
+  //Defers destroying GPU objects until no frame in flight can still use them.
+  //Whatever is pushed during a frame runs once that frame's fence comes around again.
+  class frameDeletionQueue
+  {
+    public:
+      void initalize(uint32_t framesInFlight);
+
+      void push(std::function<void()>&& destroy);
+
+      //Once per frame, right after waiting on the fence of the frame about to be recorded.
+      void advance();
+
+      //Runs everything still queued, the device has to be idle.
+      void flush();
+
+    private:
+      std::vector<std::vector<std::function<void()>>> m_frames;
+      uint32_t m_frameIndex = 0;
+  };
+}
@@ -0,0 +1,207 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <vulkan/vulkan.h>
+
+namespace malachite
+{
+  //Two level segregated fit over the offsets of one range, allocating and freeing are O(1).
+  //Free regions are bucketed by size, a bucket is found with two bit scans and neighbours merge on free.
+  class tlsfRangeAllocator
+  {
+    public:
+      static constexpr uint32_t c_invalidRegion = ~0u;
+
+      //Every offset handed out is a multiple of minAlignment, which has to be a power of two.
+      void initalize(VkDeviceSize size, VkDeviceSize minAlignment);
+
+      //Returns c_invalidRegion when no free region is large enough.
+      uint32_t allocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset);
+      void free(uint32_t region);
+
+      VkDeviceSize getSize() const { return m_size; }
+      VkDeviceSize getUsedBytes() const { return m_usedBytes; }
+      VkDeviceSize getLargestFreeRegion() const;
+      uint32_t getFreeRegionCount() const { return m_freeRegionCount; }
+      uint32_t getAllocationCount() const { return m_allocationCount; }
+
+      bool isEmpty() const { return m_allocationCount == 0; }
+
+    private:
+      static constexpr uint32_t c_secondLevelBits = 5;
+      static constexpr uint32_t c_secondLevelCount = 1u << c_secondLevelBits;
+      static constexpr uint32_t c_firstLevelCount = 64;
+
+      struct region
+      {
+        VkDeviceSize offset;
+        VkDeviceSize size;
+
+        //Neighbours in address order and in the free list of the bucket.
+        uint32_t previousPhysical;
+        uint32_t nextPhysical;
+        uint32_t previousFree;
+        uint32_t nextFree;
+        bool isFree;
+      };
+
+      static void getBucket(VkDeviceSize size, uint32_t& firstLevel, uint32_t& secondLevel);
+
+      uint32_t createRegion(VkDeviceSize offset, VkDeviceSize size);
+      void destroyRegion(uint32_t index);
+
+      void insertFree(uint32_t index);
+      void removeFree(uint32_t index);
+
+      //First free region that can hold size, c_invalidRegion when there is none.
+      uint32_t findFree(VkDeviceSize size) const;
+
+      std::vector<region> m_regions;
+      std::vector<uint32_t> m_unusedRegions;
+
+      uint64_t m_firstLevelBitmap = 0;
+      uint32_t m_secondLevelBitmaps[c_firstLevelCount] = {};
+      uint32_t m_freeLists[c_firstLevelCount][c_secondLevelCount];
+
+      VkDeviceSize m_size = 0;
+      VkDeviceSize m_minAlignment = 1;
+      VkDeviceSize m_usedBytes = 0;
+      uint32_t m_freeRegionCount = 0;
+      uint32_t m_allocationCount = 0;
+  };
+
+  enum class e_memoryUsage
+  {
+    gpuOnly,  //device local, filled through staging
+    upload,   //host visible and coherent, written by the CPU every frame or used for staging
+    readback  //host visible and coherent, cached where possible, read back by the CPU
+  };
+
+  struct gpuAllocation
+  {
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0;
+    VkDeviceSize size = 0;
+
+    //Points at offset for host visible memory, blocks stay mapped for their whole life.
+    void* mapped = nullptr;
+
+    uint32_t pool = 0;
+    uint32_t block = 0;
+    uint32_t region = tlsfRangeAllocator::c_invalidRegion;
+
+    bool isValid() const { return memory != VK_NULL_HANDLE; }
+  };
+
+  struct gpuHeapStats
+  {
+    VkDeviceSize heapSize = 0;
+    VkMemoryHeapFlags flags = 0;
+
+    //Reserved from the driver and handed out of that.
+    VkDeviceSize blockBytes = 0;
+    VkDeviceSize usedBytes = 0;
+
+    uint32_t blockCount = 0;
+    uint32_t allocationCount = 0;
+    uint32_t freeRegionCount = 0;
+    VkDeviceSize largestFreeRegion = 0;
+
+    //0 while the free space is one region, approaches 1 as it splinters into small ones.
+    float getFragmentation() const
+    {
+      VkDeviceSize freeBytes = blockBytes - usedBytes;
+      return freeBytes == 0 ? 0.0f : 1.0f - (float) largestFreeRegion / (float) freeBytes;
+    }
+  };
+
+  //Reserves device memory in large blocks per memory type and sub-allocates buffers and images out
+  //of them, so the driver sees a handful of vkAllocateMemory calls instead of one per resource.
+  //Linear and optimal tiling resources get separate blocks whenever bufferImageGranularity would
+  //otherwise force padding between them. Safe to use from several threads.
+  class gpuAllocator
+  {
+    public:
+      void initalize(VkPhysicalDevice physicalDevice, VkDevice device, VkDeviceSize blockSize = 64 * 1024 * 1024);
+
+      //Everything allocated has to be freed by now.
+      void cleanup();
+
+      //Returns false when the heap is out of memory, throws when no memory type can hold the resource at all.
+      bool allocate(const VkMemoryRequirements& requirements, e_memoryUsage usage, bool isOptimalImage, gpuAllocation& allocation);
+      void free(gpuAllocation& allocation);
+
+      //Create the resource and bind it to a new allocation, both are released by the matching destroy.
+      bool createBuffer(const VkBufferCreateInfo& bufferInfo, e_memoryUsage usage, VkBuffer& buffer, gpuAllocation& allocation);
+      bool createImage(const VkImageCreateInfo& imageInfo, e_memoryUsage usage, VkImage& image, gpuAllocation& allocation);
+      void destroyBuffer(VkBuffer& buffer, gpuAllocation& allocation);
+      void destroyImage(VkImage& image, gpuAllocation& allocation);
+
+      std::vector<gpuHeapStats> getHeapStats();
+      void logStats();
+
+      //vkAllocateMemory calls currently alive, the device guarantees at least 4096.
+      uint32_t getDeviceAllocationCount();
+
+    private:
+      struct memoryBlock
+      {
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        char* mapped = nullptr;
+        bool isDedicated = false;
+        tlsfRangeAllocator ranges;
+      };
+
+      struct memoryPool
+      {
+        uint32_t memoryType = 0;
+        bool isOptimalImage = false;
+
+        //Freed blocks leave a null entry behind so allocations keep their block index.
+        std::vector<std::unique_ptr<memoryBlock>> blocks;
+      };
+
+      uint32_t findMemoryType(uint32_t typeBits, e_memoryUsage usage) const;
+      uint32_t getPoolIndex(uint32_t memoryType, bool isOptimalImage);
+      VkDeviceSize getBlockSize(uint32_t memoryType) const;
+
+      //Falls back to smaller blocks while the heap can't fit a full one.
+      memoryBlock* createBlock(memoryPool& pool, VkDeviceSize size, VkDeviceSize minimumSize, bool isDedicated, uint32_t& blockIndex);
+      void destroyBlock(memoryPool& pool, uint32_t blockIndex);
+
+      VkDevice m_device = VK_NULL_HANDLE;
+      VkPhysicalDeviceMemoryProperties m_memoryProperties{};
+      VkDeviceSize m_blockSize = 0;
+      VkDeviceSize m_bufferImageGranularity = 1;
+
+      std::mutex m_mutex;
+      std::vector<memoryPool> m_pools;
+      uint32_t m_deviceAllocationCount = 0;
+  };
+
+  //Bump allocator over one host visible buffer for data that only lives for a frame, reset once the
+  //frame using it is done. Keep one per frame in flight.
+  class gpuLinearPool
+  {
+    public:
+      void initalize(gpuAllocator& allocator, VkDeviceSize size, VkBufferUsageFlags usage);
+      void cleanup();
+
+      //Returns false when the pool is full, offset is into getBuffer().
+      bool allocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset, void*& mapped);
+      void reset() { m_head = 0; }
+
+      VkBuffer getBuffer() const { return m_buffer; }
+      VkDeviceSize getUsedBytes() const { return m_head; }
+      VkDeviceSize getSize() const { return m_allocation.size; }
+
+    private:
+      gpuAllocator* m_allocator = nullptr;
+      VkBuffer m_buffer = VK_NULL_HANDLE;
+      gpuAllocation m_allocation;
+      VkDeviceSize m_head = 0;
+  };
+}
@@ -0,0 +1,112 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <string>
+#include <vulkan/vulkan.h>
+
+#include "profiler.h"
+
+namespace malachite
+{
+  constexpr uint32_t c_invalidGpuScope = ~0u;
+
+  //Times command buffer work with timestamp queries and hands the results to a profiler on a track of
+  //its own, converted onto the CPU timeline so CPU and GPU work line up in one trace. Every frame in
+  //flight has its own query pool, a frame's results are read once its fence comes around again so
+  //reading never waits on the GPU.
+  class gpuProfiler
+  {
+    public:
+      //Stays disabled when the queue family can't write timestamps. Submits one calibration command
+      //buffer to the queue and waits for it, later calibrations aren't waited on.
+      void initalize
+      (
+        VkPhysicalDevice physicalDevice,
+        VkDevice device,
+        VkQueue queue,
+        uint32_t queueFamilyIndex,
+        uint32_t framesInFlight,
+        profiler& profiler,
+        uint32_t maxScopesPerFrame = 128
+      );
+
+      void cleanup();
+
+      //Once the frame's fence was waited on, hands what the frame recorded last time to the profiler.
+      //False when there was nothing to hand over, otherwise endTime is when its last scope finished.
+      //Also submits and reads back the periodic calibration, so it has to be called on the thread
+      //that submits to the queue.
+      bool collect(uint32_t frameIndex, profiler::clock::time_point* endTime = nullptr);
+
+      //First thing in the frame's command buffer, outside any render pass.
+      void beginFrame(VkCommandBuffer commandBuffer, uint32_t frameIndex);
+
+      //Once the frame's command buffer was submitted. A frame that never was is dropped by collect, its
+      //query pool still holds the results collected last time.
+      void setFrameSubmitted(uint32_t frameIndex);
+
+      //Scopes may nest, they can't be opened inside a render pass begun for secondary command buffers.
+      //Returns c_invalidGpuScope when profiling is off or the frame ran out of queries.
+      uint32_t beginScope(VkCommandBuffer commandBuffer, const std::string& name);
+      void endScope(VkCommandBuffer commandBuffer, uint32_t scope);
+
+      //Frames recorded while disabled write no timestamps, recordings that are never submitted have to be.
+      void setEnabled(bool isEnabled) { m_isEnabled = isEnabled && m_isSupported; }
+      bool isEnabled() const { return m_isEnabled; }
+
+    private:
+      struct scope
+      {
+        std::string name;
+        bool isEnded;
+      };
+
+      //Scope i writes queries 2i and 2i+1.
+      struct frameQueries
+      {
+        VkQueryPool queryPool = VK_NULL_HANDLE;
+        std::vector<scope> scopes;
+        profiler::clock::time_point recordTime;
+        bool isSubmitted = false;
+      };
+
+      void submitCalibration();
+
+      //False while the calibration timestamp isn't written yet, unless waiting for it.
+      bool readCalibration(bool isWaiting);
+
+      profiler::clock::time_point toCpuTime(uint64_t timestamp) const;
+
+      VkDevice m_device = VK_NULL_HANDLE;
+      VkQueue m_queue = VK_NULL_HANDLE;
+      profiler* m_profiler = nullptr;
+      profileTrack m_track = 0;
+
+      bool m_isSupported = false;
+      bool m_isEnabled = false;
+      bool m_isRecordingFrame = false;
+
+      double m_nanosecondsPerTick = 1.0;
+      uint64_t m_timestampMask = ~0ull;
+      uint32_t m_maxScopesPerFrame = 0;
+
+      //A GPU timestamp and the CPU time it was taken at, timestamps are converted relative to it.
+      uint64_t m_calibrationTimestamp = 0;
+      profiler::clock::time_point m_calibrationTime;
+
+      //Calibration writes one timestamp from a command buffer of its own, signaling the fence.
+      VkCommandPool m_calibrationCommandPool = VK_NULL_HANDLE;
+      VkCommandBuffer m_calibrationCommandBuffer = VK_NULL_HANDLE;
+      VkQueryPool m_calibrationQueryPool = VK_NULL_HANDLE;
+      VkFence m_calibrationFence = VK_NULL_HANDLE;
+      profiler::clock::time_point m_calibrationSubmitTime;
+      bool m_isCalibrating = false;
+      bool m_isCalibrated = false;
+
+      std::vector<frameQueries> m_frames;
+      uint32_t m_currentFrame = 0;
+
+      //Scratch of collect, timestamp and availability pairs.
+      std::vector<uint64_t> m_results;
+  };
+}
@@ -0,0 +1,137 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+#include "arrayView.h"
+#include "gpuAllocator.h"
+#include "stagingRing.h"
+#include "frameDeletionQueue.h"
+
+namespace malachite
+{
+  using meshId = uint32_t;
+
+  constexpr meshId c_invalidMesh = ~0u;
+
+  //Vertices and indices of every mesh live in one shared vertex buffer and one shared index buffer
+  //in device local memory, so any set of meshes can go out in a single indirect draw. They are filled
+  //through a stagingRing whose copies go out once per frame. Copies run on a dedicated transfer queue
+  //when the device has one, the buffers are then shared with the graphics family so no ownership
+  //transfer is needed. A mesh is only drawn once the fence of its batch has signaled.
+  //Everything here is called from the main thread.
+  class meshBufferPool
+  {
+    public:
+      //Freed ranges are handed to deletionQueue, both it and allocator have to outlive the pool.
+      void initalize
+      (
+        gpuAllocator& allocator,
+        frameDeletionQueue& deletionQueue,
+        VkDevice device,
+        VkQueue transferQueue,
+        uint32_t transferFamilyIndex,
+        uint32_t graphicsFamilyIndex,
+        VkDeviceSize vertexBytes = 64 * 1024 * 1024,
+        VkDeviceSize indexBytes = 32 * 1024 * 1024,
+        VkDeviceSize stagingSize = 16 * 1024 * 1024
+      );
+      void cleanup();
+
+      //Vertices are copied as they are, vertexStride bytes each, vertex binding 0 of the scene pipeline
+      //has to match. Without indices the vertices are drawn in order. Indices are stored as 16 bit when
+      //the vertex count allows. The data is staged right away, or kept until an update finds room in
+      //the ring. Returns c_invalidMesh when the shared buffers are full.
+      meshId createMesh(arrayView<uint8_t> vertexData, uint32_t vertexStride, arrayView<uint32_t> indices = {});
+      void destroyMesh(meshId mesh);
+
+      //Once per frame after the frame fence. Retires finished batches and submits everything staged since.
+      void update();
+
+      bool isReady(meshId mesh) const;
+
+      //Binds the shared buffers and draws, false without drawing while the mesh is still uploading.
+      bool recordDraw(VkCommandBuffer commandBuffer, meshId mesh, uint32_t instanceCount, uint32_t firstInstance) const;
+
+      //Indirect draw of one instance of the mesh, false while it is still uploading.
+      bool getDrawCommand(meshId mesh, VkDrawIndexedIndirectCommand& command, VkIndexType& indexType) const;
+
+      //Binding 0 and the index buffer for draws built from getDrawCommand.
+      void bindBuffers(VkCommandBuffer commandBuffer, VkIndexType indexType) const;
+
+      //One past the highest mesh id handed out so far.
+      size_t getMeshCapacity() const { return m_meshes.size(); }
+
+    private:
+      struct meshBuffer
+      {
+        //Ranges in the shared buffers.
+        uint32_t vertexRegion = tlsfRangeAllocator::c_invalidRegion;
+        uint32_t indexRegion = tlsfRangeAllocator::c_invalidRegion;
+        VkDeviceSize vertexByteOffset = 0;
+        VkDeviceSize indexByteOffset = 0;
+
+        //Staged as the vertices followed by the indices from stagedIndexOffset.
+        VkDeviceSize vertexBytes = 0;
+        VkDeviceSize indexBytes = 0;
+        VkDeviceSize stagedIndexOffset = 0;
+
+        int32_t vertexOffset = 0;
+        uint32_t firstIndex = 0;
+        uint32_t indexCount = 0;
+        VkIndexType indexType = VK_INDEX_TYPE_UINT16;
+
+        //Batch copying the mesh, 0 until it was submitted.
+        uint64_t uploadSerial = 0;
+
+        //Vertices and packed indices while the ring had no room for them.
+        std::vector<char> pendingData;
+
+        bool isUsed = false;
+        bool isReleased = false;
+      };
+
+      //One of the shared buffers and the ranges handed out of it.
+      struct meshArena
+      {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        gpuAllocation allocation;
+        tlsfRangeAllocator ranges;
+      };
+
+      void createArena(meshArena& arena, VkDeviceSize size, VkBufferUsageFlags usage);
+      void freeRanges(meshBuffer& mesh);
+
+      //Room in the open batch for the vertices and indices, false while the ring is full.
+      bool allocateStaging(const meshBuffer& mesh, stagingSpan& span);
+      void recordCopy(meshId mesh, const stagingSpan& span);
+
+      //Vertices followed by the indices converted to indexType, generated when there are none.
+      void writeMeshData(const meshBuffer& mesh, char* destination, arrayView<uint8_t> vertexData, arrayView<uint32_t> indices) const;
+      bool isUploaded(const meshBuffer& mesh) const;
+
+      gpuAllocator* m_allocator = nullptr;
+      frameDeletionQueue* m_deletionQueue = nullptr;
+      VkDevice m_device = VK_NULL_HANDLE;
+      stagingRing m_staging;
+
+      //Both queue families, the same one twice without a dedicated transfer queue.
+      uint32_t m_queueFamilyIndices[2] = {};
+
+      meshArena m_vertices;
+      meshArena m_indices;
+
+      std::vector<meshBuffer> m_meshes;
+      std::vector<meshId> m_freeMeshes;
+
+      //Waiting on room in the ring, in the order they were created.
+      std::vector<meshId> m_pendingMeshes;
+
+      //Staged into the open batch, they get its serial once it is submitted.
+      std::vector<meshId> m_stagedMeshes;
+
+      //Destroyed before their upload finished, their ranges go once it has.
+      std::vector<meshId> m_releasedMeshes;
+  };
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <filesystem>
+#include <vulkan/vulkan.h>
+
+namespace malachite
+{
+  //VkPipelineCache persisted between runs so the driver skips pipelines it already compiled.
+  //Data written by another driver, device or a half finished write is ignored and the cache starts empty.
+  class pipelineCache
+  {
+    public:
+      void initalize(VkPhysicalDevice physicalDevice, VkDevice device, const std::filesystem::path& cachePath);
+
+      //Writes the cache next to its path and renames it over the old one, then destroys it.
+      void cleanup();
+
+      //Pass to every vkCreate*Pipelines call.
+      VkPipelineCache get() const { return m_pipelineCache; }
+
+      //False when the cache started empty, for comparing startup times.
+      bool isWarm() const { return m_isWarm; }
+
+    private:
+      //Checks our header and the driver's own, which has to match this device exactly.
+      bool isCompatible(const char* data, size_t size) const;
+      void writeCacheFile() const;
+
+      VkDevice m_device = VK_NULL_HANDLE;
+      VkPipelineCache m_pipelineCache = VK_NULL_HANDLE;
+      VkPhysicalDeviceProperties m_deviceProperties{};
+      std::filesystem::path m_cachePath;
+      bool m_isWarm = false;
+  };
+}
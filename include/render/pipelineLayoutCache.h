@@ -0,0 +1,56 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <unordered_map>
+#include <vulkan/vulkan.h>
+
+#include "spirvReflection.h"
+
+namespace malachite
+{
+  //Everything a VkPipelineLayout is made of, merged from the reflection of every stage.
+  struct pipelineLayoutDescription
+  {
+    //Indexed by set number, each sorted by binding. Unused sets in between are empty.
+    std::vector<std::vector<VkDescriptorSetLayoutBinding>> descriptorSets;
+    std::vector<VkPushConstantRange> pushConstantRanges;
+
+    //Stages sharing a binding must agree on its type and count, stage flags are combined.
+    static pipelineLayoutDescription fromReflection(const shaderReflection* stages, size_t stageCount);
+  };
+
+  //Creates each distinct descriptor set layout and pipeline layout once and hands the same
+  //handle to every pipeline asking for an identical one. Owns every handle it returns.
+  class pipelineLayoutCache
+  {
+    public:
+      void initalize(VkDevice device);
+      void cleanup();
+
+      VkDescriptorSetLayout getDescriptorSetLayout(const std::vector<VkDescriptorSetLayoutBinding>& bindings);
+      VkPipelineLayout getPipelineLayout(const pipelineLayoutDescription& description);
+
+      size_t getDescriptorSetLayoutCount() const { return m_descriptorSetLayouts.size(); }
+      size_t getPipelineLayoutCount() const { return m_pipelineLayouts.size(); }
+
+    private:
+      struct descriptorSetLayoutEntry
+      {
+        std::vector<VkDescriptorSetLayoutBinding> bindings;
+        VkDescriptorSetLayout layout;
+      };
+
+      struct pipelineLayoutEntry
+      {
+        std::vector<VkDescriptorSetLayout> setLayouts;
+        std::vector<VkPushConstantRange> pushConstantRanges;
+        VkPipelineLayout layout;
+      };
+
+      VkDevice m_device = VK_NULL_HANDLE;
+
+      //Keyed by hash, the full description settles collisions.
+      std::unordered_multimap<uint64_t, descriptorSetLayoutEntry> m_descriptorSetLayouts;
+      std::unordered_multimap<uint64_t, pipelineLayoutEntry> m_pipelineLayouts;
+  };
+}
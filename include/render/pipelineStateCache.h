@@ -0,0 +1,183 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <future>
+#include <unordered_map>
+#include <vulkan/vulkan.h>
+
+#include "arrayView.h"
+#include "threadPool.h"
+#include "pipelineLayoutCache.h"
+#include "frameDeletionQueue.h"
+
+namespace malachite
+{
+  //SPIR-V shared by every description using it, hashed once when created.
+  struct pipelineShader
+  {
+    std::shared_ptr<const std::vector<uint32_t>> spirv;
+    uint64_t hash = 0;
+
+    static pipelineShader create(arrayView<uint32_t> code);
+  };
+
+  //The state structs only hold 32 bit fields, so they hash and compare as raw bytes.
+  struct pipelineRasterState
+  {
+    VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    VkPolygonMode polygonMode = VK_POLYGON_MODE_FILL;
+    VkCullModeFlags cullMode = VK_CULL_MODE_BACK_BIT;
+    VkFrontFace frontFace = VK_FRONT_FACE_CLOCKWISE;
+  };
+
+  struct pipelineBlendState
+  {
+    VkBool32 isEnabled = VK_FALSE;
+    VkBlendFactor srcColorFactor = VK_BLEND_FACTOR_ONE;
+    VkBlendFactor dstColorFactor = VK_BLEND_FACTOR_ZERO;
+    VkBlendOp colorOp = VK_BLEND_OP_ADD;
+    VkBlendFactor srcAlphaFactor = VK_BLEND_FACTOR_ONE;
+    VkBlendFactor dstAlphaFactor = VK_BLEND_FACTOR_ZERO;
+    VkBlendOp alphaOp = VK_BLEND_OP_ADD;
+    VkColorComponentFlags colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+  };
+
+  struct pipelineDepthState
+  {
+    VkBool32 isTestEnabled = VK_FALSE;
+    VkBool32 isWriteEnabled = VK_FALSE;
+    VkCompareOp compareOp = VK_COMPARE_OP_LESS;
+  };
+
+  //Everything a graphics pipeline is made of. Viewport and scissor are always dynamic,
+  //the layout comes from reflecting the shaders.
+  struct pipelineDescription
+  {
+    pipelineShader vertexShader;
+    pipelineShader fragmentShader;
+
+    //Bound to constant_id 0, 1, ... of both stages, see shaderSpecialization.
+    std::vector<VkBool32> specializationValues;
+
+    //Left empty the vertex layout is reflected from the vertex shader inputs.
+    std::vector<VkVertexInputBindingDescription> vertexBindings;
+    std::vector<VkVertexInputAttributeDescription> vertexAttributes;
+
+    pipelineRasterState raster;
+    pipelineBlendState blend;
+    pipelineDepthState depth;
+
+    VkRenderPass renderPass = VK_NULL_HANDLE;
+    uint32_t subpass = 0;
+
+    //Shaders are compared by hash, so this never touches the SPIR-V itself.
+    uint64_t hash() const;
+    bool operator==(const pipelineDescription& other) const;
+  };
+
+  struct cachedPipeline
+  {
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    VkPipelineLayout layout = VK_NULL_HANDLE; //owned by the pipelineLayoutCache
+    double createMilliseconds = 0.0;
+  };
+
+  enum class e_pipelineStatus
+  {
+    missing,
+    pending,
+    ready,
+    failed
+  };
+
+  //Creates each distinct pipeline once, the first time a description asks for it, and keeps it
+  //until it's released or cleanup. Safe to use from several threads, concurrent requests for the
+  //same description share a single creation.
+  class pipelineStateCache
+  {
+    public:
+      //From here on layouts is only accessed through this cache, the pipeline and layout caches outlive it.
+      //Released pipelines are destroyed through deletionQueue.
+      void initalize(VkDevice device, VkPipelineCache driverCache, pipelineLayoutCache& layouts, threadPool& threads, frameDeletionQueue& deletionQueue);
+
+      //Waits for background creations, then destroys every pipeline, released ones still pending too.
+      void cleanup();
+
+      //Blocks until the pipeline exists, a pending background creation is finished on the calling thread.
+      //Throws when it can't be created.
+      cachedPipeline getPipeline(const pipelineDescription& description);
+
+      //Never blocks, a miss is created on the thread pool. Until it is ready the fallback is returned
+      //when that one is, an empty pipeline otherwise, draws using it are to be skipped.
+      cachedPipeline requestPipeline(const pipelineDescription& description, const pipelineDescription* fallback = nullptr);
+
+      e_pipelineStatus getStatus(const pipelineDescription& description);
+
+      //Drops a pipeline nothing recorded from now on uses, such as one replaced by a hot reload. It's
+      //destroyed once no frame in flight can reference it, a creation still pending is waited for first.
+      //Asking for the description again creates it anew. Call it from the main thread.
+      void releasePipeline(const pipelineDescription& description);
+
+      //Creations run on the pool and the logger isn't thread safe, so they're logged here instead,
+      //each one once after it finished. Released creations that finished are queued for deletion here
+      //too. Call it from the main thread.
+      void logCompletions();
+
+      size_t getPipelineCount();
+
+    private:
+      //Run by whichever thread claims it first, the pool or someone blocking on it.
+      struct pendingCreation
+      {
+        std::atomic<bool> isClaimed{false};
+        std::packaged_task<cachedPipeline()> task;
+
+        void run()
+        {
+          if (!isClaimed.exchange(true))
+          {
+            task();
+          }
+        }
+      };
+
+      struct pipelineEntry
+      {
+        pipelineDescription description;
+        std::shared_future<cachedPipeline> pipeline;
+        std::shared_ptr<pendingCreation> creation;
+      };
+
+      //Adds an unclaimed creation on a miss, m_mutex has to be held.
+      pipelineEntry& findOrAdd(const pipelineDescription& description, uint64_t key, bool& isAdded);
+      pipelineEntry* find(const pipelineDescription& description, uint64_t key);
+
+      cachedPipeline createPipeline(const pipelineDescription& description);
+      VkShaderModule createShaderModule(const pipelineShader& shader);
+
+      //Hands released pipelines that finished to the deletion queue, m_mutex has to be held.
+      void queueReleased();
+
+      VkDevice m_device = VK_NULL_HANDLE;
+      VkPipelineCache m_driverCache = VK_NULL_HANDLE;
+      pipelineLayoutCache* m_layouts = nullptr;
+      threadPool* m_threads = nullptr;
+      frameDeletionQueue* m_deletionQueue = nullptr;
+
+      std::mutex m_mutex;
+      std::mutex m_layoutMutex;
+
+      //Keyed by hash, the full description settles collisions.
+      std::unordered_multimap<uint64_t, pipelineEntry> m_pipelines;
+
+      //Creations logCompletions hasn't reported yet.
+      std::vector<std::shared_future<cachedPipeline>> m_unreported;
+
+      //Released while their creation was still pending.
+      std::vector<pipelineEntry> m_released;
+  };
+}
@@ -0,0 +1,267 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <string>
+#include <functional>
+#include <map>
+#include <vulkan/vulkan.h>
+
+#include "gpuAllocator.h"
+#include "frameDeletionQueue.h"
+#include "gpuProfiler.h"
+
+namespace malachite
+{
+  using renderGraphResource = uint32_t;
+
+  constexpr renderGraphResource c_invalidRenderGraphResource = ~0u;
+
+  //How a pass touches a texture, decides the layout, stages and access masks of its barriers.
+  enum class e_renderGraphAccess
+  {
+    colorAttachment,
+    depthAttachment,
+    sampled,
+    storageRead,
+    storageWrite,
+    transferSource,
+    transferDestination
+  };
+
+  struct renderGraphTextureDesc
+  {
+    VkFormat format = VK_FORMAT_UNDEFINED;
+    VkExtent2D extent = {0, 0};
+    VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+  };
+
+  //Where an imported texture stands when the graph starts, the previous owner's last use.
+  struct renderGraphTextureState
+  {
+    VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+    VkPipelineStageFlags stages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+    VkAccessFlags access = 0;
+  };
+
+  //What a pass is recording into, valid for the length of its execute callback.
+  struct renderGraphPassContext
+  {
+    //Null for passes without attachments.
+    VkRenderPass renderPass = VK_NULL_HANDLE;
+    VkFramebuffer framebuffer = VK_NULL_HANDLE;
+    VkExtent2D extent = {0, 0};
+
+    const class renderGraph* graph = nullptr;
+  };
+
+  using renderGraphExecute = std::function<void(VkCommandBuffer commandBuffer, const renderGraphPassContext& context)>;
+
+  class renderGraph;
+
+  //Declares what one pass reads and writes, handed out by renderGraph::addPass.
+  class renderGraphPassBuilder
+  {
+    public:
+      renderGraphPassBuilder(renderGraph& graph, uint32_t pass)
+        : m_graph(graph), m_pass(pass)
+      {
+      }
+
+      //Attachments in the order the fragment shader writes them. Without a clear value the previous
+      //contents are loaded, with one they are cleared and whatever wrote them before is dead.
+      renderGraphPassBuilder& writeColor(renderGraphResource texture, const VkClearColorValue* clearValue = nullptr);
+      renderGraphPassBuilder& writeDepth(renderGraphResource texture, const VkClearDepthStencilValue* clearValue = nullptr);
+
+      //Any other use, stages are where the pass touches the texture.
+      renderGraphPassBuilder& read(renderGraphResource texture, e_renderGraphAccess access, VkPipelineStageFlags stages = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+      renderGraphPassBuilder& write(renderGraphResource texture, e_renderGraphAccess access, VkPipelineStageFlags stages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+      //The render pass is begun for vkCmdExecuteCommands instead of inline commands.
+      renderGraphPassBuilder& setSecondaryCommandBuffers(bool isSecondary);
+
+      //Kept even when nothing reads what it writes, for passes writing outside the graph.
+      renderGraphPassBuilder& setSideEffects();
+
+    private:
+      renderGraph& m_graph;
+      uint32_t m_pass;
+  };
+
+  //Frame graph rebuilt every frame. Passes declare the textures they use and run in declaration
+  //order, compile culls passes whose results are never read, works out the one barrier batch each
+  //pass needs and places transient textures whose lifetimes don't overlap in the same memory.
+  //Transient images, their memory, render passes and framebuffers are cached across frames and
+  //only rebuilt when the shape of the graph changes. Everything here is called from one thread.
+  class renderGraph
+  {
+    public:
+      //With a profiler every executed pass is timed on the GPU under its name.
+      void initalize(gpuAllocator& allocator, frameDeletionQueue& deletionQueue, VkDevice device, gpuProfiler* profiler = nullptr);
+
+      //The device has to be idle.
+      void cleanup();
+
+      //Starts declaring the next frame, handles from the previous one are invalid afterwards.
+      void reset();
+
+      //Texture owned outside the graph. It is left in finalLayout after its last use, passes writing
+      //it are never culled when isOutput is set.
+      renderGraphResource importTexture
+      (
+        const char* name,
+        VkImage image,
+        VkImageView imageView,
+        const renderGraphTextureDesc& desc,
+        const renderGraphTextureState& initialState,
+        VkImageLayout finalLayout,
+        bool isOutput
+      );
+
+      //Texture that only lives within the frame, its contents are undefined at the first use.
+      renderGraphResource createTexture(const char* name, const renderGraphTextureDesc& desc);
+
+      renderGraphPassBuilder addPass(const char* name, renderGraphExecute&& execute);
+
+      //Once every pass of the frame is declared.
+      void compile();
+
+      //Records the compiled passes with their barriers, the frame's previous submission has to be done
+      //with its textures only through the queue order, no fence wait is needed.
+      void execute(VkCommandBuffer commandBuffer);
+
+      VkImageView getImageView(renderGraphResource texture) const;
+      VkImage getImage(renderGraphResource texture) const;
+
+      //Drops cached framebuffers, call it when imported image views are destroyed.
+      void releaseFramebuffers();
+
+      //Passes left after culling and barrier batches recorded by the last compile.
+      uint32_t getExecutedPassCount() const { return (uint32_t) m_executionOrder.size(); }
+      uint32_t getBarrierCount() const { return m_barrierCount; }
+
+      //Memory backing the transient textures and what they would take without aliasing.
+      VkDeviceSize getTransientBytes() const { return m_transientBytes; }
+      VkDeviceSize getUnaliasedTransientBytes() const { return m_unaliasedTransientBytes; }
+
+    private:
+      friend class renderGraphPassBuilder;
+
+      struct resourceUse
+      {
+        renderGraphResource texture;
+        e_renderGraphAccess access;
+        VkPipelineStageFlags stages;
+        bool isWrite;
+
+        //Attachments only.
+        bool isCleared;
+        VkClearValue clearValue;
+
+        //Set by compile, false when nothing reads the attachment after this pass.
+        bool isStored;
+      };
+
+      struct pass
+      {
+        std::string name;
+        renderGraphExecute execute;
+        std::vector<resourceUse> uses;
+        bool isSecondary = false;
+        bool hasSideEffects = false;
+        bool isCulled = false;
+
+        //Compiled.
+        VkRenderPass renderPass = VK_NULL_HANDLE;
+        VkFramebuffer framebuffer = VK_NULL_HANDLE;
+        VkExtent2D extent = {0, 0};
+        uint32_t firstBarrier = 0;
+        uint32_t barrierCount = 0;
+        VkPipelineStageFlags barrierSourceStages = 0;
+        VkPipelineStageFlags barrierDestinationStages = 0;
+      };
+
+      struct resource
+      {
+        std::string name;
+        renderGraphTextureDesc desc;
+        bool isImported = false;
+        bool isOutput = false;
+
+        VkImage image = VK_NULL_HANDLE;
+        VkImageView imageView = VK_NULL_HANDLE;
+        VkImageUsageFlags usage = 0;
+
+        renderGraphTextureState initialState;
+        VkImageLayout finalLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+        //Kept passes using it, in execution order, UINT32_MAX when unused.
+        uint32_t firstUse = UINT32_MAX;
+        uint32_t lastUse = 0;
+
+        //Transient placement in the shared memory.
+        VkDeviceSize memoryOffset = 0;
+        VkDeviceSize memorySize = 0;
+      };
+
+      //Barrier state of a texture while the passes are walked.
+      struct textureState
+      {
+        VkImageLayout layout;
+        VkPipelineStageFlags writeStages;
+        VkAccessFlags writeAccess;
+
+        //Reads since the last write that already waited on it.
+        VkPipelineStageFlags readStages;
+        VkAccessFlags readAccess;
+      };
+
+      //Transient images created for one shape of the graph.
+      struct transientTexture
+      {
+        VkImage image = VK_NULL_HANDLE;
+        VkImageView imageView = VK_NULL_HANDLE;
+      };
+
+      static void getUseState(const resourceUse& use, VkImageLayout& layout, VkPipelineStageFlags& stages, VkAccessFlags& access);
+
+      void addUse(uint32_t pass, const resourceUse& use);
+      void cullPasses();
+      void computeLifetimes();
+      void allocateTransients();
+      void buildBarriers();
+      void createRenderPasses();
+
+      //order is the pass's position among the kept passes.
+      VkRenderPass getRenderPass(const pass& pass, uint32_t order);
+      VkFramebuffer getFramebuffer(VkRenderPass renderPass, const std::vector<VkImageView>& attachments, VkExtent2D extent);
+
+      void releaseTransients();
+
+      gpuAllocator* m_allocator = nullptr;
+      frameDeletionQueue* m_deletionQueue = nullptr;
+      VkDevice m_device = VK_NULL_HANDLE;
+      gpuProfiler* m_profiler = nullptr;
+
+      std::vector<pass> m_passes;
+      std::vector<resource> m_resources;
+      std::vector<uint32_t> m_executionOrder;
+
+      std::vector<VkImageMemoryBarrier> m_barriers;
+      std::vector<VkImageMemoryBarrier> m_finalBarriers;
+      VkPipelineStageFlags m_finalSourceStages = 0;
+      uint32_t m_barrierCount = 0;
+
+      //Transient images and the memory they alias, rebuilt when the descriptions, usage or lifetimes change.
+      std::vector<uint64_t> m_transientSignature;
+      std::vector<transientTexture> m_transientTextures;
+      gpuAllocation m_transientMemory;
+      std::vector<gpuAllocation> m_dedicatedTransientMemory;
+      VkDeviceSize m_transientBytes = 0;
+      VkDeviceSize m_unaliasedTransientBytes = 0;
+
+      //Keyed by every field that went into them, so lookups never collide.
+      std::map<std::vector<uint64_t>, VkRenderPass> m_renderPasses;
+      std::map<std::vector<uint64_t>, VkFramebuffer> m_framebuffers;
+  };
+}
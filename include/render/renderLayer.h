@@ -1,8 +1,29 @@
 #pragma once
 #include "layer.h"
+#include "culling.h"
+#include "arrayView.h"
+#include "shader.h"
+#include "shaderVariants.h"
+#include "pipelineLayoutCache.h"
+#include "pipelineCache.h"
+#include "pipelineStateCache.h"
+#include "gpuAllocator.h"
+#include "textureStreamer.h"
+#include "meshBufferPool.h"
+#include "drawBatcher.h"
+#include "secondaryCommandRecorder.h"
+#include "renderGraph.h"
+#include "gpuProfiler.h"
+#include "frameDeletionQueue.h"
+
+#ifdef MAL_SHADER_COMPILER
+#include "fileWatcher.h"
+#include "shaderBuildService.h"
+#endif
 
 #include <optional>
 #include <filesystem>
+#include <chrono>
 #include <vulkan/vulkan.h>
 
 class GLFWwindow;
@@ -14,50 +35,172 @@ namespace malachite
     std::optional<uint32_t> graphicsFamily;
     std::optional<uint32_t> presentFamily;
 
+    //Transfer only family, the copy engine on discrete cards. Uploads use the graphics queue without one.
+    std::optional<uint32_t> transferFamily;
+
     bool isComplete()
     {
       return graphicsFamily.has_value() && presentFamily.has_value();
     }
   };
 
-  struct swapChainSupportDetails
+  constexpr uint32_t c_maxFramesInFlight = 3;
+
+  //How frames are handed to the display, picked at runtime and applied by recreating the swapchain.
+  enum class e_latencyMode
   {
-    VkSurfaceCapabilitiesKHR surfaceCapabilities;
-    std::vector<VkSurfaceFormatKHR> surfaceFormats;
-    std::vector<VkPresentModeKHR> presentModes;
+    //FIFO, capped to the refresh rate and never tears, the CPU is throttled by the queue of images.
+    vsync,
+
+    //MAILBOX, renders uncapped but only the newest image is shown at the next refresh. FIFO when unsupported.
+    lowLatency,
+
+    //IMMEDIATE, presents as soon as the frame is done and may tear. MAILBOX, then FIFO, when unsupported.
+    uncapped
   };
 
-  enum e_shaderType
+  constexpr uint32_t c_latencyModeCount = 3;
+
+  //Measured per latency mode across every frame rendered in it.
+  struct frameLatencyStats
   {
-    none = 0,
-    vertex = 1,
-    fragment = 2,
-    compute = 3,
-    geometry = 4,
-    tess_control = 5,
-    tess_evaluation = 6
+    //Presented in the mode.
+    uint64_t frameCount = 0;
+
+    //Present to present.
+    double averageFrameMilliseconds = 0.0;
+
+    //From the start of drawFrame, where the frame samples its input, to the GPU finishing its work.
+    //Presentation comes on top of it. Only measured while GPU profiling is on.
+    uint64_t latencySampleCount = 0;
+    double averageLatencyMilliseconds = 0.0;
+    double maxLatencyMilliseconds = 0.0;
+
+    //CPU blocked on the frame's fence and on acquiring an image, the back pressure of the mode.
+    double averageBlockedMilliseconds = 0.0;
   };
 
-  struct shader_schematic
+  struct swapChainSupportDetails
   {
-    std::filesystem::path fileName;
-    std::vector<std::string> fileContents;
-    std::vector<malachite::e_shaderType> shaderTypes;
+    VkSurfaceCapabilitiesKHR surfaceCapabilities;
+    std::vector<VkSurfaceFormatKHR> surfaceFormats;
+    std::vector<VkPresentModeKHR> presentModes;
   };
 
   class renderLayer : public layer
   {
     public:
-      renderLayer();
+      //The CPU records up to framesInFlight frames ahead of the GPU, clamped to [1, c_maxFramesInFlight].
+      //More hides longer GPU frames at the cost of a frame of latency each.
+      renderLayer(uint32_t framesInFlight = 2);
+
+      //Bounds of everything that may be drawn, the index of an object is its draw id.
+      boundingSpheres& getObjectBounds()
+      {
+        return m_objectBounds;
+      }
+
+      textureStreamer& getTextureStreamer()
+      {
+        return m_textureStreamer;
+      }
+
+      gpuAllocator& getGpuAllocator()
+      {
+        return m_gpuAllocator;
+      }
+
+      meshBufferPool& getMeshes()
+      {
+        return m_meshes;
+      }
+
+      //Drawn for the object instead of the shader's built in triangle once it is uploaded.
+      void setObjectMesh(uint32_t objectIndex, meshId mesh);
+
+      //Model matrix handed to the object's instance data, identity until set.
+      void setObjectTransform(uint32_t objectIndex, const math::mat4& transform);
+
+      //Objects sharing a mesh go out as one instanced draw, off draws every object on its own.
+      void setDrawBatching(bool isEnabled)
+      {
+        m_isDrawBatching = isEnabled;
+      }
+
+      //Large draw lists are recorded in slices across the thread pool, off records them all on the main thread.
+      void setParallelRecording(bool isEnabled)
+      {
+        m_isParallelRecording = isEnabled;
+      }
+
+      //CPU time spent recording the last frame's command buffer.
+      double getRecordMilliseconds() const
+      {
+        return m_recordMilliseconds;
+      }
+
+      const drawBatchStats& getDrawStats() const
+      {
+        return m_drawBatcher.getStats();
+      }
+
+      //Timestamps around the frame and every render graph pass, reported to the application's profiler
+      //on the GPU track. Ignored when the device can't write timestamps.
+      void setGpuProfiling(bool isEnabled)
+      {
+        m_gpuProfiler.setEnabled(isEnabled);
+      }
+
+      //Takes effect at the start of the next frame, the swapchain is recreated without waiting for the device.
+      //Logs the stats of the mode being left. Also set at launch with --latency <vsync|lowLatency|uncapped>
+      //and cycled with the L key.
+      void setLatencyMode(e_latencyMode mode);
+
+      e_latencyMode getLatencyMode() const
+      {
+        return m_latencyMode;
+      }
+
+      //Images the swapchain is asked for, clamped to what the surface allows. 0 is its minimum plus one.
+      //More images smooth out uneven frames at the cost of latency in vsync mode.
+      void setSwapChainImageCount(uint32_t imageCount);
+
+      const frameLatencyStats& getLatencyStats(e_latencyMode mode) const
+      {
+        return m_latencyStats[(uint32_t) mode];
+      }
+
+      //vkCmdDraw* calls in the last frame, a multi draw counts once.
+      uint32_t getDrawCallCount() const
+      {
+        return m_drawCallCount;
+      }
+
+      //Records frameCount frames of objectCount cubes batched, unbatched and unbatched on the main thread
+      //alone, logging the average CPU time per frame of each. Unbatched recording is then timed again with
+      //1, 2, 4 ... slices up to one per worker, to see how it scales with cores on the running machine.
+      //Waits for the device, the scene is left as it was. Run at startup with --benchmark-draws [object count].
+      void benchmarkDrawRecording(uint32_t objectCount = 100000, uint32_t frameCount = 100);
+
+      void setCamera(const math::mat4& viewProjection, const math::vec3& position, float maxDrawDistance);
+
+      //Picks the variant of the scene shader, keywords it doesn't declare are ignored. Swapped in at a
+      //frame boundary, development builds compile the variant in the background, others load its cooked binaries.
+      void setShaderKeywords(const std::vector<std::string_view>& enabledKeywords);
 
     private:
       //called through layer binding
 
       void initalizeDependencies();
+      void applyLaunchOptions();
       void render(double& deltaTime);
       void drawFrame(double& deltaTime);
       void cleanup();
 
+      //Builds the visible list that recordCommandBuffer draws from.
+      void cullObjects();
+
+      void initalizeResources();
       void initalizeWindow();
       void initalizeVulkan();
 
@@ -66,14 +209,41 @@ namespace malachite
       void initalizeSurface();
       void initalizePhysicalDevice();
       void initalizeLogicalDevice();
-      void initalizeSwapChain();
+      void initalizeMemoryAllocator();
+      void initalizeSwapChain(VkSwapchainKHR oldSwapChain = VK_NULL_HANDLE);
       void initalizeImageViews();
+      void initalizeSwapChainSemaphores();
       void initalizeRenderPass();
+      void initalizePipelineCache();
       void initalizeGraphicsPipeline();
-      void initalizeFrameBuffers();
       void initalizeCommandPool();
-      void initalizeCommandBuffer();
+      void initalizeCommandBuffers();
       void initalizeSyncObjects();
+      void initalizeTextureStreaming();
+      void initalizeMeshBuffers();
+
+      //The scene pipeline for the current shader variant, the SPIR-V is copied into the description.
+      pipelineDescription describeScenePipeline(arrayView<uint32_t> vertexCode, arrayView<uint32_t> fragmentCode);
+
+      //Created in the background, draws keep using the previous pipeline until it is ready.
+      void setScenePipeline(pipelineDescription&& description);
+
+      //From the simple.keywords malachite-cook writes, none when it is missing.
+      void loadShaderKeywords();
+      shaderVariantKey resolveShaderVariantKey() const;
+      std::string getSceneShaderBinaryPath(shaderVariantKey compiledKey, e_shaderType shaderType) const;
+
+      //Polled at the frame boundary, switches the scene pipeline after setShaderKeywords.
+      void updateShaderVariant();
+
+#ifdef MAL_SHADER_COMPILER
+      //Parses simple.shader, remembers what it depends on and queues its sections on the thread pool.
+      std::vector<shaderStageFuture> buildShaders();
+      void watchShaderDependencies(const shaderSourceFile& sourceFile);
+
+      //Polled at the frame boundary, rebuilds shaders whose sources changed and swaps the pipeline once they're done.
+      void updateShaderHotReload();
+#endif
 
       int rateDeviceSuitability(const VkPhysicalDevice& device);
       queueFamilyIndices findQueueFamilies(const VkPhysicalDevice& device);
@@ -82,10 +252,17 @@ namespace malachite
       VkPresentModeKHR chooseSwapPresentMode(const std::vector<VkPresentModeKHR>& availablePresentModes);
       VkExtent2D chooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilities);
 
-      VkPipelineShaderStageCreateInfo createShaderModule(std::filesystem::path fileName, e_shaderType shaderType);
-      
+      //Replaces the swapchain, what frames in flight may still use goes through the deletion queue.
+      //False while the window is minimized, the frame is skipped and it is tried again next frame.
+      bool recreateSwapChain();
+
+      void logLatencyStats(e_latencyMode mode) const;
+
       //writes the commands we want to execute into a command buffer.
-      void recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+      void recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex, arrayView<uint32_t> visibleObjects);
+
+      //Pipeline, viewport and scissor, once per command buffer the scene is drawn into.
+      void recordSceneState(VkCommandBuffer commandBuffer, VkPipeline scenePipeline);
 
       bool checkValidationLayerSupport();
       bool checkDeviceSuitablity(const VkPhysicalDevice& device);
@@ -93,6 +270,14 @@ namespace malachite
       std::vector<const char*> getRequiredExtensions();
 
     private:
+      //Everything a frame owns while the GPU works on it.
+      struct frameInFlight
+      {
+        VkCommandBuffer commandBuffer;
+        VkSemaphore imageAvailableSemaphore;
+        VkFence inFlightFence;
+      };
+
       GLFWwindow* m_glfwWindowPtr;
       VkInstance m_vulkanInstancePtr;
 
@@ -102,23 +287,104 @@ namespace malachite
       VkDevice m_vulkanLogicalDevice;
       VkSwapchainKHR m_vulkanSwapChain;
       VkRenderPass m_vulkanRenderPass;
-      VkPipelineLayout m_vulkanPipelineLayout;
-      VkPipeline m_vulkanGraphicsPipeline;
       VkCommandPool m_vulkanCommandPool;
-      VkCommandBuffer m_vulkanCommandBuffer;
 
       VkQueue m_vulkanGraphicsQueue;
       VkQueue m_vulkanPresentQueue;
+      VkQueue m_vulkanTransferQueue;
+
+      uint32_t m_framesInFlight;
+      uint32_t m_currentFrame = 0;
+      std::vector<frameInFlight> m_frames;
+      frameDeletionQueue m_deletionQueue;
 
-      VkSemaphore m_vulkanImageAvailableSemaphore;
-      VkSemaphore m_vulkanRenderFinishedSemaphore;
-      VkFence m_vulkanInFlightFence;
+      //Per swapchain image, presentation may still wait on the semaphore when the frame slot comes around again.
+      std::vector<VkSemaphore> m_vulkanRenderFinishedSemaphores;
+
+      //Fence of the frame last rendering into each swapchain image, images can be acquired out of order.
+      std::vector<VkFence> m_vulkanImagesInFlight;
 
-      std::vector<VkShaderModule> m_vulkanShaderModules;
       std::vector<VkImageView> m_vulkanSwapChainImageViews;
       std::vector<VkImage> m_vulkanSwapChainImages;
-      std::vector<VkFramebuffer> m_vulkanSwapChainFrameBuffers;
-      VkFormat m_vulkanSwapChainImageFormat;
+      VkFormat m_vulkanSwapChainImageFormat = VK_FORMAT_UNDEFINED;
       VkExtent2D m_vulkanSwapChainExtent;
+
+      e_latencyMode m_latencyMode = e_latencyMode::lowLatency;
+      uint32_t m_requestedSwapChainImageCount = 0;
+
+      //Set by mode and image count changes, resizes and suboptimal presents, handled at the next frame start.
+      bool m_isSwapChainDirty = false;
+      bool m_isFramebufferResized = false;
+
+      frameLatencyStats m_latencyStats[c_latencyModeCount];
+      uint64_t m_frameIntervalCounts[c_latencyModeCount] = {};
+
+      //Per frame in flight, when drawFrame started it and the mode it was rendered in.
+      std::vector<std::chrono::steady_clock::time_point> m_frameStartTimes;
+      std::vector<e_latencyMode> m_frameLatencyModes;
+
+      //Zero after the swapchain changes, the next interval would span the recreation.
+      std::chrono::steady_clock::time_point m_lastPresentTime;
+
+      pipelineLayoutCache m_pipelineLayoutCache;
+      pipelineCache m_pipelineCache;
+      pipelineStateCache m_pipelineStates;
+
+      //Draws ask m_pipelineStates for these, the fallback is the last scene pipeline that was ready.
+      pipelineDescription m_scenePipeline;
+      pipelineDescription m_fallbackScenePipeline;
+
+      gpuAllocator m_gpuAllocator;
+      textureStreamer m_textureStreamer;
+      meshBufferPool m_meshes;
+
+      drawBatcher m_drawBatcher;
+      bool m_isDrawBatching = true;
+
+      gpuProfiler m_gpuProfiler;
+
+      //Rebuilt by every recordCommandBuffer, the swapchain image is imported into it.
+      renderGraph m_renderGraph;
+
+      secondaryCommandRecorder m_commandRecorder;
+      bool m_isParallelRecording = true;
+
+      //Caps the slices below the recorder's maximum, 0 doesn't. Set by benchmarkDrawRecording only.
+      uint32_t m_recordSliceLimit = 0;
+      std::vector<uint32_t> m_sliceDrawCallCounts;
+
+      double m_recordMilliseconds = 0.0;
+      uint32_t m_drawCallCount = 0;
+
+      //Indexed by object, c_invalidMesh for objects without one.
+      std::vector<meshId> m_objectMeshes;
+      std::vector<math::mat4> m_objectTransforms;
+
+      shaderKeywords m_shaderKeywords;
+      shaderVariantKey m_shaderVariantKey = 0;
+      std::vector<std::string> m_enabledShaderKeywords;
+      bool m_isShaderVariantChanged = false;
+
+#ifdef MAL_SHADER_COMPILER
+      std::unique_ptr<shaderCache> m_shaderCache;
+      std::unique_ptr<shaderBuildService> m_shaderBuilder;
+      fileWatcher m_shaderWatcher;
+
+      //The shader and every include it pulled in, as absolute paths.
+      std::vector<std::filesystem::path> m_shaderDependencies;
+      std::vector<shaderStageFuture> m_pendingShaderStages;
+
+      //Set when the compiled keywords changed, the variant is built like an edited source.
+      bool m_isShaderRebuildRequested = false;
+#else
+      //Loose cooked binaries of the variant being switched to.
+      resourceHandle<fileResource> m_pendingVertexBinary;
+      resourceHandle<fileResource> m_pendingFragmentBinary;
+      shaderVariantKey m_pendingShaderVariantKey = 0;
+#endif
+
+      boundingSpheres m_objectBounds;
+      cullingParams m_cullingParams;
+      cullingStage m_cullingStage;
   };
 }
\ No newline at end of file
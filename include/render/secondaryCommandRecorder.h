@@ -0,0 +1,56 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <functional>
+#include <vulkan/vulkan.h>
+
+namespace malachite
+{
+  class threadPool;
+
+  //Records a render pass as slices of secondary command buffers across the thread pool and executes
+  //them from the primary in slice order, so the result doesn't depend on which thread ran what.
+  //Every slice of every frame in flight has a command pool of its own, a pool is only ever touched
+  //by the job recording its slice and is reset as a whole before that.
+  class secondaryCommandRecorder
+  {
+    public:
+      void initalize(VkDevice device, uint32_t queueFamilyIndex, uint32_t framesInFlight, uint32_t maxSliceCount);
+      void cleanup();
+
+      //recordSlice is called once per slice on any thread with the secondary buffer already begun,
+      //inheriting the render pass and framebuffer. The primary has to be inside a render pass begun
+      //with VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS and the frame's previous submission done.
+      void record
+      (
+        threadPool& pool,
+        uint32_t frameIndex,
+        VkCommandBuffer primaryCommandBuffer,
+        const VkCommandBufferInheritanceInfo& inheritanceInfo,
+        uint32_t sliceCount,
+        const std::function<void(VkCommandBuffer commandBuffer, uint32_t slice)>& recordSlice
+      );
+
+      uint32_t getMaxSliceCount() const
+      {
+        return m_maxSliceCount;
+      }
+
+    private:
+      struct slice
+      {
+        VkCommandPool commandPool = VK_NULL_HANDLE;
+        VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+      };
+
+      VkDevice m_device = VK_NULL_HANDLE;
+      uint32_t m_maxSliceCount = 0;
+
+      //maxSliceCount per frame in flight, frame by frame.
+      std::vector<slice> m_slices;
+
+      //Scratch of record, kept between frames to avoid reallocating.
+      std::vector<VkCommandBuffer> m_executedCommandBuffers;
+      std::vector<VkResult> m_sliceResults;
+  };
+}
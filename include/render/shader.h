@@ -0,0 +1,18 @@
+#pragma once
+
+namespace malachite
+{
+  enum e_shaderType
+  {
+    none = 0,
+    vertex = 1,
+    fragment = 2,
+    compute = 3,
+    geometry = 4,
+    tess_control = 5,
+    tess_evaluation = 6
+  };
+
+  //Extension of the binary generated for each stage, e.g. simple.vert.
+  const char* getShaderFileExtension(e_shaderType shaderType);
+}
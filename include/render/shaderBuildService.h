@@ -0,0 +1,129 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <future>
+#include <filesystem>
+#include <unordered_map>
+
+#include "shader.h"
+#include "shaderCache.h"
+#include "shaderParser.h"
+#include "shaderVariants.h"
+
+namespace malachite
+{
+  class threadPool;
+
+  struct compiledShaderStage
+  {
+    //Source file and stage, e.g. simple.vert.
+    std::string name;
+    e_shaderType shaderType = e_shaderType::none;
+    std::vector<uint32_t> spirv;
+
+    //Compiler output for this stage only, empty when it compiled cleanly.
+    std::string errorMessage;
+    uint32_t errorCount = 0;
+    uint32_t warningCount = 0;
+
+    //Where the binary was written, empty when no output was asked for.
+    std::filesystem::path outputPath;
+
+    //False when writing outputPath failed, the SPIR-V above is still usable.
+    bool isOutputWritten = false;
+
+    bool isCompiled() const
+    {
+      return !spirv.empty();
+    }
+
+    //Compiles run on the pool and the logger isn't thread safe, so nothing is logged there.
+    //Call this from the thread that collects the future.
+    void logDiagnostics() const;
+  };
+
+  using shaderStageFuture = std::shared_future<compiledShaderStage>;
+
+  //Compiles shader stages on the thread pool, every worker keeps its own shaderc::Compiler.
+  //Hits in the shaderCache skip the compiler. The pool and cache must outlive every future handed out.
+  class shaderBuildService
+  {
+    public:
+      shaderBuildService(threadPool& threadPool, shaderCache& cache, const shaderCompileSettings& settings = shaderCompileSettings());
+
+      //Parses on the calling thread and queues a compile per section, in file order.
+      //Stages are also written to outputDirectory when one is given. Compiler errors
+      //point at the original file and line, includes included.
+      std::vector<shaderStageFuture> compileFile(const std::filesystem::path& shaderFilePath, const std::filesystem::path& outputDirectory = std::filesystem::path());
+
+      //Same as compileFile for a source parsed through getIncludeCache(). Every compiled keyword
+      //set in variantKey is defined as a macro, specialization keywords are left to the pipeline.
+      std::vector<shaderStageFuture> compileSource
+      (
+        std::shared_ptr<const shaderSourceFile> sourceFile,
+        const std::filesystem::path& outputDirectory = std::filesystem::path(),
+        shaderVariantKey variantKey = 0
+      );
+
+      shaderStageFuture compileStage(std::string name, e_shaderType shaderType, std::string source, const std::filesystem::path& outputPath = std::filesystem::path());
+
+      //Includes are resolved next to the including file first, then in these search paths.
+      shaderIncludeCache& getIncludeCache()
+      {
+        return m_includeCache;
+      }
+
+    private:
+      //sourceFile is used to map error locations back, it is null for loose sources.
+      compiledShaderStage compile
+      (
+        std::string name,
+        e_shaderType shaderType,
+        std::string_view source,
+        const shaderCompileSettings& settings,
+        const std::filesystem::path& outputPath,
+        const shaderSourceFile* sourceFile,
+        size_t sectionIndex
+      );
+
+      threadPool& m_threadPool;
+      shaderCache& m_cache;
+      shaderCompileSettings m_settings;
+      shaderIncludeCache m_includeCache;
+
+      uint32_t m_spirvVersion = 0;
+      uint32_t m_spirvRevision = 0;
+  };
+
+  //Permutations of one shader, compiled the first time they're asked for. Variants that only
+  //differ in specialization keywords share an entry. Not thread safe, owned by whoever draws with it.
+  class shaderVariantSet
+  {
+    public:
+      shaderVariantSet(shaderBuildService& buildService, std::shared_ptr<const shaderSourceFile> sourceFile, const std::filesystem::path& outputDirectory = std::filesystem::path());
+
+      const shaderKeywords& getKeywords() const
+      {
+        return m_sourceFile->keywords;
+      }
+
+      //Stages in file order, the futures are the same for every later request of the variant.
+      const std::vector<shaderStageFuture>& getVariant(shaderVariantKey variantKey);
+
+      //Queues every permutation of the compiled keywords, for cooking ahead of time.
+      void compileAll();
+
+      size_t getVariantCount() const
+      {
+        return m_variants.size();
+      }
+
+    private:
+      shaderBuildService& m_buildService;
+      std::shared_ptr<const shaderSourceFile> m_sourceFile;
+      std::filesystem::path m_outputDirectory;
+
+      std::unordered_map<shaderVariantKey, std::vector<shaderStageFuture>> m_variants;
+  };
+}
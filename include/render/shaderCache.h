@@ -0,0 +1,55 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <atomic>
+#include <filesystem>
+
+namespace malachite
+{
+  //Everything handed to the compiler besides the source, all of it is part of the cache key.
+  struct shaderCompileSettings
+  {
+    std::string entryPoint = "main";
+    bool isOptimized = false;
+    std::vector<std::pair<std::string, std::string>> macroDefinitions;
+
+    uint64_t hash() const;
+  };
+
+  //On disk SPIR-V cache, one file per compiled stage named after a hash of the source,
+  //stage, compile settings and compiler SPIR-V version. Safe to use from several threads.
+  class shaderCache
+  {
+    public:
+      shaderCache(const std::filesystem::path& cacheDirectory);
+
+      //spirvVersion comes from shaderc_get_spv_version so a compiler upgrade misses.
+      static uint64_t computeKey(std::string_view source, uint32_t stage, const shaderCompileSettings& settings, uint32_t spirvVersion, uint32_t spirvRevision);
+
+      //Returns false on a miss or an unreadable entry.
+      bool load(uint64_t key, std::vector<uint32_t>& spirv);
+
+      //compileMilliseconds is reported as time saved whenever the entry is hit later.
+      //Doesn't log, it runs on workers, failures are counted and show up in logStats.
+      bool store(uint64_t key, const uint32_t* spirv, size_t wordCount, double compileMilliseconds);
+
+      void logStats() const;
+
+      uint32_t getHitCount() const { return m_hitCount; }
+      uint32_t getMissCount() const { return m_missCount; }
+      uint32_t getStoreFailureCount() const { return m_storeFailureCount; }
+
+    private:
+      std::filesystem::path getEntryPath(uint64_t key) const;
+
+      std::filesystem::path m_cacheDirectory;
+
+      std::atomic<uint32_t> m_hitCount{0};
+      std::atomic<uint32_t> m_missCount{0};
+      std::atomic<uint32_t> m_storeFailureCount{0};
+      std::atomic<uint64_t> m_savedMicroseconds{0};
+  };
+}
@@ -0,0 +1,97 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <filesystem>
+
+#include "shader.h"
+#include "shaderVariants.h"
+#include "mappedFile.h"
+
+namespace malachite
+{
+  //A run of section lines starting at sectionLine that came from files[fileIndex] starting at sourceLine.
+  struct shaderLineMapping
+  {
+    uint32_t sectionLine;
+    uint32_t fileIndex;
+    uint32_t sourceLine;
+  };
+
+  struct shaderSourceSection
+  {
+    e_shaderType shaderType = e_shaderType::none;
+
+    //Points into the mapped file, or into expanded storage when the section has includes.
+    std::string_view source;
+
+    //Sorted by sectionLine, always has at least one entry.
+    std::vector<shaderLineMapping> lineMappings;
+  };
+
+  struct shaderSourceLocation
+  {
+    const std::filesystem::path* filePath = nullptr;
+    uint32_t line = 0;
+  };
+
+  //A parsed shader file, sections stay valid as long as this does.
+  struct shaderSourceFile
+  {
+    mappedFile file;
+
+    //files[0] is the shader itself, the rest are the includes it pulled in.
+    std::vector<std::filesystem::path> files;
+    std::vector<shaderSourceSection> sections;
+
+    //From #keywords and #spec_keywords above the first stage tag.
+    shaderKeywords keywords;
+
+    //Only sections with includes own their text.
+    std::deque<std::string> expandedSources;
+
+    //Lines are 1 based and counted from the first line of the section.
+    shaderSourceLocation mapLine(size_t sectionIndex, uint32_t sectionLine) const;
+
+    //Rewrites "<tag>:<line>:" compiler locations into "<file>:<line>:" of the original source.
+    std::string remapCompilerMessage(size_t sectionIndex, std::string_view message, std::string_view tag) const;
+  };
+
+  //Include files are mapped once and shared by every parse going through the same cache.
+  class shaderIncludeCache
+  {
+    public:
+      //Searched after the directory of the including file.
+      void addSearchPath(const std::filesystem::path& searchPath);
+
+      //Returns nullptr when the include can't be found.
+      const mappedFile* find(std::string_view requestedPath, const std::filesystem::path& includingDirectory, std::filesystem::path& resolvedPath);
+
+      void clear();
+
+    private:
+      const mappedFile* findFile(const std::filesystem::path& path);
+
+      std::mutex m_mutex;
+      std::vector<std::filesystem::path> m_searchPaths;
+      std::unordered_map<std::string, std::unique_ptr<mappedFile>> m_files;
+  };
+
+  //Splits a shader on its stage tags (#vertex, #fragment, #compute, #geometry, #tess_control,
+  //#tess_evaluation) in one pass over the mapped file. Lines above the first tag are ignored,
+  //apart from keyword declarations. #include "file" is expanded in place, a file is only
+  //included once per section. Throws when the file can't be opened, an include can't be
+  //resolved or a keyword is declared twice.
+  std::shared_ptr<shaderSourceFile> parseShaderSource(const std::filesystem::path& filePath, shaderIncludeCache& includeCache);
+
+  //Keyword declarations on their own, as malachite-cook writes them next to the binaries
+  //(<shader>.keywords) so builds without the sources can still pick variants.
+  //Other lines are ignored, returns false when a keyword is declared twice.
+  bool parseShaderKeywords(std::string_view text, shaderKeywords& keywords);
+  std::string writeShaderKeywords(const shaderKeywords& keywords);
+}
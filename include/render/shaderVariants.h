@@ -0,0 +1,68 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+#include "shader.h"
+
+namespace malachite
+{
+  //One bit per keyword in declaration order, 0 is the variant with every keyword off.
+  using shaderVariantKey = uint64_t;
+
+  constexpr uint32_t c_maxShaderKeywords = 64;
+
+  //Declared above the first stage tag of a shader:
+  //#keywords LIT SKINNED     each combination is its own module, compiled with the keyword defined.
+  //#spec_keywords FOG        one module for every combination, picked when the pipeline is created.
+  //A specialization keyword is a bool constant, its constant_id is its position among the
+  //specialization keywords, e.g. layout(constant_id = 0) const bool FOG = false;
+  struct shaderKeywords
+  {
+    std::vector<std::string> names;
+    shaderVariantKey specializedMask = 0;
+
+    //Returns false when the keyword is already declared or there are too many.
+    bool add(std::string_view name, bool isSpecialized);
+
+    //0 for keywords the shader doesn't declare, so unknown keywords fall back to the base variant.
+    shaderVariantKey getKeywordBit(std::string_view name) const;
+
+    shaderVariantKey getVariantKey(const std::vector<std::string_view>& enabledKeywords) const;
+
+    shaderVariantKey getCompiledMask() const
+    {
+      return names.size() >= 64 ? ~specializedMask : ((shaderVariantKey(1) << names.size()) - 1) & ~specializedMask;
+    }
+
+    //Variants that only differ in specialization keywords share their SPIR-V.
+    shaderVariantKey getCompiledKey(shaderVariantKey variantKey) const
+    {
+      return variantKey & getCompiledMask();
+    }
+  };
+
+  //Constant values handed to vkCreateGraphicsPipelines, pointers stay valid as long as this does.
+  struct shaderSpecialization
+  {
+    std::vector<VkSpecializationMapEntry> mapEntries;
+    std::vector<VkBool32> values;
+    VkSpecializationInfo info{};
+
+    void build(const shaderKeywords& keywords, shaderVariantKey variantKey);
+
+    //One value per specialization keyword, constant_id is the index.
+    void build(const std::vector<VkBool32>& constantValues);
+
+    //nullptr when the shader has no specialization keywords.
+    const VkSpecializationInfo* get() const
+    {
+      return mapEntries.empty() ? nullptr : &info;
+    }
+  };
+
+  //The base variant keeps the plain stage name, e.g. simple.vert, others add the compiled key in hex, simple.5.vert.
+  std::string getShaderVariantFileName(std::string_view shaderName, shaderVariantKey compiledKey, e_shaderType shaderType);
+}
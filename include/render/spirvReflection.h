@@ -0,0 +1,56 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+#include "arrayView.h"
+
+namespace malachite
+{
+  struct reflectedDescriptorBinding
+  {
+    uint32_t set;
+    uint32_t binding;
+    VkDescriptorType descriptorType;
+    uint32_t descriptorCount;
+  };
+
+  struct reflectedVertexInput
+  {
+    uint32_t location;
+    VkFormat format;
+    uint32_t size;
+  };
+
+  //What a single shader stage expects from its pipeline layout and vertex input state.
+  struct shaderReflection
+  {
+    VkShaderStageFlagBits stage = VK_SHADER_STAGE_VERTEX_BIT;
+
+    //Sorted by set then binding.
+    std::vector<reflectedDescriptorBinding> descriptorBindings;
+
+    //Vertex stages only, sorted by location.
+    std::vector<reflectedVertexInput> vertexInputs;
+
+    //Zero size when the stage has no push constant block.
+    uint32_t pushConstantOffset = 0;
+    uint32_t pushConstantSize = 0;
+  };
+
+  //Reads the descriptor bindings, push constant block and vertex inputs straight out of the module.
+  //Returns false when the words aren't valid SPIR-V.
+  bool reflectSpirv(arrayView<uint32_t> spirv, shaderReflection& reflection);
+
+  //Vertex inputs from this location on are per instance, matrices take a location per column.
+  constexpr uint32_t c_firstInstanceInputLocation = 8;
+
+  //One interleaved, tightly packed vertex buffer in binding 0 holding every input in location order.
+  //Instance inputs are packed the same way into binding 1, its stride rounded up to 16 bytes.
+  void buildVertexInputLayout
+  (
+    const shaderReflection& vertexStage,
+    std::vector<VkVertexInputBindingDescription>& bindings,
+    std::vector<VkVertexInputAttributeDescription>& attributes
+  );
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+#include "gpuAllocator.h"
+
+namespace malachite
+{
+  //Where staged bytes go, copies read from buffer at offset.
+  struct stagingSpan
+  {
+    VkBuffer buffer = VK_NULL_HANDLE;
+    VkDeviceSize offset = 0;
+    void* mapped = nullptr;
+  };
+
+  //Persistently mapped ring buffer that uploads are staged through, with the copies of a frame
+  //recorded into one command buffer and submitted as one batch. Space is handed back once the
+  //fence of the batch that used it has signaled. Everything here is called from one thread.
+  class stagingRing
+  {
+    public:
+      void initalize(gpuAllocator& allocator, VkDevice device, VkQueue queue, uint32_t queueFamilyIndex, VkDeviceSize size = 16 * 1024 * 1024);
+
+      //Waits for every batch in flight.
+      void cleanup();
+
+      //Space in the open batch, false while the ring is too full. Anything larger than the whole ring
+      //gets a buffer of its own that lives as long as the batch.
+      bool allocate(VkDeviceSize size, VkDeviceSize alignment, stagingSpan& span);
+
+      //Command buffer of the open batch, record copies out of allocated spans here.
+      VkCommandBuffer getCommandBuffer();
+
+      //Submits the open batch, returns its serial or 0 when nothing was recorded.
+      uint64_t submit();
+
+      //Polls batches in flight and releases what the finished ones used.
+      void retire();
+
+      //Every batch up to this serial has finished on the GPU.
+      uint64_t getCompletedSerial() const { return m_completedSerial; }
+
+    private:
+      struct uploadBatch
+      {
+        VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+        VkFence fence = VK_NULL_HANDLE;
+        uint64_t serial = 0;
+
+        //Ring head once the batch was submitted, the tail moves here when it is done.
+        VkDeviceSize ringEnd = 0;
+        std::vector<std::pair<VkBuffer, gpuAllocation>> dedicatedBuffers;
+      };
+
+      //Takes a finished batch out of flight, false when it is still running.
+      bool retireBatch(uploadBatch& batch, bool isWaiting);
+
+      gpuAllocator* m_allocator = nullptr;
+      VkDevice m_device = VK_NULL_HANDLE;
+      VkQueue m_queue = VK_NULL_HANDLE;
+      VkCommandPool m_commandPool = VK_NULL_HANDLE;
+
+      VkBuffer m_buffer = VK_NULL_HANDLE;
+      gpuAllocation m_allocation;
+      VkDeviceSize m_size = 0;
+      VkDeviceSize m_head = 0;
+      VkDeviceSize m_tail = 0;
+
+      //Oldest first, batches on one queue finish in submission order.
+      std::vector<uploadBatch> m_inFlight;
+      std::vector<uploadBatch> m_freeBatches;
+      uploadBatch m_openBatch;
+      bool m_isOpenBatchRecording = false;
+
+      uint64_t m_nextSerial = 1;
+      uint64_t m_completedSerial = 0;
+  };
+}
@@ -0,0 +1,145 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <filesystem>
+#include <vulkan/vulkan.h>
+
+#include "resourceManager.h"
+#include "textureResource.h"
+#include "frameDeletionQueue.h"
+#include "gpuAllocator.h"
+#include "stagingRing.h"
+
+namespace malachite
+{
+  using textureId = uint32_t;
+
+  constexpr textureId c_invalidTexture = ~0u;
+
+  struct textureStreamingStats
+  {
+    size_t residentBytes = 0;
+    size_t budgetBytes = 0;
+    uint32_t textureCount = 0;
+    uint32_t pendingUploads = 0;
+    uint32_t uploadedMips = 0;
+    uint32_t evictedMips = 0;
+  };
+
+  //Decodes textures on the resourceManager I/O threads and uploads them through a staging ring,
+  //coarsest mips first. Finer mips follow the screen size asked for through requestSize and are
+  //dropped again, least recently asked for first, whenever the resident total is over budget.
+  //A texture image only holds its resident mips, growing or shrinking it swaps in a new image.
+  //Everything here is called from the main thread.
+  class textureStreamer
+  {
+    public:
+      //Textures are decoded through resources, replaced images are handed to deletionQueue and
+      //memory comes out of allocator. All of them have to outlive the streamer.
+      void initalize
+      (
+        resourceManager& resources,
+        frameDeletionQueue& deletionQueue,
+        gpuAllocator& allocator,
+        VkDevice device,
+        VkQueue queue,
+        uint32_t queueFamilyIndex,
+        size_t budgetBytes = 256 * 1024 * 1024
+      );
+      void cleanup();
+
+      //Never blocks, the same path always gives the same id.
+      textureId load(const std::filesystem::path& path);
+      void release(textureId texture);
+
+      //Pixels the texture spans on screen along its longest axis, the largest request of a frame wins.
+      void requestSize(textureId texture, float screenSize);
+
+      //Once per frame after the frame fence. Retires finished uploads, evicts down to the budget
+      //and queues the next mips. Images replaced here are destroyed once the frames in flight are done.
+      void update();
+
+      //VK_NULL_HANDLE until the first mips are resident.
+      VkImageView getImageView(textureId texture) const;
+      VkSampler getSampler() const { return m_sampler; }
+
+      //Finest mip currently resident, the mip count while nothing is.
+      uint32_t getResidentMip(textureId texture) const;
+
+      void setBudget(size_t bytes) { m_budgetBytes = bytes; }
+      const textureStreamingStats& getStats();
+
+    private:
+      struct residentImage
+      {
+        VkImage image = VK_NULL_HANDLE;
+        gpuAllocation allocation;
+        VkImageView view = VK_NULL_HANDLE;
+        size_t memorySize = 0;
+
+        //Finest mip held by the image, every coarser one is in it too.
+        uint32_t firstMip = 0;
+      };
+
+      struct streamedTexture
+      {
+        std::string path;
+        resourceHandle<textureResource> source;
+        residentImage resident;
+
+        float requestedSize = 0.0f;
+        uint64_t lastRequestedFrame = 0;
+        bool isUploading = false;
+        bool isUsed = false;
+      };
+
+      struct pendingUpload
+      {
+        textureId texture;
+        residentImage image;
+
+        //Staging batch the copies went out with, 0 until update submits it.
+        uint64_t serial = 0;
+      };
+
+      //Mip to stream towards for the size requested, the coarse tail when nothing asked lately.
+      uint32_t getWantedMip(const streamedTexture& texture) const;
+
+      //Records uploading mips [firstMip, mipCount) into a new image, submitted with the rest of the frame.
+      bool queueUpload(textureId texture, uint32_t firstMip);
+      //Swaps in the images of every upload whose staging batch has finished.
+      void retireUploads();
+
+      //Shrinks textures less important than requester until incomingBytes fit, false when nothing is left to shrink.
+      //Without a requester anything above its tail may be shrunk.
+      bool evictToBudget(size_t incomingBytes, textureId requester);
+      //Frames in flight may still sample the image, it goes through the deletion queue.
+      void retireImage(residentImage& image);
+      void destroyImage(residentImage& image);
+
+      size_t getImageSize(const textureResource& source, uint32_t firstMip) const;
+
+      resourceManager* m_resources = nullptr;
+      frameDeletionQueue* m_deletionQueue = nullptr;
+      gpuAllocator* m_allocator = nullptr;
+      VkDevice m_device = VK_NULL_HANDLE;
+      VkSampler m_sampler = VK_NULL_HANDLE;
+      stagingRing m_staging;
+
+      std::vector<streamedTexture> m_textures;
+      std::vector<textureId> m_freeTextures;
+      std::unordered_map<std::string, textureId> m_textureLookup;
+      std::vector<pendingUpload> m_uploads;
+
+      size_t m_budgetBytes = 0;
+
+      //Every image alive right now, and what they will add up to once the queued uploads are swapped in.
+      size_t m_residentBytes = 0;
+      size_t m_committedBytes = 0;
+      uint64_t m_frameIndex = 0;
+      textureStreamingStats m_stats;
+  };
+}
@@ -0,0 +1,106 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <filesystem>
+
+#include "arrayView.h"
+#include "mappedFile.h"
+
+namespace malachite
+{
+  //Packed archive layout, little endian:
+  //header | entry table sorted by name hash | name blob | payloads
+  //Payloads start 16 byte aligned, 64 byte aligned once they are a cache line or larger.
+
+  constexpr char c_assetArchiveMagic[4] = {'M', 'A', 'L', 'P'};
+  constexpr uint32_t c_assetArchiveVersion = 1;
+
+  //Every payload starts on it, archives with one that doesn't are rejected on open, so found
+  //data can be viewed as any type up to this alignment.
+  constexpr uint64_t c_assetArchivePayloadAlignment = 16;
+
+  struct assetArchiveHeader
+  {
+    char magic[4];
+    uint32_t version;
+    uint32_t entryCount;
+    uint32_t reserved;
+    uint64_t entryTableOffset;
+    uint64_t nameBlobOffset;
+    uint64_t nameBlobSize;
+  };
+
+  struct assetArchiveEntry
+  {
+    uint64_t nameHash;
+    uint64_t dataOffset;
+    uint64_t dataSize;
+    uint32_t nameOffset;
+    uint32_t nameLength;
+  };
+
+  static_assert(sizeof(assetArchiveHeader) == 40, "archive header layout changed");
+  static_assert(sizeof(assetArchiveEntry) == 32, "archive entry layout changed");
+
+  //Read only view of a packed archive, the file is mapped once and pages come in on demand.
+  //Views returned by find stay valid until the archive is closed.
+  class assetArchive
+  {
+    public:
+      assetArchive() = default;
+      ~assetArchive();
+
+      assetArchive(const assetArchive&) = delete;
+      assetArchive& operator=(const assetArchive&) = delete;
+
+      //Returns false when the file is missing or isn't a valid archive.
+      bool open(const std::filesystem::path& path);
+      void close();
+
+      bool isOpen() const
+      {
+        return m_header != nullptr;
+      }
+
+      //Names are the generic relative paths given to the packer, returns an empty view when missing.
+      arrayView<char> find(std::string_view name) const;
+      bool contains(std::string_view name) const;
+
+      uint32_t getEntryCount() const
+      {
+        return m_header ? m_header->entryCount : 0;
+      }
+
+    private:
+      mappedFile m_file;
+
+      const assetArchiveHeader* m_header = nullptr;
+      const assetArchiveEntry* m_entries = nullptr;
+      const char* m_names = nullptr;
+  };
+
+  //Builds archives offline, used by the malachite-pack tool.
+  class assetArchiveWriter
+  {
+    public:
+      void addData(const std::string& name, std::vector<char> data);
+
+      //Returns false when the file can't be read.
+      bool addFile(const std::string& name, const std::filesystem::path& filePath);
+
+      //Returns false on duplicate names or when the output can't be written.
+      bool write(const std::filesystem::path& outputPath) const;
+
+    private:
+      struct pendingAsset
+      {
+        std::string name;
+        std::vector<char> data;
+      };
+
+      std::vector<pendingAsset> m_assets;
+  };
+}
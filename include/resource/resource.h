@@ -0,0 +1,50 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+#include <memory>
+#include <filesystem>
+
+namespace malachite
+{
+  enum class e_resourceState
+  {
+    unloaded = 0,
+    loading = 1,
+    loaded = 2,
+    failed = 3
+  };
+
+  //Higher priorities are picked up by the I/O threads first.
+  enum class e_resourcePriority
+  {
+    low = 0,
+    normal = 1,
+    high = 2,
+    critical = 3
+  };
+
+  //Base of everything the resourceManager can load and account for.
+  class resource
+  {
+    public:
+      virtual ~resource() = default;
+
+      //Bytes counted against the resourceManager memory budget.
+      virtual size_t getMemorySize() const = 0;
+  };
+
+  //Raw contents of a file, used for anything without a dedicated loader.
+  class fileResource : public resource
+  {
+    public:
+      std::vector<char> bytes;
+
+      size_t getMemorySize() const override
+      {
+        return bytes.size();
+      }
+
+      //Returns nullptr when the file can't be read.
+      static std::unique_ptr<fileResource> load(const std::filesystem::path& path);
+  };
+}
@@ -0,0 +1,291 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <queue>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <typeindex>
+#include <filesystem>
+
+#include "resource.h"
+#include "assetArchive.h"
+
+namespace malachite
+{
+  class resourceManager;
+
+  //Typed, generational and reference counted handle to a resource slot. Handles are handed
+  //out before the data exists, get() returns nullptr until the load finished.
+  //A stale handle (slot reused since) never resolves to the new occupant.
+  template <typename T>
+  class resourceHandle
+  {
+    friend class resourceManager;
+
+    public:
+      resourceHandle() = default;
+      resourceHandle(const resourceHandle& other);
+      resourceHandle(resourceHandle&& other) noexcept;
+      resourceHandle& operator=(resourceHandle other) noexcept;
+      ~resourceHandle();
+
+      bool isValid() const
+      {
+        return m_manager != nullptr;
+      }
+
+      e_resourceState getState() const;
+
+      bool isLoaded() const
+      {
+        return getState() == e_resourceState::loaded;
+      }
+
+      const T* get() const;
+
+      const T* operator->() const
+      {
+        return get();
+      }
+
+      void reset();
+
+      uint32_t getIndex() const { return m_index; }
+      uint32_t getGeneration() const { return m_generation; }
+
+    private:
+      //Takes over a reference already added by the manager.
+      resourceHandle(resourceManager* manager, uint32_t index, uint32_t generation)
+        : m_manager(manager), m_index(index), m_generation(generation)
+      {
+      }
+
+      resourceManager* m_manager = nullptr;
+      uint32_t m_index = 0;
+      uint32_t m_generation = 0;
+  };
+
+  //Called on the main thread from update() once a load finished, with whether it succeeded.
+  using resourceCallback = std::function<void(bool isLoaded)>;
+  using resourceLoaderFunc = std::function<std::unique_ptr<resource>(const std::filesystem::path&)>;
+
+  //Hands out handles immediately and loads on a pool of background I/O threads, highest
+  //priority first. Resources nobody references stay cached until the memory budget is
+  //exceeded, then the least recently used ones are evicted.
+  //Handles and everything public here are meant to be used from the main thread.
+  class resourceManager
+  {
+    template <typename T>
+    friend class resourceHandle;
+
+    public:
+      resourceManager(uint32_t ioThreadCount = 2, size_t memoryBudget = 256 * 1024 * 1024);
+      ~resourceManager();
+
+      resourceManager(const resourceManager&) = delete;
+      resourceManager& operator=(const resourceManager&) = delete;
+
+      //Relative resource paths are resolved against this directory.
+      void setRootPath(const std::filesystem::path& rootPath);
+      std::filesystem::path resolvePath(const std::filesystem::path& path) const;
+
+      //Maps a packed archive made by malachite-pack, later mounts are searched first.
+      //Returns false when it is missing or invalid, loose files are used then.
+      bool mountArchive(const std::filesystem::path& path);
+
+      //Zero copy view into a mounted archive, path is relative to the resource root.
+      //Returns an empty view when no mounted archive has it.
+      arrayView<char> findPacked(const std::filesystem::path& path) const;
+
+      //Loaders run on the I/O threads and return nullptr on failure.
+      template <typename T>
+      void registerLoader(std::function<std::unique_ptr<T>(const std::filesystem::path&)> loader)
+      {
+        m_loaders[std::type_index(typeid(T))] = [loader](const std::filesystem::path& path) -> std::unique_ptr<resource>
+        {
+          return loader(path);
+        };
+      }
+
+      //Never blocks. Asking for the same path and type again shares the slot, if it is
+      //already loaded onComplete runs right away.
+      template <typename T>
+      resourceHandle<T> load
+      (
+        const std::filesystem::path& path,
+        e_resourcePriority priority = e_resourcePriority::normal,
+        resourceCallback onComplete = nullptr
+      )
+      {
+        uint32_t index = acquireSlot(std::type_index(typeid(T)), path, priority, onComplete);
+        return resourceHandle<T>(this, index, m_slots[index].generation);
+      }
+
+      //Blocks until the load finished, only meant for startup and loading screens.
+      template <typename T>
+      bool wait(const resourceHandle<T>& handle)
+      {
+        return waitForSlot(handle.m_index, handle.m_generation);
+      }
+
+      //Called once per frame by the application. Moves finished loads into their slots,
+      //runs callbacks and evicts to stay within the memory budget.
+      void update();
+
+      void setMemoryBudget(size_t bytes) { m_memoryBudget = bytes; }
+      size_t getMemoryBudget() const { return m_memoryBudget; }
+      size_t getMemoryUsage() const { return m_memoryUsage; }
+
+    private:
+      struct resourceSlot
+      {
+        std::type_index type = typeid(void);
+        std::string path;
+        std::unique_ptr<resource> data;
+        e_resourceState state = e_resourceState::unloaded;
+        e_resourcePriority priority = e_resourcePriority::normal;
+        uint32_t generation = 0;
+        uint32_t refCount = 0;
+        uint64_t lastUsedFrame = 0;
+        size_t memorySize = 0;
+        std::vector<resourceCallback> callbacks;
+
+        //Shared with queued requests so a re-prioritized load only runs once.
+        std::shared_ptr<std::atomic<bool>> isClaimed;
+      };
+
+      struct loadRequest
+      {
+        uint32_t index;
+        uint32_t generation;
+        e_resourcePriority priority;
+        uint64_t sequence;
+        std::filesystem::path path;
+        resourceLoaderFunc loader;
+        std::shared_ptr<std::atomic<bool>> isClaimed;
+      };
+
+      //Highest priority first, then first come first served.
+      struct loadRequestOrder
+      {
+        bool operator()(const loadRequest& a, const loadRequest& b) const
+        {
+          if (a.priority != b.priority)
+          {
+            return a.priority < b.priority;
+          }
+
+          return a.sequence > b.sequence;
+        }
+      };
+
+      struct loadResult
+      {
+        uint32_t index;
+        uint32_t generation;
+        std::unique_ptr<resource> data;
+      };
+
+      uint32_t acquireSlot(std::type_index type, const std::filesystem::path& path, e_resourcePriority priority, resourceCallback onComplete);
+      void queueLoad(uint32_t index);
+      void addRef(uint32_t index, uint32_t generation);
+      void release(uint32_t index, uint32_t generation);
+      resourceSlot* getSlot(uint32_t index, uint32_t generation);
+      resource* getResource(uint32_t index, uint32_t generation);
+      e_resourceState getState(uint32_t index, uint32_t generation);
+
+      bool waitForSlot(uint32_t index, uint32_t generation);
+      void processResults();
+      void trimToBudget();
+      void freeSlot(uint32_t index);
+
+      void ioThreadLoop();
+
+      std::vector<resourceSlot> m_slots;
+      std::vector<uint32_t> m_freeSlots;
+      std::map<std::pair<std::type_index, std::string>, uint32_t> m_slotLookup;
+      std::unordered_map<std::type_index, resourceLoaderFunc> m_loaders;
+      std::filesystem::path m_rootPath;
+      std::vector<std::unique_ptr<assetArchive>> m_archives;
+
+      uint64_t m_frameIndex = 0;
+      uint64_t m_requestSequence = 0;
+      size_t m_memoryUsage = 0;
+      size_t m_memoryBudget;
+
+      std::vector<std::thread> m_ioThreads;
+      std::priority_queue<loadRequest, std::vector<loadRequest>, loadRequestOrder> m_requests;
+      std::mutex m_requestMutex;
+      std::condition_variable m_requestCondition;
+      bool m_isStopping = false;
+
+      std::vector<loadResult> m_results;
+      std::mutex m_resultMutex;
+      std::condition_variable m_resultCondition;
+  };
+
+  ///
+  /// resourceHandle
+  ///
+
+  template <typename T>
+  resourceHandle<T>::resourceHandle(const resourceHandle& other)
+    : m_manager(other.m_manager), m_index(other.m_index), m_generation(other.m_generation)
+  {
+    if (m_manager)
+    {
+      m_manager->addRef(m_index, m_generation);
+    }
+  }
+
+  template <typename T>
+  resourceHandle<T>::resourceHandle(resourceHandle&& other) noexcept
+    : m_manager(other.m_manager), m_index(other.m_index), m_generation(other.m_generation)
+  {
+    other.m_manager = nullptr;
+  }
+
+  template <typename T>
+  resourceHandle<T>& resourceHandle<T>::operator=(resourceHandle other) noexcept
+  {
+    std::swap(m_manager, other.m_manager);
+    std::swap(m_index, other.m_index);
+    std::swap(m_generation, other.m_generation);
+    return *this;
+  }
+
+  template <typename T>
+  resourceHandle<T>::~resourceHandle()
+  {
+    reset();
+  }
+
+  template <typename T>
+  void resourceHandle<T>::reset()
+  {
+    if (m_manager)
+    {
+      m_manager->release(m_index, m_generation);
+      m_manager = nullptr;
+    }
+  }
+
+  template <typename T>
+  e_resourceState resourceHandle<T>::getState() const
+  {
+    return m_manager ? m_manager->getState(m_index, m_generation) : e_resourceState::unloaded;
+  }
+
+  template <typename T>
+  const T* resourceHandle<T>::get() const
+  {
+    return m_manager ? static_cast<const T*>(m_manager->getResource(m_index, m_generation)) : nullptr;
+  }
+}
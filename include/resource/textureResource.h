@@ -0,0 +1,50 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <memory>
+#include <filesystem>
+
+#include "resource.h"
+
+namespace malachite
+{
+  struct textureMip
+  {
+    uint32_t width;
+    uint32_t height;
+
+    //Into textureResource::pixels.
+    size_t offset;
+    size_t size;
+  };
+
+  //Decoded RGBA8 image with its full mip chain, built on the I/O thread that loaded it.
+  class textureResource : public resource
+  {
+    public:
+      //mips[0] is the full image, the last one is 1x1. Every mip is stored back to back.
+      std::vector<textureMip> mips;
+      std::vector<uint8_t> pixels;
+
+      uint32_t getWidth() const { return mips.empty() ? 0 : mips[0].width; }
+      uint32_t getHeight() const { return mips.empty() ? 0 : mips[0].height; }
+      uint32_t getMipCount() const { return (uint32_t) mips.size(); }
+
+      const uint8_t* getMipData(uint32_t mip) const
+      {
+        return pixels.data() + mips[mip].offset;
+      }
+
+      size_t getMemorySize() const override
+      {
+        return pixels.size();
+      }
+
+      //Takes width * height RGBA8 pixels and box filters every smaller mip from the one above.
+      static std::unique_ptr<textureResource> create(uint32_t width, uint32_t height, const uint8_t* rgbaPixels);
+
+      //Binary PGM (P5) and PPM (P6) with 8 bit channels. Returns nullptr when the file can't be decoded.
+      static std::unique_ptr<textureResource> load(const std::filesystem::path& path);
+  };
+}
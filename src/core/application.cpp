@@ -8,6 +8,7 @@ namespace malachite
     application* application::s_instance = nullptr;
 
     application::application(const std::string& name, appArgs appArgs)
+        : m_args(appArgs)
     {
         s_instance = this;
 
@@ -47,6 +48,15 @@ namespace malachite
     {
         start();
         update();
+
+        //With --trace <path> what the profiler kept is written out once the loop ends.
+        if (const char* tracePath = getArgValue("--trace"))
+        {
+            if (m_profiler.writeTrace(tracePath))
+            {
+                MAL_LOG_TRACE("Wrote profiler trace to ", tracePath);
+            }
+        }
     }
     
     void application::update()
@@ -58,6 +68,11 @@ namespace malachite
         {        
             m_time.updateStartFrameTime = std::chrono::steady_clock::now();
 
+            MAL_PROFILE_SCOPE("frame");
+
+            //Finished loads and their callbacks land before any layer runs.
+            m_resourceManager.update();
+
             for (auto layer : m_layers)
             {
                 double deltaTime = m_time.getFrameDeltaTime();
@@ -65,6 +80,9 @@ namespace malachite
                 layer->update(deltaTime);
             }
 
+            //Structural changes made by layers this frame are handed out in one batch per component type.
+            m_componentObservers.flush();
+
             m_time.updateLastFrameTime = std::chrono::steady_clock::now();
         }
     }
@@ -88,4 +106,34 @@ namespace malachite
     {
         m_layers.push_back(layer);
     }
+
+    bool application::hasArg(std::string_view flag)
+    {
+        const appArgs& args = s_instance->m_args;
+
+        for (int i = 1; i < args.argCount; i++)
+        {
+            if (flag == args.args[i])
+            {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    const char* application::getArgValue(std::string_view flag)
+    {
+        const appArgs& args = s_instance->m_args;
+
+        for (int i = 1; i + 1 < args.argCount; i++)
+        {
+            if (flag == args.args[i] && std::string_view(args.args[i + 1]).rfind("--", 0) != 0)
+            {
+                return args.args[i + 1];
+            }
+        }
+
+        return nullptr;
+    }
 }
\ No newline at end of file
@@ -0,0 +1,256 @@
+#include "malpch.h"
+#include "fileWatcher.h"
+
+#include <cerrno>
+#include <climits>
+
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+
+namespace malachite
+{
+    //Editors either rewrite in place (close after write) or write a temporary and rename it over.
+    static const uint32_t c_watchMask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_ONLYDIR;
+
+    fileWatcher::~fileWatcher()
+    {
+        stop();
+    }
+
+    bool fileWatcher::start()
+    {
+        if (isWatching())
+        {
+            return true;
+        }
+
+        m_inotifyDescriptor = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (m_inotifyDescriptor < 0)
+        {
+            MAL_LOG_ERROR("failed to initalize inotify, errno ", std::to_string(errno));
+            return false;
+        }
+
+        //Wakes the watch thread out of poll when stopping.
+        m_wakeDescriptor = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (m_wakeDescriptor < 0)
+        {
+            ::close(m_inotifyDescriptor);
+            m_inotifyDescriptor = -1;
+            return false;
+        }
+
+        m_watchThread = std::thread(&fileWatcher::watchLoop, this);
+        return true;
+    }
+
+    void fileWatcher::stop()
+    {
+        if (!isWatching())
+        {
+            return;
+        }
+
+        uint64_t wake = 1;
+        if (write(m_wakeDescriptor, &wake, sizeof(wake)) < 0)
+        {
+            MAL_LOG_ERROR("failed to wake the file watcher!");
+        }
+
+        m_watchThread.join();
+
+        ::close(m_wakeDescriptor);
+        ::close(m_inotifyDescriptor);
+        m_wakeDescriptor = -1;
+        m_inotifyDescriptor = -1;
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_watches.clear();
+        m_changedFiles.clear();
+        m_errors.clear();
+    }
+
+    bool fileWatcher::watchDirectory(const std::filesystem::path& directory, bool isRecursive)
+    {
+        std::error_code error;
+        std::filesystem::path absoluteDirectory = std::filesystem::weakly_canonical(directory, error);
+
+        if (error || !std::filesystem::is_directory(absoluteDirectory, error))
+        {
+            MAL_LOG_ERROR("Can't watch ", directory, ", not a directory.");
+            return false;
+        }
+
+        if (!start())
+        {
+            return false;
+        }
+
+        bool isAdded = addWatch(absoluteDirectory, isRecursive);
+        logErrors();
+
+        return isAdded;
+    }
+
+    bool fileWatcher::addWatch(const std::filesystem::path& directory, bool isRecursive)
+    {
+        //inotify hands back the existing descriptor when a directory is already watched.
+        int watchDescriptor = inotify_add_watch(m_inotifyDescriptor, directory.c_str(), c_watchMask);
+        if (watchDescriptor < 0)
+        {
+            //Also called from the watch thread for new subdirectories.
+            queueError("failed to watch " + directory.string() + ", errno " + std::to_string(errno));
+            return false;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+
+            watchedDirectory& watched = m_watches[watchDescriptor];
+            watched.path = directory;
+            watched.isRecursive = watched.isRecursive || isRecursive;
+        }
+
+        if (isRecursive)
+        {
+            std::error_code error;
+            for (const auto& entry : std::filesystem::directory_iterator(directory, error))
+            {
+                if (entry.is_directory(error) && !entry.is_symlink(error))
+                {
+                    addWatch(entry.path(), true);
+                }
+            }
+        }
+
+        return true;
+    }
+
+    std::vector<std::filesystem::path> fileWatcher::pollChanges()
+    {
+        logErrors();
+
+        std::vector<std::filesystem::path> changes;
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        changes.reserve(m_changedFiles.size());
+        for (const std::string& changedFile : m_changedFiles)
+        {
+            changes.emplace_back(changedFile);
+        }
+
+        m_changedFiles.clear();
+
+        return changes;
+    }
+
+    void fileWatcher::queueError(std::string message)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_errors.push_back(std::move(message));
+    }
+
+    void fileWatcher::logErrors()
+    {
+        std::vector<std::string> errors;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            errors.swap(m_errors);
+        }
+
+        for (const std::string& error : errors)
+        {
+            MAL_LOG_ERROR(error);
+        }
+    }
+
+    void fileWatcher::watchLoop()
+    {
+        //Large enough for a burst of events with long names, inotify never splits one.
+        alignas(inotify_event) char buffer[16 * (sizeof(inotify_event) + NAME_MAX + 1)];
+
+        pollfd descriptors[2];
+        descriptors[0].fd = m_inotifyDescriptor;
+        descriptors[0].events = POLLIN;
+        descriptors[1].fd = m_wakeDescriptor;
+        descriptors[1].events = POLLIN;
+
+        while (true)
+        {
+            if (poll(descriptors, 2, -1) < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+
+                queueError("File watcher poll failed, errno " + std::to_string(errno));
+                return;
+            }
+
+            if (descriptors[1].revents & POLLIN)
+            {
+                return;
+            }
+
+            ssize_t length;
+            while ((length = read(m_inotifyDescriptor, buffer, sizeof(buffer))) > 0)
+            {
+                for (char* position = buffer; position < buffer + length;)
+                {
+                    const inotify_event* event = reinterpret_cast<const inotify_event*>(position);
+                    position += sizeof(inotify_event) + event->len;
+
+                    std::filesystem::path directory;
+                    bool isRecursive = false;
+                    {
+                        std::lock_guard<std::mutex> lock(m_mutex);
+
+                        auto watch = m_watches.find(event->wd);
+                        if (watch == m_watches.end())
+                        {
+                            continue;
+                        }
+
+                        //The directory itself went away
+                        if (event->mask & IN_IGNORED)
+                        {
+                            m_watches.erase(watch);
+                            continue;
+                        }
+
+                        directory = watch->second.path;
+                        isRecursive = watch->second.isRecursive;
+                    }
+
+                    if (event->len == 0)
+                    {
+                        continue;
+                    }
+
+                    std::filesystem::path changedPath = directory / event->name;
+
+                    if (event->mask & IN_ISDIR)
+                    {
+                        if (isRecursive && (event->mask & (IN_CREATE | IN_MOVED_TO)))
+                        {
+                            addWatch(changedPath, true);
+                        }
+
+                        continue;
+                    }
+
+                    //A created file is reported again once it's closed.
+                    if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO))
+                    {
+                        std::lock_guard<std::mutex> lock(m_mutex);
+                        m_changedFiles.insert(changedPath.string());
+                    }
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,92 @@
+#include "malpch.h"
+#include "mappedFile.h"
+
+#include <utility>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace malachite
+{
+    mappedFile::~mappedFile()
+    {
+        close();
+    }
+
+    mappedFile::mappedFile(mappedFile&& other) noexcept
+        : m_data(other.m_data), m_size(other.m_size), m_isOpen(other.m_isOpen)
+    {
+        other.m_data = nullptr;
+        other.m_size = 0;
+        other.m_isOpen = false;
+    }
+
+    mappedFile& mappedFile::operator=(mappedFile&& other) noexcept
+    {
+        if (this != &other)
+        {
+            close();
+
+            std::swap(m_data, other.m_data);
+            std::swap(m_size, other.m_size);
+            std::swap(m_isOpen, other.m_isOpen);
+        }
+
+        return *this;
+    }
+
+    bool mappedFile::open(const std::filesystem::path& path)
+    {
+        close();
+
+        int fileDescriptor = ::open(path.c_str(), O_RDONLY);
+        if (fileDescriptor < 0)
+        {
+            return false;
+        }
+
+        struct stat fileStats;
+        if (fstat(fileDescriptor, &fileStats) != 0 || !S_ISREG(fileStats.st_mode))
+        {
+            ::close(fileDescriptor);
+            return false;
+        }
+
+        size_t size = (size_t) fileStats.st_size;
+        void* mapping = nullptr;
+
+        //mmap refuses zero length mappings
+        if (size > 0)
+        {
+            mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+        }
+
+        //The mapping keeps its own reference to the file.
+        ::close(fileDescriptor);
+
+        if (mapping == MAP_FAILED)
+        {
+            return false;
+        }
+
+        m_data = static_cast<const char*>(mapping);
+        m_size = size;
+        m_isOpen = true;
+
+        return true;
+    }
+
+    void mappedFile::close()
+    {
+        if (m_data)
+        {
+            munmap(const_cast<char*>(m_data), m_size);
+        }
+
+        m_data = nullptr;
+        m_size = 0;
+        m_isOpen = false;
+    }
+}
@@ -0,0 +1,213 @@
+#include "malpch.h"
+#include "profiler.h"
+#include "application.h"
+
+#include <fstream>
+
+static constexpr double c_averageWeight = 0.1;
+
+static void writeJsonString(std::ofstream& file, const std::string& text)
+{
+    file << '"';
+    for (char character : text)
+    {
+        if (character == '"' || character == '\\')
+        {
+            file << '\\' << character;
+        }
+        else if ((unsigned char) character >= 0x20)
+        {
+            file << character;
+        }
+    }
+
+    file << '"';
+}
+
+namespace malachite
+{
+    profiler::profiler(size_t maxEvents)
+        : m_epoch(clock::now()), m_maxEvents(maxEvents > 0 ? maxEvents : 1)
+    {
+    }
+
+    profileTrack profiler::getThreadTrack()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        std::thread::id threadId = std::this_thread::get_id();
+        auto track = m_threadTracks.find(threadId);
+        if (track != m_threadTracks.end())
+        {
+            return track->second;
+        }
+
+        profileTrack newTrack = (profileTrack) m_trackNames.size();
+        m_trackNames.push_back("Thread " + std::to_string(m_threadTracks.size()));
+        m_threadTracks.emplace(threadId, newTrack);
+        return newTrack;
+    }
+
+    profileTrack profiler::addTrack(const std::string& name)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        m_trackNames.push_back(name);
+        return (profileTrack) (m_trackNames.size() - 1);
+    }
+
+    uint32_t profiler::internName(const std::string& name)
+    {
+        auto nameId = m_nameIds.find(name);
+        if (nameId != m_nameIds.end())
+        {
+            return nameId->second;
+        }
+
+        m_names.push_back(name);
+        m_nameIds.emplace(name, (uint32_t) (m_names.size() - 1));
+        return (uint32_t) (m_names.size() - 1);
+    }
+
+    void profiler::addEvent(profileTrack track, const std::string& name, clock::time_point begin, clock::time_point end)
+    {
+        double milliseconds = std::chrono::duration<double, std::milli>(end - begin).count();
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        event newEvent{track, internName(name), begin, end};
+        if (m_events.size() < m_maxEvents)
+        {
+            m_events.push_back(newEvent);
+        }
+        else
+        {
+            m_events[m_nextEvent] = newEvent;
+        }
+
+        m_nextEvent = (m_nextEvent + 1) % m_maxEvents;
+
+        timing& scopeTiming = m_timings[{track, newEvent.name}];
+        scopeTiming.lastMilliseconds = milliseconds;
+        scopeTiming.averageMilliseconds = scopeTiming.count == 0 ? milliseconds : scopeTiming.averageMilliseconds + (milliseconds - scopeTiming.averageMilliseconds) * c_averageWeight;
+        scopeTiming.count++;
+    }
+
+    std::vector<profileTiming> profiler::getTimings() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        std::vector<profileTiming> timings;
+        timings.reserve(m_timings.size());
+
+        for (const auto& [key, scopeTiming] : m_timings)
+        {
+            profileTiming timing;
+            timing.track = m_trackNames[key.first];
+            timing.name = m_names[key.second];
+            timing.lastMilliseconds = scopeTiming.lastMilliseconds;
+            timing.averageMilliseconds = scopeTiming.averageMilliseconds;
+            timing.count = scopeTiming.count;
+
+            timings.push_back(std::move(timing));
+        }
+
+        return timings;
+    }
+
+    bool profiler::getTiming(const std::string& track, const std::string& name, profileTiming& timing) const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        auto nameId = m_nameIds.find(name);
+        if (nameId == m_nameIds.end())
+        {
+            return false;
+        }
+
+        for (profileTrack i = 0; i < m_trackNames.size(); i++)
+        {
+            if (m_trackNames[i] != track)
+            {
+                continue;
+            }
+
+            auto scopeTiming = m_timings.find({i, nameId->second});
+            if (scopeTiming == m_timings.end())
+            {
+                continue;
+            }
+
+            timing.track = track;
+            timing.name = name;
+            timing.lastMilliseconds = scopeTiming->second.lastMilliseconds;
+            timing.averageMilliseconds = scopeTiming->second.averageMilliseconds;
+            timing.count = scopeTiming->second.count;
+            return true;
+        }
+
+        return false;
+    }
+
+    bool profiler::writeTrace(const std::filesystem::path& path) const
+    {
+        std::ofstream file(path, std::ios::trunc);
+        if (!file)
+        {
+            MAL_LOG_ERROR("Failed to open trace file ", path.string());
+            return false;
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+
+        //Track names first, the viewer labels rows with them.
+        bool isFirst = true;
+        for (profileTrack track = 0; track < m_trackNames.size(); track++)
+        {
+            file << (isFirst ? "" : ",\n") << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":" << track << ",\"args\":{\"name\":";
+            writeJsonString(file, m_trackNames[track]);
+            file << "}}";
+
+            file << ",\n{\"ph\":\"M\",\"name\":\"thread_sort_index\",\"pid\":1,\"tid\":" << track << ",\"args\":{\"sort_index\":" << track << "}}";
+            isFirst = false;
+        }
+
+        //Oldest first once the ring has wrapped.
+        size_t firstEvent = m_events.size() < m_maxEvents ? 0 : m_nextEvent;
+        for (size_t i = 0; i < m_events.size(); i++)
+        {
+            const event& traceEvent = m_events[(firstEvent + i) % m_events.size()];
+
+            double beginMicroseconds = std::chrono::duration<double, std::micro>(traceEvent.begin - m_epoch).count();
+            double durationMicroseconds = std::chrono::duration<double, std::micro>(traceEvent.end - traceEvent.begin).count();
+
+            file << (isFirst ? "" : ",\n") << "{\"ph\":\"X\",\"pid\":1,\"tid\":" << traceEvent.track << ",\"name\":";
+            writeJsonString(file, m_names[traceEvent.name]);
+            file << ",\"ts\":" << std::fixed << beginMicroseconds << ",\"dur\":" << durationMicroseconds << "}";
+            isFirst = false;
+        }
+
+        file << "\n]}\n";
+
+        if (!file)
+        {
+            MAL_LOG_ERROR("Failed to write trace file ", path.string());
+            return false;
+        }
+
+        return true;
+    }
+
+    profileScope::profileScope(const char* name)
+        : m_name(name), m_begin(profiler::clock::now())
+    {
+    }
+
+    profileScope::~profileScope()
+    {
+        profiler& appProfiler = application::getProfiler();
+        appProfiler.addEvent(appProfiler.getThreadTrack(), m_name, m_begin, profiler::clock::now());
+    }
+}
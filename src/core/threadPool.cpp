@@ -0,0 +1,143 @@
+#include "malpch.h"
+#include "threadPool.h"
+
+#include <atomic>
+#include <algorithm>
+
+namespace malachite
+{
+    threadPool::threadPool(uint32_t threadCount)
+    {
+        if (threadCount == 0)
+        {
+            uint32_t hardwareThreads = std::thread::hardware_concurrency();
+            threadCount = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+        }
+
+        m_workers.reserve(threadCount);
+        for (uint32_t i = 0; i < threadCount; i++)
+        {
+            m_workers.emplace_back(&threadPool::workerLoop, this);
+        }
+    }
+
+    threadPool::~threadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_jobMutex);
+            m_isStopping = true;
+        }
+
+        m_jobCondition.notify_all();
+
+        for (auto& worker : m_workers)
+        {
+            worker.join();
+        }
+    }
+
+    void threadPool::submit(std::function<void()> job)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_jobMutex);
+            m_jobs.push_back(std::move(job));
+        }
+
+        m_jobCondition.notify_one();
+    }
+
+    void threadPool::workerLoop()
+    {
+        while (true)
+        {
+            std::function<void()> job;
+
+            {
+                std::unique_lock<std::mutex> lock(m_jobMutex);
+                m_jobCondition.wait(lock, [this]() { return m_isStopping || !m_jobs.empty(); });
+
+                //Drain what is queued before stopping so no future is left hanging
+                if (m_jobs.empty())
+                {
+                    return;
+                }
+
+                job = std::move(m_jobs.front());
+                m_jobs.pop_front();
+            }
+
+            job();
+        }
+    }
+
+    void threadPool::parallelFor(size_t count, size_t grainSize, const std::function<void(size_t begin, size_t end)>& func)
+    {
+        if (count == 0)
+        {
+            return;
+        }
+
+        grainSize = std::max<size_t>(grainSize, 1);
+        size_t chunkCount = (count + grainSize - 1) / grainSize;
+
+        if (chunkCount == 1)
+        {
+            func(0, count);
+            return;
+        }
+
+        //Helpers can start after the caller already finished every chunk, so the shared state
+        //outlives this call and func is only touched while a chunk is claimed.
+        struct parallelForState
+        {
+            std::atomic<size_t> nextChunk{0};
+            std::atomic<size_t> remainingChunks{0};
+            std::mutex doneMutex;
+            std::condition_variable doneCondition;
+            const std::function<void(size_t, size_t)>* func = nullptr;
+            size_t count = 0;
+            size_t grainSize = 0;
+            size_t chunkCount = 0;
+        };
+
+        auto state = std::make_shared<parallelForState>();
+        state->remainingChunks = chunkCount;
+        state->func = &func;
+        state->count = count;
+        state->grainSize = grainSize;
+        state->chunkCount = chunkCount;
+
+        auto runChunks = [](parallelForState& state)
+        {
+            while (true)
+            {
+                size_t chunk = state.nextChunk.fetch_add(1);
+                if (chunk >= state.chunkCount)
+                {
+                    return;
+                }
+
+                size_t begin = chunk * state.grainSize;
+                size_t end = std::min(begin + state.grainSize, state.count);
+                (*state.func)(begin, end);
+
+                if (state.remainingChunks.fetch_sub(1) == 1)
+                {
+                    std::lock_guard<std::mutex> lock(state.doneMutex);
+                    state.doneCondition.notify_all();
+                }
+            }
+        };
+
+        size_t helperCount = std::min<size_t>(m_workers.size(), chunkCount - 1);
+        for (size_t i = 0; i < helperCount; i++)
+        {
+            submit([state, runChunks]() { runChunks(*state); });
+        }
+
+        runChunks(*state);
+
+        std::unique_lock<std::mutex> lock(state->doneMutex);
+        state->doneCondition.wait(lock, [&state]() { return state->remainingChunks.load() == 0; });
+    }
+}
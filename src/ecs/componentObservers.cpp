@@ -0,0 +1,224 @@
+#include "malpch.h"
+#include "componentObservers.h"
+
+#include <algorithm>
+
+namespace malachite
+{
+    componentTypeID componentTypes::s_nextComponentTypeID = 0;
+
+    componentObservers::componentEventList& componentObservers::getEventList(componentTypeID componentType)
+    {
+        if (componentType >= m_eventLists.size())
+        {
+            m_eventLists.resize(componentType + 1);
+        }
+
+        return m_eventLists[componentType];
+    }
+
+    componentObserverID componentObservers::observe(componentTypeID componentType, componentObserverFunc func)
+    {
+        componentObserverID observerID = m_nextObserverID++;
+
+        //The observers of a type are being walked, adding to them could move the one being called.
+        componentEventList& eventList = getEventList(componentType);
+        if (m_isFlushing)
+        {
+            eventList.pendingObservers.push_back({observerID, std::move(func)});
+        }
+        else
+        {
+            eventList.observers.push_back({observerID, std::move(func)});
+        }
+
+        eventList.observerCount++;
+        return observerID;
+    }
+
+    void componentObservers::removeObserver(componentObserverID observerID)
+    {
+        for (auto& eventList : m_eventLists)
+        {
+            bool isRemoved = false;
+
+            for (auto i = eventList.observers.begin(); i != eventList.observers.end(); i++)
+            {
+                if (i->id != observerID)
+                {
+                    continue;
+                }
+
+                //The flush compacts them once it is done, the observer may be removing itself.
+                if (m_isFlushing)
+                {
+                    i->id = 0;
+                }
+                else
+                {
+                    eventList.observers.erase(i);
+                }
+
+                isRemoved = true;
+                break;
+            }
+
+            for (auto i = eventList.pendingObservers.begin(); !isRemoved && i != eventList.pendingObservers.end(); i++)
+            {
+                if (i->id == observerID)
+                {
+                    eventList.pendingObservers.erase(i);
+                    isRemoved = true;
+                    break;
+                }
+            }
+
+            if (!isRemoved)
+            {
+                continue;
+            }
+
+            //Nobody is left to consume the pending events
+            if (--eventList.observerCount == 0)
+            {
+                eventList.events.clear();
+                eventList.hasAdded = false;
+                eventList.hasRemoved = false;
+            }
+            return;
+        }
+    }
+
+    void componentObservers::record(componentTypeID componentType, entityID entity, bool isAdded)
+    {
+        //Types nobody observes are not buffered at all
+        if (componentType >= m_eventLists.size() || m_eventLists[componentType].observerCount == 0)
+        {
+            return;
+        }
+
+        componentEventList& eventList = m_eventLists[componentType];
+        eventList.events.push_back({entity, isAdded});
+        eventList.hasAdded |= isAdded;
+        eventList.hasRemoved |= !isAdded;
+    }
+
+    void componentObservers::notifyAdded(componentTypeID componentType, entityID entity)
+    {
+        record(componentType, entity, true);
+    }
+
+    void componentObservers::notifyRemoved(componentTypeID componentType, entityID entity)
+    {
+        record(componentType, entity, false);
+    }
+
+    void componentObservers::buildBatch(componentEventList& eventList)
+    {
+        //Both dispatch lists are empty here, swapping keeps the capacity of each side.
+        m_dispatchEvents.swap(eventList.events);
+        bool hasAdded = eventList.hasAdded;
+        bool hasRemoved = eventList.hasRemoved;
+        eventList.hasAdded = false;
+        eventList.hasRemoved = false;
+
+        //Only adds or only removes, nothing can cancel out.
+        if (!hasAdded || !hasRemoved)
+        {
+            std::vector<entityID>& dispatch = hasAdded ? m_dispatchAdded : m_dispatchRemoved;
+            for (const componentEvent& event : m_dispatchEvents)
+            {
+                dispatch.push_back(event.entity);
+            }
+
+            m_dispatchEvents.clear();
+            return;
+        }
+
+        //Groups the events of each entity keeping their order, the first says whether it had the
+        //component before the frame and the last whether it has it now.
+        std::stable_sort(m_dispatchEvents.begin(), m_dispatchEvents.end(), [](const componentEvent& a, const componentEvent& b)
+        {
+            return a.entity < b.entity;
+        });
+
+        for (size_t first = 0; first < m_dispatchEvents.size();)
+        {
+            size_t last = first;
+            while (last + 1 < m_dispatchEvents.size() && m_dispatchEvents[last + 1].entity == m_dispatchEvents[first].entity)
+            {
+                last++;
+            }
+
+            if (!m_dispatchEvents[first].isAdded)
+            {
+                m_dispatchRemoved.push_back(m_dispatchEvents[first].entity);
+            }
+
+            if (m_dispatchEvents[last].isAdded)
+            {
+                m_dispatchAdded.push_back(m_dispatchEvents[last].entity);
+            }
+
+            first = last + 1;
+        }
+
+        m_dispatchEvents.clear();
+    }
+
+    void componentObservers::flush()
+    {
+        m_isFlushing = true;
+
+        //Observers may observe new types while being called, which grows m_eventLists.
+        for (componentTypeID componentType = 0; componentType < m_eventLists.size(); componentType++)
+        {
+            if (m_eventLists[componentType].events.empty())
+            {
+                continue;
+            }
+
+            buildBatch(m_eventLists[componentType]);
+
+            if (!m_dispatchAdded.empty() || !m_dispatchRemoved.empty())
+            {
+                componentEventBatch batch{};
+                batch.componentType = componentType;
+                batch.addedEntities = m_dispatchAdded.data();
+                batch.addedCount = m_dispatchAdded.size();
+                batch.removedEntities = m_dispatchRemoved.data();
+                batch.removedCount = m_dispatchRemoved.size();
+
+                //Indexed again every call, the list itself may have moved.
+                for (size_t i = 0; i < m_eventLists[componentType].observers.size(); i++)
+                {
+                    const observer& observer = m_eventLists[componentType].observers[i];
+                    if (observer.id != 0)
+                    {
+                        observer.func(batch);
+                    }
+                }
+            }
+
+            m_dispatchAdded.clear();
+            m_dispatchRemoved.clear();
+        }
+
+        m_isFlushing = false;
+
+        for (componentEventList& eventList : m_eventLists)
+        {
+            eventList.observers.erase(std::remove_if(eventList.observers.begin(), eventList.observers.end(), [](const observer& observer)
+            {
+                return observer.id == 0;
+            }), eventList.observers.end());
+
+            for (observer& pendingObserver : eventList.pendingObservers)
+            {
+                eventList.observers.push_back(std::move(pendingObserver));
+            }
+
+            eventList.pendingObservers.clear();
+        }
+    }
+}
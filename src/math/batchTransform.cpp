@@ -0,0 +1,402 @@
+#include "malpch.h"
+#include "batchTransform.h"
+#include "threadPool.h"
+
+namespace malachite
+{
+    namespace math
+    {
+        //Entities per job, a multiple of the 8 wide AVX2 and 4 wide SSE steps.
+        static const size_t s_batchGrainSize = 4096;
+
+        ///
+        /// Scalar kernels, used for the tail of every batch and on scalar builds.
+        ///
+
+        static void transformPointsScalar
+        (
+            const mat4& m,
+            const float* xs, const float* ys, const float* zs,
+            size_t begin, size_t end,
+            float* outXs, float* outYs, float* outZs
+        )
+        {
+            for (size_t i = begin; i < end; i++)
+            {
+                const float x = xs[i];
+                const float y = ys[i];
+                const float z = zs[i];
+
+                outXs[i] = ((m[0].x * x + m[1].x * y) + m[2].x * z) + m[3].x;
+                outYs[i] = ((m[0].y * x + m[1].y * y) + m[2].y * z) + m[3].y;
+                outZs[i] = ((m[0].z * x + m[1].z * y) + m[2].z * z) + m[3].z;
+            }
+        }
+
+        static void composeModelMatricesScalar
+        (
+            const float* px, const float* py, const float* pz,
+            const float* qx, const float* qy, const float* qz, const float* qw,
+            const float* sx, const float* sy, const float* sz,
+            size_t begin, size_t end,
+            mat4* out
+        )
+        {
+            for (size_t i = begin; i < end; i++)
+            {
+                const float xx = qx[i] * qx[i];
+                const float yy = qy[i] * qy[i];
+                const float zz = qz[i] * qz[i];
+                const float xy = qx[i] * qy[i];
+                const float xz = qx[i] * qz[i];
+                const float yz = qy[i] * qz[i];
+                const float wx = qw[i] * qx[i];
+                const float wy = qw[i] * qy[i];
+                const float wz = qw[i] * qz[i];
+
+                out[i] = mat4
+                (
+                    {(1.0f - 2.0f * (yy + zz)) * sx[i], (2.0f * (xy + wz)) * sx[i], (2.0f * (xz - wy)) * sx[i], 0.0f},
+                    {(2.0f * (xy - wz)) * sy[i], (1.0f - 2.0f * (xx + zz)) * sy[i], (2.0f * (yz + wx)) * sy[i], 0.0f},
+                    {(2.0f * (xz + wy)) * sz[i], (2.0f * (yz - wx)) * sz[i], (1.0f - 2.0f * (xx + yy)) * sz[i], 0.0f},
+                    {px[i], py[i], pz[i], 1.0f}
+                );
+            }
+        }
+
+        static void normalizeQuaternionsScalar(float* xs, float* ys, float* zs, float* ws, size_t begin, size_t end)
+        {
+            for (size_t i = begin; i < end; i++)
+            {
+                const float lengthSquared = (xs[i] * xs[i] + ys[i] * ys[i]) + (zs[i] * zs[i] + ws[i] * ws[i]);
+                const float oneOverLength = 1.0f / std::sqrt(lengthSquared);
+
+                xs[i] *= oneOverLength;
+                ys[i] *= oneOverLength;
+                zs[i] *= oneOverLength;
+                ws[i] *= oneOverLength;
+            }
+        }
+
+        ///
+        /// AVX2 kernels take 8 entities per step, SSE4.1 ones 4, both in the operation order of the
+        /// scalar ones. Whatever is left past the last full step goes through the scalar kernel.
+        ///
+
+        static void transformPointsRange
+        (
+            const mat4& m,
+            const float* xs, const float* ys, const float* zs,
+            size_t begin, size_t end,
+            float* outXs, float* outYs, float* outZs
+        )
+        {
+            size_t i = begin;
+
+#if MAL_MATH_AVX2
+            const __m256 m00 = _mm256_set1_ps(m[0].x), m01 = _mm256_set1_ps(m[0].y), m02 = _mm256_set1_ps(m[0].z);
+            const __m256 m10 = _mm256_set1_ps(m[1].x), m11 = _mm256_set1_ps(m[1].y), m12 = _mm256_set1_ps(m[1].z);
+            const __m256 m20 = _mm256_set1_ps(m[2].x), m21 = _mm256_set1_ps(m[2].y), m22 = _mm256_set1_ps(m[2].z);
+            const __m256 m30 = _mm256_set1_ps(m[3].x), m31 = _mm256_set1_ps(m[3].y), m32 = _mm256_set1_ps(m[3].z);
+
+            for (; i + 8 <= end; i += 8)
+            {
+                const __m256 x = _mm256_loadu_ps(xs + i);
+                const __m256 y = _mm256_loadu_ps(ys + i);
+                const __m256 z = _mm256_loadu_ps(zs + i);
+
+                __m256 rx = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m00, x), _mm256_mul_ps(m10, y)), _mm256_mul_ps(m20, z)), m30);
+                __m256 ry = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m01, x), _mm256_mul_ps(m11, y)), _mm256_mul_ps(m21, z)), m31);
+                __m256 rz = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m02, x), _mm256_mul_ps(m12, y)), _mm256_mul_ps(m22, z)), m32);
+
+                _mm256_storeu_ps(outXs + i, rx);
+                _mm256_storeu_ps(outYs + i, ry);
+                _mm256_storeu_ps(outZs + i, rz);
+            }
+#elif MAL_MATH_SIMD
+            const __m128 m00 = _mm_set1_ps(m[0].x), m01 = _mm_set1_ps(m[0].y), m02 = _mm_set1_ps(m[0].z);
+            const __m128 m10 = _mm_set1_ps(m[1].x), m11 = _mm_set1_ps(m[1].y), m12 = _mm_set1_ps(m[1].z);
+            const __m128 m20 = _mm_set1_ps(m[2].x), m21 = _mm_set1_ps(m[2].y), m22 = _mm_set1_ps(m[2].z);
+            const __m128 m30 = _mm_set1_ps(m[3].x), m31 = _mm_set1_ps(m[3].y), m32 = _mm_set1_ps(m[3].z);
+
+            for (; i + 4 <= end; i += 4)
+            {
+                const __m128 x = _mm_loadu_ps(xs + i);
+                const __m128 y = _mm_loadu_ps(ys + i);
+                const __m128 z = _mm_loadu_ps(zs + i);
+
+                __m128 rx = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(m00, x), _mm_mul_ps(m10, y)), _mm_mul_ps(m20, z)), m30);
+                __m128 ry = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(m01, x), _mm_mul_ps(m11, y)), _mm_mul_ps(m21, z)), m31);
+                __m128 rz = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(m02, x), _mm_mul_ps(m12, y)), _mm_mul_ps(m22, z)), m32);
+
+                _mm_storeu_ps(outXs + i, rx);
+                _mm_storeu_ps(outYs + i, ry);
+                _mm_storeu_ps(outZs + i, rz);
+            }
+#endif
+
+            transformPointsScalar(m, xs, ys, zs, i, end, outXs, outYs, outZs);
+        }
+
+        static void composeModelMatricesRange
+        (
+            const float* px, const float* py, const float* pz,
+            const float* qx, const float* qy, const float* qz, const float* qw,
+            const float* sx, const float* sy, const float* sz,
+            size_t begin, size_t end,
+            mat4* out
+        )
+        {
+            size_t i = begin;
+
+#if MAL_MATH_AVX2
+            const __m256 one = _mm256_set1_ps(1.0f);
+            const __m256 two = _mm256_set1_ps(2.0f);
+
+            //Columns 0..2 of 8 matrices, transposed out to AoS once computed.
+            alignas(32) float columns[9][8];
+
+            for (; i + 8 <= end; i += 8)
+            {
+                const __m256 x = _mm256_loadu_ps(qx + i);
+                const __m256 y = _mm256_loadu_ps(qy + i);
+                const __m256 z = _mm256_loadu_ps(qz + i);
+                const __m256 w = _mm256_loadu_ps(qw + i);
+
+                const __m256 xx = _mm256_mul_ps(x, x), yy = _mm256_mul_ps(y, y), zz = _mm256_mul_ps(z, z);
+                const __m256 xy = _mm256_mul_ps(x, y), xz = _mm256_mul_ps(x, z), yz = _mm256_mul_ps(y, z);
+                const __m256 wx = _mm256_mul_ps(w, x), wy = _mm256_mul_ps(w, y), wz = _mm256_mul_ps(w, z);
+
+                const __m256 scaleX = _mm256_loadu_ps(sx + i);
+                const __m256 scaleY = _mm256_loadu_ps(sy + i);
+                const __m256 scaleZ = _mm256_loadu_ps(sz + i);
+
+                _mm256_store_ps(columns[0], _mm256_mul_ps(_mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(yy, zz))), scaleX));
+                _mm256_store_ps(columns[1], _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(xy, wz)), scaleX));
+                _mm256_store_ps(columns[2], _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(xz, wy)), scaleX));
+
+                _mm256_store_ps(columns[3], _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(xy, wz)), scaleY));
+                _mm256_store_ps(columns[4], _mm256_mul_ps(_mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(xx, zz))), scaleY));
+                _mm256_store_ps(columns[5], _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(yz, wx)), scaleY));
+
+                _mm256_store_ps(columns[6], _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(xz, wy)), scaleZ));
+                _mm256_store_ps(columns[7], _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(yz, wx)), scaleZ));
+                _mm256_store_ps(columns[8], _mm256_mul_ps(_mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(xx, yy))), scaleZ));
+
+                for (size_t lane = 0; lane < 8; lane++)
+                {
+                    out[i + lane] = mat4
+                    (
+                        {columns[0][lane], columns[1][lane], columns[2][lane], 0.0f},
+                        {columns[3][lane], columns[4][lane], columns[5][lane], 0.0f},
+                        {columns[6][lane], columns[7][lane], columns[8][lane], 0.0f},
+                        {px[i + lane], py[i + lane], pz[i + lane], 1.0f}
+                    );
+                }
+            }
+#elif MAL_MATH_SIMD
+            const __m128 one = _mm_set1_ps(1.0f);
+            const __m128 two = _mm_set1_ps(2.0f);
+
+            //Rows are 4 entities, transposed in registers so every lane becomes one column.
+            for (; i + 4 <= end; i += 4)
+            {
+                const __m128 x = _mm_loadu_ps(qx + i);
+                const __m128 y = _mm_loadu_ps(qy + i);
+                const __m128 z = _mm_loadu_ps(qz + i);
+                const __m128 w = _mm_loadu_ps(qw + i);
+
+                const __m128 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), zz = _mm_mul_ps(z, z);
+                const __m128 xy = _mm_mul_ps(x, y), xz = _mm_mul_ps(x, z), yz = _mm_mul_ps(y, z);
+                const __m128 wx = _mm_mul_ps(w, x), wy = _mm_mul_ps(w, y), wz = _mm_mul_ps(w, z);
+
+                const __m128 scaleX = _mm_loadu_ps(sx + i);
+                const __m128 scaleY = _mm_loadu_ps(sy + i);
+                const __m128 scaleZ = _mm_loadu_ps(sz + i);
+
+                __m128 c0x = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))), scaleX);
+                __m128 c0y = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xy, wz)), scaleX);
+                __m128 c0z = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xz, wy)), scaleX);
+                __m128 c0w = _mm_setzero_ps();
+
+                __m128 c1x = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xy, wz)), scaleY);
+                __m128 c1y = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))), scaleY);
+                __m128 c1z = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(yz, wx)), scaleY);
+                __m128 c1w = _mm_setzero_ps();
+
+                __m128 c2x = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xz, wy)), scaleZ);
+                __m128 c2y = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(yz, wx)), scaleZ);
+                __m128 c2z = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))), scaleZ);
+                __m128 c2w = _mm_setzero_ps();
+
+                __m128 c3x = _mm_loadu_ps(px + i);
+                __m128 c3y = _mm_loadu_ps(py + i);
+                __m128 c3z = _mm_loadu_ps(pz + i);
+                __m128 c3w = one;
+
+                _MM_TRANSPOSE4_PS(c0x, c0y, c0z, c0w);
+                _MM_TRANSPOSE4_PS(c1x, c1y, c1z, c1w);
+                _MM_TRANSPOSE4_PS(c2x, c2y, c2z, c2w);
+                _MM_TRANSPOSE4_PS(c3x, c3y, c3z, c3w);
+
+                const __m128 columns[4][4] =
+                {
+                    {c0x, c1x, c2x, c3x},
+                    {c0y, c1y, c2y, c3y},
+                    {c0z, c1z, c2z, c3z},
+                    {c0w, c1w, c2w, c3w}
+                };
+
+                for (size_t lane = 0; lane < 4; lane++)
+                {
+                    mat4& matrix = out[i + lane];
+                    _mm_store_ps(&matrix[0].x, columns[lane][0]);
+                    _mm_store_ps(&matrix[1].x, columns[lane][1]);
+                    _mm_store_ps(&matrix[2].x, columns[lane][2]);
+                    _mm_store_ps(&matrix[3].x, columns[lane][3]);
+                }
+            }
+#endif
+
+            composeModelMatricesScalar(px, py, pz, qx, qy, qz, qw, sx, sy, sz, i, end, out);
+        }
+
+        static void normalizeQuaternionsRange(float* xs, float* ys, float* zs, float* ws, size_t begin, size_t end)
+        {
+            size_t i = begin;
+
+#if MAL_MATH_AVX2
+            const __m256 one = _mm256_set1_ps(1.0f);
+
+            for (; i + 8 <= end; i += 8)
+            {
+                __m256 x = _mm256_loadu_ps(xs + i);
+                __m256 y = _mm256_loadu_ps(ys + i);
+                __m256 z = _mm256_loadu_ps(zs + i);
+                __m256 w = _mm256_loadu_ps(ws + i);
+
+                __m256 lengthSquared = _mm256_add_ps
+                (
+                    _mm256_add_ps(_mm256_mul_ps(x, x), _mm256_mul_ps(y, y)),
+                    _mm256_add_ps(_mm256_mul_ps(z, z), _mm256_mul_ps(w, w))
+                );
+                __m256 oneOverLength = _mm256_div_ps(one, _mm256_sqrt_ps(lengthSquared));
+
+                _mm256_storeu_ps(xs + i, _mm256_mul_ps(x, oneOverLength));
+                _mm256_storeu_ps(ys + i, _mm256_mul_ps(y, oneOverLength));
+                _mm256_storeu_ps(zs + i, _mm256_mul_ps(z, oneOverLength));
+                _mm256_storeu_ps(ws + i, _mm256_mul_ps(w, oneOverLength));
+            }
+#elif MAL_MATH_SIMD
+            const __m128 one = _mm_set1_ps(1.0f);
+
+            for (; i + 4 <= end; i += 4)
+            {
+                __m128 x = _mm_loadu_ps(xs + i);
+                __m128 y = _mm_loadu_ps(ys + i);
+                __m128 z = _mm_loadu_ps(zs + i);
+                __m128 w = _mm_loadu_ps(ws + i);
+
+                __m128 lengthSquared = _mm_add_ps
+                (
+                    _mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)),
+                    _mm_add_ps(_mm_mul_ps(z, z), _mm_mul_ps(w, w))
+                );
+                __m128 oneOverLength = _mm_div_ps(one, _mm_sqrt_ps(lengthSquared));
+
+                _mm_storeu_ps(xs + i, _mm_mul_ps(x, oneOverLength));
+                _mm_storeu_ps(ys + i, _mm_mul_ps(y, oneOverLength));
+                _mm_storeu_ps(zs + i, _mm_mul_ps(z, oneOverLength));
+                _mm_storeu_ps(ws + i, _mm_mul_ps(w, oneOverLength));
+            }
+#endif
+
+            normalizeQuaternionsScalar(xs, ys, zs, ws, i, end);
+        }
+
+        ///
+        /// Public entry points
+        ///
+
+        void transformPoints
+        (
+            const mat4& matrix,
+            const float* xs, const float* ys, const float* zs,
+            size_t count,
+            float* outXs, float* outYs, float* outZs
+        )
+        {
+            transformPointsRange(matrix, xs, ys, zs, 0, count, outXs, outYs, outZs);
+        }
+
+        void transformPoints
+        (
+            threadPool& pool,
+            const mat4& matrix,
+            const float* xs, const float* ys, const float* zs,
+            size_t count,
+            float* outXs, float* outYs, float* outZs
+        )
+        {
+            pool.parallelFor(count, s_batchGrainSize, [&](size_t begin, size_t end)
+            {
+                transformPointsRange(matrix, xs, ys, zs, begin, end, outXs, outYs, outZs);
+            });
+        }
+
+        void composeModelMatrices
+        (
+            const float* positionXs, const float* positionYs, const float* positionZs,
+            const float* rotationXs, const float* rotationYs, const float* rotationZs, const float* rotationWs,
+            const float* scaleXs, const float* scaleYs, const float* scaleZs,
+            size_t count,
+            mat4* outMatrices
+        )
+        {
+            composeModelMatricesRange
+            (
+                positionXs, positionYs, positionZs,
+                rotationXs, rotationYs, rotationZs, rotationWs,
+                scaleXs, scaleYs, scaleZs,
+                0, count,
+                outMatrices
+            );
+        }
+
+        void composeModelMatrices
+        (
+            threadPool& pool,
+            const float* positionXs, const float* positionYs, const float* positionZs,
+            const float* rotationXs, const float* rotationYs, const float* rotationZs, const float* rotationWs,
+            const float* scaleXs, const float* scaleYs, const float* scaleZs,
+            size_t count,
+            mat4* outMatrices
+        )
+        {
+            pool.parallelFor(count, s_batchGrainSize, [&](size_t begin, size_t end)
+            {
+                composeModelMatricesRange
+                (
+                    positionXs, positionYs, positionZs,
+                    rotationXs, rotationYs, rotationZs, rotationWs,
+                    scaleXs, scaleYs, scaleZs,
+                    begin, end,
+                    outMatrices
+                );
+            });
+        }
+
+        void normalizeQuaternions(float* xs, float* ys, float* zs, float* ws, size_t count)
+        {
+            normalizeQuaternionsRange(xs, ys, zs, ws, 0, count);
+        }
+
+        void normalizeQuaternions(threadPool& pool, float* xs, float* ys, float* zs, float* ws, size_t count)
+        {
+            pool.parallelFor(count, s_batchGrainSize, [&](size_t begin, size_t end)
+            {
+                normalizeQuaternionsRange(xs, ys, zs, ws, begin, end);
+            });
+        }
+    }
+}
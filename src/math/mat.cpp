@@ -0,0 +1,166 @@
+#include "malpch.h"
+#include "mat.h"
+
+namespace malachite
+{
+    namespace math
+    {
+        ///
+        /// mat3
+        ///
+
+        mat3 transpose(const mat3& m)
+        {
+            return mat3
+            (
+                {m[0].x, m[1].x, m[2].x},
+                {m[0].y, m[1].y, m[2].y},
+                {m[0].z, m[1].z, m[2].z}
+            );
+        }
+
+        float determinant(const mat3& m)
+        {
+            return dot(m[0], cross(m[1], m[2]));
+        }
+
+        mat3 inverse(const mat3& m)
+        {
+            //Rows of the inverse are the cross products of the columns, scaled by 1 / det.
+            vec3 r0 = cross(m[1], m[2]);
+            vec3 r1 = cross(m[2], m[0]);
+            vec3 r2 = cross(m[0], m[1]);
+
+            float oneOverDeterminant = 1.0f / dot(m[0], r0);
+
+            return transpose(mat3(r0 * oneOverDeterminant, r1 * oneOverDeterminant, r2 * oneOverDeterminant));
+        }
+
+        ///
+        /// mat4
+        ///
+
+        mat4 transpose(const mat4& m)
+        {
+            vec4 t0 = shuffle<0, 1, 0, 1>(m[0], m[1]);
+            vec4 t1 = shuffle<2, 3, 2, 3>(m[0], m[1]);
+            vec4 t2 = shuffle<0, 1, 0, 1>(m[2], m[3]);
+            vec4 t3 = shuffle<2, 3, 2, 3>(m[2], m[3]);
+
+            return mat4
+            (
+                shuffle<0, 2, 0, 2>(t0, t2),
+                shuffle<1, 3, 1, 3>(t0, t2),
+                shuffle<0, 2, 0, 2>(t1, t3),
+                shuffle<1, 3, 1, 3>(t1, t3)
+            );
+        }
+
+        //Pairs of 2x2 sub determinants taken from rows p and q of columns 1..3, laid out as
+        //(c2c3, c2c3, c1c3, c1c2) the way the cofactor expansion below consumes them.
+        template <int p, int q>
+        static vec4 subDeterminants(const mat4& m)
+        {
+            vec4 a = shuffle<p, p, p, p>(m[2], m[1]);
+            vec4 d = shuffle<q, q, q, q>(m[2], m[1]);
+
+            vec4 b = shuffle<q, q, q, q>(m[3], m[2]);
+            b = shuffle<0, 0, 0, 2>(b, b);
+
+            vec4 c = shuffle<p, p, p, p>(m[3], m[2]);
+            c = shuffle<0, 0, 0, 2>(c, c);
+
+            return a * b - c * d;
+        }
+
+        //Broadcasts row i of column 1 followed by row i of column 0 three times.
+        template <int i>
+        static vec4 cofactorColumn(const mat4& m)
+        {
+            vec4 t = shuffle<i, i, i, i>(m[1], m[0]);
+            return shuffle<0, 2, 2, 2>(t, t);
+        }
+
+        //Cofactor expansion written entirely with vec4 primitives, so the scalar and SIMD
+        //backends produce the same bits.
+        mat4 inverse(const mat4& m)
+        {
+            vec4 fac0 = subDeterminants<2, 3>(m);
+            vec4 fac1 = subDeterminants<1, 3>(m);
+            vec4 fac2 = subDeterminants<1, 2>(m);
+            vec4 fac3 = subDeterminants<0, 3>(m);
+            vec4 fac4 = subDeterminants<0, 2>(m);
+            vec4 fac5 = subDeterminants<0, 1>(m);
+
+            vec4 vec0 = cofactorColumn<0>(m);
+            vec4 vec1 = cofactorColumn<1>(m);
+            vec4 vec2 = cofactorColumn<2>(m);
+            vec4 vec3 = cofactorColumn<3>(m);
+
+            const vec4 signA(1.0f, -1.0f, 1.0f, -1.0f);
+            const vec4 signB(-1.0f, 1.0f, -1.0f, 1.0f);
+
+            vec4 inv0 = ((vec1 * fac0 - vec2 * fac1) + vec3 * fac2) * signA;
+            vec4 inv1 = ((vec0 * fac0 - vec2 * fac3) + vec3 * fac4) * signB;
+            vec4 inv2 = ((vec0 * fac1 - vec1 * fac3) + vec3 * fac5) * signA;
+            vec4 inv3 = ((vec0 * fac2 - vec1 * fac4) + vec2 * fac5) * signB;
+
+            vec4 row0 = shuffle<0, 2, 0, 2>(shuffle<0, 0, 0, 0>(inv0, inv1), shuffle<0, 0, 0, 0>(inv2, inv3));
+
+            float oneOverDeterminant = 1.0f / dot(m[0], row0);
+
+            return mat4
+            (
+                inv0 * oneOverDeterminant,
+                inv1 * oneOverDeterminant,
+                inv2 * oneOverDeterminant,
+                inv3 * oneOverDeterminant
+            );
+        }
+
+        mat4 translation(const vec3& t)
+        {
+            mat4 result = mat4::identity();
+            result[3] = vec4(t, 1.0f);
+            return result;
+        }
+
+        mat4 scaling(const vec3& s)
+        {
+            mat4 result = mat4::identity();
+            result[0].x = s.x;
+            result[1].y = s.y;
+            result[2].z = s.z;
+            return result;
+        }
+
+        mat4 perspective(float fovY, float aspect, float nearPlane, float farPlane)
+        {
+            const float f = 1.0f / std::tan(fovY * 0.5f);
+
+            mat4 result(0.0f, 0.0f, 0.0f, 0.0f);
+            result[0].x = f / aspect;
+            result[1].y = -f;
+            result[2].z = farPlane / (nearPlane - farPlane);
+            result[2].w = -1.0f;
+            result[3].z = (nearPlane * farPlane) / (nearPlane - farPlane);
+
+            return result;
+        }
+
+        mat4 lookAt(const vec3& eye, const vec3& target, const vec3& up)
+        {
+            const vec3 forward = normalize(target - eye);
+            const vec3 side = normalize(cross(forward, up));
+            const vec3 cameraUp = cross(side, forward);
+
+            return mat4
+            (
+                {side.x, cameraUp.x, -forward.x, 0.0f},
+                {side.y, cameraUp.y, -forward.y, 0.0f},
+                {side.z, cameraUp.z, -forward.z, 0.0f},
+                {-dot(side, eye), -dot(cameraUp, eye), dot(forward, eye), 1.0f}
+            );
+        }
+    }
+}
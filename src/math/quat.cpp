@@ -0,0 +1,79 @@
+#include "malpch.h"
+#include "quat.h"
+
+namespace malachite
+{
+    namespace math
+    {
+        quat fromAxisAngle(const vec3& axis, float angle)
+        {
+            const vec3 unitAxis = normalize(axis);
+            const float halfAngle = angle * 0.5f;
+            const float s = std::sin(halfAngle);
+
+            return quat(unitAxis.x * s, unitAxis.y * s, unitAxis.z * s, std::cos(halfAngle));
+        }
+
+        quat slerp(const quat& a, const quat& b, float t)
+        {
+            vec4 va = a.toVec4();
+            vec4 vb = b.toVec4();
+
+            float cosTheta = dot(va, vb);
+
+            //Take the short way around the hypersphere
+            if (cosTheta < 0.0f)
+            {
+                vb = -vb;
+                cosTheta = -cosTheta;
+            }
+
+            //Nearly parallel, sin(theta) goes to zero so fall back to a normalized lerp
+            if (cosTheta > 0.9995f)
+            {
+                return quat(normalize(lerp(va, vb, t)));
+            }
+
+            const float theta = std::acos(cosTheta);
+            const float oneOverSinTheta = 1.0f / std::sin(theta);
+
+            const float weightA = std::sin((1.0f - t) * theta) * oneOverSinTheta;
+            const float weightB = std::sin(t * theta) * oneOverSinTheta;
+
+            return quat(va * weightA + vb * weightB);
+        }
+
+        mat3 toMat3(const quat& q)
+        {
+            const float xx = q.x * q.x;
+            const float yy = q.y * q.y;
+            const float zz = q.z * q.z;
+            const float xy = q.x * q.y;
+            const float xz = q.x * q.z;
+            const float yz = q.y * q.z;
+            const float wx = q.w * q.x;
+            const float wy = q.w * q.y;
+            const float wz = q.w * q.z;
+
+            return mat3
+            (
+                {1.0f - 2.0f * (yy + zz), 2.0f * (xy + wz), 2.0f * (xz - wy)},
+                {2.0f * (xy - wz), 1.0f - 2.0f * (xx + zz), 2.0f * (yz + wx)},
+                {2.0f * (xz + wy), 2.0f * (yz - wx), 1.0f - 2.0f * (xx + yy)}
+            );
+        }
+
+        mat4 toMat4(const quat& q)
+        {
+            const mat3 r = toMat3(q);
+
+            return mat4
+            (
+                vec4(r[0], 0.0f),
+                vec4(r[1], 0.0f),
+                vec4(r[2], 0.0f),
+                vec4(0.0f, 0.0f, 0.0f, 1.0f)
+            );
+        }
+    }
+}
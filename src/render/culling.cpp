@@ -0,0 +1,462 @@
+#include "malpch.h"
+#include "culling.h"
+#include "threadPool.h"
+
+namespace malachite
+{
+    //Objects per culling job, a multiple of the 8 wide AVX2 and 4 wide SSE steps.
+    static const size_t s_cullGrainSize = 1024;
+
+    frustum extractFrustum(const math::mat4& viewProjection)
+    {
+        const math::mat4 rows = math::transpose(viewProjection);
+
+        frustum result;
+        result.planes[0] = rows[3] + rows[0]; //left
+        result.planes[1] = rows[3] - rows[0]; //right
+        result.planes[2] = rows[3] + rows[1]; //bottom
+        result.planes[3] = rows[3] - rows[1]; //top
+        result.planes[4] = rows[2];           //near, Vulkan clip depth starts at 0
+        result.planes[5] = rows[3] - rows[2]; //far
+
+        for (auto& plane : result.planes)
+        {
+            plane = plane * (1.0f / math::length(math::toVec3(plane)));
+        }
+
+        return result;
+    }
+
+    ///
+    /// Bounds storage
+    ///
+
+    uint32_t boundingSpheres::add(const math::vec3& center, float radius)
+    {
+        centerXs.push_back(center.x);
+        centerYs.push_back(center.y);
+        centerZs.push_back(center.z);
+        radii.push_back(radius);
+
+        return static_cast<uint32_t>(radii.size() - 1);
+    }
+
+    void boundingSpheres::set(uint32_t index, const math::vec3& center, float radius)
+    {
+        centerXs[index] = center.x;
+        centerYs[index] = center.y;
+        centerZs[index] = center.z;
+        radii[index] = radius;
+    }
+
+    void boundingSpheres::clear()
+    {
+        centerXs.clear();
+        centerYs.clear();
+        centerZs.clear();
+        radii.clear();
+    }
+
+    uint32_t boundingBoxes::add(const math::vec3& center, const math::vec3& extents)
+    {
+        centerXs.push_back(center.x);
+        centerYs.push_back(center.y);
+        centerZs.push_back(center.z);
+        extentXs.push_back(extents.x);
+        extentYs.push_back(extents.y);
+        extentZs.push_back(extents.z);
+
+        return static_cast<uint32_t>(extentXs.size() - 1);
+    }
+
+    void boundingBoxes::set(uint32_t index, const math::vec3& center, const math::vec3& extents)
+    {
+        centerXs[index] = center.x;
+        centerYs[index] = center.y;
+        centerZs[index] = center.z;
+        extentXs[index] = extents.x;
+        extentYs[index] = extents.y;
+        extentZs[index] = extents.z;
+    }
+
+    void boundingBoxes::clear()
+    {
+        centerXs.clear();
+        centerYs.clear();
+        centerZs.clear();
+        extentXs.clear();
+        extentYs.clear();
+        extentZs.clear();
+    }
+
+    ///
+    /// Visibility tests
+    /// A volume is kept when it is not fully behind any plane and, for the distance test,
+    /// its closest point is within maxDrawDistance of the camera. AVX2 builds test 8 volumes
+    /// per step and SSE4.1 builds 4, in the operation order of the scalar tests.
+    ///
+
+    static bool isSphereVisible(const cullingParams& params, float x, float y, float z, float radius)
+    {
+        for (const auto& plane : params.viewFrustum.planes)
+        {
+            float distance = ((plane.x * x + plane.y * y) + plane.z * z) + plane.w;
+            if (distance < -radius)
+            {
+                return false;
+            }
+        }
+
+        float dx = x - params.cameraPosition.x;
+        float dy = y - params.cameraPosition.y;
+        float dz = z - params.cameraPosition.z;
+        float reach = params.maxDrawDistance + radius;
+
+        return (dx * dx + dy * dy) + dz * dz <= reach * reach;
+    }
+
+    size_t cullSpheres(const cullingParams& params, const boundingSpheres& bounds, size_t begin, size_t end, uint32_t* outVisible)
+    {
+        const float* xs = bounds.centerXs.data();
+        const float* ys = bounds.centerYs.data();
+        const float* zs = bounds.centerZs.data();
+        const float* rs = bounds.radii.data();
+
+        size_t visibleCount = 0;
+        size_t i = begin;
+
+#if MAL_MATH_AVX2
+        __m256 planeXs[6], planeYs[6], planeZs[6], planeWs[6];
+        for (int p = 0; p < 6; p++)
+        {
+            planeXs[p] = _mm256_set1_ps(params.viewFrustum.planes[p].x);
+            planeYs[p] = _mm256_set1_ps(params.viewFrustum.planes[p].y);
+            planeZs[p] = _mm256_set1_ps(params.viewFrustum.planes[p].z);
+            planeWs[p] = _mm256_set1_ps(params.viewFrustum.planes[p].w);
+        }
+
+        const __m256 cameraX = _mm256_set1_ps(params.cameraPosition.x);
+        const __m256 cameraY = _mm256_set1_ps(params.cameraPosition.y);
+        const __m256 cameraZ = _mm256_set1_ps(params.cameraPosition.z);
+        const __m256 maxDistance = _mm256_set1_ps(params.maxDrawDistance);
+        const __m256 signBit = _mm256_set1_ps(-0.0f);
+
+        for (; i + 8 <= end; i += 8)
+        {
+            const __m256 x = _mm256_loadu_ps(xs + i);
+            const __m256 y = _mm256_loadu_ps(ys + i);
+            const __m256 z = _mm256_loadu_ps(zs + i);
+            const __m256 r = _mm256_loadu_ps(rs + i);
+            const __m256 negativeR = _mm256_xor_ps(r, signBit);
+
+            __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+            for (int p = 0; p < 6; p++)
+            {
+                __m256 distance = _mm256_add_ps
+                (
+                    _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(planeXs[p], x), _mm256_mul_ps(planeYs[p], y)), _mm256_mul_ps(planeZs[p], z)),
+                    planeWs[p]
+                );
+                inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, negativeR, _CMP_GE_OQ));
+            }
+
+            const __m256 dx = _mm256_sub_ps(x, cameraX);
+            const __m256 dy = _mm256_sub_ps(y, cameraY);
+            const __m256 dz = _mm256_sub_ps(z, cameraZ);
+            const __m256 distanceSquared = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz));
+            const __m256 reach = _mm256_add_ps(maxDistance, r);
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(distanceSquared, _mm256_mul_ps(reach, reach), _CMP_LE_OQ));
+
+            uint32_t mask = static_cast<uint32_t>(_mm256_movemask_ps(inside));
+            while (mask != 0)
+            {
+                uint32_t lane = static_cast<uint32_t>(__builtin_ctz(mask));
+                outVisible[visibleCount++] = static_cast<uint32_t>(i + lane);
+                mask &= mask - 1;
+            }
+        }
+#elif MAL_MATH_SIMD
+        __m128 planeXs[6], planeYs[6], planeZs[6], planeWs[6];
+        for (int p = 0; p < 6; p++)
+        {
+            planeXs[p] = _mm_set1_ps(params.viewFrustum.planes[p].x);
+            planeYs[p] = _mm_set1_ps(params.viewFrustum.planes[p].y);
+            planeZs[p] = _mm_set1_ps(params.viewFrustum.planes[p].z);
+            planeWs[p] = _mm_set1_ps(params.viewFrustum.planes[p].w);
+        }
+
+        const __m128 cameraX = _mm_set1_ps(params.cameraPosition.x);
+        const __m128 cameraY = _mm_set1_ps(params.cameraPosition.y);
+        const __m128 cameraZ = _mm_set1_ps(params.cameraPosition.z);
+        const __m128 maxDistance = _mm_set1_ps(params.maxDrawDistance);
+        const __m128 signBit = _mm_set1_ps(-0.0f);
+
+        for (; i + 4 <= end; i += 4)
+        {
+            const __m128 x = _mm_loadu_ps(xs + i);
+            const __m128 y = _mm_loadu_ps(ys + i);
+            const __m128 z = _mm_loadu_ps(zs + i);
+            const __m128 r = _mm_loadu_ps(rs + i);
+            const __m128 negativeR = _mm_xor_ps(r, signBit);
+
+            __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+            for (int p = 0; p < 6; p++)
+            {
+                __m128 distance = _mm_add_ps
+                (
+                    _mm_add_ps(_mm_add_ps(_mm_mul_ps(planeXs[p], x), _mm_mul_ps(planeYs[p], y)), _mm_mul_ps(planeZs[p], z)),
+                    planeWs[p]
+                );
+                inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negativeR));
+            }
+
+            const __m128 dx = _mm_sub_ps(x, cameraX);
+            const __m128 dy = _mm_sub_ps(y, cameraY);
+            const __m128 dz = _mm_sub_ps(z, cameraZ);
+            const __m128 distanceSquared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+            const __m128 reach = _mm_add_ps(maxDistance, r);
+            inside = _mm_and_ps(inside, _mm_cmple_ps(distanceSquared, _mm_mul_ps(reach, reach)));
+
+            uint32_t mask = static_cast<uint32_t>(_mm_movemask_ps(inside));
+            while (mask != 0)
+            {
+                uint32_t lane = static_cast<uint32_t>(__builtin_ctz(mask));
+                outVisible[visibleCount++] = static_cast<uint32_t>(i + lane);
+                mask &= mask - 1;
+            }
+        }
+#endif
+
+        for (; i < end; i++)
+        {
+            if (isSphereVisible(params, xs[i], ys[i], zs[i], rs[i]))
+            {
+                outVisible[visibleCount++] = static_cast<uint32_t>(i);
+            }
+        }
+
+        return visibleCount;
+    }
+
+    static bool isBoxVisible(const cullingParams& params, float x, float y, float z, float ex, float ey, float ez)
+    {
+        for (const auto& plane : params.viewFrustum.planes)
+        {
+            float distance = ((plane.x * x + plane.y * y) + plane.z * z) + plane.w;
+            float radius = (std::fabs(plane.x) * ex + std::fabs(plane.y) * ey) + std::fabs(plane.z) * ez;
+            if (distance < -radius)
+            {
+                return false;
+            }
+        }
+
+        //Distance from the camera to the closest point of the box
+        float dx = std::max(std::fabs(x - params.cameraPosition.x) - ex, 0.0f);
+        float dy = std::max(std::fabs(y - params.cameraPosition.y) - ey, 0.0f);
+        float dz = std::max(std::fabs(z - params.cameraPosition.z) - ez, 0.0f);
+
+        return (dx * dx + dy * dy) + dz * dz <= params.maxDrawDistance * params.maxDrawDistance;
+    }
+
+    size_t cullBoxes(const cullingParams& params, const boundingBoxes& bounds, size_t begin, size_t end, uint32_t* outVisible)
+    {
+        const float* xs = bounds.centerXs.data();
+        const float* ys = bounds.centerYs.data();
+        const float* zs = bounds.centerZs.data();
+        const float* exs = bounds.extentXs.data();
+        const float* eys = bounds.extentYs.data();
+        const float* ezs = bounds.extentZs.data();
+
+        size_t visibleCount = 0;
+        size_t i = begin;
+
+#if MAL_MATH_AVX2
+        __m256 planeXs[6], planeYs[6], planeZs[6], planeWs[6];
+        __m256 absPlaneXs[6], absPlaneYs[6], absPlaneZs[6];
+        for (int p = 0; p < 6; p++)
+        {
+            const math::vec4& plane = params.viewFrustum.planes[p];
+            planeXs[p] = _mm256_set1_ps(plane.x);
+            planeYs[p] = _mm256_set1_ps(plane.y);
+            planeZs[p] = _mm256_set1_ps(plane.z);
+            planeWs[p] = _mm256_set1_ps(plane.w);
+            absPlaneXs[p] = _mm256_set1_ps(std::fabs(plane.x));
+            absPlaneYs[p] = _mm256_set1_ps(std::fabs(plane.y));
+            absPlaneZs[p] = _mm256_set1_ps(std::fabs(plane.z));
+        }
+
+        const __m256 cameraX = _mm256_set1_ps(params.cameraPosition.x);
+        const __m256 cameraY = _mm256_set1_ps(params.cameraPosition.y);
+        const __m256 cameraZ = _mm256_set1_ps(params.cameraPosition.z);
+        const __m256 maxDistance = _mm256_set1_ps(params.maxDrawDistance);
+        const __m256 maxDistanceSquared = _mm256_mul_ps(maxDistance, maxDistance);
+        const __m256 signBit = _mm256_set1_ps(-0.0f);
+        const __m256 zero = _mm256_setzero_ps();
+
+        for (; i + 8 <= end; i += 8)
+        {
+            const __m256 x = _mm256_loadu_ps(xs + i);
+            const __m256 y = _mm256_loadu_ps(ys + i);
+            const __m256 z = _mm256_loadu_ps(zs + i);
+            const __m256 ex = _mm256_loadu_ps(exs + i);
+            const __m256 ey = _mm256_loadu_ps(eys + i);
+            const __m256 ez = _mm256_loadu_ps(ezs + i);
+
+            __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+            for (int p = 0; p < 6; p++)
+            {
+                __m256 distance = _mm256_add_ps
+                (
+                    _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(planeXs[p], x), _mm256_mul_ps(planeYs[p], y)), _mm256_mul_ps(planeZs[p], z)),
+                    planeWs[p]
+                );
+                __m256 radius = _mm256_add_ps
+                (
+                    _mm256_add_ps(_mm256_mul_ps(absPlaneXs[p], ex), _mm256_mul_ps(absPlaneYs[p], ey)),
+                    _mm256_mul_ps(absPlaneZs[p], ez)
+                );
+                inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, _mm256_xor_ps(radius, signBit), _CMP_GE_OQ));
+            }
+
+            const __m256 dx = _mm256_max_ps(_mm256_sub_ps(_mm256_andnot_ps(signBit, _mm256_sub_ps(x, cameraX)), ex), zero);
+            const __m256 dy = _mm256_max_ps(_mm256_sub_ps(_mm256_andnot_ps(signBit, _mm256_sub_ps(y, cameraY)), ey), zero);
+            const __m256 dz = _mm256_max_ps(_mm256_sub_ps(_mm256_andnot_ps(signBit, _mm256_sub_ps(z, cameraZ)), ez), zero);
+            const __m256 distanceSquared = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz));
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(distanceSquared, maxDistanceSquared, _CMP_LE_OQ));
+
+            uint32_t mask = static_cast<uint32_t>(_mm256_movemask_ps(inside));
+            while (mask != 0)
+            {
+                uint32_t lane = static_cast<uint32_t>(__builtin_ctz(mask));
+                outVisible[visibleCount++] = static_cast<uint32_t>(i + lane);
+                mask &= mask - 1;
+            }
+        }
+#elif MAL_MATH_SIMD
+        __m128 planeXs[6], planeYs[6], planeZs[6], planeWs[6];
+        __m128 absPlaneXs[6], absPlaneYs[6], absPlaneZs[6];
+        for (int p = 0; p < 6; p++)
+        {
+            const math::vec4& plane = params.viewFrustum.planes[p];
+            planeXs[p] = _mm_set1_ps(plane.x);
+            planeYs[p] = _mm_set1_ps(plane.y);
+            planeZs[p] = _mm_set1_ps(plane.z);
+            planeWs[p] = _mm_set1_ps(plane.w);
+            absPlaneXs[p] = _mm_set1_ps(std::fabs(plane.x));
+            absPlaneYs[p] = _mm_set1_ps(std::fabs(plane.y));
+            absPlaneZs[p] = _mm_set1_ps(std::fabs(plane.z));
+        }
+
+        const __m128 cameraX = _mm_set1_ps(params.cameraPosition.x);
+        const __m128 cameraY = _mm_set1_ps(params.cameraPosition.y);
+        const __m128 cameraZ = _mm_set1_ps(params.cameraPosition.z);
+        const __m128 maxDistance = _mm_set1_ps(params.maxDrawDistance);
+        const __m128 maxDistanceSquared = _mm_mul_ps(maxDistance, maxDistance);
+        const __m128 signBit = _mm_set1_ps(-0.0f);
+        const __m128 zero = _mm_setzero_ps();
+
+        for (; i + 4 <= end; i += 4)
+        {
+            const __m128 x = _mm_loadu_ps(xs + i);
+            const __m128 y = _mm_loadu_ps(ys + i);
+            const __m128 z = _mm_loadu_ps(zs + i);
+            const __m128 ex = _mm_loadu_ps(exs + i);
+            const __m128 ey = _mm_loadu_ps(eys + i);
+            const __m128 ez = _mm_loadu_ps(ezs + i);
+
+            __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+            for (int p = 0; p < 6; p++)
+            {
+                __m128 distance = _mm_add_ps
+                (
+                    _mm_add_ps(_mm_add_ps(_mm_mul_ps(planeXs[p], x), _mm_mul_ps(planeYs[p], y)), _mm_mul_ps(planeZs[p], z)),
+                    planeWs[p]
+                );
+                __m128 radius = _mm_add_ps
+                (
+                    _mm_add_ps(_mm_mul_ps(absPlaneXs[p], ex), _mm_mul_ps(absPlaneYs[p], ey)),
+                    _mm_mul_ps(absPlaneZs[p], ez)
+                );
+                inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, _mm_xor_ps(radius, signBit)));
+            }
+
+            const __m128 dx = _mm_max_ps(_mm_sub_ps(_mm_andnot_ps(signBit, _mm_sub_ps(x, cameraX)), ex), zero);
+            const __m128 dy = _mm_max_ps(_mm_sub_ps(_mm_andnot_ps(signBit, _mm_sub_ps(y, cameraY)), ey), zero);
+            const __m128 dz = _mm_max_ps(_mm_sub_ps(_mm_andnot_ps(signBit, _mm_sub_ps(z, cameraZ)), ez), zero);
+            const __m128 distanceSquared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+            inside = _mm_and_ps(inside, _mm_cmple_ps(distanceSquared, maxDistanceSquared));
+
+            uint32_t mask = static_cast<uint32_t>(_mm_movemask_ps(inside));
+            while (mask != 0)
+            {
+                uint32_t lane = static_cast<uint32_t>(__builtin_ctz(mask));
+                outVisible[visibleCount++] = static_cast<uint32_t>(i + lane);
+                mask &= mask - 1;
+            }
+        }
+#endif
+
+        for (; i < end; i++)
+        {
+            if (isBoxVisible(params, xs[i], ys[i], zs[i], exs[i], eys[i], ezs[i]))
+            {
+                outVisible[visibleCount++] = static_cast<uint32_t>(i);
+            }
+        }
+
+        return visibleCount;
+    }
+
+    ///
+    /// Culling stage
+    ///
+
+    template <typename Bounds, typename CullFunc>
+    void cullingStage::cullChunks(threadPool& pool, const cullingParams& params, const Bounds& bounds, CullFunc cullFunc)
+    {
+        const size_t count = bounds.size();
+        const size_t chunkCount = (count + s_cullGrainSize - 1) / s_cullGrainSize;
+
+        if (m_chunkVisible.size() < chunkCount)
+        {
+            m_chunkVisible.resize(chunkCount);
+        }
+        m_chunkVisibleCounts.assign(chunkCount, 0);
+
+        pool.parallelFor(count, s_cullGrainSize, [&](size_t begin, size_t end)
+        {
+            size_t chunk = begin / s_cullGrainSize;
+
+            std::vector<uint32_t>& chunkVisible = m_chunkVisible[chunk];
+            chunkVisible.resize(end - begin);
+
+            m_chunkVisibleCounts[chunk] = cullFunc(params, bounds, begin, end, chunkVisible.data());
+        });
+
+        //Concatenate in chunk order so the list stays sorted by object index
+        size_t visibleCount = 0;
+        for (size_t chunk = 0; chunk < chunkCount; chunk++)
+        {
+            visibleCount += m_chunkVisibleCounts[chunk];
+        }
+
+        m_visible.resize(visibleCount);
+
+        uint32_t* output = m_visible.data();
+        for (size_t chunk = 0; chunk < chunkCount; chunk++)
+        {
+            std::copy_n(m_chunkVisible[chunk].data(), m_chunkVisibleCounts[chunk], output);
+            output += m_chunkVisibleCounts[chunk];
+        }
+    }
+
+    void cullingStage::cull(threadPool& pool, const cullingParams& params, const boundingSpheres& bounds)
+    {
+        cullChunks(pool, params, bounds, cullSpheres);
+    }
+
+    void cullingStage::cull(threadPool& pool, const cullingParams& params, const boundingBoxes& bounds)
+    {
+        cullChunks(pool, params, bounds, cullBoxes);
+    }
+}
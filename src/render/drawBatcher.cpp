@@ -0,0 +1,325 @@
+#include "malpch.h"
+#include "drawBatcher.h"
+
+#include <algorithm>
+#include <cstring>
+
+static uint32_t getGroupIndex(VkIndexType indexType)
+{
+    return indexType == VK_INDEX_TYPE_UINT16 ? 0 : 1;
+}
+
+namespace malachite
+{
+    void drawBatcher::enableDeviceFeatures(const VkPhysicalDeviceFeatures& supported, VkPhysicalDeviceFeatures& enabled)
+    {
+        enabled.multiDrawIndirect = supported.multiDrawIndirect;
+        enabled.drawIndirectFirstInstance = supported.drawIndirectFirstInstance;
+    }
+
+    void drawBatcher::initalize(gpuAllocator& allocator, VkPhysicalDevice physicalDevice, uint32_t framesInFlight, VkDeviceSize frameBytes)
+    {
+        VkPhysicalDeviceFeatures features;
+        vkGetPhysicalDeviceFeatures(physicalDevice, &features);
+
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+        //Same features enableDeviceFeatures turned on.
+        if (!features.drawIndirectFirstInstance)
+        {
+            m_drawPath = e_drawPath::direct;
+        }
+        else if (features.multiDrawIndirect && properties.limits.maxDrawIndirectCount > 1)
+        {
+            m_drawPath = e_drawPath::multiDrawIndirect;
+        }
+        else
+        {
+            m_drawPath = e_drawPath::indirect;
+        }
+
+        m_maxDrawIndirectCount = std::max(properties.limits.maxDrawIndirectCount, 1u);
+
+        m_framePools.resize(framesInFlight);
+        for (gpuLinearPool& pool : m_framePools)
+        {
+            pool.initalize(allocator, frameBytes, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT);
+        }
+    }
+
+    void drawBatcher::cleanup()
+    {
+        for (gpuLinearPool& pool : m_framePools)
+        {
+            pool.cleanup();
+        }
+
+        m_framePools.clear();
+        m_pool = nullptr;
+    }
+
+    bool drawBatcher::build
+    (
+        uint32_t frameIndex,
+        arrayView<uint32_t> visibleObjects,
+        arrayView<meshId> objectMeshes,
+        arrayView<math::mat4> objectTransforms,
+        const meshBufferPool& meshes,
+        bool isBatched
+    )
+    {
+        m_pool = &m_framePools[frameIndex];
+        m_pool->reset();
+
+        m_stats = drawBatchStats();
+        m_isBatched = isBatched;
+        m_meshlessCount = 0;
+        m_meshCommands[0].clear();
+        m_meshCommands[1].clear();
+
+        size_t meshCount = meshes.getMeshCapacity();
+        m_meshInstanceCounts.assign(meshCount, 0);
+
+        auto getMesh = [&](uint32_t objectIndex)
+        {
+            return objectIndex < objectMeshes.size ? objectMeshes[objectIndex] : c_invalidMesh;
+        };
+
+        //Objects without a mesh take the first instances, every mesh the range after.
+        for (uint32_t objectIndex : visibleObjects)
+        {
+            meshId mesh = getMesh(objectIndex);
+            if (mesh == c_invalidMesh)
+            {
+                m_meshlessCount++;
+            }
+            else if (meshes.isReady(mesh))
+            {
+                m_meshInstanceCounts[mesh]++;
+            }
+        }
+
+        uint32_t instanceCount = m_meshlessCount;
+
+        VkDrawIndexedIndirectCommand command;
+        VkIndexType indexType;
+
+        if (isBatched)
+        {
+            for (meshId mesh = 0; mesh < meshCount; mesh++)
+            {
+                if (m_meshInstanceCounts[mesh] == 0 || !meshes.getDrawCommand(mesh, command, indexType))
+                {
+                    continue;
+                }
+
+                command.instanceCount = m_meshInstanceCounts[mesh];
+                command.firstInstance = instanceCount;
+                m_meshCommands[getGroupIndex(indexType)].push_back(command);
+
+                //From here on the first free slot of the mesh.
+                m_meshInstanceCounts[mesh] = instanceCount;
+                instanceCount += command.instanceCount;
+            }
+
+            m_stats.batchCount = (uint32_t) (m_meshCommands[0].size() + m_meshCommands[1].size()) + (m_meshlessCount > 0 ? 1 : 0);
+        }
+        else
+        {
+            for (uint32_t count : m_meshInstanceCounts)
+            {
+                instanceCount += count;
+            }
+        }
+
+        void* mapped;
+        if (!m_pool->allocate(instanceCount * sizeof(drawInstance), alignof(drawInstance), m_instanceOffset, mapped))
+        {
+            MAL_LOG_ERROR("Draw batch buffer is full, ", std::to_string(instanceCount), " instances don't fit");
+            m_stats = drawBatchStats();
+            return false;
+        }
+
+        drawInstance* instances = static_cast<drawInstance*>(mapped);
+        uint32_t meshlessSlot = 0;
+        uint32_t unbatchedSlot = m_meshlessCount;
+
+        for (uint32_t objectIndex : visibleObjects)
+        {
+            meshId mesh = getMesh(objectIndex);
+            if (mesh == c_invalidMesh)
+            {
+                addInstance(instances, meshlessSlot++, objectIndex, objectTransforms);
+            }
+            else if (!meshes.isReady(mesh))
+            {
+                //Skipped rather than drawn as the placeholder triangle.
+            }
+            else if (isBatched)
+            {
+                addInstance(instances, m_meshInstanceCounts[mesh]++, objectIndex, objectTransforms);
+            }
+            else
+            {
+                meshes.getDrawCommand(mesh, command, indexType);
+                command.firstInstance = unbatchedSlot;
+                m_meshCommands[getGroupIndex(indexType)].push_back(command);
+
+                addInstance(instances, unbatchedSlot++, objectIndex, objectTransforms);
+            }
+        }
+
+        m_stats.instanceCount = instanceCount;
+
+        //Both groups back to back, 16 bit indices first.
+        m_commands.clear();
+        for (uint32_t i = 0; i < 2; i++)
+        {
+            drawGroup& group = m_groups[i];
+            group.indexType = i == 0 ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+            group.firstCommand = (uint32_t) m_commands.size();
+            group.commandCount = (uint32_t) m_meshCommands[i].size();
+
+            m_commands.insert(m_commands.end(), m_meshCommands[i].begin(), m_meshCommands[i].end());
+        }
+
+        //The direct path reads the commands on the CPU.
+        if (m_drawPath != e_drawPath::direct && isBatched && !m_commands.empty())
+        {
+            VkDeviceSize commandOffset;
+            if (!m_pool->allocate(m_commands.size() * sizeof(VkDrawIndexedIndirectCommand), 4, commandOffset, mapped))
+            {
+                MAL_LOG_ERROR("Draw batch buffer is full, ", std::to_string(m_commands.size()), " draws don't fit");
+                m_stats = drawBatchStats();
+                return false;
+            }
+
+            memcpy(mapped, m_commands.data(), m_commands.size() * sizeof(VkDrawIndexedIndirectCommand));
+
+            for (drawGroup& group : m_groups)
+            {
+                group.commandOffset = commandOffset + group.firstCommand * sizeof(VkDrawIndexedIndirectCommand);
+            }
+        }
+
+        return true;
+    }
+
+    uint32_t drawBatcher::getDrawCount() const
+    {
+        if (!m_pool || m_stats.instanceCount == 0)
+        {
+            return 0;
+        }
+
+        return getMeshlessDrawCount() + (uint32_t) m_commands.size();
+    }
+
+    uint32_t drawBatcher::record(VkCommandBuffer commandBuffer, const meshBufferPool& meshes, uint32_t firstDraw, uint32_t drawCount) const
+    {
+        drawCount = std::min(drawCount, getDrawCount() - std::min(firstDraw, getDrawCount()));
+        if (drawCount == 0)
+        {
+            return 0;
+        }
+
+        uint32_t drawCallCount = 0;
+        uint32_t endDraw = firstDraw + drawCount;
+
+        VkBuffer buffer = m_pool->getBuffer();
+        vkCmdBindVertexBuffers(commandBuffer, 1, 1, &buffer, &m_instanceOffset);
+
+        //Objects without a mesh come first, batched they are a single draw.
+        uint32_t meshlessDrawCount = getMeshlessDrawCount();
+        for (uint32_t i = firstDraw; i < std::min(endDraw, meshlessDrawCount); i++)
+        {
+            vkCmdDraw(commandBuffer, 3, m_isBatched ? m_meshlessCount : 1, 0, i);
+            drawCallCount++;
+        }
+
+        for (const drawGroup& group : m_groups)
+        {
+            //The part of the group inside the range.
+            uint32_t groupFirst = meshlessDrawCount + group.firstCommand;
+            uint32_t first = std::max(firstDraw, groupFirst) - groupFirst;
+            uint32_t end = std::min(endDraw, groupFirst + group.commandCount);
+            if (end <= groupFirst + first)
+            {
+                continue;
+            }
+
+            uint32_t count = end - groupFirst - first;
+            const VkDrawIndexedIndirectCommand* commands = m_commands.data() + group.firstCommand + first;
+            VkDeviceSize commandOffset = group.commandOffset + first * sizeof(VkDrawIndexedIndirectCommand);
+
+            //One draw per object, rebinding like the draws did before they were batched.
+            if (!m_isBatched)
+            {
+                for (uint32_t i = 0; i < count; i++)
+                {
+                    meshes.bindBuffers(commandBuffer, group.indexType);
+                    vkCmdDrawIndexed(commandBuffer, commands[i].indexCount, 1, commands[i].firstIndex, commands[i].vertexOffset, commands[i].firstInstance);
+                }
+
+                drawCallCount += count;
+                continue;
+            }
+
+            meshes.bindBuffers(commandBuffer, group.indexType);
+
+            switch (m_drawPath)
+            {
+                case e_drawPath::multiDrawIndirect:
+                {
+                    for (uint32_t i = 0; i < count; i += m_maxDrawIndirectCount)
+                    {
+                        uint32_t multiDrawCount = std::min(count - i, m_maxDrawIndirectCount);
+                        vkCmdDrawIndexedIndirect(commandBuffer, buffer, commandOffset + i * sizeof(VkDrawIndexedIndirectCommand), multiDrawCount, sizeof(VkDrawIndexedIndirectCommand));
+                        drawCallCount++;
+                    }
+                    break;
+                }
+                case e_drawPath::indirect:
+                {
+                    for (uint32_t i = 0; i < count; i++)
+                    {
+                        vkCmdDrawIndexedIndirect(commandBuffer, buffer, commandOffset + i * sizeof(VkDrawIndexedIndirectCommand), 1, sizeof(VkDrawIndexedIndirectCommand));
+                    }
+
+                    drawCallCount += count;
+                    break;
+                }
+                case e_drawPath::direct:
+                {
+                    for (uint32_t i = 0; i < count; i++)
+                    {
+                        vkCmdDrawIndexed(commandBuffer, commands[i].indexCount, commands[i].instanceCount, commands[i].firstIndex, commands[i].vertexOffset, commands[i].firstInstance);
+                    }
+
+                    drawCallCount += count;
+                    break;
+                }
+            }
+        }
+
+        return drawCallCount;
+    }
+
+    uint32_t drawBatcher::getMeshlessDrawCount() const
+    {
+        if (m_meshlessCount == 0)
+        {
+            return 0;
+        }
+
+        return m_isBatched ? 1 : m_meshlessCount;
+    }
+
+    void drawBatcher::addInstance(drawInstance* instances, uint32_t slot, uint32_t objectIndex, arrayView<math::mat4> objectTransforms) const
+    {
+        drawInstance& instance = instances[slot];
+        instance.model = objectIndex < objectTransforms.size ? objectTransforms[objectIndex] : math::mat4::identity();
+        instance.objectIndex = objectIndex;
+    }
+}
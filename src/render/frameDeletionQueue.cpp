@@ -0,0 +1,42 @@
+#include "malpch.h"
+#include "frameDeletionQueue.h"
+
+namespace malachite
+{
+    void frameDeletionQueue::initalize(uint32_t framesInFlight)
+    {
+        m_frames.resize(framesInFlight);
+        m_frameIndex = 0;
+    }
+
+    void frameDeletionQueue::push(std::function<void()>&& destroy)
+    {
+        m_frames[m_frameIndex].push_back(std::move(destroy));
+    }
+
+    void frameDeletionQueue::advance()
+    {
+        //framesInFlight fences have been waited on since this slot was filled.
+        m_frameIndex = (m_frameIndex + 1) % m_frames.size();
+
+        for (std::function<void()>& destroy : m_frames[m_frameIndex])
+        {
+            destroy();
+        }
+
+        m_frames[m_frameIndex].clear();
+    }
+
+    void frameDeletionQueue::flush()
+    {
+        for (std::vector<std::function<void()>>& frame : m_frames)
+        {
+            for (std::function<void()>& destroy : frame)
+            {
+                destroy();
+            }
+
+            frame.clear();
+        }
+    }
+}
@@ -0,0 +1,765 @@
+#include "malpch.h"
+#include "gpuAllocator.h"
+
+#include <stdexcept>
+#include <algorithm>
+
+//Keeps tiny allocations from splintering blocks, and covers the offset alignment of most buffer uses.
+static constexpr VkDeviceSize c_minAllocationAlignment = 64;
+
+static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+{
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+static uint32_t findLastSetBit(uint64_t value)
+{
+    return 63 - (uint32_t) __builtin_clzll(value);
+}
+
+static uint32_t findFirstSetBit(uint64_t value)
+{
+    return (uint32_t) __builtin_ctzll(value);
+}
+
+namespace malachite
+{
+    ///
+    /// tlsfRangeAllocator
+    ///
+
+    void tlsfRangeAllocator::initalize(VkDeviceSize size, VkDeviceSize minAlignment)
+    {
+        m_regions.clear();
+        m_unusedRegions.clear();
+
+        m_firstLevelBitmap = 0;
+        std::fill(std::begin(m_secondLevelBitmaps), std::end(m_secondLevelBitmaps), 0u);
+        for (auto& freeList : m_freeLists)
+        {
+            std::fill(std::begin(freeList), std::end(freeList), c_invalidRegion);
+        }
+
+        m_size = size;
+        m_minAlignment = minAlignment;
+        m_usedBytes = 0;
+        m_freeRegionCount = 0;
+        m_allocationCount = 0;
+
+        insertFree(createRegion(0, size));
+    }
+
+    void tlsfRangeAllocator::getBucket(VkDeviceSize size, uint32_t& firstLevel, uint32_t& secondLevel)
+    {
+        //Small sizes get a bucket each, above that every power of two is split into c_secondLevelCount.
+        if (size < c_secondLevelCount)
+        {
+            firstLevel = 0;
+            secondLevel = (uint32_t) size;
+            return;
+        }
+
+        uint32_t topBit = findLastSetBit(size);
+        firstLevel = topBit - c_secondLevelBits + 1;
+        secondLevel = (uint32_t) (size >> (topBit - c_secondLevelBits)) - c_secondLevelCount;
+    }
+
+    uint32_t tlsfRangeAllocator::findFree(VkDeviceSize size) const
+    {
+        uint32_t firstLevel;
+        uint32_t secondLevel;
+        getBucket(size, firstLevel, secondLevel);
+
+        if (firstLevel >= c_firstLevelCount)
+        {
+            return c_invalidRegion;
+        }
+
+        //Rounded up to the next bucket, so whatever is found there fits without walking the list.
+        uint32_t roundedFirstLevel;
+        uint32_t roundedSecondLevel;
+        getBucket(size < c_secondLevelCount ? size : size + (VkDeviceSize(1) << (findLastSetBit(size) - c_secondLevelBits)) - 1, roundedFirstLevel, roundedSecondLevel);
+
+        if (roundedFirstLevel < c_firstLevelCount)
+        {
+            uint32_t secondLevelMap = m_secondLevelBitmaps[roundedFirstLevel] & (~0u << roundedSecondLevel);
+            if (secondLevelMap == 0 && roundedFirstLevel + 1 < c_firstLevelCount)
+            {
+                uint64_t firstLevelMap = m_firstLevelBitmap & (~0ull << (roundedFirstLevel + 1));
+                if (firstLevelMap != 0)
+                {
+                    roundedFirstLevel = findFirstSetBit(firstLevelMap);
+                    secondLevelMap = m_secondLevelBitmaps[roundedFirstLevel];
+                }
+            }
+
+            if (secondLevelMap != 0)
+            {
+                return m_freeLists[roundedFirstLevel][findFirstSetBit(secondLevelMap)];
+            }
+        }
+
+        //Nothing in the larger buckets, a region in the size's own bucket may still be large enough.
+        for (uint32_t index = m_freeLists[firstLevel][secondLevel]; index != c_invalidRegion; index = m_regions[index].nextFree)
+        {
+            if (m_regions[index].size >= size)
+            {
+                return index;
+            }
+        }
+
+        return c_invalidRegion;
+    }
+
+    uint32_t tlsfRangeAllocator::allocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset)
+    {
+        size = alignUp(std::max(size, VkDeviceSize(1)), m_minAlignment);
+        alignment = std::max(alignment, m_minAlignment);
+
+        //Free regions start on minAlignment, so this is the most padding alignment can cost.
+        uint32_t index = findFree(size + alignment - m_minAlignment);
+        if (index == c_invalidRegion)
+        {
+            return c_invalidRegion;
+        }
+
+        removeFree(index);
+
+        VkDeviceSize alignedOffset = alignUp(m_regions[index].offset, alignment);
+        VkDeviceSize padding = alignedOffset - m_regions[index].offset;
+
+        //Padding in front stays free, it can still merge with whatever is freed before it.
+        if (padding > 0)
+        {
+            uint32_t front = createRegion(m_regions[index].offset, padding);
+            m_regions[front].previousPhysical = m_regions[index].previousPhysical;
+            m_regions[front].nextPhysical = index;
+
+            if (m_regions[front].previousPhysical != c_invalidRegion)
+            {
+                m_regions[m_regions[front].previousPhysical].nextPhysical = front;
+            }
+
+            m_regions[index].previousPhysical = front;
+            m_regions[index].offset = alignedOffset;
+            m_regions[index].size -= padding;
+
+            insertFree(front);
+        }
+
+        if (m_regions[index].size > size)
+        {
+            uint32_t back = createRegion(alignedOffset + size, m_regions[index].size - size);
+            m_regions[back].previousPhysical = index;
+            m_regions[back].nextPhysical = m_regions[index].nextPhysical;
+
+            if (m_regions[back].nextPhysical != c_invalidRegion)
+            {
+                m_regions[m_regions[back].nextPhysical].previousPhysical = back;
+            }
+
+            m_regions[index].nextPhysical = back;
+            m_regions[index].size = size;
+
+            insertFree(back);
+        }
+
+        m_usedBytes += size;
+        m_allocationCount++;
+
+        offset = alignedOffset;
+        return index;
+    }
+
+    void tlsfRangeAllocator::free(uint32_t index)
+    {
+        m_usedBytes -= m_regions[index].size;
+        m_allocationCount--;
+
+        uint32_t previous = m_regions[index].previousPhysical;
+        if (previous != c_invalidRegion && m_regions[previous].isFree)
+        {
+            removeFree(previous);
+
+            m_regions[previous].size += m_regions[index].size;
+            m_regions[previous].nextPhysical = m_regions[index].nextPhysical;
+
+            if (m_regions[previous].nextPhysical != c_invalidRegion)
+            {
+                m_regions[m_regions[previous].nextPhysical].previousPhysical = previous;
+            }
+
+            destroyRegion(index);
+            index = previous;
+        }
+
+        uint32_t next = m_regions[index].nextPhysical;
+        if (next != c_invalidRegion && m_regions[next].isFree)
+        {
+            removeFree(next);
+
+            m_regions[index].size += m_regions[next].size;
+            m_regions[index].nextPhysical = m_regions[next].nextPhysical;
+
+            if (m_regions[index].nextPhysical != c_invalidRegion)
+            {
+                m_regions[m_regions[index].nextPhysical].previousPhysical = index;
+            }
+
+            destroyRegion(next);
+        }
+
+        insertFree(index);
+    }
+
+    VkDeviceSize tlsfRangeAllocator::getLargestFreeRegion() const
+    {
+        if (m_firstLevelBitmap == 0)
+        {
+            return 0;
+        }
+
+        //Only the top bucket can hold the largest region, its list isn't sorted though.
+        uint32_t firstLevel = findLastSetBit(m_firstLevelBitmap);
+        uint32_t secondLevel = findLastSetBit(m_secondLevelBitmaps[firstLevel]);
+
+        VkDeviceSize largest = 0;
+        for (uint32_t index = m_freeLists[firstLevel][secondLevel]; index != c_invalidRegion; index = m_regions[index].nextFree)
+        {
+            largest = std::max(largest, m_regions[index].size);
+        }
+
+        return largest;
+    }
+
+    uint32_t tlsfRangeAllocator::createRegion(VkDeviceSize offset, VkDeviceSize size)
+    {
+        uint32_t index;
+        if (!m_unusedRegions.empty())
+        {
+            index = m_unusedRegions.back();
+            m_unusedRegions.pop_back();
+        }
+        else
+        {
+            index = (uint32_t) m_regions.size();
+            m_regions.emplace_back();
+        }
+
+        m_regions[index] = {offset, size, c_invalidRegion, c_invalidRegion, c_invalidRegion, c_invalidRegion, false};
+        return index;
+    }
+
+    void tlsfRangeAllocator::destroyRegion(uint32_t index)
+    {
+        m_unusedRegions.push_back(index);
+    }
+
+    void tlsfRangeAllocator::insertFree(uint32_t index)
+    {
+        uint32_t firstLevel;
+        uint32_t secondLevel;
+        getBucket(m_regions[index].size, firstLevel, secondLevel);
+
+        uint32_t head = m_freeLists[firstLevel][secondLevel];
+
+        m_regions[index].isFree = true;
+        m_regions[index].previousFree = c_invalidRegion;
+        m_regions[index].nextFree = head;
+
+        if (head != c_invalidRegion)
+        {
+            m_regions[head].previousFree = index;
+        }
+
+        m_freeLists[firstLevel][secondLevel] = index;
+        m_secondLevelBitmaps[firstLevel] |= 1u << secondLevel;
+        m_firstLevelBitmap |= 1ull << firstLevel;
+        m_freeRegionCount++;
+    }
+
+    void tlsfRangeAllocator::removeFree(uint32_t index)
+    {
+        uint32_t firstLevel;
+        uint32_t secondLevel;
+        getBucket(m_regions[index].size, firstLevel, secondLevel);
+
+        region& freeRegion = m_regions[index];
+
+        if (freeRegion.previousFree != c_invalidRegion)
+        {
+            m_regions[freeRegion.previousFree].nextFree = freeRegion.nextFree;
+        }
+        else
+        {
+            m_freeLists[firstLevel][secondLevel] = freeRegion.nextFree;
+        }
+
+        if (freeRegion.nextFree != c_invalidRegion)
+        {
+            m_regions[freeRegion.nextFree].previousFree = freeRegion.previousFree;
+        }
+
+        if (m_freeLists[firstLevel][secondLevel] == c_invalidRegion)
+        {
+            m_secondLevelBitmaps[firstLevel] &= ~(1u << secondLevel);
+            if (m_secondLevelBitmaps[firstLevel] == 0)
+            {
+                m_firstLevelBitmap &= ~(1ull << firstLevel);
+            }
+        }
+
+        freeRegion.isFree = false;
+        m_freeRegionCount--;
+    }
+
+    ///
+    /// gpuAllocator
+    ///
+
+    void gpuAllocator::initalize(VkPhysicalDevice physicalDevice, VkDevice device, VkDeviceSize blockSize)
+    {
+        m_device = device;
+        m_blockSize = blockSize;
+
+        vkGetPhysicalDeviceMemoryProperties(physicalDevice, &m_memoryProperties);
+
+        VkPhysicalDeviceProperties deviceProperties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+        m_bufferImageGranularity = deviceProperties.limits.bufferImageGranularity;
+    }
+
+    void gpuAllocator::cleanup()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        for (memoryPool& pool : m_pools)
+        {
+            for (uint32_t blockIndex = 0; blockIndex < pool.blocks.size(); blockIndex++)
+            {
+                if (!pool.blocks[blockIndex])
+                {
+                    continue;
+                }
+
+                if (!pool.blocks[blockIndex]->ranges.isEmpty())
+                {
+                    MAL_LOG_ERROR("GPU memory still allocated on cleanup, allocations: ", std::to_string(pool.blocks[blockIndex]->ranges.getAllocationCount()));
+                }
+
+                destroyBlock(pool, blockIndex);
+            }
+        }
+
+        m_pools.clear();
+    }
+
+    uint32_t gpuAllocator::findMemoryType(uint32_t typeBits, e_memoryUsage usage) const
+    {
+        VkMemoryPropertyFlags required = 0;
+        VkMemoryPropertyFlags preferred = 0;
+        VkMemoryPropertyFlags avoided = 0;
+
+        switch (usage)
+        {
+            case e_memoryUsage::gpuOnly:
+            {
+                //Host visible device memory is scarce on discrete cards, leave it to what needs it.
+                preferred = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+                avoided = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+                break;
+            }
+            case e_memoryUsage::upload:
+            {
+                required = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+                break;
+            }
+            case e_memoryUsage::readback:
+            {
+                required = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+                preferred = VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+                break;
+            }
+        }
+
+        //Everything wanted first, then just the preferred flags, then just the required ones.
+        for (uint32_t pass = 0; pass < 3; pass++)
+        {
+            VkMemoryPropertyFlags wanted = required | (pass < 2 ? preferred : 0);
+            VkMemoryPropertyFlags unwanted = pass == 0 ? avoided : 0;
+
+            for (uint32_t i = 0; i < m_memoryProperties.memoryTypeCount; i++)
+            {
+                VkMemoryPropertyFlags flags = m_memoryProperties.memoryTypes[i].propertyFlags;
+
+                if ((typeBits & (1u << i)) && (flags & wanted) == wanted && (flags & unwanted) == 0)
+                {
+                    return i;
+                }
+            }
+        }
+
+        return ~0u;
+    }
+
+    uint32_t gpuAllocator::getPoolIndex(uint32_t memoryType, bool isOptimalImage)
+    {
+        //Without a granularity to respect everything can share blocks.
+        if (m_bufferImageGranularity <= 1)
+        {
+            isOptimalImage = false;
+        }
+
+        for (uint32_t i = 0; i < m_pools.size(); i++)
+        {
+            if (m_pools[i].memoryType == memoryType && m_pools[i].isOptimalImage == isOptimalImage)
+            {
+                return i;
+            }
+        }
+
+        memoryPool pool;
+        pool.memoryType = memoryType;
+        pool.isOptimalImage = isOptimalImage;
+        m_pools.push_back(std::move(pool));
+
+        return (uint32_t) m_pools.size() - 1;
+    }
+
+    VkDeviceSize gpuAllocator::getBlockSize(uint32_t memoryType) const
+    {
+        //Small heaps like the host visible part of VRAM would be taken whole by a single default block.
+        VkDeviceSize heapSize = m_memoryProperties.memoryHeaps[m_memoryProperties.memoryTypes[memoryType].heapIndex].size;
+        return std::min(m_blockSize, heapSize / 8);
+    }
+
+    gpuAllocator::memoryBlock* gpuAllocator::createBlock(memoryPool& pool, VkDeviceSize size, VkDeviceSize minimumSize, bool isDedicated, uint32_t& blockIndex)
+    {
+        const VkMemoryType& memoryType = m_memoryProperties.memoryTypes[pool.memoryType];
+        VkDeviceSize blockSize = std::max(size, minimumSize);
+
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        while (true)
+        {
+            VkMemoryAllocateInfo allocInfo{};
+            allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+            allocInfo.allocationSize = blockSize;
+            allocInfo.memoryTypeIndex = pool.memoryType;
+
+            if (vkAllocateMemory(m_device, &allocInfo, nullptr, &memory) == VK_SUCCESS)
+            {
+                break;
+            }
+
+            if (blockSize == minimumSize)
+            {
+                return nullptr;
+            }
+
+            blockSize = std::max(blockSize / 2, minimumSize);
+        }
+
+        auto block = std::make_unique<memoryBlock>();
+        block->memory = memory;
+        block->isDedicated = isDedicated;
+        block->ranges.initalize(blockSize, c_minAllocationAlignment);
+
+        if (memoryType.propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+        {
+            void* mapped;
+            if (vkMapMemory(m_device, memory, 0, VK_WHOLE_SIZE, 0, &mapped) != VK_SUCCESS)
+            {
+                vkFreeMemory(m_device, memory, nullptr);
+                throw std::runtime_error("failed to map gpu memory block!");
+            }
+
+            block->mapped = static_cast<char*>(mapped);
+        }
+
+        m_deviceAllocationCount++;
+
+        auto unusedSlot = std::find(pool.blocks.begin(), pool.blocks.end(), nullptr);
+        blockIndex = (uint32_t) (unusedSlot - pool.blocks.begin());
+
+        if (unusedSlot == pool.blocks.end())
+        {
+            pool.blocks.push_back(std::move(block));
+        }
+        else
+        {
+            *unusedSlot = std::move(block);
+        }
+
+        return pool.blocks[blockIndex].get();
+    }
+
+    void gpuAllocator::destroyBlock(memoryPool& pool, uint32_t blockIndex)
+    {
+        //Freeing implicitly unmaps.
+        vkFreeMemory(m_device, pool.blocks[blockIndex]->memory, nullptr);
+        pool.blocks[blockIndex].reset();
+
+        m_deviceAllocationCount--;
+    }
+
+    bool gpuAllocator::allocate(const VkMemoryRequirements& requirements, e_memoryUsage usage, bool isOptimalImage, gpuAllocation& allocation)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        uint32_t memoryType = findMemoryType(requirements.memoryTypeBits, usage);
+        if (memoryType == ~0u)
+        {
+            throw std::runtime_error("failed to find a suitable memory type!");
+        }
+
+        uint32_t poolIndex = getPoolIndex(memoryType, isOptimalImage);
+        memoryPool& pool = m_pools[poolIndex];
+
+        //Resources close to the block size get a block of their own instead of wasting the rest of one.
+        VkDeviceSize blockSize = getBlockSize(memoryType);
+        bool isDedicated = requirements.size > blockSize / 2;
+
+        uint32_t blockIndex = 0;
+        uint32_t region = tlsfRangeAllocator::c_invalidRegion;
+        VkDeviceSize offset = 0;
+
+        if (!isDedicated)
+        {
+            for (; blockIndex < pool.blocks.size(); blockIndex++)
+            {
+                if (pool.blocks[blockIndex])
+                {
+                    region = pool.blocks[blockIndex]->ranges.allocate(requirements.size, requirements.alignment, offset);
+                    if (region != tlsfRangeAllocator::c_invalidRegion)
+                    {
+                        break;
+                    }
+                }
+            }
+        }
+
+        if (region == tlsfRangeAllocator::c_invalidRegion)
+        {
+            //Padding can push an aligned allocation past the end of an exactly sized block.
+            VkDeviceSize minimumSize = alignUp(requirements.size, c_minAllocationAlignment) + std::max(requirements.alignment, c_minAllocationAlignment);
+
+            memoryBlock* block = createBlock(pool, isDedicated ? minimumSize : blockSize, minimumSize, isDedicated, blockIndex);
+            if (!block)
+            {
+                MAL_LOG_ERROR("Out of GPU memory allocating ", std::to_string(requirements.size), " bytes");
+                return false;
+            }
+
+            region = block->ranges.allocate(requirements.size, requirements.alignment, offset);
+        }
+
+        memoryBlock& block = *pool.blocks[blockIndex];
+
+        allocation.memory = block.memory;
+        allocation.offset = offset;
+        allocation.size = requirements.size;
+        allocation.mapped = block.mapped ? block.mapped + offset : nullptr;
+        allocation.pool = poolIndex;
+        allocation.block = blockIndex;
+        allocation.region = region;
+
+        return true;
+    }
+
+    void gpuAllocator::free(gpuAllocation& allocation)
+    {
+        if (!allocation.isValid())
+        {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        memoryPool& pool = m_pools[allocation.pool];
+        memoryBlock& block = *pool.blocks[allocation.block];
+
+        block.ranges.free(allocation.region);
+
+        //One empty block is kept around so a pool emptying and refilling every frame doesn't hit the driver.
+        if (block.ranges.isEmpty())
+        {
+            bool isOtherBlockEmpty = false;
+            for (uint32_t i = 0; i < pool.blocks.size(); i++)
+            {
+                isOtherBlockEmpty |= i != allocation.block && pool.blocks[i] && pool.blocks[i]->ranges.isEmpty();
+            }
+
+            if (isOtherBlockEmpty || block.isDedicated)
+            {
+                destroyBlock(pool, allocation.block);
+            }
+        }
+
+        allocation = gpuAllocation();
+    }
+
+    bool gpuAllocator::createBuffer(const VkBufferCreateInfo& bufferInfo, e_memoryUsage usage, VkBuffer& buffer, gpuAllocation& allocation)
+    {
+        if (vkCreateBuffer(m_device, &bufferInfo, nullptr, &buffer) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create buffer!");
+        }
+
+        VkMemoryRequirements requirements;
+        vkGetBufferMemoryRequirements(m_device, buffer, &requirements);
+
+        if (!allocate(requirements, usage, false, allocation))
+        {
+            vkDestroyBuffer(m_device, buffer, nullptr);
+            buffer = VK_NULL_HANDLE;
+            return false;
+        }
+
+        vkBindBufferMemory(m_device, buffer, allocation.memory, allocation.offset);
+        return true;
+    }
+
+    bool gpuAllocator::createImage(const VkImageCreateInfo& imageInfo, e_memoryUsage usage, VkImage& image, gpuAllocation& allocation)
+    {
+        if (vkCreateImage(m_device, &imageInfo, nullptr, &image) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create image!");
+        }
+
+        VkMemoryRequirements requirements;
+        vkGetImageMemoryRequirements(m_device, image, &requirements);
+
+        if (!allocate(requirements, usage, imageInfo.tiling == VK_IMAGE_TILING_OPTIMAL, allocation))
+        {
+            vkDestroyImage(m_device, image, nullptr);
+            image = VK_NULL_HANDLE;
+            return false;
+        }
+
+        vkBindImageMemory(m_device, image, allocation.memory, allocation.offset);
+        return true;
+    }
+
+    void gpuAllocator::destroyBuffer(VkBuffer& buffer, gpuAllocation& allocation)
+    {
+        vkDestroyBuffer(m_device, buffer, nullptr);
+        buffer = VK_NULL_HANDLE;
+
+        free(allocation);
+    }
+
+    void gpuAllocator::destroyImage(VkImage& image, gpuAllocation& allocation)
+    {
+        vkDestroyImage(m_device, image, nullptr);
+        image = VK_NULL_HANDLE;
+
+        free(allocation);
+    }
+
+    std::vector<gpuHeapStats> gpuAllocator::getHeapStats()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        std::vector<gpuHeapStats> heapStats(m_memoryProperties.memoryHeapCount);
+        for (uint32_t i = 0; i < m_memoryProperties.memoryHeapCount; i++)
+        {
+            heapStats[i].heapSize = m_memoryProperties.memoryHeaps[i].size;
+            heapStats[i].flags = m_memoryProperties.memoryHeaps[i].flags;
+        }
+
+        for (const memoryPool& pool : m_pools)
+        {
+            gpuHeapStats& stats = heapStats[m_memoryProperties.memoryTypes[pool.memoryType].heapIndex];
+
+            for (const std::unique_ptr<memoryBlock>& block : pool.blocks)
+            {
+                if (!block)
+                {
+                    continue;
+                }
+
+                stats.blockBytes += block->ranges.getSize();
+                stats.usedBytes += block->ranges.getUsedBytes();
+                stats.blockCount++;
+                stats.allocationCount += block->ranges.getAllocationCount();
+                stats.freeRegionCount += block->ranges.getFreeRegionCount();
+                stats.largestFreeRegion = std::max(stats.largestFreeRegion, block->ranges.getLargestFreeRegion());
+            }
+        }
+
+        return heapStats;
+    }
+
+    void gpuAllocator::logStats()
+    {
+        std::vector<gpuHeapStats> heapStats = getHeapStats();
+
+        for (size_t i = 0; i < heapStats.size(); i++)
+        {
+            const gpuHeapStats& stats = heapStats[i];
+            if (stats.blockCount == 0)
+            {
+                continue;
+            }
+
+            MAL_LOG_TRACE
+            (
+                "GPU Heap ", std::to_string(i), (stats.flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) ? " (device local)" : "",
+                " Used: ", std::to_string(stats.usedBytes / 1024), " KB",
+                " Reserved: ", std::to_string(stats.blockBytes / 1024), " KB in ", std::to_string(stats.blockCount), " blocks",
+                " Allocations: ", std::to_string(stats.allocationCount),
+                " Fragmentation: ", std::to_string(stats.getFragmentation())
+            );
+        }
+    }
+
+    uint32_t gpuAllocator::getDeviceAllocationCount()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_deviceAllocationCount;
+    }
+
+    ///
+    /// gpuLinearPool
+    ///
+
+    void gpuLinearPool::initalize(gpuAllocator& allocator, VkDeviceSize size, VkBufferUsageFlags usage)
+    {
+        m_allocator = &allocator;
+        m_head = 0;
+
+        VkBufferCreateInfo bufferInfo{};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = size;
+        bufferInfo.usage = usage;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        if (!m_allocator->createBuffer(bufferInfo, e_memoryUsage::upload, m_buffer, m_allocation))
+        {
+            throw std::runtime_error("failed to allocate linear pool!");
+        }
+    }
+
+    void gpuLinearPool::cleanup()
+    {
+        if (m_buffer)
+        {
+            m_allocator->destroyBuffer(m_buffer, m_allocation);
+        }
+    }
+
+    bool gpuLinearPool::allocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset, void*& mapped)
+    {
+        VkDeviceSize alignedHead = alignUp(m_head, std::max(alignment, VkDeviceSize(1)));
+        if (alignedHead + size > m_allocation.size)
+        {
+            return false;
+        }
+
+        offset = alignedHead;
+        mapped = static_cast<char*>(m_allocation.mapped) + alignedHead;
+        m_head = alignedHead + size;
+
+        return true;
+    }
+}
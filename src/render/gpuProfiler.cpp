@@ -0,0 +1,376 @@
+#include "malpch.h"
+#include "gpuProfiler.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+//Often enough to follow the drift between the clocks, and well inside the wrap of the fewest valid
+//bits a queue can report, 36 bits of nanosecond ticks wrap after about a minute.
+static constexpr std::chrono::seconds c_calibrationInterval(1);
+
+namespace malachite
+{
+    void gpuProfiler::initalize
+    (
+        VkPhysicalDevice physicalDevice,
+        VkDevice device,
+        VkQueue queue,
+        uint32_t queueFamilyIndex,
+        uint32_t framesInFlight,
+        profiler& profiler,
+        uint32_t maxScopesPerFrame
+    )
+    {
+        m_device = device;
+        m_queue = queue;
+        m_profiler = &profiler;
+        m_maxScopesPerFrame = maxScopesPerFrame;
+
+        uint32_t queueFamilyCount = 0;
+        vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+
+        std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+        vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+
+        uint32_t validBits = queueFamilyIndex < queueFamilyCount ? queueFamilies[queueFamilyIndex].timestampValidBits : 0;
+        if (validBits == 0)
+        {
+            MAL_LOG_TRACE("GPU timestamps aren't supported on the graphics queue, GPU profiling is off.");
+            return;
+        }
+
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+        m_nanosecondsPerTick = properties.limits.timestampPeriod;
+        m_timestampMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+
+        VkQueryPoolCreateInfo queryPoolInfo{};
+        queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        queryPoolInfo.queryCount = m_maxScopesPerFrame * 2;
+
+        m_frames.resize(framesInFlight);
+        for (frameQueries& frame : m_frames)
+        {
+            if (vkCreateQueryPool(m_device, &queryPoolInfo, nullptr, &frame.queryPool) != VK_SUCCESS)
+            {
+                throw std::runtime_error("failed to create timestamp query pool!");
+            }
+
+            frame.scopes.reserve(m_maxScopesPerFrame);
+        }
+
+        VkCommandPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+        poolInfo.queueFamilyIndex = queueFamilyIndex;
+
+        if (vkCreateCommandPool(m_device, &poolInfo, nullptr, &m_calibrationCommandPool) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create command pool!");
+        }
+
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = m_calibrationCommandPool;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandBufferCount = 1;
+
+        if (vkAllocateCommandBuffers(m_device, &allocInfo, &m_calibrationCommandBuffer) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to allocate command buffers!");
+        }
+
+        queryPoolInfo.queryCount = 1;
+        if (vkCreateQueryPool(m_device, &queryPoolInfo, nullptr, &m_calibrationQueryPool) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create timestamp query pool!");
+        }
+
+        VkFenceCreateInfo fenceInfo{};
+        fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+        if (vkCreateFence(m_device, &fenceInfo, nullptr, &m_calibrationFence) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create calibration fence!");
+        }
+
+        submitCalibration();
+        readCalibration(true);
+
+        m_track = profiler.addTrack("GPU");
+        m_isSupported = true;
+        m_isEnabled = true;
+    }
+
+    void gpuProfiler::cleanup()
+    {
+        for (frameQueries& frame : m_frames)
+        {
+            vkDestroyQueryPool(m_device, frame.queryPool, nullptr);
+        }
+
+        if (m_isCalibrating)
+        {
+            vkWaitForFences(m_device, 1, &m_calibrationFence, VK_TRUE, UINT64_MAX);
+        }
+
+        vkDestroyFence(m_device, m_calibrationFence, nullptr);
+        vkDestroyQueryPool(m_device, m_calibrationQueryPool, nullptr);
+        vkDestroyCommandPool(m_device, m_calibrationCommandPool, nullptr);
+
+        m_calibrationFence = VK_NULL_HANDLE;
+        m_calibrationQueryPool = VK_NULL_HANDLE;
+        m_calibrationCommandPool = VK_NULL_HANDLE;
+        m_calibrationCommandBuffer = VK_NULL_HANDLE;
+        m_isCalibrating = false;
+        m_isCalibrated = false;
+
+        m_frames.clear();
+        m_isSupported = false;
+        m_isEnabled = false;
+        m_isRecordingFrame = false;
+    }
+
+    void gpuProfiler::submitCalibration()
+    {
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+        vkBeginCommandBuffer(m_calibrationCommandBuffer, &beginInfo);
+        vkCmdResetQueryPool(m_calibrationCommandBuffer, m_calibrationQueryPool, 0, 1);
+        vkCmdWriteTimestamp(m_calibrationCommandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_calibrationQueryPool, 0);
+        vkEndCommandBuffer(m_calibrationCommandBuffer);
+
+        VkSubmitInfo submitInfo{};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &m_calibrationCommandBuffer;
+
+        m_calibrationSubmitTime = profiler::clock::now();
+        if (vkQueueSubmit(m_queue, 1, &submitInfo, m_calibrationFence) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to submit timestamp calibration!");
+        }
+
+        m_isCalibrating = true;
+    }
+
+    bool gpuProfiler::readCalibration(bool isWaiting)
+    {
+        if (isWaiting)
+        {
+            vkWaitForFences(m_device, 1, &m_calibrationFence, VK_TRUE, UINT64_MAX);
+        }
+        else if (vkGetFenceStatus(m_device, m_calibrationFence) != VK_SUCCESS)
+        {
+            return false;
+        }
+
+        profiler::clock::time_point signaledTime = profiler::clock::now();
+
+        uint64_t timestamp = 0;
+        vkGetQueryPoolResults(m_device, m_calibrationQueryPool, 0, 1, sizeof(timestamp), &timestamp, sizeof(timestamp), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+        timestamp &= m_timestampMask;
+
+        //The timestamp was taken somewhere between submitting and seeing the fence signaled. The first
+        //calibration takes the middle, later ones keep the current estimate unless it falls outside,
+        //then it's moved to the nearer edge, earlier or later. Frames are polled, so the window can be wide.
+        profiler::clock::time_point time = m_calibrationSubmitTime + (signaledTime - m_calibrationSubmitTime) / 2;
+        if (m_isCalibrated)
+        {
+            time = std::clamp(toCpuTime(timestamp), m_calibrationSubmitTime, signaledTime);
+        }
+
+        //Reanchored either way, timestamps never get far enough from it to wrap.
+        m_calibrationTimestamp = timestamp;
+        m_calibrationTime = time;
+        m_isCalibrated = true;
+        m_isCalibrating = false;
+
+        vkResetFences(m_device, 1, &m_calibrationFence);
+        return true;
+    }
+
+    profiler::clock::time_point gpuProfiler::toCpuTime(uint64_t timestamp) const
+    {
+        //Masked so timestamps with fewer valid bits still count up across a wrap. Frames recorded
+        //before a recalibration are behind it, the upper half of the range counts back.
+        uint64_t ticks = (timestamp - m_calibrationTimestamp) & m_timestampMask;
+        double signedTicks = ticks <= (m_timestampMask >> 1) ? (double) ticks : -(double) ((m_calibrationTimestamp - timestamp) & m_timestampMask);
+
+        std::chrono::duration<double, std::nano> elapsed(signedTicks * m_nanosecondsPerTick);
+        return m_calibrationTime + std::chrono::duration_cast<profiler::clock::duration>(elapsed);
+    }
+
+    bool gpuProfiler::collect(uint32_t frameIndex, profiler::clock::time_point* endTime)
+    {
+        if (!m_isSupported)
+        {
+            return false;
+        }
+
+        //The clocks drift apart, a calibration is kept in flight every so often while enabled.
+        if (m_isCalibrating)
+        {
+            readCalibration(false);
+        }
+        else if (m_isEnabled && profiler::clock::now() - m_calibrationSubmitTime >= c_calibrationInterval)
+        {
+            submitCalibration();
+        }
+
+        //Read at most once per submission, a frame that bailed out before submitting would otherwise
+        //hand over the results of the one before it again.
+        frameQueries& frame = m_frames[frameIndex];
+        if (frame.scopes.empty() || !frame.isSubmitted)
+        {
+            frame.scopes.clear();
+            frame.isSubmitted = false;
+            return false;
+        }
+
+        frame.isSubmitted = false;
+
+        uint32_t queryCount = (uint32_t) frame.scopes.size() * 2;
+        m_results.resize(queryCount * 2);
+
+        //Not ready only means some scope wasn't ended, the availability of each query says which.
+        VkResult result = vkGetQueryPoolResults
+        (
+            m_device, frame.queryPool, 0, queryCount,
+            m_results.size() * sizeof(uint64_t), m_results.data(), 2 * sizeof(uint64_t),
+            VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT
+        );
+
+        if (result != VK_SUCCESS && result != VK_NOT_READY)
+        {
+            MAL_LOG_ERROR("Failed to read GPU timestamps, VkResult ", std::to_string(result));
+            frame.scopes.clear();
+            return false;
+        }
+
+        //Work can't start before it was recorded or finish after its fence was waited on, which was before
+        //now. A calibration that says otherwise is moved later or earlier by the difference.
+        profiler::clock::time_point collectTime = profiler::clock::now();
+        profiler::clock::duration laterCorrection(0);
+        profiler::clock::duration earlierCorrection(0);
+
+        for (uint32_t i = 0; i < frame.scopes.size(); i++)
+        {
+            if (!frame.scopes[i].isEnded)
+            {
+                continue;
+            }
+
+            if (m_results[i * 4 + 1] != 0)
+            {
+                laterCorrection = std::max(laterCorrection, frame.recordTime - toCpuTime(m_results[i * 4]));
+            }
+
+            if (m_results[i * 4 + 3] != 0)
+            {
+                earlierCorrection = std::max(earlierCorrection, toCpuTime(m_results[i * 4 + 2]) - collectTime);
+            }
+        }
+
+        if (laterCorrection.count() > 0)
+        {
+            m_calibrationTime += laterCorrection;
+        }
+        else if (earlierCorrection.count() > 0)
+        {
+            m_calibrationTime -= earlierCorrection;
+        }
+
+        bool isCollected = false;
+        profiler::clock::time_point lastEndTime;
+
+        for (uint32_t i = 0; i < frame.scopes.size(); i++)
+        {
+            const scope& scope = frame.scopes[i];
+            if (!scope.isEnded || m_results[i * 4 + 1] == 0 || m_results[i * 4 + 3] == 0)
+            {
+                continue;
+            }
+
+            profiler::clock::time_point scopeEndTime = toCpuTime(m_results[i * 4 + 2]);
+            m_profiler->addEvent(m_track, scope.name, toCpuTime(m_results[i * 4]), scopeEndTime);
+
+            lastEndTime = isCollected ? std::max(lastEndTime, scopeEndTime) : scopeEndTime;
+            isCollected = true;
+        }
+
+        frame.scopes.clear();
+
+        if (isCollected && endTime)
+        {
+            *endTime = lastEndTime;
+        }
+
+        return isCollected;
+    }
+
+    void gpuProfiler::beginFrame(VkCommandBuffer commandBuffer, uint32_t frameIndex)
+    {
+        m_currentFrame = frameIndex;
+
+        //Enabling mid frame only takes effect from the next one, the pool wasn't reset for this one.
+        m_isRecordingFrame = m_isEnabled;
+        if (!m_isRecordingFrame)
+        {
+            return;
+        }
+
+        frameQueries& frame = m_frames[frameIndex];
+        frame.scopes.clear();
+        frame.recordTime = profiler::clock::now();
+        frame.isSubmitted = false;
+
+        vkCmdResetQueryPool(commandBuffer, frame.queryPool, 0, m_maxScopesPerFrame * 2);
+    }
+
+    void gpuProfiler::setFrameSubmitted(uint32_t frameIndex)
+    {
+        if (m_isSupported)
+        {
+            m_frames[frameIndex].isSubmitted = true;
+        }
+    }
+
+    uint32_t gpuProfiler::beginScope(VkCommandBuffer commandBuffer, const std::string& name)
+    {
+        if (!m_isRecordingFrame)
+        {
+            return c_invalidGpuScope;
+        }
+
+        frameQueries& frame = m_frames[m_currentFrame];
+        if (frame.scopes.size() >= m_maxScopesPerFrame)
+        {
+            return c_invalidGpuScope;
+        }
+
+        uint32_t scopeIndex = (uint32_t) frame.scopes.size();
+        frame.scopes.push_back({name, false});
+
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, frame.queryPool, scopeIndex * 2);
+        return scopeIndex;
+    }
+
+    void gpuProfiler::endScope(VkCommandBuffer commandBuffer, uint32_t scope)
+    {
+        if (scope == c_invalidGpuScope || !m_isRecordingFrame)
+        {
+            return;
+        }
+
+        frameQueries& frame = m_frames[m_currentFrame];
+
+        //Written once everything recorded before it has finished.
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, frame.queryPool, scope * 2 + 1);
+        frame.scopes[scope].isEnded = true;
+    }
+}
@@ -0,0 +1,381 @@
+#include "malpch.h"
+#include "meshBufferPool.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+//Index buffer offsets have to be a multiple of the index size.
+static constexpr VkDeviceSize c_indexAlignment = 4;
+
+namespace malachite
+{
+    void meshBufferPool::initalize
+    (
+        gpuAllocator& allocator,
+        frameDeletionQueue& deletionQueue,
+        VkDevice device,
+        VkQueue transferQueue,
+        uint32_t transferFamilyIndex,
+        uint32_t graphicsFamilyIndex,
+        VkDeviceSize vertexBytes,
+        VkDeviceSize indexBytes,
+        VkDeviceSize stagingSize
+    )
+    {
+        m_allocator = &allocator;
+        m_deletionQueue = &deletionQueue;
+        m_device = device;
+        m_queueFamilyIndices[0] = graphicsFamilyIndex;
+        m_queueFamilyIndices[1] = transferFamilyIndex;
+
+        createArena(m_vertices, vertexBytes, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+        createArena(m_indices, indexBytes, VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+
+        m_staging.initalize(allocator, device, transferQueue, transferFamilyIndex, stagingSize);
+    }
+
+    void meshBufferPool::cleanup()
+    {
+        m_staging.cleanup();
+
+        m_allocator->destroyBuffer(m_vertices.buffer, m_vertices.allocation);
+        m_allocator->destroyBuffer(m_indices.buffer, m_indices.allocation);
+
+        m_meshes.clear();
+        m_freeMeshes.clear();
+        m_pendingMeshes.clear();
+        m_stagedMeshes.clear();
+        m_releasedMeshes.clear();
+    }
+
+    void meshBufferPool::createArena(meshArena& arena, VkDeviceSize size, VkBufferUsageFlags usage)
+    {
+        VkBufferCreateInfo bufferInfo{};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = size;
+        bufferInfo.usage = usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+
+        //Written by the transfer queue and read by the graphics queue, sharing it skips the ownership transfer.
+        if (m_queueFamilyIndices[0] != m_queueFamilyIndices[1])
+        {
+            bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+            bufferInfo.queueFamilyIndexCount = 2;
+            bufferInfo.pQueueFamilyIndices = m_queueFamilyIndices;
+        }
+        else
+        {
+            bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        }
+
+        if (!m_allocator->createBuffer(bufferInfo, e_memoryUsage::gpuOnly, arena.buffer, arena.allocation))
+        {
+            throw std::runtime_error("failed to allocate mesh buffer!");
+        }
+
+        arena.ranges.initalize(size, c_indexAlignment);
+    }
+
+    meshId meshBufferPool::createMesh(arrayView<uint8_t> vertexData, uint32_t vertexStride, arrayView<uint32_t> indices)
+    {
+        if (vertexData.empty() || vertexStride == 0)
+        {
+            MAL_LOG_ERROR("Mesh created without vertices");
+            return c_invalidMesh;
+        }
+
+        meshBuffer mesh;
+        mesh.vertexBytes = vertexData.sizeBytes();
+
+        uint32_t vertexCount = (uint32_t) (vertexData.size / vertexStride);
+        mesh.indexCount = indices.empty() ? vertexCount : (uint32_t) indices.size;
+
+        //Half the index bandwidth whenever every vertex can be addressed with 16 bits.
+        mesh.indexType = vertexCount <= 65536 ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+        VkDeviceSize indexSize = mesh.indexType == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t);
+
+        mesh.indexBytes = mesh.indexCount * indexSize;
+        mesh.stagedIndexOffset = (mesh.vertexBytes + c_indexAlignment - 1) & ~(c_indexAlignment - 1);
+
+        //Draws address vertices in whole strides from the start of the buffer, so the range gets
+        //enough slack to start on a multiple of the stride.
+        VkDeviceSize rangeOffset;
+        mesh.vertexRegion = m_vertices.ranges.allocate(mesh.vertexBytes + vertexStride - 1, c_indexAlignment, rangeOffset);
+        mesh.vertexByteOffset = (rangeOffset + vertexStride - 1) / vertexStride * vertexStride;
+        mesh.vertexOffset = (int32_t) (mesh.vertexByteOffset / vertexStride);
+
+        mesh.indexRegion = m_indices.ranges.allocate(mesh.indexBytes, c_indexAlignment, mesh.indexByteOffset);
+        mesh.firstIndex = (uint32_t) (mesh.indexByteOffset / indexSize);
+
+        if (mesh.vertexRegion == tlsfRangeAllocator::c_invalidRegion || mesh.indexRegion == tlsfRangeAllocator::c_invalidRegion)
+        {
+            MAL_LOG_ERROR("Mesh buffers are full, mesh of ", std::to_string(vertexCount), " vertices dropped");
+            freeRanges(mesh);
+            return c_invalidMesh;
+        }
+
+        mesh.isUsed = true;
+
+        meshId id;
+        if (!m_freeMeshes.empty())
+        {
+            id = m_freeMeshes.back();
+            m_freeMeshes.pop_back();
+        }
+        else
+        {
+            id = (meshId) m_meshes.size();
+            m_meshes.emplace_back();
+        }
+
+        m_meshes[id] = std::move(mesh);
+
+        //Meshes waiting on the ring go first, so uploads finish in the order they were asked for.
+        stagingSpan span;
+        if (m_pendingMeshes.empty() && allocateStaging(m_meshes[id], span))
+        {
+            writeMeshData(m_meshes[id], static_cast<char*>(span.mapped), vertexData, indices);
+            recordCopy(id, span);
+        }
+        else
+        {
+            meshBuffer& pending = m_meshes[id];
+            pending.pendingData.resize((size_t) (pending.stagedIndexOffset + pending.indexBytes));
+            writeMeshData(pending, pending.pendingData.data(), vertexData, indices);
+
+            m_pendingMeshes.push_back(id);
+        }
+
+        return id;
+    }
+
+    void meshBufferPool::destroyMesh(meshId id)
+    {
+        if (id >= m_meshes.size() || !m_meshes[id].isUsed)
+        {
+            return;
+        }
+
+        meshBuffer& mesh = m_meshes[id];
+        mesh.isUsed = false;
+
+        auto pending = std::find(m_pendingMeshes.begin(), m_pendingMeshes.end(), id);
+        if (pending != m_pendingMeshes.end())
+        {
+            //The GPU never saw it.
+            m_pendingMeshes.erase(pending);
+            freeRanges(mesh);
+        }
+        else if (isUploaded(mesh))
+        {
+            //Frames in flight may still draw it.
+            uint32_t vertexRegion = mesh.vertexRegion;
+            uint32_t indexRegion = mesh.indexRegion;
+            m_deletionQueue->push([this, vertexRegion, indexRegion]()
+            {
+                m_vertices.ranges.free(vertexRegion);
+                m_indices.ranges.free(indexRegion);
+            });
+        }
+        else
+        {
+            //Still being copied into, the slot is kept until the copy is done.
+            mesh.isReleased = true;
+            m_releasedMeshes.push_back(id);
+            return;
+        }
+
+        mesh = meshBuffer();
+        m_freeMeshes.push_back(id);
+    }
+
+    void meshBufferPool::update()
+    {
+        m_staging.retire();
+
+        for (size_t i = 0; i < m_releasedMeshes.size();)
+        {
+            meshId id = m_releasedMeshes[i];
+            meshBuffer& mesh = m_meshes[id];
+
+            if (!isUploaded(mesh))
+            {
+                i++;
+                continue;
+            }
+
+            //Never drawn, nothing else can be using it.
+            freeRanges(mesh);
+            mesh = meshBuffer();
+            m_freeMeshes.push_back(id);
+
+            m_releasedMeshes[i] = m_releasedMeshes.back();
+            m_releasedMeshes.pop_back();
+        }
+
+        size_t stagedCount = 0;
+        for (; stagedCount < m_pendingMeshes.size(); stagedCount++)
+        {
+            meshId id = m_pendingMeshes[stagedCount];
+            meshBuffer& mesh = m_meshes[id];
+
+            stagingSpan span;
+            if (!allocateStaging(mesh, span))
+            {
+                break;
+            }
+
+            memcpy(span.mapped, mesh.pendingData.data(), mesh.pendingData.size());
+            mesh.pendingData = std::vector<char>();
+
+            recordCopy(id, span);
+        }
+
+        m_pendingMeshes.erase(m_pendingMeshes.begin(), m_pendingMeshes.begin() + stagedCount);
+
+        if (m_stagedMeshes.empty())
+        {
+            return;
+        }
+
+        //On the graphics queue the copies still have to be made visible to vertex input.
+        //A dedicated transfer queue can't wait on that stage, the fence has to do.
+        if (m_queueFamilyIndices[0] == m_queueFamilyIndices[1])
+        {
+            VkMemoryBarrier barrier{};
+            barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT;
+
+            vkCmdPipelineBarrier
+            (
+                m_staging.getCommandBuffer(),
+                VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+                0,
+                1, &barrier,
+                0, nullptr,
+                0, nullptr
+            );
+        }
+
+        uint64_t serial = m_staging.submit();
+        for (meshId id : m_stagedMeshes)
+        {
+            m_meshes[id].uploadSerial = serial;
+        }
+
+        m_stagedMeshes.clear();
+    }
+
+    bool meshBufferPool::isReady(meshId id) const
+    {
+        return id < m_meshes.size() && m_meshes[id].isUsed && isUploaded(m_meshes[id]);
+    }
+
+    bool meshBufferPool::recordDraw(VkCommandBuffer commandBuffer, meshId id, uint32_t instanceCount, uint32_t firstInstance) const
+    {
+        VkDrawIndexedIndirectCommand command;
+        VkIndexType indexType;
+        if (!getDrawCommand(id, command, indexType))
+        {
+            return false;
+        }
+
+        bindBuffers(commandBuffer, indexType);
+        vkCmdDrawIndexed(commandBuffer, command.indexCount, instanceCount, command.firstIndex, command.vertexOffset, firstInstance);
+
+        return true;
+    }
+
+    bool meshBufferPool::getDrawCommand(meshId id, VkDrawIndexedIndirectCommand& command, VkIndexType& indexType) const
+    {
+        if (!isReady(id))
+        {
+            return false;
+        }
+
+        const meshBuffer& mesh = m_meshes[id];
+
+        command.indexCount = mesh.indexCount;
+        command.instanceCount = 1;
+        command.firstIndex = mesh.firstIndex;
+        command.vertexOffset = mesh.vertexOffset;
+        command.firstInstance = 0;
+        indexType = mesh.indexType;
+
+        return true;
+    }
+
+    void meshBufferPool::bindBuffers(VkCommandBuffer commandBuffer, VkIndexType indexType) const
+    {
+        VkDeviceSize vertexOffset = 0;
+        vkCmdBindVertexBuffers(commandBuffer, 0, 1, &m_vertices.buffer, &vertexOffset);
+        vkCmdBindIndexBuffer(commandBuffer, m_indices.buffer, 0, indexType);
+    }
+
+    void meshBufferPool::freeRanges(meshBuffer& mesh)
+    {
+        if (mesh.vertexRegion != tlsfRangeAllocator::c_invalidRegion)
+        {
+            m_vertices.ranges.free(mesh.vertexRegion);
+        }
+
+        if (mesh.indexRegion != tlsfRangeAllocator::c_invalidRegion)
+        {
+            m_indices.ranges.free(mesh.indexRegion);
+        }
+
+        mesh.vertexRegion = tlsfRangeAllocator::c_invalidRegion;
+        mesh.indexRegion = tlsfRangeAllocator::c_invalidRegion;
+    }
+
+    bool meshBufferPool::allocateStaging(const meshBuffer& mesh, stagingSpan& span)
+    {
+        return m_staging.allocate(mesh.stagedIndexOffset + mesh.indexBytes, c_indexAlignment, span);
+    }
+
+    void meshBufferPool::recordCopy(meshId id, const stagingSpan& span)
+    {
+        const meshBuffer& mesh = m_meshes[id];
+        VkCommandBuffer commandBuffer = m_staging.getCommandBuffer();
+
+        VkBufferCopy vertexRegion{};
+        vertexRegion.srcOffset = span.offset;
+        vertexRegion.dstOffset = mesh.vertexByteOffset;
+        vertexRegion.size = mesh.vertexBytes;
+        vkCmdCopyBuffer(commandBuffer, span.buffer, m_vertices.buffer, 1, &vertexRegion);
+
+        VkBufferCopy indexRegion{};
+        indexRegion.srcOffset = span.offset + mesh.stagedIndexOffset;
+        indexRegion.dstOffset = mesh.indexByteOffset;
+        indexRegion.size = mesh.indexBytes;
+        vkCmdCopyBuffer(commandBuffer, span.buffer, m_indices.buffer, 1, &indexRegion);
+
+        m_stagedMeshes.push_back(id);
+    }
+
+    void meshBufferPool::writeMeshData(const meshBuffer& mesh, char* destination, arrayView<uint8_t> vertexData, arrayView<uint32_t> indices) const
+    {
+        memcpy(destination, vertexData.data, vertexData.sizeBytes());
+
+        char* indexDestination = destination + mesh.stagedIndexOffset;
+        for (uint32_t i = 0; i < mesh.indexCount; i++)
+        {
+            uint32_t index = indices.empty() ? i : indices[i];
+
+            if (mesh.indexType == VK_INDEX_TYPE_UINT16)
+            {
+                reinterpret_cast<uint16_t*>(indexDestination)[i] = (uint16_t) index;
+            }
+            else
+            {
+                reinterpret_cast<uint32_t*>(indexDestination)[i] = index;
+            }
+        }
+    }
+
+    bool meshBufferPool::isUploaded(const meshBuffer& mesh) const
+    {
+        return mesh.uploadSerial != 0 && mesh.uploadSerial <= m_staging.getCompletedSerial();
+    }
+}
@@ -0,0 +1,175 @@
+#include "malpch.h"
+#include "pipelineCache.h"
+#include "mappedFile.h"
+#include "hash.h"
+
+#include <fstream>
+#include <cstring>
+#include <vector>
+
+//Bump whenever the file layout changes.
+static constexpr uint32_t c_pipelineCacheVersion = 1;
+static constexpr char c_pipelineCacheMagic[4] = {'M', 'P', 'L', 'C'};
+
+//Drivers don't all validate what they're handed, the hash keeps truncated or corrupt data away from them.
+struct pipelineCacheFileHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t dataSize;
+    uint64_t dataHash;
+};
+
+//VkPipelineCacheHeaderVersionOne, read field by field since it is tightly packed.
+static constexpr size_t c_driverHeaderSize = 16 + VK_UUID_SIZE;
+
+namespace malachite
+{
+    void pipelineCache::initalize(VkPhysicalDevice physicalDevice, VkDevice device, const std::filesystem::path& cachePath)
+    {
+        m_device = device;
+        m_cachePath = cachePath;
+
+        vkGetPhysicalDeviceProperties(physicalDevice, &m_deviceProperties);
+
+        //Stays mapped until the driver copied the data into the cache.
+        mappedFile file;
+        m_isWarm = file.open(m_cachePath) && isCompatible(file.getData(), file.getSize());
+
+        VkPipelineCacheCreateInfo createInfo{};
+        createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+
+        if (m_isWarm)
+        {
+            createInfo.initialDataSize = file.getSize() - sizeof(pipelineCacheFileHeader);
+            createInfo.pInitialData = file.getData() + sizeof(pipelineCacheFileHeader);
+        }
+        else if (file.isOpen())
+        {
+            MAL_LOG_TRACE("Pipeline cache is stale or from another device, starting empty: ", m_cachePath);
+        }
+
+        if (vkCreatePipelineCache(m_device, &createInfo, nullptr, &m_pipelineCache) != VK_SUCCESS)
+        {
+            //A driver may still refuse data it wrote itself, an empty cache is always accepted.
+            createInfo.initialDataSize = 0;
+            createInfo.pInitialData = nullptr;
+            m_isWarm = false;
+
+            if (vkCreatePipelineCache(m_device, &createInfo, nullptr, &m_pipelineCache) != VK_SUCCESS)
+            {
+                throw std::runtime_error("failed to create pipeline cache!");
+            }
+        }
+
+        MAL_LOG_TRACE("Pipeline Cache: ", m_isWarm ? "loaded " + std::to_string(createInfo.initialDataSize) + " bytes" : "empty");
+    }
+
+    void pipelineCache::cleanup()
+    {
+        if (!m_pipelineCache)
+        {
+            return;
+        }
+
+        writeCacheFile();
+
+        vkDestroyPipelineCache(m_device, m_pipelineCache, nullptr);
+        m_pipelineCache = VK_NULL_HANDLE;
+    }
+
+    bool pipelineCache::isCompatible(const char* data, size_t size) const
+    {
+        if (size < sizeof(pipelineCacheFileHeader) + c_driverHeaderSize)
+        {
+            return false;
+        }
+
+        pipelineCacheFileHeader header;
+        memcpy(&header, data, sizeof(header));
+
+        const char* driverData = data + sizeof(header);
+        size_t driverDataSize = size - sizeof(header);
+
+        if (!std::equal(header.magic, header.magic + 4, c_pipelineCacheMagic) || header.version != c_pipelineCacheVersion ||
+            header.dataSize != driverDataSize || header.dataHash != fnv1a64(driverData, driverDataSize))
+        {
+            return false;
+        }
+
+        uint32_t driverHeader[4];
+        memcpy(driverHeader, driverData, sizeof(driverHeader));
+
+        uint32_t headerSize = driverHeader[0];
+        uint32_t headerVersion = driverHeader[1];
+        uint32_t vendorID = driverHeader[2];
+        uint32_t deviceID = driverHeader[3];
+
+        //A driver update changes the UUID, its old binaries are useless to the new one.
+        return headerSize >= c_driverHeaderSize && headerSize <= driverDataSize &&
+            headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+            vendorID == m_deviceProperties.vendorID &&
+            deviceID == m_deviceProperties.deviceID &&
+            memcmp(driverData + sizeof(driverHeader), m_deviceProperties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+    }
+
+    void pipelineCache::writeCacheFile() const
+    {
+        size_t dataSize = 0;
+        if (vkGetPipelineCacheData(m_device, m_pipelineCache, &dataSize, nullptr) != VK_SUCCESS || dataSize == 0)
+        {
+            return;
+        }
+
+        std::vector<char> data(dataSize);
+        if (vkGetPipelineCacheData(m_device, m_pipelineCache, &dataSize, data.data()) != VK_SUCCESS)
+        {
+            MAL_LOG_ERROR("Failed to read back pipeline cache data.");
+            return;
+        }
+
+        pipelineCacheFileHeader header{};
+        std::copy(c_pipelineCacheMagic, c_pipelineCacheMagic + 4, header.magic);
+        header.version = c_pipelineCacheVersion;
+        header.dataSize = dataSize;
+        header.dataHash = fnv1a64(data.data(), dataSize);
+
+        std::error_code error;
+        std::filesystem::create_directories(m_cachePath.parent_path(), error);
+
+        //Written next to the cache and renamed over it, a crash mid write leaves the old cache intact.
+        std::filesystem::path temporaryPath = m_cachePath;
+        temporaryPath += ".tmp";
+
+        {
+            std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+            if (!file.is_open())
+            {
+                MAL_LOG_ERROR("Failed to write pipeline cache: ", m_cachePath);
+                return;
+            }
+
+            file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            file.write(data.data(), dataSize);
+
+            if (!file.flush())
+            {
+                MAL_LOG_ERROR("Failed to write pipeline cache: ", m_cachePath);
+                file.close();
+                std::filesystem::remove(temporaryPath, error);
+                return;
+            }
+        }
+
+        std::filesystem::rename(temporaryPath, m_cachePath, error);
+
+        if (error)
+        {
+            MAL_LOG_ERROR("Failed to replace pipeline cache: ", m_cachePath);
+            std::filesystem::remove(temporaryPath, error);
+            return;
+        }
+
+        MAL_LOG_TRACE("Saved Pipeline Cache: ", std::to_string(dataSize), " bytes");
+    }
+}
@@ -0,0 +1,206 @@
+#include "malpch.h"
+#include "pipelineLayoutCache.h"
+#include "hash.h"
+
+#include <stdexcept>
+#include <algorithm>
+
+static uint64_t hashWords(const uint32_t* words, size_t count, uint64_t seed)
+{
+    return malachite::fnv1a64(reinterpret_cast<const char*>(words), count * sizeof(uint32_t), seed);
+}
+
+static bool isSameBinding(const VkDescriptorSetLayoutBinding& a, const VkDescriptorSetLayoutBinding& b)
+{
+    return a.binding == b.binding && a.descriptorType == b.descriptorType &&
+        a.descriptorCount == b.descriptorCount && a.stageFlags == b.stageFlags;
+}
+
+static bool isSamePushConstantRange(const VkPushConstantRange& a, const VkPushConstantRange& b)
+{
+    return a.stageFlags == b.stageFlags && a.offset == b.offset && a.size == b.size;
+}
+
+namespace malachite
+{
+    pipelineLayoutDescription pipelineLayoutDescription::fromReflection(const shaderReflection* stages, size_t stageCount)
+    {
+        pipelineLayoutDescription description;
+
+        VkPushConstantRange pushConstantRange{};
+        uint32_t pushConstantEnd = 0;
+
+        for (size_t i = 0; i < stageCount; i++)
+        {
+            const shaderReflection& stage = stages[i];
+
+            for (const reflectedDescriptorBinding& reflectedBinding : stage.descriptorBindings)
+            {
+                if (reflectedBinding.set >= description.descriptorSets.size())
+                {
+                    description.descriptorSets.resize(reflectedBinding.set + 1);
+                }
+
+                std::vector<VkDescriptorSetLayoutBinding>& bindings = description.descriptorSets[reflectedBinding.set];
+
+                auto existing = std::find_if(bindings.begin(), bindings.end(), [&](const VkDescriptorSetLayoutBinding& binding)
+                {
+                    return binding.binding == reflectedBinding.binding;
+                });
+
+                if (existing == bindings.end())
+                {
+                    VkDescriptorSetLayoutBinding binding{};
+                    binding.binding = reflectedBinding.binding;
+                    binding.descriptorType = reflectedBinding.descriptorType;
+                    binding.descriptorCount = reflectedBinding.descriptorCount;
+                    binding.stageFlags = stage.stage;
+                    binding.pImmutableSamplers = nullptr;
+
+                    bindings.push_back(binding);
+                    continue;
+                }
+
+                if (existing->descriptorType != reflectedBinding.descriptorType || existing->descriptorCount != reflectedBinding.descriptorCount)
+                {
+                    MAL_LOG_ERROR("Descriptor set ", std::to_string(reflectedBinding.set), " binding ", std::to_string(reflectedBinding.binding), " differs between stages");
+                    throw std::runtime_error("shader stages disagree on a descriptor binding!");
+                }
+
+                existing->stageFlags |= stage.stage;
+            }
+
+            //A single range covering every stage's block, flagged for every stage using it.
+            if (stage.pushConstantSize > 0)
+            {
+                uint32_t stageEnd = stage.pushConstantOffset + stage.pushConstantSize;
+
+                pushConstantRange.offset = pushConstantRange.stageFlags ? std::min(pushConstantRange.offset, stage.pushConstantOffset) : stage.pushConstantOffset;
+                pushConstantRange.stageFlags |= stage.stage;
+                pushConstantEnd = std::max(pushConstantEnd, stageEnd);
+            }
+        }
+
+        for (auto& bindings : description.descriptorSets)
+        {
+            std::sort(bindings.begin(), bindings.end(), [](const VkDescriptorSetLayoutBinding& a, const VkDescriptorSetLayoutBinding& b)
+            {
+                return a.binding < b.binding;
+            });
+        }
+
+        if (pushConstantRange.stageFlags)
+        {
+            pushConstantRange.size = pushConstantEnd - pushConstantRange.offset;
+            description.pushConstantRanges.push_back(pushConstantRange);
+        }
+
+        return description;
+    }
+
+    void pipelineLayoutCache::initalize(VkDevice device)
+    {
+        m_device = device;
+    }
+
+    void pipelineLayoutCache::cleanup()
+    {
+        for (auto& entry : m_pipelineLayouts)
+        {
+            vkDestroyPipelineLayout(m_device, entry.second.layout, nullptr);
+        }
+
+        for (auto& entry : m_descriptorSetLayouts)
+        {
+            vkDestroyDescriptorSetLayout(m_device, entry.second.layout, nullptr);
+        }
+
+        m_pipelineLayouts.clear();
+        m_descriptorSetLayouts.clear();
+    }
+
+    VkDescriptorSetLayout pipelineLayoutCache::getDescriptorSetLayout(const std::vector<VkDescriptorSetLayoutBinding>& bindings)
+    {
+        uint64_t hash = c_fnv1a64Offset;
+        for (const auto& binding : bindings)
+        {
+            uint32_t words[] = {binding.binding, (uint32_t) binding.descriptorType, binding.descriptorCount, binding.stageFlags};
+            hash = hashWords(words, 4, hash);
+        }
+
+        auto range = m_descriptorSetLayouts.equal_range(hash);
+        for (auto entry = range.first; entry != range.second; entry++)
+        {
+            if (std::equal(bindings.begin(), bindings.end(), entry->second.bindings.begin(), entry->second.bindings.end(), isSameBinding))
+            {
+                return entry->second.layout;
+            }
+        }
+
+        VkDescriptorSetLayoutCreateInfo layoutInfo{};
+        layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layoutInfo.bindingCount = (uint32_t) bindings.size();
+        layoutInfo.pBindings = bindings.data();
+
+        VkDescriptorSetLayout layout;
+        if (vkCreateDescriptorSetLayout(m_device, &layoutInfo, nullptr, &layout) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create descriptor set layout!");
+        }
+
+        m_descriptorSetLayouts.insert({hash, {bindings, layout}});
+
+        return layout;
+    }
+
+    VkPipelineLayout pipelineLayoutCache::getPipelineLayout(const pipelineLayoutDescription& description)
+    {
+        //Set layouts are deduplicated first, so equal sets compare by handle here.
+        std::vector<VkDescriptorSetLayout> setLayouts;
+        setLayouts.reserve(description.descriptorSets.size());
+
+        uint64_t hash = c_fnv1a64Offset;
+        for (const auto& bindings : description.descriptorSets)
+        {
+            VkDescriptorSetLayout setLayout = getDescriptorSetLayout(bindings);
+            setLayouts.push_back(setLayout);
+            hash = fnv1a64(reinterpret_cast<const char*>(&setLayout), sizeof(setLayout), hash);
+        }
+
+        for (const auto& range : description.pushConstantRanges)
+        {
+            uint32_t words[] = {range.stageFlags, range.offset, range.size};
+            hash = hashWords(words, 3, hash);
+        }
+
+        auto range = m_pipelineLayouts.equal_range(hash);
+        for (auto entry = range.first; entry != range.second; entry++)
+        {
+            const pipelineLayoutEntry& existing = entry->second;
+
+            if (existing.setLayouts == setLayouts &&
+                std::equal(description.pushConstantRanges.begin(), description.pushConstantRanges.end(),
+                    existing.pushConstantRanges.begin(), existing.pushConstantRanges.end(), isSamePushConstantRange))
+            {
+                return existing.layout;
+            }
+        }
+
+        VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipelineLayoutInfo.setLayoutCount = (uint32_t) setLayouts.size();
+        pipelineLayoutInfo.pSetLayouts = setLayouts.data();
+        pipelineLayoutInfo.pushConstantRangeCount = (uint32_t) description.pushConstantRanges.size();
+        pipelineLayoutInfo.pPushConstantRanges = description.pushConstantRanges.data();
+
+        VkPipelineLayout layout;
+        if (vkCreatePipelineLayout(m_device, &pipelineLayoutInfo, nullptr, &layout) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create pipeline layout!");
+        }
+
+        m_pipelineLayouts.insert({hash, {setLayouts, description.pushConstantRanges, layout}});
+
+        return layout;
+    }
+}
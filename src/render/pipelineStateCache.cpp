@@ -0,0 +1,530 @@
+#include "malpch.h"
+#include "pipelineStateCache.h"
+#include "spirvReflection.h"
+#include "shaderVariants.h"
+#include "hash.h"
+
+#include <stdexcept>
+#include <cstring>
+#include <chrono>
+
+template <typename T>
+static uint64_t hashBytes(const T& value, uint64_t seed)
+{
+    return malachite::fnv1a64(reinterpret_cast<const char*>(&value), sizeof(T), seed);
+}
+
+//The size goes in first so elements can't move between neighbouring vectors.
+template <typename T>
+static uint64_t hashVector(const std::vector<T>& values, uint64_t seed)
+{
+    uint64_t result = hashBytes(values.size(), seed);
+    return malachite::fnv1a64(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T), result);
+}
+
+template <typename T>
+static bool isSameBytes(const T& a, const T& b)
+{
+    return memcmp(&a, &b, sizeof(T)) == 0;
+}
+
+template <typename T>
+static bool isSameVector(const std::vector<T>& a, const std::vector<T>& b)
+{
+    return a.size() == b.size() && (a.empty() || memcmp(a.data(), b.data(), a.size() * sizeof(T)) == 0);
+}
+
+namespace malachite
+{
+    pipelineShader pipelineShader::create(arrayView<uint32_t> code)
+    {
+        pipelineShader shader;
+        shader.spirv = std::make_shared<const std::vector<uint32_t>>(code.begin(), code.end());
+        shader.hash = fnv1a64(reinterpret_cast<const char*>(code.data), code.sizeBytes());
+
+        return shader;
+    }
+
+    uint64_t pipelineDescription::hash() const
+    {
+        uint64_t result = hashBytes(vertexShader.hash, c_fnv1a64Offset);
+        result = hashBytes(fragmentShader.hash, result);
+        result = hashVector(specializationValues, result);
+        result = hashVector(vertexBindings, result);
+        result = hashVector(vertexAttributes, result);
+        result = hashBytes(raster, result);
+        result = hashBytes(blend, result);
+        result = hashBytes(depth, result);
+        result = hashBytes(renderPass, result);
+        result = hashBytes(subpass, result);
+
+        return result;
+    }
+
+    bool pipelineDescription::operator==(const pipelineDescription& other) const
+    {
+        return vertexShader.hash == other.vertexShader.hash && fragmentShader.hash == other.fragmentShader.hash &&
+            isSameVector(specializationValues, other.specializationValues) &&
+            isSameVector(vertexBindings, other.vertexBindings) &&
+            isSameVector(vertexAttributes, other.vertexAttributes) &&
+            isSameBytes(raster, other.raster) && isSameBytes(blend, other.blend) && isSameBytes(depth, other.depth) &&
+            renderPass == other.renderPass && subpass == other.subpass;
+    }
+
+    void pipelineStateCache::initalize(VkDevice device, VkPipelineCache driverCache, pipelineLayoutCache& layouts, threadPool& threads, frameDeletionQueue& deletionQueue)
+    {
+        m_device = device;
+        m_driverCache = driverCache;
+        m_layouts = &layouts;
+        m_threads = &threads;
+        m_deletionQueue = &deletionQueue;
+    }
+
+    void pipelineStateCache::cleanup()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        for (auto& [key, entry] : m_pipelines)
+        {
+            m_released.push_back(std::move(entry));
+        }
+
+        for (pipelineEntry& entry : m_released)
+        {
+            //Creations still queued on the pool are run here, so none is left referencing the cache.
+            entry.creation->run();
+            entry.pipeline.wait();
+
+            try
+            {
+                vkDestroyPipeline(m_device, entry.pipeline.get().pipeline, nullptr);
+            }
+            catch (const std::runtime_error&)
+            {
+                //Failed creations have nothing to destroy.
+            }
+        }
+
+        m_pipelines.clear();
+        m_released.clear();
+        m_unreported.clear();
+    }
+
+    cachedPipeline pipelineStateCache::getPipeline(const pipelineDescription& description)
+    {
+        uint64_t key = description.hash();
+        std::shared_ptr<pendingCreation> creation;
+        std::shared_future<cachedPipeline> pipeline;
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+
+            bool isAdded;
+            pipelineEntry& entry = findOrAdd(description, key, isAdded);
+            creation = entry.creation;
+            pipeline = entry.pipeline;
+        }
+
+        //Either runs the creation right here or waits for the thread that claimed it.
+        creation->run();
+        return pipeline.get();
+    }
+
+    cachedPipeline pipelineStateCache::requestPipeline(const pipelineDescription& description, const pipelineDescription* fallback)
+    {
+        uint64_t key = description.hash();
+        std::shared_future<cachedPipeline> pipeline;
+        std::shared_future<cachedPipeline> fallbackPipeline;
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+
+            bool isAdded;
+            pipelineEntry& entry = findOrAdd(description, key, isAdded);
+            pipeline = entry.pipeline;
+
+            if (isAdded)
+            {
+                std::shared_ptr<pendingCreation> creation = entry.creation;
+                m_threads->submit([creation]()
+                {
+                    creation->run();
+                });
+            }
+
+            //Only ever used when already there, a fallback is never created on demand.
+            pipelineEntry* fallbackEntry = fallback ? find(*fallback, fallback->hash()) : nullptr;
+            if (fallbackEntry)
+            {
+                fallbackPipeline = fallbackEntry->pipeline;
+            }
+        }
+
+        for (const std::shared_future<cachedPipeline>& candidate : {pipeline, fallbackPipeline})
+        {
+            if (!candidate.valid() || candidate.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+            {
+                continue;
+            }
+
+            try
+            {
+                return candidate.get();
+            }
+            catch (const std::runtime_error&)
+            {
+                //Logged by logCompletions, try the fallback.
+            }
+        }
+
+        return cachedPipeline();
+    }
+
+    e_pipelineStatus pipelineStateCache::getStatus(const pipelineDescription& description)
+    {
+        std::shared_future<cachedPipeline> pipeline;
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+
+            pipelineEntry* entry = find(description, description.hash());
+            if (!entry)
+            {
+                return e_pipelineStatus::missing;
+            }
+
+            pipeline = entry->pipeline;
+        }
+
+        if (pipeline.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        {
+            return e_pipelineStatus::pending;
+        }
+
+        try
+        {
+            pipeline.get();
+            return e_pipelineStatus::ready;
+        }
+        catch (const std::runtime_error&)
+        {
+            return e_pipelineStatus::failed;
+        }
+    }
+
+    void pipelineStateCache::releasePipeline(const pipelineDescription& description)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        auto range = m_pipelines.equal_range(description.hash());
+        for (auto it = range.first; it != range.second; it++)
+        {
+            if (it->second.description == description)
+            {
+                m_released.push_back(std::move(it->second));
+                m_pipelines.erase(it);
+                break;
+            }
+        }
+
+        queueReleased();
+    }
+
+    void pipelineStateCache::queueReleased()
+    {
+        for (size_t i = 0; i < m_released.size();)
+        {
+            const std::shared_future<cachedPipeline>& pipeline = m_released[i].pipeline;
+            if (pipeline.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+            {
+                i++;
+                continue;
+            }
+
+            try
+            {
+                VkDevice device = m_device;
+                VkPipeline releasedPipeline = pipeline.get().pipeline;
+
+                m_deletionQueue->push([device, releasedPipeline]()
+                {
+                    vkDestroyPipeline(device, releasedPipeline, nullptr);
+                });
+            }
+            catch (const std::runtime_error&)
+            {
+                //Failed creations have nothing to destroy.
+            }
+
+            m_released[i] = std::move(m_released.back());
+            m_released.pop_back();
+        }
+    }
+
+    void pipelineStateCache::logCompletions()
+    {
+        std::vector<std::shared_future<cachedPipeline>> completed;
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+
+            queueReleased();
+
+            for (size_t i = 0; i < m_unreported.size();)
+            {
+                if (m_unreported[i].wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+                {
+                    i++;
+                    continue;
+                }
+
+                completed.push_back(std::move(m_unreported[i]));
+                m_unreported[i] = std::move(m_unreported.back());
+                m_unreported.pop_back();
+            }
+        }
+
+        for (const std::shared_future<cachedPipeline>& pipeline : completed)
+        {
+            try
+            {
+                MAL_LOG_TRACE("Created Graphics Pipeline in ", std::to_string(pipeline.get().createMilliseconds), " ms");
+            }
+            catch (const std::runtime_error& error)
+            {
+                MAL_LOG_ERROR("Failed to create graphics pipeline: ", error.what());
+            }
+        }
+    }
+
+    size_t pipelineStateCache::getPipelineCount()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_pipelines.size();
+    }
+
+    pipelineStateCache::pipelineEntry* pipelineStateCache::find(const pipelineDescription& description, uint64_t key)
+    {
+        auto range = m_pipelines.equal_range(key);
+        for (auto it = range.first; it != range.second; it++)
+        {
+            if (it->second.description == description)
+            {
+                return &it->second;
+            }
+        }
+
+        return nullptr;
+    }
+
+    pipelineStateCache::pipelineEntry& pipelineStateCache::findOrAdd(const pipelineDescription& description, uint64_t key, bool& isAdded)
+    {
+        pipelineEntry* found = find(description, key);
+        isAdded = !found;
+
+        if (found)
+        {
+            return *found;
+        }
+
+        //The entry keeps its own copy, shaders are shared so this doesn't copy SPIR-V.
+        pipelineEntry entry;
+        entry.description = description;
+        entry.creation = std::make_shared<pendingCreation>();
+        entry.creation->task = std::packaged_task<cachedPipeline()>([this, description]()
+        {
+            return createPipeline(description);
+        });
+        entry.pipeline = entry.creation->task.get_future().share();
+        m_unreported.push_back(entry.pipeline);
+
+        return m_pipelines.emplace(key, std::move(entry))->second;
+    }
+
+    VkShaderModule pipelineStateCache::createShaderModule(const pipelineShader& shader)
+    {
+        VkShaderModuleCreateInfo createInfo{};
+        createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+        createInfo.codeSize = shader.spirv->size() * sizeof(uint32_t);
+        createInfo.pCode = shader.spirv->data();
+
+        VkShaderModule shaderModule;
+        if (vkCreateShaderModule(m_device, &createInfo, nullptr, &shaderModule) != VK_SUCCESS)
+        {
+            return VK_NULL_HANDLE;
+        }
+
+        return shaderModule;
+    }
+
+    cachedPipeline pipelineStateCache::createPipeline(const pipelineDescription& description)
+    {
+        auto createStartTime = std::chrono::steady_clock::now();
+
+        //Layouts and vertex inputs come from the shaders themselves instead of being written by hand.
+        shaderReflection stageReflections[2];
+        if (!reflectSpirv(*description.vertexShader.spirv, stageReflections[0]) || !reflectSpirv(*description.fragmentShader.spirv, stageReflections[1]))
+        {
+            throw std::runtime_error("failed to reflect shader modules!");
+        }
+
+        cachedPipeline result;
+
+        //Pipeline layout, shared with every other pipeline whose shaders declare the same resources
+        {
+            std::lock_guard<std::mutex> lock(m_layoutMutex);
+            result.layout = m_layouts->getPipelineLayout(pipelineLayoutDescription::fromReflection(stageReflections, 2));
+        }
+
+        VkShaderModule vertexModule = createShaderModule(description.vertexShader);
+        VkShaderModule fragmentModule = createShaderModule(description.fragmentShader);
+
+        //Specialization keywords are baked in here, compiled keywords already picked the modules.
+        shaderSpecialization specialization;
+        specialization.build(description.specializationValues);
+
+        VkPipelineShaderStageCreateInfo shaderStages[2]{};
+        shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+        shaderStages[0].module = vertexModule;
+        shaderStages[0].pName = "main";
+        shaderStages[0].pSpecializationInfo = specialization.get();
+
+        shaderStages[1] = shaderStages[0];
+        shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+        shaderStages[1].module = fragmentModule;
+
+        //
+        //Input Assembly//
+        //
+
+        std::vector<VkVertexInputBindingDescription> vertexBindings = description.vertexBindings;
+        std::vector<VkVertexInputAttributeDescription> vertexAttributes = description.vertexAttributes;
+
+        if (vertexBindings.empty() && vertexAttributes.empty())
+        {
+            buildVertexInputLayout(stageReflections[0], vertexBindings, vertexAttributes);
+        }
+
+        VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
+        vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+        vertexInputInfo.vertexBindingDescriptionCount = (uint32_t) vertexBindings.size();
+        vertexInputInfo.pVertexBindingDescriptions = vertexBindings.data();
+        vertexInputInfo.vertexAttributeDescriptionCount = (uint32_t) vertexAttributes.size();
+        vertexInputInfo.pVertexAttributeDescriptions = vertexAttributes.data();
+
+        VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+        inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+        inputAssembly.topology = description.raster.topology;
+        inputAssembly.primitiveRestartEnable = VK_FALSE;
+
+        //
+        //Viewports and scissors//
+        //
+
+        VkDynamicState dynamicStates[] =
+        {
+            VK_DYNAMIC_STATE_VIEWPORT,
+            VK_DYNAMIC_STATE_SCISSOR
+        };
+
+        VkPipelineDynamicStateCreateInfo dynamicState{};
+        dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+        dynamicState.dynamicStateCount = 2;
+        dynamicState.pDynamicStates = dynamicStates;
+
+        VkPipelineViewportStateCreateInfo viewportState{};
+        viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+        viewportState.viewportCount = 1;
+        viewportState.scissorCount = 1;
+
+        //Rasterizing
+        VkPipelineRasterizationStateCreateInfo rasterizer{};
+        rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+        rasterizer.depthClampEnable = VK_FALSE;
+        rasterizer.rasterizerDiscardEnable = VK_FALSE;
+        rasterizer.polygonMode = description.raster.polygonMode;
+        rasterizer.lineWidth = 1.0f;
+        rasterizer.cullMode = description.raster.cullMode;
+        rasterizer.frontFace = description.raster.frontFace;
+        rasterizer.depthBiasEnable = VK_FALSE;
+
+        // Multisampling
+        VkPipelineMultisampleStateCreateInfo multisampling{};
+        multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+        multisampling.sampleShadingEnable = VK_FALSE;
+        multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+        multisampling.minSampleShading = 1.0f;
+
+        //
+        //Depth and Stencil testing//
+        //
+
+        VkPipelineDepthStencilStateCreateInfo depthStencil{};
+        depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+        depthStencil.depthTestEnable = description.depth.isTestEnabled;
+        depthStencil.depthWriteEnable = description.depth.isWriteEnabled;
+        depthStencil.depthCompareOp = description.depth.compareOp;
+        depthStencil.depthBoundsTestEnable = VK_FALSE;
+        depthStencil.stencilTestEnable = VK_FALSE;
+
+        bool isDepthUsed = description.depth.isTestEnabled || description.depth.isWriteEnabled;
+
+        //Color blending
+        VkPipelineColorBlendAttachmentState colorBlendAttachment{};
+        colorBlendAttachment.colorWriteMask = description.blend.colorWriteMask;
+        colorBlendAttachment.blendEnable = description.blend.isEnabled;
+        colorBlendAttachment.srcColorBlendFactor = description.blend.srcColorFactor;
+        colorBlendAttachment.dstColorBlendFactor = description.blend.dstColorFactor;
+        colorBlendAttachment.colorBlendOp = description.blend.colorOp;
+        colorBlendAttachment.srcAlphaBlendFactor = description.blend.srcAlphaFactor;
+        colorBlendAttachment.dstAlphaBlendFactor = description.blend.dstAlphaFactor;
+        colorBlendAttachment.alphaBlendOp = description.blend.alphaOp;
+
+        VkPipelineColorBlendStateCreateInfo colorBlending{};
+        colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+        colorBlending.logicOpEnable = VK_FALSE;
+        colorBlending.logicOp = VK_LOGIC_OP_COPY;
+        colorBlending.attachmentCount = 1;
+        colorBlending.pAttachments = &colorBlendAttachment;
+
+        VkGraphicsPipelineCreateInfo pipelineInfo{};
+        pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+        pipelineInfo.stageCount = 2;
+        pipelineInfo.pStages = shaderStages;
+        pipelineInfo.pVertexInputState = &vertexInputInfo;
+        pipelineInfo.pInputAssemblyState = &inputAssembly;
+        pipelineInfo.pViewportState = &viewportState;
+        pipelineInfo.pRasterizationState = &rasterizer;
+        pipelineInfo.pMultisampleState = &multisampling;
+        pipelineInfo.pDepthStencilState = isDepthUsed ? &depthStencil : nullptr;
+        pipelineInfo.pColorBlendState = &colorBlending;
+        pipelineInfo.pDynamicState = &dynamicState;
+        pipelineInfo.layout = result.layout;
+        pipelineInfo.renderPass = description.renderPass;
+        pipelineInfo.subpass = description.subpass;
+        pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+        pipelineInfo.basePipelineIndex = -1;
+
+        VkResult status = VK_ERROR_INITIALIZATION_FAILED;
+        if (vertexModule && fragmentModule)
+        {
+            status = vkCreateGraphicsPipelines(m_device, m_driverCache, 1, &pipelineInfo, nullptr, &result.pipeline);
+        }
+
+        //Modules are only needed while the pipeline is created.
+        vkDestroyShaderModule(m_device, vertexModule, nullptr);
+        vkDestroyShaderModule(m_device, fragmentModule, nullptr);
+
+        if (status != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create graphics pipeline!");
+        }
+
+        //Usually runs on a worker, logCompletions reports it from the main thread.
+        std::chrono::duration<double, std::milli> createTime = std::chrono::steady_clock::now() - createStartTime;
+        result.createMilliseconds = createTime.count();
+
+        return result;
+    }
+}
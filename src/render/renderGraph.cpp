@@ -0,0 +1,1023 @@
+#include "malpch.h"
+#include "renderGraph.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+static constexpr VkAccessFlags c_writeAccess =
+    VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+    VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+    VK_ACCESS_SHADER_WRITE_BIT |
+    VK_ACCESS_TRANSFER_WRITE_BIT;
+
+static bool isDepthFormat(VkFormat format)
+{
+    switch (format)
+    {
+        case VK_FORMAT_D16_UNORM:
+        case VK_FORMAT_X8_D24_UNORM_PACK32:
+        case VK_FORMAT_D32_SFLOAT:
+        case VK_FORMAT_D16_UNORM_S8_UINT:
+        case VK_FORMAT_D24_UNORM_S8_UINT:
+        case VK_FORMAT_D32_SFLOAT_S8_UINT:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static bool hasStencil(VkFormat format)
+{
+    return format == VK_FORMAT_D16_UNORM_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT || format == VK_FORMAT_D32_SFLOAT_S8_UINT;
+}
+
+static VkImageAspectFlags getAspectMask(VkFormat format)
+{
+    if (!isDepthFormat(format))
+    {
+        return VK_IMAGE_ASPECT_COLOR_BIT;
+    }
+
+    return VK_IMAGE_ASPECT_DEPTH_BIT | (hasStencil(format) ? VK_IMAGE_ASPECT_STENCIL_BIT : 0);
+}
+
+static bool isAttachment(malachite::e_renderGraphAccess access)
+{
+    return access == malachite::e_renderGraphAccess::colorAttachment || access == malachite::e_renderGraphAccess::depthAttachment;
+}
+
+namespace malachite
+{
+    renderGraphPassBuilder& renderGraphPassBuilder::writeColor(renderGraphResource texture, const VkClearColorValue* clearValue)
+    {
+        renderGraph::resourceUse use{};
+        use.texture = texture;
+        use.access = e_renderGraphAccess::colorAttachment;
+        use.stages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        use.isWrite = true;
+        use.isCleared = clearValue != nullptr;
+
+        if (clearValue)
+        {
+            use.clearValue.color = *clearValue;
+        }
+
+        m_graph.addUse(m_pass, use);
+        return *this;
+    }
+
+    renderGraphPassBuilder& renderGraphPassBuilder::writeDepth(renderGraphResource texture, const VkClearDepthStencilValue* clearValue)
+    {
+        renderGraph::resourceUse use{};
+        use.texture = texture;
+        use.access = e_renderGraphAccess::depthAttachment;
+        use.stages = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+        use.isWrite = true;
+        use.isCleared = clearValue != nullptr;
+
+        if (clearValue)
+        {
+            use.clearValue.depthStencil = *clearValue;
+        }
+
+        m_graph.addUse(m_pass, use);
+        return *this;
+    }
+
+    renderGraphPassBuilder& renderGraphPassBuilder::read(renderGraphResource texture, e_renderGraphAccess access, VkPipelineStageFlags stages)
+    {
+        renderGraph::resourceUse use{};
+        use.texture = texture;
+        use.access = access;
+        use.stages = stages;
+        use.isWrite = false;
+
+        m_graph.addUse(m_pass, use);
+        return *this;
+    }
+
+    renderGraphPassBuilder& renderGraphPassBuilder::write(renderGraphResource texture, e_renderGraphAccess access, VkPipelineStageFlags stages)
+    {
+        renderGraph::resourceUse use{};
+        use.texture = texture;
+        use.access = access;
+        use.stages = stages;
+        use.isWrite = true;
+
+        m_graph.addUse(m_pass, use);
+        return *this;
+    }
+
+    renderGraphPassBuilder& renderGraphPassBuilder::setSecondaryCommandBuffers(bool isSecondary)
+    {
+        m_graph.m_passes[m_pass].isSecondary = isSecondary;
+        return *this;
+    }
+
+    renderGraphPassBuilder& renderGraphPassBuilder::setSideEffects()
+    {
+        m_graph.m_passes[m_pass].hasSideEffects = true;
+        return *this;
+    }
+
+    void renderGraph::initalize(gpuAllocator& allocator, frameDeletionQueue& deletionQueue, VkDevice device, gpuProfiler* profiler)
+    {
+        m_allocator = &allocator;
+        m_deletionQueue = &deletionQueue;
+        m_device = device;
+        m_profiler = profiler;
+    }
+
+    void renderGraph::cleanup()
+    {
+        //Queued, the caller flushes the deletion queue afterwards.
+        releaseTransients();
+        releaseFramebuffers();
+
+        for (auto& [key, renderPass] : m_renderPasses)
+        {
+            vkDestroyRenderPass(m_device, renderPass, nullptr);
+        }
+
+        m_renderPasses.clear();
+        reset();
+    }
+
+    void renderGraph::reset()
+    {
+        m_passes.clear();
+        m_resources.clear();
+        m_executionOrder.clear();
+        m_barriers.clear();
+        m_finalBarriers.clear();
+        m_finalSourceStages = 0;
+        m_barrierCount = 0;
+    }
+
+    renderGraphResource renderGraph::importTexture
+    (
+        const char* name,
+        VkImage image,
+        VkImageView imageView,
+        const renderGraphTextureDesc& desc,
+        const renderGraphTextureState& initialState,
+        VkImageLayout finalLayout,
+        bool isOutput
+    )
+    {
+        resource texture;
+        texture.name = name;
+        texture.desc = desc;
+        texture.isImported = true;
+        texture.isOutput = isOutput;
+        texture.image = image;
+        texture.imageView = imageView;
+        texture.initialState = initialState;
+        texture.finalLayout = finalLayout;
+
+        m_resources.push_back(std::move(texture));
+        return (renderGraphResource) (m_resources.size() - 1);
+    }
+
+    renderGraphResource renderGraph::createTexture(const char* name, const renderGraphTextureDesc& desc)
+    {
+        resource texture;
+        texture.name = name;
+        texture.desc = desc;
+
+        m_resources.push_back(std::move(texture));
+        return (renderGraphResource) (m_resources.size() - 1);
+    }
+
+    renderGraphPassBuilder renderGraph::addPass(const char* name, renderGraphExecute&& execute)
+    {
+        pass newPass;
+        newPass.name = name;
+        newPass.execute = std::move(execute);
+
+        m_passes.push_back(std::move(newPass));
+        return renderGraphPassBuilder(*this, (uint32_t) (m_passes.size() - 1));
+    }
+
+    void renderGraph::addUse(uint32_t passIndex, const resourceUse& use)
+    {
+        if (use.texture >= m_resources.size())
+        {
+            MAL_LOG_ERROR("Render graph pass ", m_passes[passIndex].name, " uses a texture that doesn't exist");
+            return;
+        }
+
+        m_passes[passIndex].uses.push_back(use);
+    }
+
+    void renderGraph::compile()
+    {
+        cullPasses();
+        computeLifetimes();
+        allocateTransients();
+        buildBarriers();
+        createRenderPasses();
+    }
+
+    void renderGraph::cullPasses()
+    {
+        //Liveness walked backwards from the outputs. A pass is kept when something live reads what it
+        //writes, a cleared attachment kills whatever wrote the texture before it.
+        std::vector<bool> isLive(m_resources.size());
+        for (size_t i = 0; i < m_resources.size(); i++)
+        {
+            isLive[i] = m_resources[i].isOutput;
+        }
+
+        for (size_t i = m_passes.size(); i-- > 0;)
+        {
+            pass& pass = m_passes[i];
+
+            bool isNeeded = pass.hasSideEffects;
+            for (const resourceUse& use : pass.uses)
+            {
+                isNeeded |= use.isWrite && isLive[use.texture];
+            }
+
+            pass.isCulled = !isNeeded;
+            if (pass.isCulled)
+            {
+                continue;
+            }
+
+            //Imported textures outlive the graph, so their attachments are always stored.
+            for (resourceUse& use : pass.uses)
+            {
+                use.isStored = isLive[use.texture] || m_resources[use.texture].isImported;
+            }
+
+            for (const resourceUse& use : pass.uses)
+            {
+                if (use.isWrite && use.isCleared)
+                {
+                    isLive[use.texture] = false;
+                }
+            }
+
+            //Loaded attachments and partial writes keep the previous contents.
+            for (const resourceUse& use : pass.uses)
+            {
+                if (!use.isWrite || !use.isCleared)
+                {
+                    isLive[use.texture] = true;
+                }
+            }
+        }
+
+        m_executionOrder.clear();
+        for (uint32_t i = 0; i < m_passes.size(); i++)
+        {
+            if (!m_passes[i].isCulled)
+            {
+                m_executionOrder.push_back(i);
+            }
+        }
+    }
+
+    void renderGraph::computeLifetimes()
+    {
+        for (uint32_t order = 0; order < m_executionOrder.size(); order++)
+        {
+            for (const resourceUse& use : m_passes[m_executionOrder[order]].uses)
+            {
+                resource& texture = m_resources[use.texture];
+                texture.firstUse = std::min(texture.firstUse, order);
+                texture.lastUse = std::max(texture.lastUse, order);
+
+                switch (use.access)
+                {
+                    case e_renderGraphAccess::colorAttachment: texture.usage |= VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT; break;
+                    case e_renderGraphAccess::depthAttachment: texture.usage |= VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT; break;
+                    case e_renderGraphAccess::sampled: texture.usage |= VK_IMAGE_USAGE_SAMPLED_BIT; break;
+                    case e_renderGraphAccess::storageRead:
+                    case e_renderGraphAccess::storageWrite: texture.usage |= VK_IMAGE_USAGE_STORAGE_BIT; break;
+                    case e_renderGraphAccess::transferSource: texture.usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT; break;
+                    case e_renderGraphAccess::transferDestination: texture.usage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT; break;
+                }
+            }
+        }
+    }
+
+    void renderGraph::allocateTransients()
+    {
+        std::vector<uint32_t> transients;
+        std::vector<uint64_t> signature;
+
+        for (uint32_t i = 0; i < m_resources.size(); i++)
+        {
+            const resource& texture = m_resources[i];
+            if (texture.isImported || texture.firstUse == UINT32_MAX)
+            {
+                continue;
+            }
+
+            transients.push_back(i);
+            signature.insert(signature.end(),
+            {
+                i, (uint64_t) texture.desc.format, texture.desc.extent.width, texture.desc.extent.height,
+                (uint64_t) texture.desc.samples, texture.usage, texture.firstUse, texture.lastUse
+            });
+        }
+
+        //Same shape as last frame, the images and their placement carry over.
+        if (signature == m_transientSignature && transients.size() == m_transientTextures.size())
+        {
+            for (size_t i = 0; i < transients.size(); i++)
+            {
+                m_resources[transients[i]].image = m_transientTextures[i].image;
+                m_resources[transients[i]].imageView = m_transientTextures[i].imageView;
+            }
+
+            return;
+        }
+
+        releaseTransients();
+        releaseFramebuffers();
+        m_transientSignature = std::move(signature);
+
+        if (transients.empty())
+        {
+            return;
+        }
+
+        std::vector<VkMemoryRequirements> requirements(transients.size());
+        m_transientTextures.resize(transients.size());
+
+        for (size_t i = 0; i < transients.size(); i++)
+        {
+            resource& texture = m_resources[transients[i]];
+
+            VkImageCreateInfo imageInfo{};
+            imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+            imageInfo.imageType = VK_IMAGE_TYPE_2D;
+            imageInfo.format = texture.desc.format;
+            imageInfo.extent = {texture.desc.extent.width, texture.desc.extent.height, 1};
+            imageInfo.mipLevels = 1;
+            imageInfo.arrayLayers = 1;
+            imageInfo.samples = texture.desc.samples;
+            imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+            imageInfo.usage = texture.usage;
+            imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+            imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+            if (vkCreateImage(m_device, &imageInfo, nullptr, &texture.image) != VK_SUCCESS)
+            {
+                throw std::runtime_error("failed to create render graph texture!");
+            }
+
+            vkGetImageMemoryRequirements(m_device, texture.image, &requirements[i]);
+            m_transientTextures[i].image = texture.image;
+        }
+
+        //Largest first, each at the lowest offset clear of everything placed whose lifetime overlaps.
+        std::vector<uint32_t> placementOrder(transients.size());
+        for (uint32_t i = 0; i < placementOrder.size(); i++)
+        {
+            placementOrder[i] = i;
+        }
+
+        std::sort(placementOrder.begin(), placementOrder.end(), [&](uint32_t a, uint32_t b)
+        {
+            return requirements[a].size != requirements[b].size ? requirements[a].size > requirements[b].size : a < b;
+        });
+
+        VkMemoryRequirements sharedRequirements{};
+        sharedRequirements.alignment = 1;
+        sharedRequirements.memoryTypeBits = ~0u;
+
+        std::vector<uint32_t> placed;
+        std::vector<bool> isDedicated(transients.size(), false);
+        std::vector<std::pair<VkDeviceSize, VkDeviceSize>> occupied;
+
+        m_unaliasedTransientBytes = 0;
+
+        for (uint32_t i : placementOrder)
+        {
+            resource& texture = m_resources[transients[i]];
+            const VkMemoryRequirements& imageRequirements = requirements[i];
+            m_unaliasedTransientBytes += imageRequirements.size;
+
+            //No memory type left that every image can live in, this one gets memory of its own.
+            if ((sharedRequirements.memoryTypeBits & imageRequirements.memoryTypeBits) == 0)
+            {
+                isDedicated[i] = true;
+                continue;
+            }
+
+            occupied.clear();
+            for (uint32_t other : placed)
+            {
+                const resource& otherTexture = m_resources[transients[other]];
+                if (otherTexture.firstUse <= texture.lastUse && texture.firstUse <= otherTexture.lastUse)
+                {
+                    occupied.push_back({otherTexture.memoryOffset, otherTexture.memoryOffset + otherTexture.memorySize});
+                }
+            }
+
+            std::sort(occupied.begin(), occupied.end());
+
+            VkDeviceSize offset = 0;
+            for (const auto& [begin, end] : occupied)
+            {
+                if (offset + imageRequirements.size <= begin)
+                {
+                    break;
+                }
+
+                offset = std::max(offset, (end + imageRequirements.alignment - 1) / imageRequirements.alignment * imageRequirements.alignment);
+            }
+
+            texture.memoryOffset = offset;
+            texture.memorySize = imageRequirements.size;
+
+            sharedRequirements.size = std::max(sharedRequirements.size, offset + imageRequirements.size);
+            sharedRequirements.alignment = std::max(sharedRequirements.alignment, imageRequirements.alignment);
+            sharedRequirements.memoryTypeBits &= imageRequirements.memoryTypeBits;
+
+            placed.push_back(i);
+        }
+
+        m_transientBytes = 0;
+
+        if (!placed.empty())
+        {
+            if (!m_allocator->allocate(sharedRequirements, e_memoryUsage::gpuOnly, true, m_transientMemory))
+            {
+                throw std::runtime_error("failed to allocate render graph memory!");
+            }
+
+            m_transientBytes = sharedRequirements.size;
+        }
+
+        for (uint32_t i = 0; i < transients.size(); i++)
+        {
+            resource& texture = m_resources[transients[i]];
+
+            if (isDedicated[i])
+            {
+                gpuAllocation allocation;
+                if (!m_allocator->allocate(requirements[i], e_memoryUsage::gpuOnly, true, allocation))
+                {
+                    throw std::runtime_error("failed to allocate render graph memory!");
+                }
+
+                vkBindImageMemory(m_device, texture.image, allocation.memory, allocation.offset);
+                m_dedicatedTransientMemory.push_back(allocation);
+                m_transientBytes += requirements[i].size;
+
+                //Shares nothing, only its own previous frame has to be waited on.
+                texture.memoryOffset = 0;
+                texture.memorySize = 0;
+            }
+            else
+            {
+                vkBindImageMemory(m_device, texture.image, m_transientMemory.memory, m_transientMemory.offset + texture.memoryOffset);
+            }
+
+            VkImageViewCreateInfo viewInfo{};
+            viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+            viewInfo.image = texture.image;
+            viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+            viewInfo.format = texture.desc.format;
+            viewInfo.subresourceRange.aspectMask = getAspectMask(texture.desc.format);
+            viewInfo.subresourceRange.baseMipLevel = 0;
+            viewInfo.subresourceRange.levelCount = 1;
+            viewInfo.subresourceRange.baseArrayLayer = 0;
+            viewInfo.subresourceRange.layerCount = 1;
+
+            if (vkCreateImageView(m_device, &viewInfo, nullptr, &texture.imageView) != VK_SUCCESS)
+            {
+                throw std::runtime_error("failed to create render graph texture view!");
+            }
+
+            m_transientTextures[i].imageView = texture.imageView;
+        }
+
+        MAL_LOG_TRACE
+        (
+            "Render graph placed ", std::to_string(transients.size()), " transient textures in ",
+            std::to_string(m_transientBytes / 1024), "KB instead of ", std::to_string(m_unaliasedTransientBytes / 1024), "KB"
+        );
+    }
+
+    void renderGraph::getUseState(const resourceUse& use, VkImageLayout& layout, VkPipelineStageFlags& stages, VkAccessFlags& access)
+    {
+        stages = use.stages;
+
+        switch (use.access)
+        {
+            case e_renderGraphAccess::colorAttachment:
+                layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+                access = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | (use.isCleared ? 0 : VK_ACCESS_COLOR_ATTACHMENT_READ_BIT);
+                break;
+            case e_renderGraphAccess::depthAttachment:
+                layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+                access = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT;
+                break;
+            case e_renderGraphAccess::sampled:
+                layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+                access = VK_ACCESS_SHADER_READ_BIT;
+                break;
+            case e_renderGraphAccess::storageRead:
+                layout = VK_IMAGE_LAYOUT_GENERAL;
+                access = VK_ACCESS_SHADER_READ_BIT;
+                break;
+            case e_renderGraphAccess::storageWrite:
+                layout = VK_IMAGE_LAYOUT_GENERAL;
+                access = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+                break;
+            case e_renderGraphAccess::transferSource:
+                layout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+                access = VK_ACCESS_TRANSFER_READ_BIT;
+                break;
+            case e_renderGraphAccess::transferDestination:
+                layout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+                access = VK_ACCESS_TRANSFER_WRITE_BIT;
+                break;
+        }
+    }
+
+    void renderGraph::buildBarriers()
+    {
+        std::vector<textureState> states(m_resources.size());
+
+        //Stages and writes of the last pass using each texture.
+        std::vector<VkPipelineStageFlags> lastStages(m_resources.size(), 0);
+        std::vector<VkAccessFlags> lastWrites(m_resources.size(), 0);
+
+        for (uint32_t passIndex : m_executionOrder)
+        {
+            for (const resourceUse& use : m_passes[passIndex].uses)
+            {
+                VkImageLayout layout;
+                VkPipelineStageFlags stages;
+                VkAccessFlags access;
+                getUseState(use, layout, stages, access);
+
+                lastStages[use.texture] = stages;
+                lastWrites[use.texture] = access & c_writeAccess;
+            }
+        }
+
+        for (uint32_t i = 0; i < m_resources.size(); i++)
+        {
+            const resource& texture = m_resources[i];
+            textureState& state = states[i];
+            state = {};
+
+            if (texture.isImported)
+            {
+                state.layout = texture.initialState.layout;
+                state.writeStages = texture.initialState.stages;
+                state.writeAccess = texture.initialState.access;
+                continue;
+            }
+
+            //Transient memory was last used by this texture or another one placed over it, possibly
+            //in the previous frame. Waiting on all of them is conservative but never misses one.
+            state.layout = VK_IMAGE_LAYOUT_UNDEFINED;
+            state.writeStages = lastStages[i];
+            state.writeAccess = lastWrites[i];
+
+            for (uint32_t other = 0; other < m_resources.size(); other++)
+            {
+                const resource& otherTexture = m_resources[other];
+                bool isOverlapping = !otherTexture.isImported && otherTexture.memorySize > 0 && texture.memorySize > 0 &&
+                    otherTexture.memoryOffset < texture.memoryOffset + texture.memorySize &&
+                    texture.memoryOffset < otherTexture.memoryOffset + otherTexture.memorySize;
+
+                if (isOverlapping)
+                {
+                    state.writeStages |= lastStages[other];
+                    state.writeAccess |= lastWrites[other];
+                }
+            }
+        }
+
+        m_barriers.clear();
+
+        for (uint32_t passIndex : m_executionOrder)
+        {
+            pass& pass = m_passes[passIndex];
+            pass.firstBarrier = (uint32_t) m_barriers.size();
+            pass.barrierSourceStages = 0;
+            pass.barrierDestinationStages = 0;
+
+            for (const resourceUse& use : pass.uses)
+            {
+                const resource& texture = m_resources[use.texture];
+                textureState& state = states[use.texture];
+
+                VkImageLayout layout;
+                VkPipelineStageFlags stages;
+                VkAccessFlags access;
+                getUseState(use, layout, stages, access);
+
+                bool isLayoutChange = state.layout != layout;
+                bool isBarrierNeeded;
+
+                if (isLayoutChange || use.isWrite)
+                {
+                    //Layout transitions and write after write or read.
+                    isBarrierNeeded = isLayoutChange || state.writeStages != 0 || state.readStages != 0;
+                }
+                else
+                {
+                    //Read after read needs nothing, read after write once per stage and access.
+                    isBarrierNeeded = state.writeAccess != 0 && ((stages & ~state.readStages) != 0 || (access & ~state.readAccess) != 0);
+                }
+
+                if (isBarrierNeeded)
+                {
+                    VkImageMemoryBarrier barrier{};
+                    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+                    barrier.srcAccessMask = state.writeAccess;
+                    barrier.dstAccessMask = access;
+
+                    //Cleared contents are dead, the driver can skip preserving them.
+                    barrier.oldLayout = use.isCleared ? VK_IMAGE_LAYOUT_UNDEFINED : state.layout;
+                    barrier.newLayout = layout;
+                    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                    barrier.image = texture.image;
+                    barrier.subresourceRange.aspectMask = getAspectMask(texture.desc.format);
+                    barrier.subresourceRange.baseMipLevel = 0;
+                    barrier.subresourceRange.levelCount = 1;
+                    barrier.subresourceRange.baseArrayLayer = 0;
+                    barrier.subresourceRange.layerCount = 1;
+
+                    m_barriers.push_back(barrier);
+
+                    pass.barrierSourceStages |= state.writeStages | state.readStages;
+                    pass.barrierDestinationStages |= stages;
+                }
+
+                if (use.isWrite)
+                {
+                    state = {layout, stages, access & c_writeAccess, 0, 0};
+                }
+                else if (isLayoutChange)
+                {
+                    //Later readers chain through this barrier's stages.
+                    state.layout = layout;
+                    state.readStages = stages;
+                    state.readAccess = access;
+                }
+                else if (isBarrierNeeded || state.writeAccess == 0)
+                {
+                    state.readStages |= stages;
+                    state.readAccess |= access;
+                }
+            }
+
+            pass.barrierCount = (uint32_t) m_barriers.size() - pass.firstBarrier;
+        }
+
+        //Imported textures are handed back in the layout their owner expects.
+        m_finalBarriers.clear();
+        m_finalSourceStages = 0;
+
+        for (uint32_t i = 0; i < m_resources.size(); i++)
+        {
+            const resource& texture = m_resources[i];
+            const textureState& state = states[i];
+
+            if (!texture.isImported || texture.firstUse == UINT32_MAX || texture.finalLayout == VK_IMAGE_LAYOUT_UNDEFINED || texture.finalLayout == state.layout)
+            {
+                continue;
+            }
+
+            VkImageMemoryBarrier barrier{};
+            barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            barrier.srcAccessMask = state.writeAccess;
+            barrier.dstAccessMask = 0;
+            barrier.oldLayout = state.layout;
+            barrier.newLayout = texture.finalLayout;
+            barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.image = texture.image;
+            barrier.subresourceRange.aspectMask = getAspectMask(texture.desc.format);
+            barrier.subresourceRange.baseMipLevel = 0;
+            barrier.subresourceRange.levelCount = 1;
+            barrier.subresourceRange.baseArrayLayer = 0;
+            barrier.subresourceRange.layerCount = 1;
+
+            m_finalBarriers.push_back(barrier);
+            m_finalSourceStages |= state.writeStages | state.readStages;
+        }
+
+        m_barrierCount = 0;
+        for (uint32_t passIndex : m_executionOrder)
+        {
+            m_barrierCount += m_passes[passIndex].barrierCount > 0 ? 1 : 0;
+        }
+
+        m_barrierCount += m_finalBarriers.empty() ? 0 : 1;
+    }
+
+    void renderGraph::createRenderPasses()
+    {
+        std::vector<VkImageView> attachments;
+
+        for (uint32_t order = 0; order < m_executionOrder.size(); order++)
+        {
+            pass& pass = m_passes[m_executionOrder[order]];
+            pass.renderPass = VK_NULL_HANDLE;
+            pass.framebuffer = VK_NULL_HANDLE;
+            pass.extent = {0, 0};
+
+            attachments.clear();
+            for (const resourceUse& use : pass.uses)
+            {
+                if (isAttachment(use.access))
+                {
+                    attachments.push_back(m_resources[use.texture].imageView);
+                    pass.extent = m_resources[use.texture].desc.extent;
+                }
+            }
+
+            if (attachments.empty())
+            {
+                continue;
+            }
+
+            pass.renderPass = getRenderPass(pass, order);
+            pass.framebuffer = getFramebuffer(pass.renderPass, attachments, pass.extent);
+        }
+    }
+
+    VkRenderPass renderGraph::getRenderPass(const pass& pass, uint32_t order)
+    {
+        std::vector<VkAttachmentDescription> attachments;
+        std::vector<VkAttachmentReference> colorReferences;
+        VkAttachmentReference depthReference{};
+        bool hasDepth = false;
+
+        std::vector<uint64_t> key;
+
+        for (const resourceUse& use : pass.uses)
+        {
+            if (!isAttachment(use.access))
+            {
+                continue;
+            }
+
+            const resource& texture = m_resources[use.texture];
+            bool isDepth = use.access == e_renderGraphAccess::depthAttachment;
+
+            //Barriers before the pass already moved it into the attachment layout.
+            VkImageLayout layout = isDepth ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL : VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+            bool isFirstUse = !texture.isImported && texture.firstUse == order;
+
+            VkAttachmentDescription attachment{};
+            attachment.format = texture.desc.format;
+            attachment.samples = texture.desc.samples;
+            attachment.loadOp = use.isCleared ? VK_ATTACHMENT_LOAD_OP_CLEAR : (isFirstUse ? VK_ATTACHMENT_LOAD_OP_DONT_CARE : VK_ATTACHMENT_LOAD_OP_LOAD);
+            attachment.storeOp = use.isStored ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+            attachment.stencilLoadOp = hasStencil(texture.desc.format) ? attachment.loadOp : VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+            attachment.stencilStoreOp = hasStencil(texture.desc.format) ? attachment.storeOp : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+            attachment.initialLayout = layout;
+            attachment.finalLayout = layout;
+
+            VkAttachmentReference reference{(uint32_t) attachments.size(), layout};
+            if (isDepth)
+            {
+                depthReference = reference;
+                hasDepth = true;
+            }
+            else
+            {
+                colorReferences.push_back(reference);
+            }
+
+            attachments.push_back(attachment);
+            key.insert(key.end(), {(uint64_t) attachment.format, (uint64_t) attachment.samples, (uint64_t) attachment.loadOp, (uint64_t) attachment.storeOp, isDepth});
+        }
+
+        auto cached = m_renderPasses.find(key);
+        if (cached != m_renderPasses.end())
+        {
+            return cached->second;
+        }
+
+        VkSubpassDescription subpass{};
+        subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+        subpass.colorAttachmentCount = (uint32_t) colorReferences.size();
+        subpass.pColorAttachments = colorReferences.data();
+        subpass.pDepthStencilAttachment = hasDepth ? &depthReference : nullptr;
+
+        VkRenderPassCreateInfo renderPassInfo{};
+        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+        renderPassInfo.attachmentCount = (uint32_t) attachments.size();
+        renderPassInfo.pAttachments = attachments.data();
+        renderPassInfo.subpassCount = 1;
+        renderPassInfo.pSubpasses = &subpass;
+
+        VkRenderPass renderPass;
+        if (vkCreateRenderPass(m_device, &renderPassInfo, nullptr, &renderPass) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create render pass!");
+        }
+
+        m_renderPasses.emplace(std::move(key), renderPass);
+        return renderPass;
+    }
+
+    VkFramebuffer renderGraph::getFramebuffer(VkRenderPass renderPass, const std::vector<VkImageView>& attachments, VkExtent2D extent)
+    {
+        std::vector<uint64_t> key = {(uint64_t) renderPass, extent.width, extent.height};
+        for (VkImageView attachment : attachments)
+        {
+            key.push_back((uint64_t) attachment);
+        }
+
+        auto cached = m_framebuffers.find(key);
+        if (cached != m_framebuffers.end())
+        {
+            return cached->second;
+        }
+
+        VkFramebufferCreateInfo framebufferInfo{};
+        framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+        framebufferInfo.renderPass = renderPass;
+        framebufferInfo.attachmentCount = (uint32_t) attachments.size();
+        framebufferInfo.pAttachments = attachments.data();
+        framebufferInfo.width = extent.width;
+        framebufferInfo.height = extent.height;
+        framebufferInfo.layers = 1;
+
+        VkFramebuffer framebuffer;
+        if (vkCreateFramebuffer(m_device, &framebufferInfo, nullptr, &framebuffer) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create framebuffer!");
+        }
+
+        m_framebuffers.emplace(std::move(key), framebuffer);
+        return framebuffer;
+    }
+
+    void renderGraph::execute(VkCommandBuffer commandBuffer)
+    {
+        std::vector<VkClearValue> clearValues;
+
+        for (uint32_t passIndex : m_executionOrder)
+        {
+            pass& pass = m_passes[passIndex];
+
+            //Outside the render pass, timestamps can't be written between secondary command buffers.
+            uint32_t gpuScope = m_profiler ? m_profiler->beginScope(commandBuffer, pass.name) : c_invalidGpuScope;
+
+            if (pass.barrierCount > 0)
+            {
+                vkCmdPipelineBarrier
+                (
+                    commandBuffer,
+                    pass.barrierSourceStages ? pass.barrierSourceStages : (VkPipelineStageFlags) VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                    pass.barrierDestinationStages,
+                    0,
+                    0, nullptr,
+                    0, nullptr,
+                    pass.barrierCount, m_barriers.data() + pass.firstBarrier
+                );
+            }
+
+            renderGraphPassContext context;
+            context.renderPass = pass.renderPass;
+            context.framebuffer = pass.framebuffer;
+            context.extent = pass.extent;
+            context.graph = this;
+
+            if (!pass.renderPass)
+            {
+                pass.execute(commandBuffer, context);
+
+                if (m_profiler)
+                {
+                    m_profiler->endScope(commandBuffer, gpuScope);
+                }
+
+                continue;
+            }
+
+            clearValues.clear();
+            for (const resourceUse& use : pass.uses)
+            {
+                if (isAttachment(use.access))
+                {
+                    clearValues.push_back(use.clearValue);
+                }
+            }
+
+            VkRenderPassBeginInfo renderPassInfo{};
+            renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+            renderPassInfo.renderPass = pass.renderPass;
+            renderPassInfo.framebuffer = pass.framebuffer;
+            renderPassInfo.renderArea.offset = {0, 0};
+            renderPassInfo.renderArea.extent = pass.extent;
+            renderPassInfo.clearValueCount = (uint32_t) clearValues.size();
+            renderPassInfo.pClearValues = clearValues.data();
+
+            vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, pass.isSecondary ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE);
+            pass.execute(commandBuffer, context);
+            vkCmdEndRenderPass(commandBuffer);
+
+            if (m_profiler)
+            {
+                m_profiler->endScope(commandBuffer, gpuScope);
+            }
+        }
+
+        if (!m_finalBarriers.empty())
+        {
+            vkCmdPipelineBarrier
+            (
+                commandBuffer,
+                m_finalSourceStages ? m_finalSourceStages : (VkPipelineStageFlags) VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                0,
+                0, nullptr,
+                0, nullptr,
+                (uint32_t) m_finalBarriers.size(), m_finalBarriers.data()
+            );
+        }
+    }
+
+    VkImageView renderGraph::getImageView(renderGraphResource texture) const
+    {
+        return texture < m_resources.size() ? m_resources[texture].imageView : VK_NULL_HANDLE;
+    }
+
+    VkImage renderGraph::getImage(renderGraphResource texture) const
+    {
+        return texture < m_resources.size() ? m_resources[texture].image : VK_NULL_HANDLE;
+    }
+
+    void renderGraph::releaseFramebuffers()
+    {
+        std::vector<VkFramebuffer> framebuffers;
+        for (auto& [key, framebuffer] : m_framebuffers)
+        {
+            framebuffers.push_back(framebuffer);
+        }
+
+        m_framebuffers.clear();
+
+        if (framebuffers.empty())
+        {
+            return;
+        }
+
+        VkDevice device = m_device;
+        m_deletionQueue->push([device, framebuffers = std::move(framebuffers)]()
+        {
+            for (VkFramebuffer framebuffer : framebuffers)
+            {
+                vkDestroyFramebuffer(device, framebuffer, nullptr);
+            }
+        });
+    }
+
+    void renderGraph::releaseTransients()
+    {
+        m_transientSignature.clear();
+
+        if (m_transientTextures.empty() && !m_transientMemory.isValid() && m_dedicatedTransientMemory.empty())
+        {
+            return;
+        }
+
+        //Frames in flight may still render into them.
+        VkDevice device = m_device;
+        gpuAllocator* allocator = m_allocator;
+        m_deletionQueue->push([device, allocator, textures = std::move(m_transientTextures), memory = m_transientMemory, dedicatedMemory = std::move(m_dedicatedTransientMemory)]() mutable
+        {
+            for (transientTexture& texture : textures)
+            {
+                vkDestroyImageView(device, texture.imageView, nullptr);
+                vkDestroyImage(device, texture.image, nullptr);
+            }
+
+            if (memory.isValid())
+            {
+                allocator->free(memory);
+            }
+
+            for (gpuAllocation& allocation : dedicatedMemory)
+            {
+                allocator->free(allocation);
+            }
+        });
+
+        m_transientTextures.clear();
+        m_dedicatedTransientMemory.clear();
+        m_transientMemory = gpuAllocation();
+        m_transientBytes = 0;
+        m_unaliasedTransientBytes = 0;
+    }
+}
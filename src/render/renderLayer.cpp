@@ -1,6 +1,13 @@
 #include "malpch.h"
 #include "renderLayer.h"
 #include "application.h"
+#include "batchTransform.h"
+#include "threadPool.h"
+#include "shaderParser.h"
+
+#ifdef MAL_SHADER_COMPILER
+#include "shaderBuildService.h"
+#endif
 
 #include <iostream>
 #include <stdexcept>
@@ -8,8 +15,10 @@
 #include <algorithm> // Necessary for std::clamp
 #include <fstream>
 #include <filesystem>
-
-#include <shaderc/shaderc.hpp>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <utility>
 
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
@@ -93,279 +102,129 @@ static void destroyDebugUtilsMessengerEXT
     }
 }
 
-static std::vector<char> readShaderFile(const std::string& filename)
-{
-    std::ifstream file(filename, std::ios::ate | std::ios::binary);
+///
+/// Render Layer
+/// this layer handles the Render setup, cleanup, and flow.
+///
 
-    if (!file.is_open())
+//Fewer draws than this per slice aren't worth a secondary command buffer.
+static constexpr uint32_t c_minDrawsPerSlice = 256;
+
+static const char* getLatencyModeName(malachite::e_latencyMode mode)
+{
+    switch (mode)
     {
-        throw std::runtime_error("failed to open file!");
+        case malachite::e_latencyMode::vsync: return "Vsync";
+        case malachite::e_latencyMode::lowLatency: return "Low latency";
+        case malachite::e_latencyMode::uncapped: return "Uncapped";
     }
 
-    size_t fileSize = (size_t) file.tellg();
-    std::vector<char> buffer(fileSize);
-
-    file.seekg(0);
-    file.read(buffer.data(), fileSize);
+    return "Unknown";
+}
 
-    file.close();
+//Names taken by --latency, false for anything else.
+static bool parseLatencyMode(std::string_view name, malachite::e_latencyMode& mode)
+{
+    if (name == "vsync")
+    {
+        mode = malachite::e_latencyMode::vsync;
+    }
+    else if (name == "lowLatency")
+    {
+        mode = malachite::e_latencyMode::lowLatency;
+    }
+    else if (name == "uncapped")
+    {
+        mode = malachite::e_latencyMode::uncapped;
+    }
+    else
+    {
+        return false;
+    }
 
-    return buffer;
+    return true;
 }
 
-static void parseShaderTextFile
-(   
-    const std::filesystem::path& filePath, 
-    malachite::shader_schematic& shaderSchematic
-)
+static void accumulateAverage(double& average, double value, uint64_t count)
 {
-    std::ifstream file =  std::ifstream(filePath);
+    average += (value - average) / (double) count;
+}
 
-    if (!file.is_open()) 
+namespace malachite
+{
+    renderLayer::renderLayer(uint32_t framesInFlight)
+        : layer(0, layerFunctionConfig()), m_framesInFlight(std::clamp(framesInFlight, 1u, c_maxFramesInFlight))
     {
-        throw std::runtime_error("failed to open file!");
+        m_config.initalize = MAL_BIND_FUNCTION(renderLayer::initalizeDependencies, this);
+        m_config.postInitalize = MAL_BIND_FUNCTION(renderLayer::applyLaunchOptions, this);
+        m_config.update = MAL_BIND_FUNCTION_PARAMS(renderLayer::render, this, std::placeholders::_1);
+        m_config.postClose = MAL_BIND_FUNCTION(renderLayer::cleanup, this);
     }
 
-    std::map<std::string, malachite::e_shaderType> shaderTypeMap = 
+    void renderLayer::setCamera(const math::mat4& viewProjection, const math::vec3& position, float maxDrawDistance)
     {
-        {"#vertex", malachite::e_shaderType::vertex},
-        {"#fragment", malachite::e_shaderType::fragment}
-    };
-
-    std::string line;
-    std::string fileSection = "";
-    int lineNumber = 0;
-    int tagCount = 0;
-    int submittedSectionsCount = 0;
-    bool isSkipLine = false;
+        m_cullingParams.viewFrustum = extractFrustum(viewProjection);
+        m_cullingParams.cameraPosition = position;
+        m_cullingParams.maxDrawDistance = maxDrawDistance;
+    }
 
-    MAL_LOG_TRACE("Starting Line Read For File: ", filePath);
-    while (std::getline(file, line))
+    void renderLayer::setShaderKeywords(const std::vector<std::string_view>& enabledKeywords)
     {
-        lineNumber++;
-        bool isTagLine = false;
+        m_enabledShaderKeywords.assign(enabledKeywords.begin(), enabledKeywords.end());
+        m_isShaderVariantChanged = true;
+    }
 
-        if(isSkipLine)
-        {
-            line.clear();
-            isSkipLine = false;
-            continue;
-        }
+    void renderLayer::initalizeDependencies()
+    {
+        initalizeResources();
+        initalizeWindow();
+        initalizeVulkan();
+    }
 
-        for (auto i = shaderTypeMap.begin(); i != shaderTypeMap.end(); i++)
+    void renderLayer::applyLaunchOptions()
+    {
+        //The swapchain made at initalization is replaced at the first frame.
+        if (const char* value = application::getArgValue("--latency"))
         {
-            std::string tag = i->first;
-            malachite::e_shaderType shaderType = i->second;
-            
-            isTagLine = line == tag;
-
-            if (isTagLine)
+            e_latencyMode mode;
+            if (parseLatencyMode(value, mode))
             {
-                isSkipLine = true;
-                tagCount++;
-
-                MAL_LOG_TRACE("Found Tag: ", tag, "Line: ", lineNumber);
-
-                shaderSchematic.shaderTypes.push_back(shaderType);
-                break;
+                setLatencyMode(mode);
+            }
+            else
+            {
+                MAL_LOG_ERROR("Unknown latency mode ", value, ", expected vsync, lowLatency or uncapped.");
             }
         }
 
-        //Ignore all lines above first tag line. Useful for documentation
-        if (tagCount == 0)
+        //Before the first frame, so nothing of the scene is in flight yet.
+        if (application::hasArg("--benchmark-draws"))
         {
-            line.clear();
-            continue;
-        }
+            const char* value = application::getArgValue("--benchmark-draws");
+            uint32_t objectCount = value ? (uint32_t) std::strtoul(value, nullptr, 10) : 0;
 
-        if (isTagLine)
-        {
-            if (tagCount > 1)
+            if (objectCount > 0)
             {
-                submittedSectionsCount++;
-
-                std::string submitSection = fileSection;
-
-                MAL_LOG_TRACE("Submitted: \n", submitSection);
-
-                // Submit then clear file section string
-                shaderSchematic.fileContents.push_back(submitSection);
-                fileSection.clear();
+                benchmarkDrawRecording(objectCount);
             }
-
-            //Clear line to add more data
-            line.clear();
-            continue;
-        }
-
-        //Add data from line to fileSection then clear line contents
-        fileSection += line;
-        fileSection.push_back('\n');
-        line.clear();
-    }
-
-    //This is to ensure if end of file is found and no submitted section is found to
-    //Push back the currently cached fileSection to fileContents list
-    if (fileSection.size() > 0)
-    {
-        std::string submitSection = fileSection;
-
-        MAL_LOG_TRACE("Submitted: \n", submitSection);
-
-        // Submit then clear file section string
-        shaderSchematic.fileContents.push_back(submitSection);
-        fileSection.clear();
-    }
-}
-
-static void generateSPRVBinaries(std::filesystem::path shaderFilePath, std::filesystem::path generatedFileDirPath)
-{
-    malachite::shader_schematic shaderSchematic;
-    shaderSchematic.fileName = shaderFilePath.filename();
-
-    parseShaderTextFile(shaderFilePath, shaderSchematic);
-    
-    shaderc::Compiler compiler;
-    shaderc::CompileOptions options;
-
-    std::map<malachite::e_shaderType, shaderc_shader_kind> shaderTypeMap = 
-    {
-        {malachite::e_shaderType::vertex, shaderc_vertex_shader},
-        {malachite::e_shaderType::fragment, shaderc_fragment_shader},
-        {malachite::e_shaderType::compute, shaderc_compute_shader},
-        {malachite::e_shaderType::geometry, shaderc_geometry_shader},
-        {malachite::e_shaderType::tess_control, shaderc_tess_control_shader},
-        {malachite::e_shaderType::tess_evaluation, shaderc_tess_evaluation_shader},
-    };
-
-    std::map<malachite::e_shaderType, const char*> shaderFileExtMap = 
-    {
-        {malachite::e_shaderType::vertex, "vert"},
-        {malachite::e_shaderType::fragment, "frag"},
-        {malachite::e_shaderType::compute, "comp"},
-        {malachite::e_shaderType::geometry, "geom"},
-        {malachite::e_shaderType::tess_control, "tessc"},
-        {malachite::e_shaderType::tess_evaluation, "tesse"},
-    };
-
-    MAL_LOG_TRACE("Compiling Shader: ", shaderSchematic.fileName);
-
-    for (int i = 0; i < shaderSchematic.fileContents.size(); i++)
-    {
-        const char* fileContent = shaderSchematic.fileContents[i].c_str();
-        size_t fileContentSize = strlen(fileContent);
-        malachite::e_shaderType shaderType = shaderSchematic.shaderTypes[i];
-
-        MAL_LOG_TRACE("Shader Section Content: \n", shaderSchematic.fileContents[i]);
-
-        const char* shaderFileExt = shaderFileExtMap[shaderType];
-        shaderc_shader_kind compilerShaderType = shaderTypeMap[shaderType];
-
-        std::string fileSectionTag = shaderSchematic.fileName.c_str();
-        fileSectionTag.append(".");
-        fileSectionTag.append(shaderFileExt);
-
-        const char* fileSectionTagConst = fileSectionTag.c_str();
-
-        //Preprocessed Source Compilation
-        //{ 
-        //    shaderc::PreprocessedSourceCompilationResult result = compiler.PreprocessGlsl
-        //    (
-        //        fileContent,                        //file data
-        //        fileContentSize,                    //file data size
-        //        compilerShaderType,                 //shader type
-        //        fileSectionTagConst,                //file tag (identifier)
-        //        options     
-        //    );
-        //
-        //    size_t errorCount = result.GetNumErrors();
-        //    size_t warningCount = result.GetNumWarnings();
-        //
-        //    std::string errorMessage = result.GetErrorMessage();
-        //
-        //    if(errorCount > 0)
-        //    {
-        //        MAL_LOG_ERROR("ERRORS ", errorCount, " WARNINGS ", warningCount);
-        //        MAL_LOG_ERROR("Shader Compiler Error: \n", errorMessage);
-        //        continue;
-        //    }
-        //
-        //    std::filesystem::path generatedFilePath = generatedFileDirPath / shaderSchematic.fileName;
-        //    generatedFilePath.replace_extension(shaderFileExt);
-        //
-        //    MAL_LOG_TRACE("Creating Output Binary of Shader Module: ", generatedFilePath);
-        //
-        //    std::ofstream outputFile(generatedFilePath, std::ios::binary);
-        //    outputFile.write
-        //    (
-        //        result.cbegin(),                          //Data
-        //        result.cend() - result.cbegin() //Data Size
-        //    );
-        //
-        //    outputFile.close();
-        //}
-        
-        //Make module from preprocess
-        { 
-            shaderc::SpvCompilationResult result = compiler.CompileGlslToSpv
-            (            
-                fileContent,                        //file data
-                fileContentSize,                    //file data size
-                compilerShaderType,                 //shader type
-                fileSectionTagConst,                //file tag (identifier)
-                "main",                             //entry point
-                options                             //options
-            );
-
-            size_t errorCount = result.GetNumErrors();
-            size_t warningCount = result.GetNumWarnings();
-
-            std::string errorMessage = result.GetErrorMessage();
-
-            if(errorCount > 0)
+            else
             {
-                MAL_LOG_ERROR("ERRORS ", errorCount, " WARNINGS ", warningCount);
-                MAL_LOG_ERROR("Shader Compiler Error: \n", errorMessage);
-                continue;
+                benchmarkDrawRecording();
             }
-
-            std::filesystem::path generatedFilePath = generatedFileDirPath / shaderSchematic.fileName;
-            generatedFilePath.replace_extension(shaderFileExt);
-
-            MAL_LOG_TRACE("Creating Output Binary of Shader Module: ", generatedFilePath);
-
-            std::ofstream outputFile(generatedFilePath, std::ios::binary);
-
-            outputFile.write
-            (
-                reinterpret_cast<const char*>(result.cbegin()),      //Data
-                (result.cend() - result.cbegin()) * sizeof(uint32_t) //Data Size
-            );
-
-            outputFile.close();
         }
     }
-}
-
-///
-/// Render Layer
-/// this layer handles the Render setup, cleanup, and flow.
-///
 
-namespace malachite
-{
-    renderLayer::renderLayer()
-        : layer(0, layerFunctionConfig())
+    void renderLayer::initalizeResources()
     {
-        m_config.initalize = MAL_BIND_FUNCTION(renderLayer::initalizeDependencies, this);
-        m_config.update = MAL_BIND_FUNCTION_PARAMS(renderLayer::render, this, std::placeholders::_1);
-        m_config.postClose = MAL_BIND_FUNCTION(renderLayer::cleanup, this);
-    }
+        //Resource paths are relative to the resource root, which is relative to the running process.
+        resourceManager& resources = application::getResourceManager();
+        resources.setRootPath("bin/res/");
 
-    void renderLayer::initalizeDependencies()
-    {
-        initalizeWindow();
-        initalizeVulkan();
+        //Packed by malachite-pack, without it everything is read from loose files.
+        if (!resources.mountArchive("assets.malpak"))
+        {
+            MAL_LOG_TRACE("No asset archive found, using loose resource files.");
+        }
     }
 
     void renderLayer::initalizeVulkan()
@@ -377,14 +236,17 @@ namespace malachite
         initalizeSurface();
         initalizePhysicalDevice();
         initalizeLogicalDevice();
+        initalizeMemoryAllocator();
         initalizeSwapChain();
         initalizeImageViews();
         initalizeRenderPass();
+        initalizePipelineCache();
         initalizeGraphicsPipeline();
-        initalizeFrameBuffers();
         initalizeCommandPool();
-        initalizeCommandBuffer();
+        initalizeCommandBuffers();
         initalizeSyncObjects();
+        initalizeTextureStreaming();
+        initalizeMeshBuffers();
 
         MAL_LOG_TRACE("Vulkan Initalization Sucessful.");
     }
@@ -396,14 +258,30 @@ namespace malachite
 
         glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
 
-        //Handle resize later...
-        glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+        glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
 
         //TODO have app pass window width and height args
         const uint32_t WIDTH = 800;
         const uint32_t HEIGHT = 600;
         
         m_glfwWindowPtr = glfwCreateWindow(WIDTH, HEIGHT, "Vulkan", nullptr, nullptr);
+
+        //Not every platform reports the swapchain out of date on resize, drawFrame recreates it on this too.
+        glfwSetWindowUserPointer(m_glfwWindowPtr, this);
+        glfwSetFramebufferSizeCallback(m_glfwWindowPtr, [](GLFWwindow* window, int width, int height)
+        {
+            static_cast<renderLayer*>(glfwGetWindowUserPointer(window))->m_isFramebufferResized = true;
+        });
+
+        //L cycles the latency modes, each logs its stats as it's left.
+        glfwSetKeyCallback(m_glfwWindowPtr, [](GLFWwindow* window, int key, int, int action, int)
+        {
+            if (key == GLFW_KEY_L && action == GLFW_PRESS)
+            {
+                renderLayer* layer = static_cast<renderLayer*>(glfwGetWindowUserPointer(window));
+                layer->setLatencyMode((e_latencyMode) (((uint32_t) layer->getLatencyMode() + 1) % c_latencyModeCount));
+            }
+        });
         MAL_LOG_TRACE("Window Initalization Sucessful.");
     }
 
@@ -533,10 +411,7 @@ namespace malachite
         return score;
     }
 
-    //Right now Qyeye only supports graphics commands.
-    //TODO extend this to have wider range such as
-    // - compute commands
-    // - memory transfer commands
+    //TODO extend this to compute commands
     queueFamilyIndices renderLayer::findQueueFamilies(const VkPhysicalDevice& device)
     {
         queueFamilyIndices indices;
@@ -571,6 +446,17 @@ namespace malachite
             i++;
         }
 
+        //Families without graphics or compute are the dedicated copy engines, they run beside rendering.
+        for (uint32_t family = 0; family < queueFamilyCount; family++)
+        {
+            VkQueueFlags flags = queueFamilies[family].queueFlags;
+            if ((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)))
+            {
+                indices.transferFamily = family;
+                break;
+            }
+        }
+
         return indices;
     }
 
@@ -585,6 +471,11 @@ namespace malachite
             indices.presentFamily.value()
         };
 
+        if (indices.transferFamily.has_value())
+        {
+            uniqueQueueFamilies.insert(indices.transferFamily.value());
+        }
+
         float queuePriority = 1.0f;
         for (uint32_t queueFamily : uniqueQueueFamilies) 
         {
@@ -596,7 +487,11 @@ namespace malachite
             queueCreateInfos.push_back(queueCreateInfo);
         }
 
+        VkPhysicalDeviceFeatures supportedFeatures;
+        vkGetPhysicalDeviceFeatures(m_vulkanPhysicalDevice, &supportedFeatures);
+
         VkPhysicalDeviceFeatures deviceFeatures{};
+        drawBatcher::enableDeviceFeatures(supportedFeatures, deviceFeatures);
 
         VkDeviceCreateInfo createInfo{};
         createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
@@ -614,9 +509,10 @@ namespace malachite
 
         vkGetDeviceQueue(m_vulkanLogicalDevice, indices.graphicsFamily.value(), 0, &m_vulkanGraphicsQueue);
         vkGetDeviceQueue(m_vulkanLogicalDevice, indices.presentFamily.value(), 0, &m_vulkanPresentQueue);
+        vkGetDeviceQueue(m_vulkanLogicalDevice, indices.transferFamily.value_or(indices.graphicsFamily.value()), 0, &m_vulkanTransferQueue);
     }
 
-    void renderLayer::initalizeSwapChain()
+    void renderLayer::initalizeSwapChain(VkSwapchainKHR oldSwapChain)
     {
         swapChainSupportDetails swapChainSupport = querySwapChainSupport(m_vulkanPhysicalDevice);
             
@@ -624,7 +520,8 @@ namespace malachite
         VkPresentModeKHR presentMode = chooseSwapPresentMode(swapChainSupport.presentModes);
         VkExtent2D extent = chooseSwapExtent(swapChainSupport.surfaceCapabilities);
 
-        uint32_t imageCount = swapChainSupport.surfaceCapabilities.minImageCount + 1;
+        uint32_t imageCount = m_requestedSwapChainImageCount > 0 ? m_requestedSwapChainImageCount : swapChainSupport.surfaceCapabilities.minImageCount + 1;
+        imageCount = std::max(imageCount, swapChainSupport.surfaceCapabilities.minImageCount);
 
         if (swapChainSupport.surfaceCapabilities.maxImageCount > 0 && imageCount > swapChainSupport.surfaceCapabilities.maxImageCount)
         {
@@ -666,7 +563,8 @@ namespace malachite
 
         createInfo.presentMode = presentMode;
         createInfo.clipped = VK_TRUE;
-        createInfo.oldSwapchain = VK_NULL_HANDLE;
+        //Lets the driver hand resources over, the old one is retired either way.
+        createInfo.oldSwapchain = oldSwapChain;
 
         if (vkCreateSwapchainKHR(m_vulkanLogicalDevice, &createInfo, nullptr, &m_vulkanSwapChain) != VK_SUCCESS)
         {
@@ -708,6 +606,15 @@ namespace malachite
 
     VkSurfaceFormatKHR renderLayer::chooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR>& availableFormats)
     {
+        //The render pass and pipelines are built for the format, a recreated swapchain keeps it.
+        for (const auto& availableFormat : availableFormats)
+        {
+            if (availableFormat.format == m_vulkanSwapChainImageFormat)
+            {
+                return availableFormat;
+            }
+        }
+
         for (const auto& availableFormat : availableFormats) 
         {
             if (availableFormat.format == VK_FORMAT_B8G8R8A8_SRGB && availableFormat.colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR) {
@@ -720,14 +627,38 @@ namespace malachite
 
     VkPresentModeKHR renderLayer::chooseSwapPresentMode(const std::vector<VkPresentModeKHR>& availablePresentModes) 
     {
-        for (const auto& availablePresentMode : availablePresentModes) 
+        auto isAvailable = [&](VkPresentModeKHR presentMode)
         {
-            if (availablePresentMode == VK_PRESENT_MODE_MAILBOX_KHR) 
-            {
-                return availablePresentMode;
-            }
+            return std::find(availablePresentModes.begin(), availablePresentModes.end(), presentMode) != availablePresentModes.end();
+        };
+
+        switch (m_latencyMode)
+        {
+            case e_latencyMode::uncapped:
+                if (isAvailable(VK_PRESENT_MODE_IMMEDIATE_KHR))
+                {
+                    return VK_PRESENT_MODE_IMMEDIATE_KHR;
+                }
+
+                [[fallthrough]];
+            case e_latencyMode::lowLatency:
+                if (isAvailable(VK_PRESENT_MODE_MAILBOX_KHR))
+                {
+                    if (m_latencyMode != e_latencyMode::lowLatency)
+                    {
+                        MAL_LOG_TRACE(getLatencyModeName(m_latencyMode), " latency mode isn't supported, presenting with MAILBOX.");
+                    }
+
+                    return VK_PRESENT_MODE_MAILBOX_KHR;
+                }
+
+                MAL_LOG_TRACE(getLatencyModeName(m_latencyMode), " latency mode isn't supported, presenting with FIFO.");
+                break;
+            case e_latencyMode::vsync:
+                break;
         }
 
+        //The only mode every device supports.
         return VK_PRESENT_MODE_FIFO_KHR;
     }
 
@@ -785,6 +716,7 @@ namespace malachite
         }
     }
 
+    //Pipelines are created against this one, the render graph begins compatible passes of its own.
     void renderLayer::initalizeRenderPass()
     {
         //Attachment description
@@ -824,410 +756,1081 @@ namespace malachite
         }
     }
 
-    void renderLayer::initalizeGraphicsPipeline()
+    void renderLayer::initalizeMemoryAllocator()
     {
-        //Shaders
-
-        //TODO add resource system
-        //path is relative to running process, but an actual resource structure is missing
+        m_gpuAllocator.initalize(m_vulkanPhysicalDevice, m_vulkanLogicalDevice);
+    }
 
-        const char* shaderPath = "bin/res/shaders/simple.shader";
-        const char* shaderBinaryOutputPath = "bin/res/shaderbinaries/";
+    void renderLayer::initalizePipelineCache()
+    {
+        //Written back on cleanup, the next launch skips compiling pipelines the driver has already seen.
+        m_pipelineCache.initalize(m_vulkanPhysicalDevice, m_vulkanLogicalDevice, application::getResourceManager().resolvePath("pipeline.cache"));
+    }
 
-        const char* vertexPath = "bin/res/shaderbinaries/simple.vert";
-        const char* fragmentPath = "bin/res/shaderbinaries/simple.frag";
+    void renderLayer::initalizeGraphicsPipeline()
+    {
+        //Shaders
 
-        std::filesystem::path mainPath = std::filesystem::current_path();
-        MAL_LOG_TRACE("Current Working Directory Path: ", mainPath);
-        MAL_LOG_TRACE("Generating SPV Binaries: ", shaderPath);
+        resourceManager& resources = application::getResourceManager();
 
-        generateSPRVBinaries(shaderPath, shaderBinaryOutputPath);
-        VkPipelineShaderStageCreateInfo vertexStage = createShaderModule(vertexPath, e_shaderType::vertex);
-        VkPipelineShaderStageCreateInfo fragmentStage = createShaderModule(fragmentPath, e_shaderType::fragment);
+        //Keywords enabled before initalization already pick the first variant.
+        loadShaderKeywords();
+        m_shaderVariantKey = resolveShaderVariantKey();
 
-        VkPipelineShaderStageCreateInfo shaderStages[] = {vertexStage, fragmentStage};
-        
-        //
-        //Input Assembly//
-        //
-
-        VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
-        vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-        vertexInputInfo.vertexBindingDescriptionCount = 0;
-        vertexInputInfo.pVertexBindingDescriptions = nullptr; // Optional
-        vertexInputInfo.vertexAttributeDescriptionCount = 0;
-        vertexInputInfo.pVertexAttributeDescriptions = nullptr; // Optional
-
-        VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
-        inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-        inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-        inputAssembly.primitiveRestartEnable = VK_FALSE;
-
-        //
-        //Viewports and scissors//
-        //
+        std::string vertexPath = getSceneShaderBinaryPath(m_shaderKeywords.getCompiledKey(m_shaderVariantKey), e_shaderType::vertex);
+        std::string fragmentPath = getSceneShaderBinaryPath(m_shaderKeywords.getCompiledKey(m_shaderVariantKey), e_shaderType::fragment);
 
-        VkViewport viewport{};
-        viewport.x = 0.0f;
-        viewport.y = 0.0f;
-        viewport.width = (float) m_vulkanSwapChainExtent.width;
-        viewport.height = (float) m_vulkanSwapChainExtent.height;
-        viewport.minDepth = 0.0f;
-        viewport.maxDepth = 1.0f;
+        //Packed binaries are used straight from the mapping, loose ones are compiled or loaded here.
+        arrayView<uint32_t> vertexCode = resources.findPacked(vertexPath).as<uint32_t>();
+        arrayView<uint32_t> fragmentCode = resources.findPacked(fragmentPath).as<uint32_t>();
 
-        //This acts like a mask for the rasterizer.
-        VkRect2D scissor{};
-        scissor.offset = {0, 0};
-        scissor.extent = m_vulkanSwapChainExtent;
+#ifdef MAL_SHADER_COMPILER
+        m_shaderCache = std::make_unique<shaderCache>(resources.resolvePath("shadercache/"));
+        m_shaderBuilder = std::make_unique<shaderBuildService>(application::getThreadPool(), *m_shaderCache);
 
-        std::vector<VkDynamicState> dynamicStates = 
-        {
-            VK_DYNAMIC_STATE_VIEWPORT,
-            VK_DYNAMIC_STATE_SCISSOR
-        };
+        //Keeps the compiled words alive until the modules are created.
+        std::vector<shaderStageFuture> compiledStages;
 
-        VkPipelineDynamicStateCreateInfo dynamicState{};
-        dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-        dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
-        dynamicState.pDynamicStates = dynamicStates.data();
-
-        VkPipelineViewportStateCreateInfo viewportState{};
-        viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-        viewportState.viewportCount = 1;
-        viewportState.scissorCount = 1;
-
-        //Rasterizing
-        VkPipelineRasterizationStateCreateInfo rasterizer{};
-        rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-        rasterizer.depthClampEnable = VK_FALSE;
-        rasterizer.rasterizerDiscardEnable = VK_FALSE;
-        rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
-        rasterizer.lineWidth = 1.0f;
-        rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
-        rasterizer.frontFace = VK_FRONT_FACE_CLOCKWISE;
-        rasterizer.depthBiasEnable = VK_FALSE;
-        rasterizer.depthBiasConstantFactor = 0.0f; // Optional
-        rasterizer.depthBiasClamp = 0.0f; // Optional
-        rasterizer.depthBiasSlopeFactor = 0.0f; // Optional
-
-        // Multisampling
-        VkPipelineMultisampleStateCreateInfo multisampling{};
-        multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-        multisampling.sampleShadingEnable = VK_FALSE;
-        multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-        multisampling.minSampleShading = 1.0f; // Optional
-        multisampling.pSampleMask = nullptr; // Optional
-        multisampling.alphaToCoverageEnable = VK_FALSE; // Optional
-        multisampling.alphaToOneEnable = VK_FALSE; // Optional
-
-        //
-        //Depth and Stencil testing//
-        //
-
-        //Color blending
-        VkPipelineColorBlendAttachmentState colorBlendAttachment{};
-        colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-        colorBlendAttachment.blendEnable = VK_FALSE;
-        colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_ONE; // Optional
-        colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ZERO; // Optional
-        colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD; // Optional
-        colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE; // Optional
-        colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO; // Optional
-        colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD; // Optional
-
-        VkPipelineColorBlendStateCreateInfo colorBlending{};
-        colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-        colorBlending.logicOpEnable = VK_FALSE;
-        colorBlending.logicOp = VK_LOGIC_OP_COPY; // Optional
-        colorBlending.attachmentCount = 1;
-        colorBlending.pAttachments = &colorBlendAttachment;
-        colorBlending.blendConstants[0] = 0.0f; // Optional
-        colorBlending.blendConstants[1] = 0.0f; // Optional
-        colorBlending.blendConstants[2] = 0.0f; // Optional
-        colorBlending.blendConstants[3] = 0.0f; // Optional
-
-        //Pipeline layout
-        VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
-        pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-        pipelineLayoutInfo.setLayoutCount = 0; // Optional
-        pipelineLayoutInfo.pSetLayouts = nullptr; // Optional
-        pipelineLayoutInfo.pushConstantRangeCount = 0; // Optional
-        pipelineLayoutInfo.pPushConstantRanges = nullptr; // Optional
-
-        if (vkCreatePipelineLayout(m_vulkanLogicalDevice, &pipelineLayoutInfo, nullptr, 
-            &m_vulkanPipelineLayout) != VK_SUCCESS) 
-        {
-            throw std::runtime_error("failed to create pipeline layout!");
-        }
-
-        VkGraphicsPipelineCreateInfo pipelineInfo{};
-        pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-        pipelineInfo.stageCount = 2;
-        pipelineInfo.pStages = shaderStages;
-        pipelineInfo.pVertexInputState = &vertexInputInfo;
-        pipelineInfo.pInputAssemblyState = &inputAssembly;
-        pipelineInfo.pViewportState = &viewportState;
-        pipelineInfo.pRasterizationState = &rasterizer;
-        pipelineInfo.pMultisampleState = &multisampling;
-        pipelineInfo.pDepthStencilState = nullptr; // Optional
-        pipelineInfo.pColorBlendState = &colorBlending;
-        pipelineInfo.pDynamicState = &dynamicState;
-        pipelineInfo.layout = m_vulkanPipelineLayout;
-        pipelineInfo.renderPass = m_vulkanRenderPass;
-        pipelineInfo.subpass = 0;
-        pipelineInfo.basePipelineHandle = VK_NULL_HANDLE; // Optional
-        pipelineInfo.basePipelineIndex = -1; // Optional
-
-        if (vkCreateGraphicsPipelines(m_vulkanLogicalDevice, VK_NULL_HANDLE, 1, 
-            &pipelineInfo, nullptr, &m_vulkanGraphicsPipeline) != VK_SUCCESS)
-        {
-            throw std::runtime_error("failed to create graphics pipeline!");
-        }
-
-        //Clean up after sending to VK
-        for (VkShaderModule shaderModule: m_vulkanShaderModules)
-        {
-            vkDestroyShaderModule(m_vulkanLogicalDevice, shaderModule, nullptr);
-        }
-
-        m_vulkanShaderModules.clear();
-    }
-
-    VkPipelineShaderStageCreateInfo renderLayer::createShaderModule(std::filesystem::path filePath, e_shaderType shaderType)
-    {
-        MAL_LOG_TRACE("Reading Shader at path: ", filePath);
-
-        std::vector<char> shaderCode = readShaderFile(filePath);
-
-        VkShaderModuleCreateInfo createInfo{};
-        createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-        createInfo.codeSize = shaderCode.size();
-        createInfo.pCode = reinterpret_cast<const uint32_t*>(shaderCode.data());
-        
-        //Handle this error better
-        VkShaderModule shaderModule;
-        if (vkCreateShaderModule(m_vulkanLogicalDevice, &createInfo, nullptr, &shaderModule) != VK_SUCCESS)
+        if (vertexCode.empty() || fragmentCode.empty())
         {
-            throw std::runtime_error("failed to create shader module!");
-        }
+            std::filesystem::path mainPath = std::filesystem::current_path();
+            MAL_LOG_TRACE("Current Working Directory Path: ", mainPath);
 
-        VkPipelineShaderStageCreateInfo shaderStageInfo{};
-        shaderStageInfo.module = shaderModule;
-        shaderStageInfo.pName = "main";
+            compiledStages = buildShaders();
 
-        switch (shaderType)
-        {
-            case e_shaderType::vertex:
+            //Sections compile in parallel, each stage is picked up as soon as its own future is ready.
+            for (const shaderStageFuture& compiledStage : compiledStages)
             {
-                shaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-                shaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
-                break;
+                const compiledShaderStage& stage = compiledStage.get();
+                stage.logDiagnostics();
+
+                if (stage.shaderType == e_shaderType::vertex && stage.isCompiled())
+                {
+                    vertexCode = stage.spirv;
+                }
+                else if (stage.shaderType == e_shaderType::fragment && stage.isCompiled())
+                {
+                    fragmentCode = stage.spirv;
+                }
             }
-            case e_shaderType::fragment:
+
+            m_shaderCache->logStats();
+
+            if (vertexCode.empty() || fragmentCode.empty())
             {
-                shaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-                shaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-                break;
+                throw std::runtime_error("failed to compile shaders!");
             }
-            default:
+        }
+        else
+        {
+            //Packed binaries are used as is with the keywords cooked alongside, the source is only parsed to know what to watch.
+            std::shared_ptr<shaderSourceFile> sourceFile = parseShaderSource(resources.resolvePath("shaders/simple.shader"), m_shaderBuilder->getIncludeCache());
+            watchShaderDependencies(*sourceFile);
+        }
+#else
+        //Shipping builds have no compiler, the binaries come from malachite-cook.
+        resourceHandle<fileResource> vertexBinary;
+        resourceHandle<fileResource> fragmentBinary;
+
+        if (vertexCode.empty() || fragmentCode.empty())
+        {
+            vertexBinary = resources.load<fileResource>(vertexPath, e_resourcePriority::critical);
+            fragmentBinary = resources.load<fileResource>(fragmentPath, e_resourcePriority::critical);
+
+            //The pipeline can't be built without them, blocking is fine during initalization only.
+            if (!resources.wait(vertexBinary) || !resources.wait(fragmentBinary))
             {
-                throw std::runtime_error("shader type is not supported!");
-                break;
+                throw std::runtime_error("failed to load cooked shader binaries!");
             }
+
+            vertexCode = arrayView<char>(vertexBinary->bytes).as<uint32_t>();
+            fragmentCode = arrayView<char>(fragmentBinary->bytes).as<uint32_t>();
         }
+#endif
+
+        m_pipelineLayoutCache.initalize(m_vulkanLogicalDevice);
+        m_pipelineStates.initalize(m_vulkanLogicalDevice, m_pipelineCache.get(), m_pipelineLayoutCache, application::getThreadPool(), m_deletionQueue);
 
-        m_vulkanShaderModules.push_back(shaderModule);
+        //Nothing to draw with until the first pipeline exists, so this one is created right away.
+        auto pipelineStartTime = std::chrono::steady_clock::now();
 
-        return shaderStageInfo;
+        m_scenePipeline = describeScenePipeline(vertexCode, fragmentCode);
+        m_pipelineStates.getPipeline(m_scenePipeline);
+        m_pipelineStates.logCompletions();
+
+        //Run once with and once without pipeline.cache to see what the driver cache saves.
+        std::chrono::duration<double, std::milli> pipelineTime = std::chrono::steady_clock::now() - pipelineStartTime;
+        MAL_LOG_TRACE
+        (
+            "Startup Pipelines: ", std::to_string(m_pipelineStates.getPipelineCount()),
+            " in ", std::to_string(pipelineTime.count()), " ms, ",
+            m_pipelineCache.isWarm() ? "warm" : "cold", " pipeline cache"
+        );
     }
 
-    void renderLayer::initalizeFrameBuffers()
+    pipelineDescription renderLayer::describeScenePipeline(arrayView<uint32_t> vertexCode, arrayView<uint32_t> fragmentCode)
     {
-        m_vulkanSwapChainFrameBuffers.resize(m_vulkanSwapChainImageViews.size());
+        pipelineDescription description;
+        description.vertexShader = pipelineShader::create(vertexCode);
+        description.fragmentShader = pipelineShader::create(fragmentCode);
 
-        for (size_t i = 0; i < m_vulkanSwapChainImageViews.size(); i++) {
-            VkImageView attachments[] = {
-                m_vulkanSwapChainImageViews[i]
-            };
+        //Specialization keywords are baked in when the pipeline is created, compiled keywords already picked the code.
+        shaderSpecialization specialization;
+        specialization.build(m_shaderKeywords, m_shaderVariantKey);
+        description.specializationValues = specialization.values;
 
-            VkFramebufferCreateInfo framebufferInfo{};
-            framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-            framebufferInfo.renderPass = m_vulkanRenderPass;
-            framebufferInfo.attachmentCount = 1;
-            framebufferInfo.pAttachments = attachments;
-            framebufferInfo.width = m_vulkanSwapChainExtent.width;
-            framebufferInfo.height = m_vulkanSwapChainExtent.height;
-            framebufferInfo.layers = 1;
+        description.renderPass = m_vulkanRenderPass;
+        description.subpass = 0;
 
-            if (vkCreateFramebuffer(m_vulkanLogicalDevice, &framebufferInfo, nullptr, &m_vulkanSwapChainFrameBuffers[i]) != VK_SUCCESS) 
-            {
-                throw std::runtime_error("failed to create framebuffer!");
-            }
-        }
+        return description;
     }
 
-    void renderLayer::initalizeCommandPool()
+    void renderLayer::loadShaderKeywords()
     {
-        malachite::queueFamilyIndices queueFamilyIndices = findQueueFamilies(m_vulkanPhysicalDevice);
+        resourceManager& resources = application::getResourceManager();
+        const char* keywordsPath = "shaderbinaries/simple.keywords";
 
-        VkCommandPoolCreateInfo poolInfo{};
-        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-        poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-        poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
+        arrayView<char> keywords = resources.findPacked(keywordsPath);
+        resourceHandle<fileResource> keywordsFile;
 
-        if (vkCreateCommandPool(m_vulkanLogicalDevice, &poolInfo, nullptr, &m_vulkanCommandPool) != VK_SUCCESS) 
+        if (keywords.empty())
         {
-            throw std::runtime_error("failed to create command pool!");
-        }
-    }
+            //Not there when the shaders were never cooked, only the base variant can be used then.
+            keywordsFile = resources.load<fileResource>(keywordsPath, e_resourcePriority::critical);
+            if (!resources.wait(keywordsFile))
+            {
+                m_shaderKeywords = shaderKeywords();
+                return;
+            }
 
-    void renderLayer::initalizeCommandBuffer()
-    {
-        VkCommandBufferAllocateInfo allocInfo{};
-        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-        allocInfo.commandPool = m_vulkanCommandPool;
-        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-        allocInfo.commandBufferCount = 1;
+            keywords = arrayView<char>(keywordsFile->bytes);
+        }
 
-        if (vkAllocateCommandBuffers(m_vulkanLogicalDevice, &allocInfo, &m_vulkanCommandBuffer) != VK_SUCCESS)
+        if (!parseShaderKeywords(std::string_view(keywords.data, keywords.size), m_shaderKeywords))
         {
-            throw std::runtime_error("failed to allocate command buffers!");
+            throw std::runtime_error("failed to parse shader keywords!");
         }
     }
 
-    void renderLayer::recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex)
+    shaderVariantKey renderLayer::resolveShaderVariantKey() const
     {
-        VkCommandBufferBeginInfo beginInfo{};
-        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-        beginInfo.flags = 0; // Optional
-        beginInfo.pInheritanceInfo = nullptr; // Optional
+        std::vector<std::string_view> enabledKeywords(m_enabledShaderKeywords.begin(), m_enabledShaderKeywords.end());
+        return m_shaderKeywords.getVariantKey(enabledKeywords);
+    }
 
-        if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) 
+    std::string renderLayer::getSceneShaderBinaryPath(shaderVariantKey compiledKey, e_shaderType shaderType) const
+    {
+        return "shaderbinaries/" + getShaderVariantFileName("simple", compiledKey, shaderType);
+    }
+
+    void renderLayer::updateShaderVariant()
+    {
+#ifndef MAL_SHADER_COMPILER
+        //Binaries of the previous switch, checked again every frame until both are done.
+        if (m_pendingVertexBinary.isValid())
         {
-            throw std::runtime_error("failed to begin recording command buffer!");
-        }
+            auto isDone = [](e_resourceState state)
+            {
+                return state == e_resourceState::loaded || state == e_resourceState::failed;
+            };
 
-        VkRenderPassBeginInfo renderPassInfo{};
-        renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-        renderPassInfo.renderPass = m_vulkanRenderPass;
-        renderPassInfo.framebuffer = m_vulkanSwapChainFrameBuffers[imageIndex];
-        renderPassInfo.renderArea.offset = {0, 0};
-        renderPassInfo.renderArea.extent = m_vulkanSwapChainExtent;
-
-        //TODO make a wrapper for safe and easy command buffer manipulation
-        vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
-        {
-            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_vulkanGraphicsPipeline);
-
-            VkClearValue clearColor = {{{0.0f, 0.0f, 0.0f, 1.0f}}};
-            renderPassInfo.clearValueCount = 1;
-            renderPassInfo.pClearValues = &clearColor;
-
-            VkViewport viewport{};
-            viewport.x = 0.0f;
-            viewport.y = 0.0f;
-            viewport.width = static_cast<float>(m_vulkanSwapChainExtent.width);
-            viewport.height = static_cast<float>(m_vulkanSwapChainExtent.height);
-            viewport.minDepth = 0.0f;
-            viewport.maxDepth = 1.0f;
-            vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
-
-            VkRect2D scissor{};
-            scissor.offset = {0, 0};
-            scissor.extent = m_vulkanSwapChainExtent;
-            vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
-
-            // vertex count
-            // instance count
-            // first vertex
-            // first instance
-            vkCmdDraw(commandBuffer, 3, 1, 0, 0);
-            
-            // Always call this.
-            vkCmdEndRenderPass(commandBuffer);
+            if (!isDone(m_pendingVertexBinary.getState()) || !isDone(m_pendingFragmentBinary.getState()))
+            {
+                return;
+            }
+
+            if (m_pendingVertexBinary.isLoaded() && m_pendingFragmentBinary.isLoaded())
+            {
+                m_shaderVariantKey = m_pendingShaderVariantKey;
+                setScenePipeline(describeScenePipeline(arrayView<char>(m_pendingVertexBinary->bytes).as<uint32_t>(), arrayView<char>(m_pendingFragmentBinary->bytes).as<uint32_t>()));
+            }
+            else
+            {
+                //Keep running on the old variant.
+                MAL_LOG_ERROR("Failed to load shader variant: ", std::to_string(m_pendingShaderVariantKey));
+            }
+
+            m_pendingVertexBinary.reset();
+            m_pendingFragmentBinary.reset();
         }
+#endif
 
-        if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+        if (!m_isShaderVariantChanged)
         {
-            throw std::runtime_error("failed to record command buffer!");
+            return;
         }
-    }
-
-    void renderLayer::initalizeSyncObjects()
-    {
-        VkSemaphoreCreateInfo semaphoreInfo{};
-        semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-        VkFenceCreateInfo fenceInfo{};
-        fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-        fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+        m_isShaderVariantChanged = false;
 
-        if (vkCreateSemaphore(m_vulkanLogicalDevice, &semaphoreInfo, nullptr, &m_vulkanImageAvailableSemaphore) != VK_SUCCESS ||
-            vkCreateSemaphore(m_vulkanLogicalDevice, &semaphoreInfo, nullptr, &m_vulkanRenderFinishedSemaphore) != VK_SUCCESS ||
-            vkCreateFence(m_vulkanLogicalDevice, &fenceInfo, nullptr, &m_vulkanInFlightFence) != VK_SUCCESS) 
+        shaderVariantKey variantKey = resolveShaderVariantKey();
+        if (variantKey == m_shaderVariantKey)
         {
-            throw std::runtime_error("failed to create semaphores!");
+            return;
         }
-    }
 
-    void renderLayer::render(double& deltaTime)
-    {
-        if(glfwWindowShouldClose(m_glfwWindowPtr))
+        //Only specialization keywords changed, the code stays and only the constants are rebuilt.
+        if (m_shaderKeywords.getCompiledKey(variantKey) == m_shaderKeywords.getCompiledKey(m_shaderVariantKey))
         {
-            vkDeviceWaitIdle(m_vulkanLogicalDevice);
+            m_shaderVariantKey = variantKey;
 
-            application::closeApp();
+            shaderSpecialization specialization;
+            specialization.build(m_shaderKeywords, m_shaderVariantKey);
+
+            pipelineDescription description = m_scenePipeline;
+            description.specializationValues = specialization.values;
+            setScenePipeline(std::move(description));
             return;
         }
 
-        glfwPollEvents();
-        drawFrame(deltaTime);
-    }
+#ifdef MAL_SHADER_COMPILER
+        //Cooked binaries may be older than the source, updateShaderHotReload compiles the variant instead.
+        m_isShaderRebuildRequested = true;
+#else
+        resourceManager& resources = application::getResourceManager();
 
-    void renderLayer::drawFrame(double& deltaTime)
-    {
-        vkWaitForFences(m_vulkanLogicalDevice, 1, &m_vulkanInFlightFence, VK_TRUE, UINT64_MAX);
-        vkResetFences(m_vulkanLogicalDevice, 1, &m_vulkanInFlightFence);
+        shaderVariantKey compiledKey = m_shaderKeywords.getCompiledKey(variantKey);
+        std::string vertexPath = getSceneShaderBinaryPath(compiledKey, e_shaderType::vertex);
+        std::string fragmentPath = getSceneShaderBinaryPath(compiledKey, e_shaderType::fragment);
 
-        uint32_t imageIndex;
-        vkAcquireNextImageKHR(m_vulkanLogicalDevice, m_vulkanSwapChain, UINT64_MAX, m_vulkanImageAvailableSemaphore, VK_NULL_HANDLE, &imageIndex);
+        arrayView<uint32_t> vertexCode = resources.findPacked(vertexPath).as<uint32_t>();
+        arrayView<uint32_t> fragmentCode = resources.findPacked(fragmentPath).as<uint32_t>();
 
-        vkResetCommandBuffer(m_vulkanCommandBuffer, 0);
-        recordCommandBuffer(m_vulkanCommandBuffer, imageIndex);
+        if (!vertexCode.empty() && !fragmentCode.empty())
+        {
+            m_shaderVariantKey = variantKey;
+            setScenePipeline(describeScenePipeline(vertexCode, fragmentCode));
+            return;
+        }
 
-        VkSubmitInfo submitInfo{};
-        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        //Never block the frame on loose files, swapped in by a later frame.
+        m_pendingShaderVariantKey = variantKey;
+        m_pendingVertexBinary = resources.load<fileResource>(vertexPath, e_resourcePriority::high);
+        m_pendingFragmentBinary = resources.load<fileResource>(fragmentPath, e_resourcePriority::high);
+#endif
+    }
 
-        VkSemaphore waitSemaphores[] = {m_vulkanImageAvailableSemaphore};
+    void renderLayer::setScenePipeline(pipelineDescription&& description)
+    {
+        //Of the current and the fallback pipeline, the one not kept is released.
+        pipelineDescription replaced = m_scenePipeline;
+        if (m_pipelineStates.getStatus(m_scenePipeline) == e_pipelineStatus::ready)
+        {
+            replaced = std::exchange(m_fallbackScenePipeline, m_scenePipeline);
+        }
+
+        m_scenePipeline = std::move(description);
+        m_pipelineStates.requestPipeline(m_scenePipeline);
+
+        //Frames in flight may still draw with it, it's destroyed once they're done.
+        if (!(replaced == m_scenePipeline) && !(replaced == m_fallbackScenePipeline))
+        {
+            m_pipelineStates.releasePipeline(replaced);
+        }
+    }
+
+#ifdef MAL_SHADER_COMPILER
+    std::vector<shaderStageFuture> renderLayer::buildShaders()
+    {
+        resourceManager& resources = application::getResourceManager();
+
+        std::filesystem::path shaderPath = resources.resolvePath("shaders/simple.shader");
+        std::filesystem::path shaderBinaryOutputPath = resources.resolvePath("shaderbinaries/");
+
+        MAL_LOG_TRACE("Generating SPV Binaries: ", shaderPath);
+
+        std::shared_ptr<shaderSourceFile> sourceFile = parseShaderSource(shaderPath, m_shaderBuilder->getIncludeCache());
+        watchShaderDependencies(*sourceFile);
+
+        //Keywords may have been added or removed by the edit, so the key is rebuilt from the names.
+        m_shaderKeywords = sourceFile->keywords;
+        m_shaderVariantKey = resolveShaderVariantKey();
+
+        return m_shaderBuilder->compileSource(sourceFile, shaderBinaryOutputPath, m_shaderVariantKey);
+    }
+
+    void renderLayer::watchShaderDependencies(const shaderSourceFile& sourceFile)
+    {
+        //Edits to the shader or its includes are picked up by updateShaderHotReload.
+        m_shaderDependencies.clear();
+        for (const std::filesystem::path& file : sourceFile.files)
+        {
+            std::error_code error;
+            m_shaderDependencies.push_back(std::filesystem::weakly_canonical(file, error));
+
+            //Includes may come from outside the shader directory, only their own directory is watched.
+            m_shaderWatcher.watchDirectory(m_shaderDependencies.back().parent_path(), false);
+        }
+    }
+
+    void renderLayer::updateShaderHotReload()
+    {
+        if (m_pendingShaderStages.empty())
+        {
+            bool isDependencyChanged = false;
+            for (const std::filesystem::path& changedFile : m_shaderWatcher.pollChanges())
+            {
+                if (std::find(m_shaderDependencies.begin(), m_shaderDependencies.end(), changedFile) != m_shaderDependencies.end())
+                {
+                    MAL_LOG_TRACE("Shader source changed: ", changedFile);
+                    isDependencyChanged = true;
+                }
+            }
+
+            if (!isDependencyChanged && !m_isShaderRebuildRequested)
+            {
+                return;
+            }
+
+            m_isShaderRebuildRequested = false;
+
+            //Nothing is compiling, so no section still points into the mapped includes.
+            m_shaderBuilder->getIncludeCache().clear();
+
+            //Unchanged sections hash the same and come straight out of the shader cache.
+            try
+            {
+                m_pendingShaderStages = buildShaders();
+            }
+            catch (const std::runtime_error& error)
+            {
+                MAL_LOG_ERROR("Shader reload failed: ", error.what());
+            }
+
+            return;
+        }
+
+        //Never block the frame on the compiler, try again next frame.
+        for (const shaderStageFuture& pendingStage : m_pendingShaderStages)
+        {
+            if (pendingStage.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+            {
+                return;
+            }
+        }
+
+        std::vector<shaderStageFuture> compiledStages = std::move(m_pendingShaderStages);
+        m_pendingShaderStages.clear();
+
+        arrayView<uint32_t> vertexCode;
+        arrayView<uint32_t> fragmentCode;
+        bool isCompiled = true;
+
+        //Every stage is logged before giving up, a later one may have errors of its own.
+        for (const shaderStageFuture& compiledStage : compiledStages)
+        {
+            const compiledShaderStage& stage = compiledStage.get();
+            stage.logDiagnostics();
+
+            if (!stage.isCompiled())
+            {
+                isCompiled = false;
+            }
+            else if (stage.shaderType == e_shaderType::vertex)
+            {
+                vertexCode = stage.spirv;
+            }
+            else if (stage.shaderType == e_shaderType::fragment)
+            {
+                fragmentCode = stage.spirv;
+            }
+        }
+
+        //Keep running on the old pipeline.
+        if (!isCompiled || vertexCode.empty() || fragmentCode.empty())
+        {
+            return;
+        }
+
+        //Unchanged state hashes the same, so reverting an edit picks the old pipeline straight back up.
+        setScenePipeline(describeScenePipeline(vertexCode, fragmentCode));
+
+        m_shaderCache->logStats();
+        MAL_LOG_TRACE("Reloading graphics pipeline.");
+    }
+#endif
+
+    void renderLayer::initalizeCommandPool()
+    {
+        malachite::queueFamilyIndices queueFamilyIndices = findQueueFamilies(m_vulkanPhysicalDevice);
+
+        VkCommandPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+        poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
+
+        if (vkCreateCommandPool(m_vulkanLogicalDevice, &poolInfo, nullptr, &m_vulkanCommandPool) != VK_SUCCESS) 
+        {
+            throw std::runtime_error("failed to create command pool!");
+        }
+    }
+
+    void renderLayer::initalizeTextureStreaming()
+    {
+        //Uploads share the graphics queue, they're submitted between frames from the main thread.
+        malachite::queueFamilyIndices queueFamilyIndices = findQueueFamilies(m_vulkanPhysicalDevice);
+        m_textureStreamer.initalize(application::getResourceManager(), m_deletionQueue, m_gpuAllocator, m_vulkanLogicalDevice, m_vulkanGraphicsQueue, queueFamilyIndices.graphicsFamily.value());
+    }
+
+    void renderLayer::initalizeMeshBuffers()
+    {
+        //A transfer queue uploads while the graphics queue renders, the graphics queue does both otherwise.
+        malachite::queueFamilyIndices queueFamilyIndices = findQueueFamilies(m_vulkanPhysicalDevice);
+        uint32_t graphicsFamily = queueFamilyIndices.graphicsFamily.value();
+
+        m_meshes.initalize(m_gpuAllocator, m_deletionQueue, m_vulkanLogicalDevice, m_vulkanTransferQueue, queueFamilyIndices.transferFamily.value_or(graphicsFamily), graphicsFamily);
+        m_drawBatcher.initalize(m_gpuAllocator, m_vulkanPhysicalDevice, m_framesInFlight);
+    }
+
+    void renderLayer::setObjectMesh(uint32_t objectIndex, meshId mesh)
+    {
+        if (objectIndex >= m_objectMeshes.size())
+        {
+            m_objectMeshes.resize(objectIndex + 1, c_invalidMesh);
+        }
+
+        m_objectMeshes[objectIndex] = mesh;
+    }
+
+    void renderLayer::setObjectTransform(uint32_t objectIndex, const math::mat4& transform)
+    {
+        if (objectIndex >= m_objectTransforms.size())
+        {
+            m_objectTransforms.resize(objectIndex + 1, math::mat4::identity());
+        }
+
+        m_objectTransforms[objectIndex] = transform;
+    }
+
+    void renderLayer::benchmarkDrawRecording(uint32_t objectCount, uint32_t frameCount)
+    {
+        //Nothing may be using the frame's batch buffer or command buffer while they're rerecorded.
+        vkDeviceWaitIdle(m_vulkanLogicalDevice);
+
+        //Unit cube, 8 positions and 36 indices.
+        const float cubeVertices[] =
+        {
+            -0.5f, -0.5f, -0.5f,   0.5f, -0.5f, -0.5f,   0.5f,  0.5f, -0.5f,  -0.5f,  0.5f, -0.5f,
+            -0.5f, -0.5f,  0.5f,   0.5f, -0.5f,  0.5f,   0.5f,  0.5f,  0.5f,  -0.5f,  0.5f,  0.5f
+        };
+
+        const std::vector<uint32_t> cubeIndices =
+        {
+            0, 2, 1, 0, 3, 2,  4, 5, 6, 4, 6, 7,  0, 1, 5, 0, 5, 4,
+            3, 6, 2, 3, 7, 6,  0, 4, 7, 0, 7, 3,  1, 2, 6, 1, 6, 5
+        };
+
+        //A handful of meshes so batching has more than one draw to merge into.
+        constexpr uint32_t c_benchmarkMeshCount = 16;
+
+        std::vector<meshId> benchmarkMeshes;
+        for (uint32_t i = 0; i < c_benchmarkMeshCount; i++)
+        {
+            benchmarkMeshes.push_back(m_meshes.createMesh(arrayView<uint8_t>(reinterpret_cast<const uint8_t*>(cubeVertices), sizeof(cubeVertices)), 3 * sizeof(float), cubeIndices));
+        }
+
+        //Submit the copies, wait for them and let the pool see they're done.
+        m_meshes.update();
+        vkDeviceWaitIdle(m_vulkanLogicalDevice);
+        m_meshes.update();
+
+        //Cubes on a grid, every object visible.
+        uint32_t gridSize = (uint32_t) std::ceil(std::cbrt((double) objectCount));
+
+        std::vector<float> positionXs(objectCount), positionYs(objectCount), positionZs(objectCount);
+        std::vector<float> rotationXs(objectCount, 0.0f), rotationYs(objectCount, 0.0f), rotationZs(objectCount, 0.0f), rotationWs(objectCount, 1.0f);
+        std::vector<float> scales(objectCount, 1.0f);
+
+        boundingSpheres benchmarkBounds;
+        std::vector<meshId> benchmarkObjectMeshes(objectCount);
+        std::vector<math::mat4> benchmarkTransforms(objectCount);
+        std::vector<uint32_t> visibleObjects(objectCount);
+
+        for (uint32_t i = 0; i < objectCount; i++)
+        {
+            positionXs[i] = (float) (i % gridSize) * 2.0f;
+            positionYs[i] = (float) (i / gridSize % gridSize) * 2.0f;
+            positionZs[i] = (float) (i / (gridSize * gridSize)) * 2.0f;
+
+            benchmarkBounds.add({positionXs[i], positionYs[i], positionZs[i]}, 0.87f);
+            benchmarkObjectMeshes[i] = benchmarkMeshes[i % c_benchmarkMeshCount];
+            visibleObjects[i] = i;
+        }
+
+        math::composeModelMatrices
+        (
+            application::getThreadPool(),
+            positionXs.data(), positionYs.data(), positionZs.data(),
+            rotationXs.data(), rotationYs.data(), rotationZs.data(), rotationWs.data(),
+            scales.data(), scales.data(), scales.data(),
+            objectCount,
+            benchmarkTransforms.data()
+        );
+
+        std::swap(m_objectBounds, benchmarkBounds);
+        std::swap(m_objectMeshes, benchmarkObjectMeshes);
+        std::swap(m_objectTransforms, benchmarkTransforms);
+        bool wasDrawBatching = m_isDrawBatching;
+        bool wasParallelRecording = m_isParallelRecording;
+
+        //Nothing recorded here is submitted, its timestamps would never be written.
+        bool wasGpuProfiling = m_gpuProfiler.isEnabled();
+        m_gpuProfiler.setEnabled(false);
+
+        VkCommandBuffer commandBuffer = m_frames[m_currentFrame].commandBuffer;
+
+        struct benchmarkMode
+        {
+            const char* name;
+            bool isBatched;
+            bool isParallel;
+        };
+
+        const benchmarkMode modes[] =
+        {
+            {"Batched", true, true},
+            {"Unbatched", false, true},
+            {"Unbatched single threaded", false, false}
+        };
+
+        //Average milliseconds per recorded frame.
+        auto timeRecording = [&]()
+        {
+            auto startTime = std::chrono::steady_clock::now();
+            for (uint32_t frame = 0; frame < frameCount; frame++)
+            {
+                vkResetCommandBuffer(commandBuffer, 0);
+                recordCommandBuffer(commandBuffer, 0, visibleObjects);
+            }
+
+            std::chrono::duration<double, std::milli> recordTime = std::chrono::steady_clock::now() - startTime;
+            return recordTime.count() / std::max(frameCount, 1u);
+        };
+
+        for (const benchmarkMode& mode : modes)
+        {
+            m_isDrawBatching = mode.isBatched;
+            m_isParallelRecording = mode.isParallel;
+
+            double frameMilliseconds = timeRecording();
+
+            MAL_LOG_TRACE
+            (
+                mode.name, " recording of ", std::to_string(objectCount), " objects: ",
+                std::to_string(frameMilliseconds), "ms per frame, ",
+                std::to_string(m_drawCallCount), " draw calls"
+            );
+        }
+
+        //One slice records inline on the main thread, the speedup of the others is relative to it.
+        m_isDrawBatching = false;
+        m_isParallelRecording = true;
+
+        std::vector<uint32_t> sliceCounts;
+        for (uint32_t sliceCount = 1; sliceCount < m_commandRecorder.getMaxSliceCount(); sliceCount *= 2)
+        {
+            sliceCounts.push_back(sliceCount);
+        }
+
+        sliceCounts.push_back(m_commandRecorder.getMaxSliceCount());
+
+        double inlineMilliseconds = 0.0;
+
+        for (uint32_t sliceCount : sliceCounts)
+        {
+            m_recordSliceLimit = sliceCount;
+
+            double frameMilliseconds = timeRecording();
+            if (sliceCount == 1)
+            {
+                inlineMilliseconds = frameMilliseconds;
+            }
+
+            MAL_LOG_TRACE
+            (
+                "Unbatched recording in ", std::to_string(sliceCount), " slices: ",
+                std::to_string(frameMilliseconds), "ms per frame, ",
+                std::to_string(inlineMilliseconds / frameMilliseconds), "x"
+            );
+        }
+
+        m_recordSliceLimit = 0;
+        vkResetCommandBuffer(commandBuffer, 0);
+
+        std::swap(m_objectBounds, benchmarkBounds);
+        std::swap(m_objectMeshes, benchmarkObjectMeshes);
+        std::swap(m_objectTransforms, benchmarkTransforms);
+        m_isDrawBatching = wasDrawBatching;
+        m_isParallelRecording = wasParallelRecording;
+        m_gpuProfiler.setEnabled(wasGpuProfiling);
+
+        for (meshId mesh : benchmarkMeshes)
+        {
+            m_meshes.destroyMesh(mesh);
+        }
+    }
+
+    void renderLayer::initalizeCommandBuffers()
+    {
+        m_frames.resize(m_framesInFlight);
+
+        std::vector<VkCommandBuffer> commandBuffers(m_framesInFlight);
+
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = m_vulkanCommandPool;
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandBufferCount = m_framesInFlight;
+
+        if (vkAllocateCommandBuffers(m_vulkanLogicalDevice, &allocInfo, commandBuffers.data()) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to allocate command buffers!");
+        }
+
+        for (uint32_t i = 0; i < m_framesInFlight; i++)
+        {
+            m_frames[i].commandBuffer = commandBuffers[i];
+        }
+
+        //A slice for every worker and one for the recording thread, which works on them too.
+        malachite::queueFamilyIndices queueFamilyIndices = findQueueFamilies(m_vulkanPhysicalDevice);
+        m_commandRecorder.initalize(m_vulkanLogicalDevice, queueFamilyIndices.graphicsFamily.value(), m_framesInFlight, application::getThreadPool().getThreadCount() + 1);
+
+        m_gpuProfiler.initalize(m_vulkanPhysicalDevice, m_vulkanLogicalDevice, m_vulkanGraphicsQueue, queueFamilyIndices.graphicsFamily.value(), m_framesInFlight, application::getProfiler());
+    }
+
+    void renderLayer::recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex, arrayView<uint32_t> visibleObjects)
+    {
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = 0; // Optional
+        beginInfo.pInheritanceInfo = nullptr; // Optional
+
+        if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) 
+        {
+            throw std::runtime_error("failed to begin recording command buffer!");
+        }
+
+        //The graph times each of its passes inside this one.
+        m_gpuProfiler.beginFrame(commandBuffer, m_currentFrame);
+        uint32_t frameScope = m_gpuProfiler.beginScope(commandBuffer, "frame");
+
+        //A scene pipeline still being created falls back to the previous one, without either the pass only clears.
+        cachedPipeline scenePipeline = m_pipelineStates.requestPipeline(m_scenePipeline, &m_fallbackScenePipeline);
+
+        //Only what survived culling, the instance data carries the object index.
+        bool hasObjectDraws = scenePipeline.pipeline && m_objectBounds.size() > 0 &&
+            m_drawBatcher.build(m_currentFrame, visibleObjects, m_objectMeshes, m_objectTransforms, m_meshes, m_isDrawBatching);
+
+        //Large draw lists are split into slices recorded on the thread pool.
+        uint32_t drawCount = hasObjectDraws ? m_drawBatcher.getDrawCount() : 0;
+        uint32_t maxSliceCount = m_recordSliceLimit > 0 ? std::min(m_recordSliceLimit, m_commandRecorder.getMaxSliceCount()) : m_commandRecorder.getMaxSliceCount();
+        uint32_t sliceCount = m_isParallelRecording ? std::min(drawCount / c_minDrawsPerSlice, maxSliceCount) : 0;
+        bool isRecordingSlices = sliceCount > 1;
+
+        m_drawCallCount = 0;
+
+        m_renderGraph.reset();
+
+        renderGraphTextureDesc swapChainDesc;
+        swapChainDesc.format = m_vulkanSwapChainImageFormat;
+        swapChainDesc.extent = m_vulkanSwapChainExtent;
+
+        //The acquire semaphore is waited on at the color output stage, the first barrier chains to it.
+        renderGraphTextureState swapChainState;
+        swapChainState.layout = VK_IMAGE_LAYOUT_UNDEFINED;
+        swapChainState.stages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        swapChainState.access = 0;
+
+        renderGraphResource swapChainImage = m_renderGraph.importTexture
+        (
+            "swapchain",
+            m_vulkanSwapChainImages[imageIndex],
+            m_vulkanSwapChainImageViews[imageIndex],
+            swapChainDesc,
+            swapChainState,
+            VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+            true
+        );
+
+        VkClearColorValue clearColor = {{0.0f, 0.0f, 0.0f, 1.0f}};
+
+        m_renderGraph.addPass("scene", [&](VkCommandBuffer passCommandBuffer, const renderGraphPassContext& context)
+        {
+            if (isRecordingSlices)
+            {
+                VkCommandBufferInheritanceInfo inheritanceInfo{};
+                inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+                inheritanceInfo.renderPass = context.renderPass;
+                inheritanceInfo.subpass = 0;
+                inheritanceInfo.framebuffer = context.framebuffer;
+
+                m_sliceDrawCallCounts.assign(sliceCount, 0);
+
+                //State isn't inherited, every slice binds its own.
+                m_commandRecorder.record(application::getThreadPool(), m_currentFrame, passCommandBuffer, inheritanceInfo, sliceCount, [&](VkCommandBuffer sliceCommandBuffer, uint32_t slice)
+                {
+                    uint32_t firstDraw = (uint32_t) ((uint64_t) drawCount * slice / sliceCount);
+                    uint32_t endDraw = (uint32_t) ((uint64_t) drawCount * (slice + 1) / sliceCount);
+
+                    recordSceneState(sliceCommandBuffer, scenePipeline.pipeline);
+                    m_sliceDrawCallCounts[slice] = m_drawBatcher.record(sliceCommandBuffer, m_meshes, firstDraw, endDraw - firstDraw);
+                });
+
+                for (uint32_t sliceDrawCallCount : m_sliceDrawCallCounts)
+                {
+                    m_drawCallCount += sliceDrawCallCount;
+                }
+
+                return;
+            }
+
+            recordSceneState(passCommandBuffer, scenePipeline.pipeline);
+
+            if (!scenePipeline.pipeline)
+            {
+                //Both failed to build, the errors were logged when they did.
+            }
+            else if (m_objectBounds.size() == 0)
+            {
+                // vertex count
+                // instance count
+                // first vertex
+                // first instance
+                vkCmdDraw(passCommandBuffer, 3, 1, 0, 0);
+                m_drawCallCount = 1;
+            }
+            else if (hasObjectDraws)
+            {
+                m_drawCallCount = m_drawBatcher.record(passCommandBuffer, m_meshes);
+            }
+        })
+        .writeColor(swapChainImage, &clearColor)
+        .setSecondaryCommandBuffers(isRecordingSlices);
+
+        m_renderGraph.compile();
+        m_renderGraph.execute(commandBuffer);
+
+        m_gpuProfiler.endScope(commandBuffer, frameScope);
+
+        if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to record command buffer!");
+        }
+    }
+
+    void renderLayer::recordSceneState(VkCommandBuffer commandBuffer, VkPipeline scenePipeline)
+    {
+        if (scenePipeline)
+        {
+            vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, scenePipeline);
+        }
+
+        VkViewport viewport{};
+        viewport.x = 0.0f;
+        viewport.y = 0.0f;
+        viewport.width = static_cast<float>(m_vulkanSwapChainExtent.width);
+        viewport.height = static_cast<float>(m_vulkanSwapChainExtent.height);
+        viewport.minDepth = 0.0f;
+        viewport.maxDepth = 1.0f;
+        vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+        VkRect2D scissor{};
+        scissor.offset = {0, 0};
+        scissor.extent = m_vulkanSwapChainExtent;
+        vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+    }
+
+    void renderLayer::initalizeSyncObjects()
+    {
+        VkSemaphoreCreateInfo semaphoreInfo{};
+        semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+        VkFenceCreateInfo fenceInfo{};
+        fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+        for (frameInFlight& frame : m_frames)
+        {
+            if (vkCreateSemaphore(m_vulkanLogicalDevice, &semaphoreInfo, nullptr, &frame.imageAvailableSemaphore) != VK_SUCCESS ||
+                vkCreateFence(m_vulkanLogicalDevice, &fenceInfo, nullptr, &frame.inFlightFence) != VK_SUCCESS) 
+            {
+                throw std::runtime_error("failed to create semaphores!");
+            }
+        }
+
+        initalizeSwapChainSemaphores();
+
+        m_frameStartTimes.assign(m_framesInFlight, {});
+        m_frameLatencyModes.assign(m_framesInFlight, m_latencyMode);
+
+        m_deletionQueue.initalize(m_framesInFlight);
+        m_renderGraph.initalize(m_gpuAllocator, m_deletionQueue, m_vulkanLogicalDevice, &m_gpuProfiler);
+    }
+
+    void renderLayer::initalizeSwapChainSemaphores()
+    {
+        VkSemaphoreCreateInfo semaphoreInfo{};
+        semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+        m_vulkanRenderFinishedSemaphores.resize(m_vulkanSwapChainImages.size());
+        for (VkSemaphore& semaphore : m_vulkanRenderFinishedSemaphores)
+        {
+            if (vkCreateSemaphore(m_vulkanLogicalDevice, &semaphoreInfo, nullptr, &semaphore) != VK_SUCCESS)
+            {
+                throw std::runtime_error("failed to create semaphores!");
+            }
+        }
+
+        m_vulkanImagesInFlight.assign(m_vulkanSwapChainImages.size(), VK_NULL_HANDLE);
+    }
+
+    void renderLayer::setLatencyMode(e_latencyMode mode)
+    {
+        if (mode == m_latencyMode)
+        {
+            return;
+        }
+
+        logLatencyStats(m_latencyMode);
+
+        m_latencyMode = mode;
+        m_isSwapChainDirty = true;
+    }
+
+    void renderLayer::setSwapChainImageCount(uint32_t imageCount)
+    {
+        m_requestedSwapChainImageCount = imageCount;
+        m_isSwapChainDirty = true;
+    }
+
+    void renderLayer::logLatencyStats(e_latencyMode mode) const
+    {
+        const frameLatencyStats& stats = m_latencyStats[(uint32_t) mode];
+        if (stats.frameCount == 0)
+        {
+            return;
+        }
+
+        MAL_LOG_TRACE
+        (
+            getLatencyModeName(mode), " mode over ", std::to_string(stats.frameCount), " frames: ",
+            std::to_string(stats.averageFrameMilliseconds), "ms per frame, ",
+            std::to_string(stats.averageLatencyMilliseconds), "ms latency (", std::to_string(stats.maxLatencyMilliseconds), "ms max), ",
+            std::to_string(stats.averageBlockedMilliseconds), "ms blocked"
+        );
+    }
+
+    bool renderLayer::recreateSwapChain()
+    {
+        int width = 0;
+        int height = 0;
+        glfwGetFramebufferSize(m_glfwWindowPtr, &width, &height);
+
+        //Minimized, there is nothing to present to.
+        if (width == 0 || height == 0)
+        {
+            return false;
+        }
+
+        //No device wait, earlier frames may still render to or present the old images. Their fences
+        //have all come around by the time the deletion queue gets to these.
+        VkSwapchainKHR oldSwapChain = m_vulkanSwapChain;
+        std::vector<VkImageView> oldImageViews = std::move(m_vulkanSwapChainImageViews);
+        std::vector<VkSemaphore> oldSemaphores = std::move(m_vulkanRenderFinishedSemaphores);
+        m_vulkanSwapChainImageViews.clear();
+        m_vulkanRenderFinishedSemaphores.clear();
+
+        initalizeSwapChain(oldSwapChain);
+        initalizeImageViews();
+        initalizeSwapChainSemaphores();
+
+        //Framebuffers of the old views.
+        m_renderGraph.releaseFramebuffers();
+
+        VkDevice device = m_vulkanLogicalDevice;
+        m_deletionQueue.push([device, oldSwapChain, oldImageViews = std::move(oldImageViews), oldSemaphores = std::move(oldSemaphores)]()
+        {
+            for (VkImageView imageView : oldImageViews)
+            {
+                vkDestroyImageView(device, imageView, nullptr);
+            }
+
+            for (VkSemaphore semaphore : oldSemaphores)
+            {
+                vkDestroySemaphore(device, semaphore, nullptr);
+            }
+
+            vkDestroySwapchainKHR(device, oldSwapChain, nullptr);
+        });
+
+        m_isSwapChainDirty = false;
+        m_isFramebufferResized = false;
+        m_lastPresentTime = {};
+
+        MAL_LOG_TRACE
+        (
+            "Swapchain recreated at ", std::to_string(m_vulkanSwapChainExtent.width), "x", std::to_string(m_vulkanSwapChainExtent.height),
+            " with ", std::to_string(m_vulkanSwapChainImages.size()), " images, ", getLatencyModeName(m_latencyMode), " mode"
+        );
+
+        return true;
+    }
+
+    void renderLayer::render(double& deltaTime)
+    {
+        if(glfwWindowShouldClose(m_glfwWindowPtr))
+        {
+            vkDeviceWaitIdle(m_vulkanLogicalDevice);
+
+            application::closeApp();
+            return;
+        }
+
+        glfwPollEvents();
+
+        //Pipelines finished on the pool since the last frame, a reload's failure shows up here.
+        m_pipelineStates.logCompletions();
+
+        drawFrame(deltaTime);
+    }
+
+    void renderLayer::cullObjects()
+    {
+        m_cullingStage.cull(application::getThreadPool(), m_cullingParams, m_objectBounds);
+    }
+
+    void renderLayer::drawFrame(double& deltaTime)
+    {
+        MAL_PROFILE_SCOPE("drawFrame");
+
+        //Where the frame samples its input, latency is measured from here.
+        auto frameStartTime = std::chrono::steady_clock::now();
+
+        //CPU only, runs while the GPU may still be busy with the previous frame.
+        {
+            MAL_PROFILE_SCOPE("cull");
+            cullObjects();
+        }
+
+        //Only waits for the frame that last used this slot, the others keep the GPU busy meanwhile.
+        frameInFlight& frame = m_frames[m_currentFrame];
+        auto blockStartTime = std::chrono::steady_clock::now();
+        {
+            MAL_PROFILE_SCOPE("waitForFrame");
+            vkWaitForFences(m_vulkanLogicalDevice, 1, &frame.inFlightFence, VK_TRUE, UINT64_MAX);
+        }
+
+        std::chrono::duration<double, std::milli> blockedTime = std::chrono::steady_clock::now() - blockStartTime;
+
+        //Its timestamps are final now, reading them doesn't wait. The last one is when the GPU finished the frame.
+        std::chrono::steady_clock::time_point gpuEndTime;
+        if (m_gpuProfiler.collect(m_currentFrame, &gpuEndTime) && m_frameStartTimes[m_currentFrame] != std::chrono::steady_clock::time_point())
+        {
+            frameLatencyStats& stats = m_latencyStats[(uint32_t) m_frameLatencyModes[m_currentFrame]];
+            double latency = std::chrono::duration<double, std::milli>(gpuEndTime - m_frameStartTimes[m_currentFrame]).count();
+
+            stats.latencySampleCount++;
+            accumulateAverage(stats.averageLatencyMilliseconds, latency, stats.latencySampleCount);
+            stats.maxLatencyMilliseconds = std::max(stats.maxLatencyMilliseconds, latency);
+        }
+
+        m_frameStartTimes[m_currentFrame] = {};
+
+        //A mode or image count change, a resize or a suboptimal present last frame. Skipped while minimized.
+        if ((m_isSwapChainDirty || m_isFramebufferResized) && !recreateSwapChain())
+        {
+            return;
+        }
+
+        //Acquired before the deletion queue advances, it may bail out without submitting and the queue
+        //has to advance once per submitted frame. Nothing this frame records uses what recreation queues.
+        uint32_t imageIndex;
+        VkResult acquireResult;
+
+        blockStartTime = std::chrono::steady_clock::now();
+        {
+            MAL_PROFILE_SCOPE("acquireImage");
+            acquireResult = vkAcquireNextImageKHR(m_vulkanLogicalDevice, m_vulkanSwapChain, UINT64_MAX, frame.imageAvailableSemaphore, VK_NULL_HANDLE, &imageIndex);
+        }
+
+        blockedTime += std::chrono::steady_clock::now() - blockStartTime;
+
+        if (acquireResult == VK_ERROR_OUT_OF_DATE_KHR)
+        {
+            //Nothing was acquired or signaled, the frame starts over on the new swapchain.
+            recreateSwapChain();
+            return;
+        }
+        else if (acquireResult == VK_SUBOPTIMAL_KHR)
+        {
+            //Still presentable, replaced at the next frame.
+            m_isSwapChainDirty = true;
+        }
+        else if (acquireResult != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to acquire swap chain image!");
+        }
+
+        //Objects replaced a full round of frames ago can't be in use anymore.
+        m_deletionQueue.advance();
+
+        //Frame boundary, pipelines swapped here go through the deletion queue.
+        updateShaderVariant();
+
+#ifdef MAL_SHADER_COMPILER
+        updateShaderHotReload();
+#endif
+
+        //Same for texture images replaced by streaming.
+        m_textureStreamer.update();
+
+        //Submits the mesh copies staged since the last frame.
+        m_meshes.update();
+
+        //With more frames in flight than images, or images handed out of order, another frame may still render to it.
+        if (m_vulkanImagesInFlight[imageIndex] != VK_NULL_HANDLE && m_vulkanImagesInFlight[imageIndex] != frame.inFlightFence)
+        {
+            blockStartTime = std::chrono::steady_clock::now();
+            vkWaitForFences(m_vulkanLogicalDevice, 1, &m_vulkanImagesInFlight[imageIndex], VK_TRUE, UINT64_MAX);
+            blockedTime += std::chrono::steady_clock::now() - blockStartTime;
+        }
+
+        m_vulkanImagesInFlight[imageIndex] = frame.inFlightFence;
+
+        vkResetFences(m_vulkanLogicalDevice, 1, &frame.inFlightFence);
+
+        vkResetCommandBuffer(frame.commandBuffer, 0);
+
+        auto recordStartTime = std::chrono::steady_clock::now();
+        {
+            MAL_PROFILE_SCOPE("recordCommandBuffer");
+            recordCommandBuffer(frame.commandBuffer, imageIndex, m_cullingStage.getVisible());
+        }
+
+        std::chrono::duration<double, std::milli> recordTime = std::chrono::steady_clock::now() - recordStartTime;
+        m_recordMilliseconds = recordTime.count();
+
+        VkSubmitInfo submitInfo{};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+
+        VkSemaphore waitSemaphores[] = {frame.imageAvailableSemaphore};
         VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
         submitInfo.waitSemaphoreCount = 1;
         submitInfo.pWaitSemaphores = waitSemaphores;
         submitInfo.pWaitDstStageMask = waitStages;
         submitInfo.commandBufferCount = 1;
-        submitInfo.pCommandBuffers = &m_vulkanCommandBuffer;
+        submitInfo.pCommandBuffers = &frame.commandBuffer;
 
-        VkSemaphore signalSemaphores[] = {m_vulkanRenderFinishedSemaphore};
+        VkSemaphore signalSemaphores[] = {m_vulkanRenderFinishedSemaphores[imageIndex]};
         submitInfo.signalSemaphoreCount = 1;
         submitInfo.pSignalSemaphores = signalSemaphores;
 
-        if (vkQueueSubmit(m_vulkanGraphicsQueue, 1, &submitInfo, m_vulkanInFlightFence) != VK_SUCCESS)
+        if (vkQueueSubmit(m_vulkanGraphicsQueue, 1, &submitInfo, frame.inFlightFence) != VK_SUCCESS)
         {
             throw std::runtime_error("failed to submit draw command buffer!");
         }
 
-        VkSubpassDependency dependency{};
-        dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-        dependency.dstSubpass = 0;
-
-        dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-        dependency.srcAccessMask = 0;
-
-        dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-        dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-
-        VkRenderPassCreateInfo renderPassInfo{};
-        renderPassInfo.dependencyCount = 1;
-        renderPassInfo.pDependencies = &dependency;
+        m_gpuProfiler.setFrameSubmitted(m_currentFrame);
 
         VkPresentInfoKHR presentInfo{};
         presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -1240,27 +1843,88 @@ namespace malachite
         presentInfo.pImageIndices = &imageIndex;
         presentInfo.pResults = nullptr; // Optionals
 
-        vkQueuePresentKHR(m_vulkanPresentQueue, &presentInfo);
+        VkResult presentResult;
+        {
+            MAL_PROFILE_SCOPE("present");
+            presentResult = vkQueuePresentKHR(m_vulkanPresentQueue, &presentInfo);
+        }
+
+        if (presentResult == VK_ERROR_OUT_OF_DATE_KHR || presentResult == VK_SUBOPTIMAL_KHR)
+        {
+            //The frame was submitted either way, the swapchain is replaced at the start of the next one.
+            m_isSwapChainDirty = true;
+        }
+        else if (presentResult != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to present swap chain image!");
+        }
+
+        //Latency is read back once the frame's timestamps are, frame times and blocking are known now.
+        m_frameStartTimes[m_currentFrame] = frameStartTime;
+        m_frameLatencyModes[m_currentFrame] = m_latencyMode;
+
+        auto presentTime = std::chrono::steady_clock::now();
+        frameLatencyStats& stats = m_latencyStats[(uint32_t) m_latencyMode];
+        stats.frameCount++;
+        accumulateAverage(stats.averageBlockedMilliseconds, blockedTime.count(), stats.frameCount);
+
+        if (m_lastPresentTime != std::chrono::steady_clock::time_point())
+        {
+            m_frameIntervalCounts[(uint32_t) m_latencyMode]++;
+            accumulateAverage(stats.averageFrameMilliseconds, std::chrono::duration<double, std::milli>(presentTime - m_lastPresentTime).count(), m_frameIntervalCounts[(uint32_t) m_latencyMode]);
+        }
+
+        m_lastPresentTime = presentTime;
+
+        m_currentFrame = (m_currentFrame + 1) % m_framesInFlight;
     }
 
     void renderLayer::cleanup()
     {
-        vkDestroySemaphore(m_vulkanLogicalDevice, m_vulkanImageAvailableSemaphore, nullptr);
+#ifdef MAL_SHADER_COMPILER
+        //Compiles still queued on the pool reference the build service.
+        for (const shaderStageFuture& pendingStage : m_pendingShaderStages)
+        {
+            pendingStage.wait();
+        }
 
-        vkDestroySemaphore(m_vulkanLogicalDevice, m_vulkanRenderFinishedSemaphore, nullptr);
+        m_pendingShaderStages.clear();
+        m_shaderWatcher.stop();
+#endif
 
-        vkDestroyFence(m_vulkanLogicalDevice, m_vulkanInFlightFence, nullptr);
+        logLatencyStats(m_latencyMode);
 
-        vkDestroyCommandPool(m_vulkanLogicalDevice, m_vulkanCommandPool, nullptr);
+        m_textureStreamer.cleanup();
+        m_meshes.cleanup();
+        m_drawBatcher.cleanup();
+        m_renderGraph.cleanup();
 
-        for (auto framebuffer : m_vulkanSwapChainFrameBuffers) 
+        //The device is idle, nothing queued for deletion is in use.
+        m_deletionQueue.flush();
+
+        m_gpuAllocator.cleanup();
+
+        for (frameInFlight& frame : m_frames)
         {
-            vkDestroyFramebuffer(m_vulkanLogicalDevice, framebuffer, nullptr);
+            vkDestroySemaphore(m_vulkanLogicalDevice, frame.imageAvailableSemaphore, nullptr);
+
+            vkDestroyFence(m_vulkanLogicalDevice, frame.inFlightFence, nullptr);
         }
 
-        vkDestroyPipeline(m_vulkanLogicalDevice, m_vulkanGraphicsPipeline, nullptr);
+        for (VkSemaphore semaphore : m_vulkanRenderFinishedSemaphores)
+        {
+            vkDestroySemaphore(m_vulkanLogicalDevice, semaphore, nullptr);
+        }
+
+        m_commandRecorder.cleanup();
+        m_gpuProfiler.cleanup();
+        vkDestroyCommandPool(m_vulkanLogicalDevice, m_vulkanCommandPool, nullptr);
+
+        m_pipelineStates.cleanup();
+
+        m_pipelineLayoutCache.cleanup();
 
-        vkDestroyPipelineLayout(m_vulkanLogicalDevice, m_vulkanPipelineLayout, nullptr);
+        m_pipelineCache.cleanup();
 
         vkDestroyRenderPass(m_vulkanLogicalDevice, m_vulkanRenderPass, nullptr);
 
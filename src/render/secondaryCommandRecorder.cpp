@@ -0,0 +1,107 @@
+#include "malpch.h"
+#include "secondaryCommandRecorder.h"
+#include "threadPool.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace malachite
+{
+    void secondaryCommandRecorder::initalize(VkDevice device, uint32_t queueFamilyIndex, uint32_t framesInFlight, uint32_t maxSliceCount)
+    {
+        m_device = device;
+        m_maxSliceCount = std::max(maxSliceCount, 1u);
+        m_slices.resize(framesInFlight * m_maxSliceCount);
+
+        VkCommandPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+        poolInfo.queueFamilyIndex = queueFamilyIndex;
+
+        for (slice& slice : m_slices)
+        {
+            if (vkCreateCommandPool(m_device, &poolInfo, nullptr, &slice.commandPool) != VK_SUCCESS)
+            {
+                throw std::runtime_error("failed to create secondary command pool!");
+            }
+
+            VkCommandBufferAllocateInfo allocInfo{};
+            allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            allocInfo.commandPool = slice.commandPool;
+            allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+            allocInfo.commandBufferCount = 1;
+
+            if (vkAllocateCommandBuffers(m_device, &allocInfo, &slice.commandBuffer) != VK_SUCCESS)
+            {
+                throw std::runtime_error("failed to allocate secondary command buffers!");
+            }
+        }
+    }
+
+    void secondaryCommandRecorder::cleanup()
+    {
+        //Frees the command buffers with them.
+        for (slice& slice : m_slices)
+        {
+            vkDestroyCommandPool(m_device, slice.commandPool, nullptr);
+        }
+
+        m_slices.clear();
+    }
+
+    void secondaryCommandRecorder::record
+    (
+        threadPool& pool,
+        uint32_t frameIndex,
+        VkCommandBuffer primaryCommandBuffer,
+        const VkCommandBufferInheritanceInfo& inheritanceInfo,
+        uint32_t sliceCount,
+        const std::function<void(VkCommandBuffer commandBuffer, uint32_t slice)>& recordSlice
+    )
+    {
+        sliceCount = std::clamp(sliceCount, 1u, m_maxSliceCount);
+        slice* frameSlices = m_slices.data() + frameIndex * m_maxSliceCount;
+
+        m_sliceResults.assign(sliceCount, VK_SUCCESS);
+
+        //One slice per chunk, workers can't throw so failures are reported back here.
+        pool.parallelFor(sliceCount, 1, [&](size_t begin, size_t end)
+        {
+            for (size_t i = begin; i < end; i++)
+            {
+                slice& slice = frameSlices[i];
+
+                //Cheaper than resetting the buffers one by one, and the pool is only this slice's.
+                vkResetCommandPool(m_device, slice.commandPool, 0);
+
+                VkCommandBufferBeginInfo beginInfo{};
+                beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+                beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+                beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+                m_sliceResults[i] = vkBeginCommandBuffer(slice.commandBuffer, &beginInfo);
+                if (m_sliceResults[i] != VK_SUCCESS)
+                {
+                    continue;
+                }
+
+                recordSlice(slice.commandBuffer, (uint32_t) i);
+
+                m_sliceResults[i] = vkEndCommandBuffer(slice.commandBuffer);
+            }
+        });
+
+        m_executedCommandBuffers.clear();
+        for (uint32_t i = 0; i < sliceCount; i++)
+        {
+            if (m_sliceResults[i] != VK_SUCCESS)
+            {
+                throw std::runtime_error("failed to record secondary command buffer!");
+            }
+
+            m_executedCommandBuffers.push_back(frameSlices[i].commandBuffer);
+        }
+
+        vkCmdExecuteCommands(primaryCommandBuffer, sliceCount, m_executedCommandBuffers.data());
+    }
+}
@@ -0,0 +1,19 @@
+#include "malpch.h"
+#include "shader.h"
+
+namespace malachite
+{
+    const char* getShaderFileExtension(e_shaderType shaderType)
+    {
+        switch (shaderType)
+        {
+            case e_shaderType::vertex: return "vert";
+            case e_shaderType::fragment: return "frag";
+            case e_shaderType::compute: return "comp";
+            case e_shaderType::geometry: return "geom";
+            case e_shaderType::tess_control: return "tessc";
+            case e_shaderType::tess_evaluation: return "tesse";
+            default: return "";
+        }
+    }
+}
@@ -0,0 +1,243 @@
+#include "malpch.h"
+#include "shaderBuildService.h"
+#include "threadPool.h"
+
+#include <fstream>
+#include <chrono>
+#include <stdexcept>
+
+#include <shaderc/shaderc.hpp>
+
+static shaderc_shader_kind getCompilerShaderKind(malachite::e_shaderType shaderType)
+{
+    switch (shaderType)
+    {
+        case malachite::e_shaderType::vertex: return shaderc_vertex_shader;
+        case malachite::e_shaderType::fragment: return shaderc_fragment_shader;
+        case malachite::e_shaderType::compute: return shaderc_compute_shader;
+        case malachite::e_shaderType::geometry: return shaderc_geometry_shader;
+        case malachite::e_shaderType::tess_control: return shaderc_tess_control_shader;
+        case malachite::e_shaderType::tess_evaluation: return shaderc_tess_evaluation_shader;
+        default: throw std::runtime_error("shader type is not supported!");
+    }
+}
+
+//shaderc::Compiler isn't safe to share, so every thread that compiles gets its own.
+static const shaderc::Compiler& getThreadCompiler()
+{
+    thread_local shaderc::Compiler compiler;
+    return compiler;
+}
+
+namespace malachite
+{
+    shaderBuildService::shaderBuildService(threadPool& threadPool, shaderCache& cache, const shaderCompileSettings& settings)
+        : m_threadPool(threadPool), m_cache(cache), m_settings(settings)
+    {
+        unsigned int spirvVersion = 0;
+        unsigned int spirvRevision = 0;
+        shaderc_get_spv_version(&spirvVersion, &spirvRevision);
+
+        m_spirvVersion = spirvVersion;
+        m_spirvRevision = spirvRevision;
+    }
+
+    std::vector<shaderStageFuture> shaderBuildService::compileFile(const std::filesystem::path& shaderFilePath, const std::filesystem::path& outputDirectory)
+    {
+        return compileSource(parseShaderSource(shaderFilePath, m_includeCache), outputDirectory);
+    }
+
+    std::vector<shaderStageFuture> shaderBuildService::compileSource(std::shared_ptr<const shaderSourceFile> sourceFile, const std::filesystem::path& outputDirectory, shaderVariantKey variantKey)
+    {
+        //Shared with every compile job, the sections point into its mapping.
+        const std::filesystem::path& shaderFilePath = sourceFile->files[0];
+        const shaderKeywords& keywords = sourceFile->keywords;
+
+        shaderVariantKey compiledKey = keywords.getCompiledKey(variantKey);
+
+        //Keywords end up in the settings, so every permutation gets its own cache entry.
+        auto settings = std::make_shared<shaderCompileSettings>(m_settings);
+        for (size_t i = 0; i < keywords.names.size(); i++)
+        {
+            if (compiledKey & (shaderVariantKey(1) << i))
+            {
+                settings->macroDefinitions.push_back({keywords.names[i], "1"});
+            }
+        }
+
+        MAL_LOG_TRACE("Compiling Shader: ", shaderFilePath.filename(), " Sections: ", std::to_string(sourceFile->sections.size()), " Variant: ", std::to_string(compiledKey));
+
+        std::vector<shaderStageFuture> stages;
+        stages.reserve(sourceFile->sections.size());
+
+        std::string shaderName = shaderFilePath.stem().string();
+
+        for (size_t i = 0; i < sourceFile->sections.size(); i++)
+        {
+            e_shaderType shaderType = sourceFile->sections[i].shaderType;
+            std::string stageFileName = getShaderVariantFileName(shaderName, compiledKey, shaderType);
+
+            std::filesystem::path outputPath;
+            if (!outputDirectory.empty())
+            {
+                outputPath = outputDirectory / stageFileName;
+            }
+
+            stages.push_back(m_threadPool.submitTask([this, sourceFile, settings, i, name = std::move(stageFileName), shaderType, outputPath]()
+            {
+                return compile(name, shaderType, sourceFile->sections[i].source, *settings, outputPath, sourceFile.get(), i);
+            }).share());
+        }
+
+        return stages;
+    }
+
+    shaderStageFuture shaderBuildService::compileStage(std::string name, e_shaderType shaderType, std::string source, const std::filesystem::path& outputPath)
+    {
+        return m_threadPool.submitTask([this, name = std::move(name), shaderType, source = std::move(source), outputPath]()
+        {
+            return compile(name, shaderType, source, m_settings, outputPath, nullptr, 0);
+        }).share();
+    }
+
+    compiledShaderStage shaderBuildService::compile
+    (
+        std::string name,
+        e_shaderType shaderType,
+        std::string_view source,
+        const shaderCompileSettings& settings,
+        const std::filesystem::path& outputPath,
+        const shaderSourceFile* sourceFile,
+        size_t sectionIndex
+    )
+    {
+        compiledShaderStage stage;
+        stage.name = std::move(name);
+        stage.shaderType = shaderType;
+
+        uint64_t cacheKey = shaderCache::computeKey(source, (uint32_t) shaderType, settings, m_spirvVersion, m_spirvRevision);
+
+        if (!m_cache.load(cacheKey, stage.spirv))
+        {
+            shaderc::CompileOptions options;
+
+            if (settings.isOptimized)
+            {
+                options.SetOptimizationLevel(shaderc_optimization_level_performance);
+            }
+
+            for (const auto& macro : settings.macroDefinitions)
+            {
+                options.AddMacroDefinition(macro.first, macro.second);
+            }
+
+            auto compileStartTime = std::chrono::steady_clock::now();
+
+            shaderc::SpvCompilationResult result = getThreadCompiler().CompileGlslToSpv
+            (
+                source.data(),                      //file data
+                source.size(),                      //file data size
+                getCompilerShaderKind(shaderType),  //shader type
+                stage.name.c_str(),                 //file tag (identifier)
+                settings.entryPoint.c_str(),        //entry point
+                options                             //options
+            );
+
+            stage.errorCount = (uint32_t) result.GetNumErrors();
+            stage.warningCount = (uint32_t) result.GetNumWarnings();
+
+            if (stage.errorCount > 0)
+            {
+                stage.errorMessage = result.GetErrorMessage();
+
+                if (sourceFile)
+                {
+                    stage.errorMessage = sourceFile->remapCompilerMessage(sectionIndex, stage.errorMessage, stage.name);
+                }
+
+                return stage;
+            }
+
+            std::chrono::duration<double, std::milli> compileTime = std::chrono::steady_clock::now() - compileStartTime;
+
+            stage.spirv.assign(result.cbegin(), result.cend());
+            m_cache.store(cacheKey, stage.spirv.data(), stage.spirv.size(), compileTime.count());
+        }
+
+        if (!outputPath.empty())
+        {
+            stage.outputPath = outputPath;
+
+            std::ofstream outputFile(outputPath, std::ios::binary);
+
+            outputFile.write
+            (
+                reinterpret_cast<const char*>(stage.spirv.data()),  //Data
+                stage.spirv.size() * sizeof(uint32_t)               //Data Size
+            );
+
+            outputFile.close();
+            stage.isOutputWritten = outputFile.good();
+
+            //A truncated binary would be loaded as if it were whole.
+            if (!stage.isOutputWritten)
+            {
+                std::error_code removeError;
+                std::filesystem::remove(outputPath, removeError);
+            }
+        }
+
+        return stage;
+    }
+
+    void compiledShaderStage::logDiagnostics() const
+    {
+        if (errorCount > 0)
+        {
+            MAL_LOG_ERROR(name, " ERRORS ", std::to_string(errorCount), " WARNINGS ", std::to_string(warningCount));
+            MAL_LOG_ERROR("Shader Compiler Error: \n", errorMessage);
+            return;
+        }
+
+        if (!outputPath.empty() && !isOutputWritten)
+        {
+            MAL_LOG_ERROR("Failed to write shader binary ", outputPath);
+        }
+        else if (!outputPath.empty())
+        {
+            MAL_LOG_TRACE("Creating Output Binary of Shader Module: ", outputPath);
+        }
+    }
+
+    shaderVariantSet::shaderVariantSet(shaderBuildService& buildService, std::shared_ptr<const shaderSourceFile> sourceFile, const std::filesystem::path& outputDirectory)
+        : m_buildService(buildService), m_sourceFile(std::move(sourceFile)), m_outputDirectory(outputDirectory)
+    {
+    }
+
+    const std::vector<shaderStageFuture>& shaderVariantSet::getVariant(shaderVariantKey variantKey)
+    {
+        shaderVariantKey compiledKey = getKeywords().getCompiledKey(variantKey);
+
+        auto variant = m_variants.find(compiledKey);
+        if (variant != m_variants.end())
+        {
+            return variant->second;
+        }
+
+        return m_variants.emplace(compiledKey, m_buildService.compileSource(m_sourceFile, m_outputDirectory, compiledKey)).first->second;
+    }
+
+    void shaderVariantSet::compileAll()
+    {
+        //Walks every subset of the compiled mask, including the empty one.
+        shaderVariantKey compiledMask = getKeywords().getCompiledMask();
+        shaderVariantKey variantKey = 0;
+
+        do
+        {
+            getVariant(variantKey);
+            variantKey = (variantKey - compiledMask) & compiledMask;
+        }
+        while (variantKey != 0);
+    }
+}
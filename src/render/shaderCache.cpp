@@ -0,0 +1,160 @@
+#include "malpch.h"
+#include "shaderCache.h"
+#include "hash.h"
+
+#include <fstream>
+#include <thread>
+
+//Bump whenever the entry layout or key inputs change.
+static constexpr uint32_t c_shaderCacheVersion = 1;
+static constexpr char c_shaderCacheMagic[4] = {'M', 'S', 'P', 'C'};
+
+struct shaderCacheEntryHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t key;
+    uint64_t compileMicroseconds;
+    uint64_t wordCount;
+};
+
+namespace malachite
+{
+    uint64_t shaderCompileSettings::hash() const
+    {
+        uint64_t result = fnv1a64(entryPoint);
+        result = fnv1a64(isOptimized ? "O" : "0", 1, result);
+
+        //Separators keep ("AB", "") and ("A", "B") apart.
+        for (const auto& macro : macroDefinitions)
+        {
+            result = fnv1a64(macro.first, result);
+            result = fnv1a64("=", 1, result);
+            result = fnv1a64(macro.second, result);
+            result = fnv1a64(";", 1, result);
+        }
+
+        return result;
+    }
+
+    shaderCache::shaderCache(const std::filesystem::path& cacheDirectory)
+        : m_cacheDirectory(cacheDirectory)
+    {
+        std::error_code error;
+        std::filesystem::create_directories(m_cacheDirectory, error);
+    }
+
+    uint64_t shaderCache::computeKey(std::string_view source, uint32_t stage, const shaderCompileSettings& settings, uint32_t spirvVersion, uint32_t spirvRevision)
+    {
+        uint32_t keyInputs[] = {c_shaderCacheVersion, stage, spirvVersion, spirvRevision};
+        uint64_t settingsHash = settings.hash();
+
+        uint64_t key = fnv1a64(source);
+        key = fnv1a64(reinterpret_cast<const char*>(keyInputs), sizeof(keyInputs), key);
+        key = fnv1a64(reinterpret_cast<const char*>(&settingsHash), sizeof(settingsHash), key);
+
+        return key;
+    }
+
+    std::filesystem::path shaderCache::getEntryPath(uint64_t key) const
+    {
+        char fileName[24];
+        snprintf(fileName, sizeof(fileName), "%016llx.spv", (unsigned long long) key);
+
+        return m_cacheDirectory / fileName;
+    }
+
+    bool shaderCache::load(uint64_t key, std::vector<uint32_t>& spirv)
+    {
+        std::filesystem::path entryPath = getEntryPath(key);
+
+        std::error_code error;
+        uint64_t fileSize = std::filesystem::file_size(entryPath, error);
+
+        std::ifstream file(entryPath, std::ios::binary);
+
+        shaderCacheEntryHeader header{};
+        bool isHit = !error && fileSize >= sizeof(header) &&
+            file.is_open() && file.read(reinterpret_cast<char*>(&header), sizeof(header)) &&
+            std::equal(header.magic, header.magic + 4, c_shaderCacheMagic) &&
+            header.version == c_shaderCacheVersion &&
+            header.key == key &&
+            header.wordCount == (fileSize - sizeof(header)) / sizeof(uint32_t);
+
+        if (isHit)
+        {
+            spirv.resize((size_t) header.wordCount);
+            isHit = (bool) file.read(reinterpret_cast<char*>(spirv.data()), spirv.size() * sizeof(uint32_t));
+        }
+
+        if (!isHit)
+        {
+            spirv.clear();
+            m_missCount++;
+            return false;
+        }
+
+        m_hitCount++;
+        m_savedMicroseconds += header.compileMicroseconds;
+
+        return true;
+    }
+
+    bool shaderCache::store(uint64_t key, const uint32_t* spirv, size_t wordCount, double compileMilliseconds)
+    {
+        shaderCacheEntryHeader header{};
+        std::copy(c_shaderCacheMagic, c_shaderCacheMagic + 4, header.magic);
+        header.version = c_shaderCacheVersion;
+        header.key = key;
+        header.compileMicroseconds = (uint64_t) (compileMilliseconds * 1000.0);
+        header.wordCount = wordCount;
+
+        std::filesystem::path entryPath = getEntryPath(key);
+
+        //Written next to the entry and renamed over it, so readers never see half an entry.
+        std::filesystem::path temporaryPath = entryPath;
+        temporaryPath += "." + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp";
+
+        bool isWritten = false;
+        {
+            std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+
+            file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            file.write(reinterpret_cast<const char*>(spirv), wordCount * sizeof(uint32_t));
+            file.close();
+
+            //A full disk only shows up here, renaming a short file would hand out a broken entry.
+            isWritten = file.good();
+        }
+
+        std::error_code error;
+        if (isWritten)
+        {
+            std::filesystem::rename(temporaryPath, entryPath, error);
+        }
+
+        if (!isWritten || error)
+        {
+            std::filesystem::remove(temporaryPath, error);
+            m_storeFailureCount++;
+            return false;
+        }
+
+        return true;
+    }
+
+    void shaderCache::logStats() const
+    {
+        MAL_LOG_TRACE
+        (
+            "Shader Cache Hits: ", std::to_string(m_hitCount.load()),
+            " Misses: ", std::to_string(m_missCount.load()),
+            " Time Saved: ", std::to_string(m_savedMicroseconds.load() / 1000.0), " ms"
+        );
+
+        if (m_storeFailureCount > 0)
+        {
+            MAL_LOG_ERROR("Failed to write shader cache entries: ", std::to_string(m_storeFailureCount.load()), " in ", m_cacheDirectory);
+        }
+    }
+}
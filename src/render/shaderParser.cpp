@@ -0,0 +1,523 @@
+#include "malpch.h"
+#include "shaderParser.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <unordered_set>
+
+struct shaderStageTag
+{
+    std::string_view tag;
+    malachite::e_shaderType shaderType;
+};
+
+static constexpr shaderStageTag c_shaderStageTags[] =
+{
+    {"#vertex", malachite::e_shaderType::vertex},
+    {"#fragment", malachite::e_shaderType::fragment},
+    {"#compute", malachite::e_shaderType::compute},
+    {"#geometry", malachite::e_shaderType::geometry},
+    {"#tess_control", malachite::e_shaderType::tess_control},
+    {"#tess_evaluation", malachite::e_shaderType::tess_evaluation}
+};
+
+//Includes nested deeper than this are treated as a cycle.
+static constexpr uint32_t c_maxIncludeDepth = 32;
+
+static bool isSpace(char character)
+{
+    return character == ' ' || character == '\t' || character == '\r';
+}
+
+static std::string_view trimLine(std::string_view line)
+{
+    while (!line.empty() && isSpace(line.front()))
+    {
+        line.remove_prefix(1);
+    }
+
+    while (!line.empty() && isSpace(line.back()))
+    {
+        line.remove_suffix(1);
+    }
+
+    return line;
+}
+
+//Returns the line at offset without its line ending and moves offset to the next one.
+static std::string_view readLine(std::string_view text, size_t& offset)
+{
+    size_t end = text.find('\n', offset);
+    if (end == std::string_view::npos)
+    {
+        end = text.size();
+    }
+
+    std::string_view line = text.substr(offset, end - offset);
+    offset = std::min(end + 1, text.size());
+
+    return line;
+}
+
+static malachite::e_shaderType findStageTag(std::string_view line)
+{
+    //Most lines bail out here, tags are only compared against lines starting with '#'.
+    if (line.empty() || line[0] != '#')
+    {
+        return malachite::e_shaderType::none;
+    }
+
+    line = trimLine(line);
+
+    for (const shaderStageTag& stageTag : c_shaderStageTags)
+    {
+        if (line == stageTag.tag)
+        {
+            return stageTag.shaderType;
+        }
+    }
+
+    return malachite::e_shaderType::none;
+}
+
+//Matches #include "path" and #include <path>.
+static bool findIncludeDirective(std::string_view line, std::string_view& includePath)
+{
+    line = trimLine(line);
+
+    if (line.empty() || line[0] != '#')
+    {
+        return false;
+    }
+
+    line = trimLine(line.substr(1));
+
+    constexpr std::string_view directive = "include";
+    if (line.substr(0, directive.size()) != directive)
+    {
+        return false;
+    }
+
+    line = trimLine(line.substr(directive.size()));
+
+    if (line.size() < 2 || (line[0] != '"' && line[0] != '<'))
+    {
+        return false;
+    }
+
+    char closing = line[0] == '"' ? '"' : '>';
+    size_t end = line.find(closing, 1);
+
+    if (end == std::string_view::npos)
+    {
+        return false;
+    }
+
+    includePath = line.substr(1, end - 1);
+    return true;
+}
+
+//Matches #keywords A B and #spec_keywords C, returns false for any other line.
+static bool findKeywordDirective(std::string_view line, std::string_view& keywords, bool& isSpecialized)
+{
+    if (line.empty() || line[0] != '#')
+    {
+        return false;
+    }
+
+    line = trimLine(line);
+
+    constexpr std::string_view keywordDirective = "#keywords";
+    constexpr std::string_view specializedDirective = "#spec_keywords";
+
+    auto matches = [&](std::string_view directive)
+    {
+        return line.substr(0, directive.size()) == directive &&
+            (line.size() == directive.size() || isSpace(line[directive.size()]));
+    };
+
+    if (matches(keywordDirective))
+    {
+        keywords = line.substr(keywordDirective.size());
+        isSpecialized = false;
+        return true;
+    }
+
+    if (matches(specializedDirective))
+    {
+        keywords = line.substr(specializedDirective.size());
+        isSpecialized = true;
+        return true;
+    }
+
+    return false;
+}
+
+//Adds the space separated keywords of one directive, invalidKeyword is set when one can't be added.
+static bool addKeywords(std::string_view keywords, bool isSpecialized, malachite::shaderKeywords& declaredKeywords, std::string_view& invalidKeyword)
+{
+    size_t keywordOffset = 0;
+    while (keywordOffset < keywords.size())
+    {
+        size_t keywordEnd = keywordOffset;
+        while (keywordEnd < keywords.size() && !isSpace(keywords[keywordEnd]))
+        {
+            keywordEnd++;
+        }
+
+        std::string_view keyword = keywords.substr(keywordOffset, keywordEnd - keywordOffset);
+        keywordOffset = keywordEnd + 1;
+
+        if (!keyword.empty() && !declaredKeywords.add(keyword, isSpecialized))
+        {
+            invalidKeyword = keyword;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+namespace malachite
+{
+    //Builds one section, only copies text once the section turns out to have an include.
+    struct shaderSectionBuilder
+    {
+        shaderSectionBuilder(shaderSourceFile& sourceFile, shaderIncludeCache& includeCache)
+            : sourceFile(sourceFile), includeCache(includeCache)
+        {
+        }
+
+        shaderSourceFile& sourceFile;
+        shaderIncludeCache& includeCache;
+        shaderSourceSection section;
+
+        const char* sourceStart = nullptr;
+        uint32_t nextSectionLine = 1;
+
+        bool isExpanding = false;
+        std::string expandedSource;
+        std::unordered_set<std::string> includedFiles;
+
+        void appendLine(std::string_view line, uint32_t fileIndex, uint32_t sourceLine)
+        {
+            const shaderLineMapping& lastMapping = section.lineMappings.back();
+            bool isContinuous = lastMapping.fileIndex == fileIndex &&
+                lastMapping.sourceLine + (nextSectionLine - lastMapping.sectionLine) == sourceLine;
+
+            if (!isContinuous)
+            {
+                section.lineMappings.push_back({nextSectionLine, fileIndex, sourceLine});
+            }
+
+            expandedSource.append(line.data(), line.size());
+            expandedSource.push_back('\n');
+            nextSectionLine++;
+        }
+
+        void include(std::string_view requestedPath, std::filesystem::path includingFile, uint32_t includingLine, uint32_t depth)
+        {
+            std::filesystem::path resolvedPath;
+            const mappedFile* file = includeCache.find(requestedPath, includingFile.parent_path(), resolvedPath);
+
+            if (!file || depth > c_maxIncludeDepth)
+            {
+                MAL_LOG_ERROR("Unresolved shader include: ", std::string(requestedPath), " at ", includingFile, ":", std::to_string(includingLine));
+                throw std::runtime_error("failed to resolve shader include!");
+            }
+
+            //Acts as an include guard, the first include of a file in a section wins.
+            if (!includedFiles.insert(resolvedPath.string()).second)
+            {
+                return;
+            }
+
+            auto existingFile = std::find(sourceFile.files.begin(), sourceFile.files.end(), resolvedPath);
+            uint32_t fileIndex = (uint32_t) (existingFile - sourceFile.files.begin());
+
+            if (existingFile == sourceFile.files.end())
+            {
+                sourceFile.files.push_back(resolvedPath);
+            }
+
+            std::string_view text = file->getText();
+            size_t offset = 0;
+            uint32_t lineNumber = 0;
+
+            while (offset < text.size())
+            {
+                std::string_view line = readLine(text, offset);
+                lineNumber++;
+
+                std::string_view nestedPath;
+                if (findIncludeDirective(line, nestedPath))
+                {
+                    include(nestedPath, sourceFile.files[fileIndex], lineNumber, depth + 1);
+                    continue;
+                }
+
+                appendLine(line, fileIndex, lineNumber);
+            }
+        }
+    };
+
+    std::shared_ptr<shaderSourceFile> parseShaderSource(const std::filesystem::path& filePath, shaderIncludeCache& includeCache)
+    {
+        auto sourceFile = std::make_shared<shaderSourceFile>();
+
+        if (!sourceFile->file.open(filePath))
+        {
+            throw std::runtime_error("failed to open file!");
+        }
+
+        sourceFile->files.push_back(filePath.lexically_normal());
+
+        std::string_view text = sourceFile->file.getText();
+        size_t offset = 0;
+        uint32_t lineNumber = 0;
+
+        std::unique_ptr<shaderSectionBuilder> builder;
+
+        auto submitSection = [&](const char* sectionEnd)
+        {
+            if (!builder)
+            {
+                return;
+            }
+
+            if (builder->isExpanding)
+            {
+                sourceFile->expandedSources.push_back(std::move(builder->expandedSource));
+                builder->section.source = sourceFile->expandedSources.back();
+            }
+            else
+            {
+                builder->section.source = std::string_view(builder->sourceStart, sectionEnd - builder->sourceStart);
+            }
+
+            sourceFile->sections.push_back(std::move(builder->section));
+            builder.reset();
+        };
+
+        while (offset < text.size())
+        {
+            const char* lineStart = text.data() + offset;
+            std::string_view line = readLine(text, offset);
+            lineNumber++;
+
+            e_shaderType shaderType = findStageTag(line);
+
+            if (shaderType != e_shaderType::none)
+            {
+                submitSection(lineStart);
+
+                builder = std::unique_ptr<shaderSectionBuilder>(new shaderSectionBuilder(*sourceFile, includeCache));
+                builder->section.shaderType = shaderType;
+                builder->section.lineMappings.push_back({1, 0, lineNumber + 1});
+                builder->sourceStart = text.data() + offset;
+                continue;
+            }
+
+            //Ignore all lines above first tag line except keywords. Useful for documentation
+            if (!builder)
+            {
+                std::string_view keywords;
+                bool isSpecialized = false;
+                std::string_view invalidKeyword;
+
+                if (findKeywordDirective(line, keywords, isSpecialized) && !addKeywords(keywords, isSpecialized, sourceFile->keywords, invalidKeyword))
+                {
+                    MAL_LOG_ERROR("Invalid shader keyword: ", std::string(invalidKeyword), " at ", filePath, ":", std::to_string(lineNumber));
+                    throw std::runtime_error("failed to declare shader keyword!");
+                }
+
+                continue;
+            }
+
+            std::string_view includePath;
+            if (findIncludeDirective(line, includePath))
+            {
+                //Everything up to here is still untouched file text, copy it once and expand from now on.
+                if (!builder->isExpanding)
+                {
+                    builder->isExpanding = true;
+                    builder->expandedSource.assign(builder->sourceStart, lineStart - builder->sourceStart);
+                }
+
+                builder->include(includePath, sourceFile->files[0], lineNumber, 1);
+                continue;
+            }
+
+            if (builder->isExpanding)
+            {
+                builder->appendLine(line, 0, lineNumber);
+            }
+            else
+            {
+                builder->nextSectionLine++;
+            }
+        }
+
+        submitSection(text.data() + text.size());
+
+        return sourceFile;
+    }
+
+    shaderSourceLocation shaderSourceFile::mapLine(size_t sectionIndex, uint32_t sectionLine) const
+    {
+        const std::vector<shaderLineMapping>& lineMappings = sections[sectionIndex].lineMappings;
+
+        auto mapping = std::upper_bound(lineMappings.begin(), lineMappings.end(), sectionLine, [](uint32_t line, const shaderLineMapping& mapping)
+        {
+            return line < mapping.sectionLine;
+        });
+
+        if (mapping != lineMappings.begin())
+        {
+            mapping--;
+        }
+
+        return {&files[mapping->fileIndex], mapping->sourceLine + (sectionLine - std::min(sectionLine, mapping->sectionLine))};
+    }
+
+    std::string shaderSourceFile::remapCompilerMessage(size_t sectionIndex, std::string_view message, std::string_view tag) const
+    {
+        std::string result;
+        result.reserve(message.size());
+
+        size_t offset = 0;
+        while (offset < message.size())
+        {
+            size_t lineStart = offset;
+            std::string_view line = readLine(message, offset);
+
+            //shaderc reports "<tag>:<line>: error: ..."
+            size_t digitsStart = tag.size() + 1;
+            size_t digitsEnd = digitsStart;
+
+            while (digitsEnd < line.size() && line[digitsEnd] >= '0' && line[digitsEnd] <= '9')
+            {
+                digitsEnd++;
+            }
+
+            bool isLocation = line.substr(0, tag.size()) == tag && line.size() > digitsEnd &&
+                line[tag.size()] == ':' && digitsEnd > digitsStart && line[digitsEnd] == ':';
+
+            if (isLocation)
+            {
+                uint32_t sectionLine = (uint32_t) std::stoul(std::string(line.substr(digitsStart, digitsEnd - digitsStart)));
+                shaderSourceLocation location = mapLine(sectionIndex, sectionLine);
+
+                result += location.filePath->generic_string();
+                result += ":" + std::to_string(location.line);
+                result += line.substr(digitsEnd);
+            }
+            else
+            {
+                result += line;
+            }
+
+            //Keep the original line ending, if any.
+            if (offset > lineStart + line.size())
+            {
+                result.push_back('\n');
+            }
+        }
+
+        return result;
+    }
+
+    void shaderIncludeCache::addSearchPath(const std::filesystem::path& searchPath)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_searchPaths.push_back(searchPath);
+    }
+
+    const mappedFile* shaderIncludeCache::find(std::string_view requestedPath, const std::filesystem::path& includingDirectory, std::filesystem::path& resolvedPath)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        std::filesystem::path candidate = (includingDirectory / requestedPath).lexically_normal();
+        if (const mappedFile* file = findFile(candidate))
+        {
+            resolvedPath = candidate;
+            return file;
+        }
+
+        for (const auto& searchPath : m_searchPaths)
+        {
+            candidate = (searchPath / requestedPath).lexically_normal();
+            if (const mappedFile* file = findFile(candidate))
+            {
+                resolvedPath = candidate;
+                return file;
+            }
+        }
+
+        return nullptr;
+    }
+
+    const mappedFile* shaderIncludeCache::findFile(const std::filesystem::path& path)
+    {
+        auto cached = m_files.find(path.string());
+        if (cached != m_files.end())
+        {
+            return cached->second.get();
+        }
+
+        //Misses aren't cached, the file may still show up later.
+        auto file = std::make_unique<mappedFile>();
+        if (!file->open(path))
+        {
+            return nullptr;
+        }
+
+        const mappedFile* result = file.get();
+        m_files[path.string()] = std::move(file);
+
+        return result;
+    }
+
+    void shaderIncludeCache::clear()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_files.clear();
+    }
+
+    bool parseShaderKeywords(std::string_view text, shaderKeywords& keywords)
+    {
+        keywords = shaderKeywords();
+
+        size_t offset = 0;
+        while (offset < text.size())
+        {
+            std::string_view line = readLine(text, offset);
+            std::string_view directiveKeywords;
+            bool isSpecialized = false;
+            std::string_view invalidKeyword;
+
+            if (findKeywordDirective(line, directiveKeywords, isSpecialized) && !addKeywords(directiveKeywords, isSpecialized, keywords, invalidKeyword))
+            {
+                MAL_LOG_ERROR("Invalid shader keyword: ", std::string(invalidKeyword));
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    std::string writeShaderKeywords(const shaderKeywords& keywords)
+    {
+        //One directive per keyword keeps the declaration order, which the variant key bits follow.
+        std::string text;
+        for (size_t i = 0; i < keywords.names.size(); i++)
+        {
+            bool isSpecialized = (keywords.specializedMask >> i) & 1;
+            text += isSpecialized ? "#spec_keywords " : "#keywords ";
+            text += keywords.names[i];
+            text += '\n';
+        }
+
+        return text;
+    }
+}
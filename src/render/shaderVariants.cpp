@@ -0,0 +1,106 @@
+#include "malpch.h"
+#include "shaderVariants.h"
+
+#include <cstdio>
+
+namespace malachite
+{
+    bool shaderKeywords::add(std::string_view name, bool isSpecialized)
+    {
+        if (name.empty() || names.size() >= c_maxShaderKeywords || getKeywordBit(name) != 0)
+        {
+            return false;
+        }
+
+        if (isSpecialized)
+        {
+            specializedMask |= shaderVariantKey(1) << names.size();
+        }
+
+        names.emplace_back(name);
+        return true;
+    }
+
+    shaderVariantKey shaderKeywords::getKeywordBit(std::string_view name) const
+    {
+        for (size_t i = 0; i < names.size(); i++)
+        {
+            if (names[i] == name)
+            {
+                return shaderVariantKey(1) << i;
+            }
+        }
+
+        return 0;
+    }
+
+    shaderVariantKey shaderKeywords::getVariantKey(const std::vector<std::string_view>& enabledKeywords) const
+    {
+        shaderVariantKey variantKey = 0;
+
+        for (std::string_view keyword : enabledKeywords)
+        {
+            variantKey |= getKeywordBit(keyword);
+        }
+
+        return variantKey;
+    }
+
+    void shaderSpecialization::build(const shaderKeywords& keywords, shaderVariantKey variantKey)
+    {
+        std::vector<VkBool32> keywordValues;
+
+        for (size_t i = 0; i < keywords.names.size(); i++)
+        {
+            shaderVariantKey keywordBit = shaderVariantKey(1) << i;
+            if (keywords.specializedMask & keywordBit)
+            {
+                keywordValues.push_back((variantKey & keywordBit) ? VK_TRUE : VK_FALSE);
+            }
+        }
+
+        build(keywordValues);
+    }
+
+    void shaderSpecialization::build(const std::vector<VkBool32>& constantValues)
+    {
+        mapEntries.clear();
+        values = constantValues;
+
+        for (size_t i = 0; i < values.size(); i++)
+        {
+            //Ids the module doesn't use are ignored by Vulkan, so every stage can take the same info.
+            VkSpecializationMapEntry mapEntry{};
+            mapEntry.constantID = (uint32_t) i;
+            mapEntry.offset = (uint32_t) (i * sizeof(VkBool32));
+            mapEntry.size = sizeof(VkBool32);
+
+            mapEntries.push_back(mapEntry);
+        }
+
+        info = VkSpecializationInfo{};
+        info.mapEntryCount = (uint32_t) mapEntries.size();
+        info.pMapEntries = mapEntries.data();
+        info.dataSize = values.size() * sizeof(VkBool32);
+        info.pData = values.data();
+    }
+
+    std::string getShaderVariantFileName(std::string_view shaderName, shaderVariantKey compiledKey, e_shaderType shaderType)
+    {
+        std::string fileName(shaderName);
+
+        if (compiledKey != 0)
+        {
+            char hexKey[17];
+            snprintf(hexKey, sizeof(hexKey), "%llx", (unsigned long long) compiledKey);
+
+            fileName += ".";
+            fileName += hexKey;
+        }
+
+        fileName += ".";
+        fileName += getShaderFileExtension(shaderType);
+
+        return fileName;
+    }
+}
@@ -0,0 +1,542 @@
+#include "malpch.h"
+#include "spirvReflection.h"
+
+#include <algorithm>
+#include <unordered_map>
+
+//Only the parts of the SPIR-V spec reflection needs.
+namespace spirv
+{
+    constexpr uint32_t c_magicNumber = 0x07230203;
+    constexpr uint32_t c_headerWordCount = 5;
+
+    enum e_opcode : uint16_t
+    {
+        opEntryPoint = 15,
+        opTypeBool = 20,
+        opTypeInt = 21,
+        opTypeFloat = 22,
+        opTypeVector = 23,
+        opTypeMatrix = 24,
+        opTypeImage = 25,
+        opTypeSampler = 26,
+        opTypeSampledImage = 27,
+        opTypeArray = 28,
+        opTypeRuntimeArray = 29,
+        opTypeStruct = 30,
+        opTypePointer = 32,
+        opConstant = 43,
+        opVariable = 59,
+        opDecorate = 71,
+        opMemberDecorate = 72
+    };
+
+    enum e_decoration : uint32_t
+    {
+        decorationBlock = 2,
+        decorationBufferBlock = 3,
+        decorationArrayStride = 6,
+        decorationMatrixStride = 7,
+        decorationBuiltIn = 11,
+        decorationLocation = 30,
+        decorationBinding = 33,
+        decorationDescriptorSet = 34,
+        decorationOffset = 35
+    };
+
+    enum e_storageClass : uint32_t
+    {
+        storageUniformConstant = 0,
+        storageInput = 1,
+        storageUniform = 2,
+        storagePushConstant = 9,
+        storageStorageBuffer = 12
+    };
+
+    enum e_imageDimension : uint32_t
+    {
+        dimensionBuffer = 5,
+        dimensionSubpassData = 6
+    };
+}
+
+static constexpr uint32_t c_unset = ~0u;
+
+struct spirvMember
+{
+    uint32_t offset = 0;
+    uint32_t matrixStride = 0;
+};
+
+struct spirvId
+{
+    uint16_t opcode = 0;
+    const uint32_t* words = nullptr;
+    uint16_t wordCount = 0;
+
+    uint32_t set = c_unset;
+    uint32_t binding = c_unset;
+    uint32_t location = c_unset;
+    uint32_t arrayStride = 0;
+    bool isBuiltIn = false;
+    bool isBlock = false;
+    bool isBufferBlock = false;
+
+    std::vector<spirvMember> members;
+};
+
+struct spirvModule
+{
+    std::vector<spirvId> ids;
+
+    const spirvId* get(uint32_t id) const
+    {
+        return id < ids.size() && ids[id].words ? &ids[id] : nullptr;
+    }
+
+    uint32_t getConstant(uint32_t id) const
+    {
+        const spirvId* constant = get(id);
+        return constant && constant->opcode == spirv::opConstant && constant->wordCount > 3 ? constant->words[3] : 1;
+    }
+
+    //Byte size following the explicit layout decorations, only needed for push constant blocks.
+    uint32_t getTypeSize(uint32_t typeId, uint32_t matrixStride = 0) const
+    {
+        const spirvId* type = get(typeId);
+        if (!type)
+        {
+            return 0;
+        }
+
+        switch (type->opcode)
+        {
+            case spirv::opTypeBool:
+                return 4;
+            case spirv::opTypeInt:
+            case spirv::opTypeFloat:
+                return type->words[2] / 8;
+            case spirv::opTypeVector:
+                return type->words[3] * getTypeSize(type->words[2]);
+            case spirv::opTypeMatrix:
+                return type->words[3] * (matrixStride ? matrixStride : getTypeSize(type->words[2]));
+            case spirv::opTypeArray:
+                return getConstant(type->words[3]) * (type->arrayStride ? type->arrayStride : getTypeSize(type->words[2]));
+            case spirv::opTypeStruct:
+            {
+                uint32_t size = 0;
+                for (uint32_t i = 0; i + 2 < type->wordCount && i < type->members.size(); i++)
+                {
+                    const spirvMember& member = type->members[i];
+                    size = std::max(size, member.offset + getTypeSize(type->words[2 + i], member.matrixStride));
+                }
+
+                return size;
+            }
+            default:
+                return 0;
+        }
+    }
+};
+
+//Words an instruction needs for every operand read here, counting the opcode word.
+static uint16_t getMinWordCount(uint16_t opcode)
+{
+    switch (opcode)
+    {
+        case spirv::opTypeBool:
+        case spirv::opTypeSampler:
+        case spirv::opTypeStruct:
+            return 2;
+        case spirv::opTypeFloat:
+        case spirv::opTypeSampledImage:
+        case spirv::opTypeRuntimeArray:
+        case spirv::opDecorate:
+            return 3;
+        case spirv::opEntryPoint:
+        case spirv::opTypeInt:
+        case spirv::opTypeVector:
+        case spirv::opTypeMatrix:
+        case spirv::opTypeArray:
+        case spirv::opTypePointer:
+        case spirv::opConstant:
+        case spirv::opVariable:
+        case spirv::opMemberDecorate:
+            return 4;
+        case spirv::opTypeImage:
+            return 9;
+        default:
+            return 1;
+    }
+}
+
+static VkShaderStageFlagBits getShaderStage(uint32_t executionModel)
+{
+    switch (executionModel)
+    {
+        case 0: return VK_SHADER_STAGE_VERTEX_BIT;
+        case 1: return VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT;
+        case 2: return VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT;
+        case 3: return VK_SHADER_STAGE_GEOMETRY_BIT;
+        case 4: return VK_SHADER_STAGE_FRAGMENT_BIT;
+        default: return VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+}
+
+//Returns false for resources that don't map to a descriptor.
+static bool getDescriptorType(const spirvId& type, uint32_t storageClass, VkDescriptorType& descriptorType)
+{
+    switch (type.opcode)
+    {
+        case spirv::opTypeSampler:
+            descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER;
+            return true;
+        case spirv::opTypeSampledImage:
+            descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            return true;
+        case spirv::opTypeImage:
+        {
+            uint32_t dimension = type.words[3];
+            bool isSampled = type.words[7] == 1;
+
+            if (dimension == spirv::dimensionSubpassData)
+            {
+                descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+            }
+            else if (dimension == spirv::dimensionBuffer)
+            {
+                descriptorType = isSampled ? VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER;
+            }
+            else
+            {
+                descriptorType = isSampled ? VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE : VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+            }
+
+            return true;
+        }
+        case spirv::opTypeStruct:
+        {
+            if (storageClass == spirv::storageStorageBuffer || type.isBufferBlock)
+            {
+                descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+                return true;
+            }
+
+            if (storageClass == spirv::storageUniform && type.isBlock)
+            {
+                descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+                return true;
+            }
+
+            return false;
+        }
+        default:
+            return false;
+    }
+}
+
+static VkFormat getVertexFormat(const spirvModule& module, uint32_t typeId, uint32_t& size)
+{
+    const spirvId* type = module.get(typeId);
+    uint32_t componentCount = 1;
+
+    if (type && type->opcode == spirv::opTypeVector)
+    {
+        componentCount = type->words[3];
+        type = module.get(type->words[2]);
+    }
+
+    //64 bit and 16 bit inputs are left to hand written layouts.
+    if (!type || (type->opcode != spirv::opTypeFloat && type->opcode != spirv::opTypeInt) || type->words[2] != 32 || componentCount < 1 || componentCount > 4)
+    {
+        size = 0;
+        return VK_FORMAT_UNDEFINED;
+    }
+
+    size = componentCount * 4;
+
+    static const VkFormat floatFormats[] = {VK_FORMAT_R32_SFLOAT, VK_FORMAT_R32G32_SFLOAT, VK_FORMAT_R32G32B32_SFLOAT, VK_FORMAT_R32G32B32A32_SFLOAT};
+    static const VkFormat signedFormats[] = {VK_FORMAT_R32_SINT, VK_FORMAT_R32G32_SINT, VK_FORMAT_R32G32B32_SINT, VK_FORMAT_R32G32B32A32_SINT};
+    static const VkFormat unsignedFormats[] = {VK_FORMAT_R32_UINT, VK_FORMAT_R32G32_UINT, VK_FORMAT_R32G32B32_UINT, VK_FORMAT_R32G32B32A32_UINT};
+
+    if (type->opcode == spirv::opTypeFloat)
+    {
+        return floatFormats[componentCount - 1];
+    }
+
+    return type->words[3] ? signedFormats[componentCount - 1] : unsignedFormats[componentCount - 1];
+}
+
+namespace malachite
+{
+    bool reflectSpirv(arrayView<uint32_t> spirv, shaderReflection& reflection)
+    {
+        reflection = shaderReflection();
+
+        if (spirv.size < spirv::c_headerWordCount || spirv[0] != spirv::c_magicNumber)
+        {
+            return false;
+        }
+
+        spirvModule module;
+        module.ids.resize(spirv[3]);
+
+        std::vector<const spirvId*> variables;
+        bool hasEntryPoint = false;
+
+        //First pass records where every id is defined and how it's decorated.
+        for (size_t offset = spirv::c_headerWordCount; offset < spirv.size;)
+        {
+            const uint32_t* words = spirv.data + offset;
+            uint16_t opcode = (uint16_t) (words[0] & 0xffff);
+            uint16_t wordCount = (uint16_t) (words[0] >> 16);
+
+            //Every operand read from here on lies inside its instruction.
+            if (wordCount < getMinWordCount(opcode) || offset + wordCount > spirv.size)
+            {
+                return false;
+            }
+
+            offset += wordCount;
+
+            //Result id position depends on whether the instruction has a result type.
+            uint32_t resultId = c_unset;
+
+            switch (opcode)
+            {
+                case spirv::opEntryPoint:
+                {
+                    if (!hasEntryPoint)
+                    {
+                        reflection.stage = getShaderStage(words[1]);
+                        hasEntryPoint = true;
+                    }
+
+                    break;
+                }
+                case spirv::opTypeBool:
+                case spirv::opTypeInt:
+                case spirv::opTypeFloat:
+                case spirv::opTypeVector:
+                case spirv::opTypeMatrix:
+                case spirv::opTypeImage:
+                case spirv::opTypeSampler:
+                case spirv::opTypeSampledImage:
+                case spirv::opTypeArray:
+                case spirv::opTypeRuntimeArray:
+                case spirv::opTypeStruct:
+                case spirv::opTypePointer:
+                {
+                    resultId = words[1];
+                    break;
+                }
+                case spirv::opConstant:
+                case spirv::opVariable:
+                {
+                    resultId = words[2];
+                    break;
+                }
+                case spirv::opDecorate:
+                {
+                    if (words[1] >= module.ids.size())
+                    {
+                        break;
+                    }
+
+                    spirvId& target = module.ids[words[1]];
+                    uint32_t value = wordCount > 3 ? words[3] : 0;
+
+                    switch (words[2])
+                    {
+                        case spirv::decorationBlock: target.isBlock = true; break;
+                        case spirv::decorationBufferBlock: target.isBufferBlock = true; break;
+                        case spirv::decorationArrayStride: target.arrayStride = value; break;
+                        case spirv::decorationBuiltIn: target.isBuiltIn = true; break;
+                        case spirv::decorationLocation: target.location = value; break;
+                        case spirv::decorationBinding: target.binding = value; break;
+                        case spirv::decorationDescriptorSet: target.set = value; break;
+                    }
+
+                    break;
+                }
+                case spirv::opMemberDecorate:
+                {
+                    if (words[1] >= module.ids.size())
+                    {
+                        break;
+                    }
+
+                    std::vector<spirvMember>& members = module.ids[words[1]].members;
+                    uint32_t memberIndex = words[2];
+                    uint32_t value = wordCount > 4 ? words[4] : 0;
+
+                    if (memberIndex >= members.size())
+                    {
+                        members.resize(memberIndex + 1);
+                    }
+
+                    if (words[3] == spirv::decorationOffset)
+                    {
+                        members[memberIndex].offset = value;
+                    }
+                    else if (words[3] == spirv::decorationMatrixStride)
+                    {
+                        members[memberIndex].matrixStride = value;
+                    }
+
+                    break;
+                }
+            }
+
+            if (resultId != c_unset)
+            {
+                if (resultId >= module.ids.size())
+                {
+                    return false;
+                }
+
+                spirvId& id = module.ids[resultId];
+                id.opcode = opcode;
+                id.words = words;
+                id.wordCount = wordCount;
+
+                if (opcode == spirv::opVariable)
+                {
+                    variables.push_back(&id);
+                }
+            }
+        }
+
+        //Second pass walks the global variables, every type is known by now.
+        for (const spirvId* variable : variables)
+        {
+            uint32_t storageClass = variable->words[3];
+
+            const spirvId* pointer = module.get(variable->words[1]);
+            if (!pointer || pointer->opcode != spirv::opTypePointer)
+            {
+                continue;
+            }
+
+            uint32_t typeId = pointer->words[3];
+            const spirvId* type = module.get(typeId);
+            if (!type)
+            {
+                continue;
+            }
+
+            switch (storageClass)
+            {
+                case spirv::storageUniformConstant:
+                case spirv::storageUniform:
+                case spirv::storageStorageBuffer:
+                {
+                    if (variable->binding == c_unset)
+                    {
+                        break;
+                    }
+
+                    //Arrays of resources become one binding with several descriptors.
+                    uint32_t descriptorCount = 1;
+                    while (type && (type->opcode == spirv::opTypeArray || type->opcode == spirv::opTypeRuntimeArray))
+                    {
+                        descriptorCount *= type->opcode == spirv::opTypeArray ? module.getConstant(type->words[3]) : 1;
+                        type = module.get(type->words[2]);
+                    }
+
+                    VkDescriptorType descriptorType;
+                    if (type && getDescriptorType(*type, storageClass, descriptorType))
+                    {
+                        uint32_t set = variable->set == c_unset ? 0 : variable->set;
+                        reflection.descriptorBindings.push_back({set, variable->binding, descriptorType, descriptorCount});
+                    }
+
+                    break;
+                }
+                case spirv::storagePushConstant:
+                {
+                    uint32_t offset = c_unset;
+                    for (const spirvMember& member : type->members)
+                    {
+                        offset = std::min(offset, member.offset);
+                    }
+
+                    reflection.pushConstantOffset = offset == c_unset ? 0 : offset;
+                    reflection.pushConstantSize = module.getTypeSize(typeId) - reflection.pushConstantOffset;
+                    break;
+                }
+                case spirv::storageInput:
+                {
+                    if (reflection.stage != VK_SHADER_STAGE_VERTEX_BIT || variable->isBuiltIn || variable->location == c_unset || type->isBlock)
+                    {
+                        break;
+                    }
+
+                    //Matrices take one location per column.
+                    uint32_t columnCount = 1;
+                    uint32_t columnTypeId = typeId;
+
+                    if (type->opcode == spirv::opTypeMatrix)
+                    {
+                        columnCount = type->words[3];
+                        columnTypeId = type->words[2];
+                    }
+
+                    for (uint32_t column = 0; column < columnCount; column++)
+                    {
+                        uint32_t size = 0;
+                        VkFormat format = getVertexFormat(module, columnTypeId, size);
+
+                        if (format != VK_FORMAT_UNDEFINED)
+                        {
+                            reflection.vertexInputs.push_back({variable->location + column, format, size});
+                        }
+                    }
+
+                    break;
+                }
+            }
+        }
+
+        std::sort(reflection.descriptorBindings.begin(), reflection.descriptorBindings.end(), [](const reflectedDescriptorBinding& a, const reflectedDescriptorBinding& b)
+        {
+            return a.set != b.set ? a.set < b.set : a.binding < b.binding;
+        });
+
+        std::sort(reflection.vertexInputs.begin(), reflection.vertexInputs.end(), [](const reflectedVertexInput& a, const reflectedVertexInput& b)
+        {
+            return a.location < b.location;
+        });
+
+        return true;
+    }
+
+    void buildVertexInputLayout
+    (
+        const shaderReflection& vertexStage,
+        std::vector<VkVertexInputBindingDescription>& bindings,
+        std::vector<VkVertexInputAttributeDescription>& attributes
+    )
+    {
+        bindings.clear();
+        attributes.clear();
+
+        uint32_t strides[2] = {};
+        for (const reflectedVertexInput& input : vertexStage.vertexInputs)
+        {
+            uint32_t binding = input.location >= c_firstInstanceInputLocation ? 1 : 0;
+            attributes.push_back({input.location, binding, input.format, strides[binding]});
+            strides[binding] += input.size;
+        }
+
+        if (strides[0] > 0)
+        {
+            bindings.push_back({0, strides[0], VK_VERTEX_INPUT_RATE_VERTEX});
+        }
+
+        if (strides[1] > 0)
+        {
+            bindings.push_back({1, (strides[1] + 15) & ~15u, VK_VERTEX_INPUT_RATE_INSTANCE});
+        }
+    }
+}
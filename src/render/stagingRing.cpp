@@ -0,0 +1,262 @@
+#include "malpch.h"
+#include "stagingRing.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+{
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+namespace malachite
+{
+    void stagingRing::initalize(gpuAllocator& allocator, VkDevice device, VkQueue queue, uint32_t queueFamilyIndex, VkDeviceSize size)
+    {
+        m_allocator = &allocator;
+        m_device = device;
+        m_queue = queue;
+        m_size = size;
+        m_head = 0;
+        m_tail = 0;
+
+        VkCommandPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+        poolInfo.queueFamilyIndex = queueFamilyIndex;
+
+        if (vkCreateCommandPool(m_device, &poolInfo, nullptr, &m_commandPool) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create staging command pool!");
+        }
+
+        VkBufferCreateInfo bufferInfo{};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = size;
+        bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        if (!m_allocator->createBuffer(bufferInfo, e_memoryUsage::upload, m_buffer, m_allocation))
+        {
+            throw std::runtime_error("failed to allocate staging ring!");
+        }
+    }
+
+    void stagingRing::cleanup()
+    {
+        //Never submitted, nothing in it ran.
+        if (m_isOpenBatchRecording)
+        {
+            vkEndCommandBuffer(m_openBatch.commandBuffer);
+            m_isOpenBatchRecording = false;
+        }
+
+        for (auto& [buffer, allocation] : m_openBatch.dedicatedBuffers)
+        {
+            m_allocator->destroyBuffer(buffer, allocation);
+        }
+
+        m_openBatch.dedicatedBuffers.clear();
+        m_freeBatches.push_back(std::move(m_openBatch));
+
+        for (uploadBatch& batch : m_inFlight)
+        {
+            retireBatch(batch, true);
+        }
+
+        m_inFlight.clear();
+
+        for (uploadBatch& batch : m_freeBatches)
+        {
+            vkDestroyFence(m_device, batch.fence, nullptr);
+        }
+
+        m_freeBatches.clear();
+
+        //Frees every command buffer with it.
+        vkDestroyCommandPool(m_device, m_commandPool, nullptr);
+        m_allocator->destroyBuffer(m_buffer, m_allocation);
+    }
+
+    bool stagingRing::allocate(VkDeviceSize size, VkDeviceSize alignment, stagingSpan& span)
+    {
+        if (size > m_size)
+        {
+            VkBufferCreateInfo bufferInfo{};
+            bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+            bufferInfo.size = size;
+            bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+            bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+            VkBuffer buffer;
+            gpuAllocation allocation;
+            if (!m_allocator->createBuffer(bufferInfo, e_memoryUsage::upload, buffer, allocation))
+            {
+                return false;
+            }
+
+            getCommandBuffer();
+            m_openBatch.dedicatedBuffers.push_back({buffer, allocation});
+
+            span = {buffer, 0, allocation.mapped};
+            return true;
+        }
+
+        //The head never catches up to the tail, so head == tail always means the ring is empty.
+        VkDeviceSize offset = alignUp(m_head, std::max(alignment, VkDeviceSize(1)));
+        if (m_head >= m_tail)
+        {
+            if (offset + size > m_size)
+            {
+                //Wraps around, whatever is left at the end is skipped this time round.
+                if (size >= m_tail)
+                {
+                    return false;
+                }
+
+                offset = 0;
+            }
+        }
+        else if (offset + size >= m_tail)
+        {
+            return false;
+        }
+
+        getCommandBuffer();
+        m_head = offset + size;
+
+        span = {m_buffer, offset, static_cast<char*>(m_allocation.mapped) + offset};
+        return true;
+    }
+
+    VkCommandBuffer stagingRing::getCommandBuffer()
+    {
+        if (m_isOpenBatchRecording)
+        {
+            return m_openBatch.commandBuffer;
+        }
+
+        if (!m_openBatch.commandBuffer)
+        {
+            if (!m_freeBatches.empty())
+            {
+                m_openBatch = std::move(m_freeBatches.back());
+                m_freeBatches.pop_back();
+            }
+            else
+            {
+                VkCommandBufferAllocateInfo commandBufferInfo{};
+                commandBufferInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+                commandBufferInfo.commandPool = m_commandPool;
+                commandBufferInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+                commandBufferInfo.commandBufferCount = 1;
+
+                if (vkAllocateCommandBuffers(m_device, &commandBufferInfo, &m_openBatch.commandBuffer) != VK_SUCCESS)
+                {
+                    throw std::runtime_error("failed to allocate staging command buffer!");
+                }
+
+                VkFenceCreateInfo fenceInfo{};
+                fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+                if (vkCreateFence(m_device, &fenceInfo, nullptr, &m_openBatch.fence) != VK_SUCCESS)
+                {
+                    throw std::runtime_error("failed to create staging fence!");
+                }
+            }
+        }
+
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+        if (vkBeginCommandBuffer(m_openBatch.commandBuffer, &beginInfo) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to begin recording staging command buffer!");
+        }
+
+        m_isOpenBatchRecording = true;
+        return m_openBatch.commandBuffer;
+    }
+
+    uint64_t stagingRing::submit()
+    {
+        if (!m_isOpenBatchRecording)
+        {
+            return 0;
+        }
+
+        if (vkEndCommandBuffer(m_openBatch.commandBuffer) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to record staging command buffer!");
+        }
+
+        VkSubmitInfo submitInfo{};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &m_openBatch.commandBuffer;
+
+        if (vkQueueSubmit(m_queue, 1, &submitInfo, m_openBatch.fence) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to submit staging command buffer!");
+        }
+
+        m_openBatch.serial = m_nextSerial++;
+        m_openBatch.ringEnd = m_head;
+
+        uint64_t serial = m_openBatch.serial;
+
+        m_inFlight.push_back(std::move(m_openBatch));
+        m_openBatch = uploadBatch();
+        m_isOpenBatchRecording = false;
+
+        return serial;
+    }
+
+    void stagingRing::retire()
+    {
+        size_t retiredCount = 0;
+        while (retiredCount < m_inFlight.size() && retireBatch(m_inFlight[retiredCount], false))
+        {
+            retiredCount++;
+        }
+
+        for (size_t i = 0; i < retiredCount; i++)
+        {
+            m_freeBatches.push_back(std::move(m_inFlight[i]));
+        }
+
+        m_inFlight.erase(m_inFlight.begin(), m_inFlight.begin() + retiredCount);
+
+        //Nothing left in the ring, start over at the front so large uploads don't have to wrap.
+        if (m_inFlight.empty() && m_head == m_tail)
+        {
+            m_head = 0;
+            m_tail = 0;
+        }
+    }
+
+    bool stagingRing::retireBatch(uploadBatch& batch, bool isWaiting)
+    {
+        VkResult status = isWaiting ? vkWaitForFences(m_device, 1, &batch.fence, VK_TRUE, UINT64_MAX) : vkGetFenceStatus(m_device, batch.fence);
+        if (status != VK_SUCCESS)
+        {
+            return false;
+        }
+
+        m_tail = batch.ringEnd;
+        m_completedSerial = batch.serial;
+
+        for (auto& [buffer, allocation] : batch.dedicatedBuffers)
+        {
+            m_allocator->destroyBuffer(buffer, allocation);
+        }
+
+        batch.dedicatedBuffers.clear();
+
+        vkResetFences(m_device, 1, &batch.fence);
+        vkResetCommandBuffer(batch.commandBuffer, 0);
+
+        return true;
+    }
+}
@@ -0,0 +1,629 @@
+#include "malpch.h"
+#include "textureStreamer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+//Mips at or below this size are uploaded first and never evicted, so a texture always shows something.
+static constexpr uint32_t c_tailMipSize = 64;
+
+//Textures nobody asked a size for in this many frames fall back to their tail.
+static constexpr uint64_t c_unrequestedFrames = 120;
+
+//Caps how much is staged per frame, one growing texture per frame is always allowed.
+static constexpr size_t c_maxUploadBytesPerFrame = 32 * 1024 * 1024;
+
+//A frame of uploads fits, larger textures get a staging buffer of their own from the ring.
+static constexpr VkDeviceSize c_stagingRingSize = c_maxUploadBytesPerFrame;
+
+//Buffer offsets of copies into an image are a multiple of the texel size, this covers it and what drivers prefer.
+static constexpr VkDeviceSize c_stagingAlignment = 16;
+
+static uint32_t getTailMip(const malachite::textureResource& source)
+{
+    for (uint32_t mip = 0; mip < source.getMipCount(); mip++)
+    {
+        if (std::max(source.mips[mip].width, source.mips[mip].height) <= c_tailMipSize)
+        {
+            return mip;
+        }
+    }
+
+    return source.getMipCount() - 1;
+}
+
+namespace malachite
+{
+    void textureStreamer::initalize
+    (
+        resourceManager& resources,
+        frameDeletionQueue& deletionQueue,
+        gpuAllocator& allocator,
+        VkDevice device,
+        VkQueue queue,
+        uint32_t queueFamilyIndex,
+        size_t budgetBytes
+    )
+    {
+        m_resources = &resources;
+        m_deletionQueue = &deletionQueue;
+        m_allocator = &allocator;
+        m_device = device;
+        m_budgetBytes = budgetBytes;
+
+        //Layouts are moved to shader read in the same batch, so it goes on the graphics queue.
+        m_staging.initalize(allocator, device, queue, queueFamilyIndex, c_stagingRingSize);
+
+        //Views only cover resident mips, so an unclamped sampler just uses the finest one there is.
+        VkSamplerCreateInfo samplerInfo{};
+        samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+        samplerInfo.magFilter = VK_FILTER_LINEAR;
+        samplerInfo.minFilter = VK_FILTER_LINEAR;
+        samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+        samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+        samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+        samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+        samplerInfo.anisotropyEnable = VK_FALSE;
+        samplerInfo.maxAnisotropy = 1.0f;
+        samplerInfo.minLod = 0.0f;
+        samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+        samplerInfo.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
+
+        if (vkCreateSampler(m_device, &samplerInfo, nullptr, &m_sampler) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create texture sampler!");
+        }
+    }
+
+    void textureStreamer::cleanup()
+    {
+        //Waits for every batch in flight, after that each upload is done.
+        m_staging.cleanup();
+        retireUploads();
+
+        for (streamedTexture& texture : m_textures)
+        {
+            destroyImage(texture.resident);
+            texture.source.reset();
+        }
+
+        m_textures.clear();
+        m_freeTextures.clear();
+        m_textureLookup.clear();
+
+        vkDestroySampler(m_device, m_sampler, nullptr);
+    }
+
+    textureId textureStreamer::load(const std::filesystem::path& path)
+    {
+        std::string key = path.lexically_normal().generic_string();
+
+        auto found = m_textureLookup.find(key);
+        if (found != m_textureLookup.end())
+        {
+            return found->second;
+        }
+
+        textureId texture;
+        if (!m_freeTextures.empty())
+        {
+            texture = m_freeTextures.back();
+            m_freeTextures.pop_back();
+        }
+        else
+        {
+            texture = (textureId) m_textures.size();
+            m_textures.emplace_back();
+        }
+
+        streamedTexture& streamed = m_textures[texture];
+        streamed.path = key;
+        streamed.source = m_resources->load<textureResource>(path, e_resourcePriority::normal);
+        streamed.requestedSize = 0.0f;
+        streamed.lastRequestedFrame = m_frameIndex;
+        streamed.isUsed = true;
+
+        m_textureLookup[key] = texture;
+        return texture;
+    }
+
+    void textureStreamer::release(textureId texture)
+    {
+        if (texture >= m_textures.size() || !m_textures[texture].isUsed)
+        {
+            return;
+        }
+
+        //The image may still be in flight, it goes in the next update after the frame fence.
+        streamedTexture& streamed = m_textures[texture];
+        streamed.isUsed = false;
+        m_textureLookup.erase(streamed.path);
+    }
+
+    void textureStreamer::requestSize(textureId texture, float screenSize)
+    {
+        if (texture >= m_textures.size())
+        {
+            return;
+        }
+
+        streamedTexture& streamed = m_textures[texture];
+
+        if (streamed.lastRequestedFrame != m_frameIndex)
+        {
+            streamed.requestedSize = screenSize;
+            streamed.lastRequestedFrame = m_frameIndex;
+        }
+        else
+        {
+            streamed.requestedSize = std::max(streamed.requestedSize, screenSize);
+        }
+    }
+
+    VkImageView textureStreamer::getImageView(textureId texture) const
+    {
+        return texture < m_textures.size() ? m_textures[texture].resident.view : VK_NULL_HANDLE;
+    }
+
+    uint32_t textureStreamer::getResidentMip(textureId texture) const
+    {
+        if (texture >= m_textures.size())
+        {
+            return 0;
+        }
+
+        const streamedTexture& streamed = m_textures[texture];
+        const textureResource* source = streamed.source.get();
+
+        if (streamed.resident.image)
+        {
+            return streamed.resident.firstMip;
+        }
+
+        return source ? source->getMipCount() : 0;
+    }
+
+    const textureStreamingStats& textureStreamer::getStats()
+    {
+        m_stats.residentBytes = m_residentBytes;
+        m_stats.budgetBytes = m_budgetBytes;
+        m_stats.textureCount = (uint32_t) (m_textures.size() - m_freeTextures.size());
+        m_stats.pendingUploads = (uint32_t) m_uploads.size();
+
+        return m_stats;
+    }
+
+    uint32_t textureStreamer::getWantedMip(const streamedTexture& texture) const
+    {
+        const textureResource* source = texture.source.get();
+        uint32_t tailMip = getTailMip(*source);
+
+        if (m_frameIndex - texture.lastRequestedFrame > c_unrequestedFrames || texture.requestedSize <= 0.0f)
+        {
+            return tailMip;
+        }
+
+        //One texel per pixel, a texture twice the size on screen wants one mip finer.
+        float texelsPerPixel = (float) std::max(source->getWidth(), source->getHeight()) / texture.requestedSize;
+        uint32_t mip = texelsPerPixel > 1.0f ? (uint32_t) std::floor(std::log2(texelsPerPixel)) : 0;
+
+        return std::min(mip, tailMip);
+    }
+
+    void textureStreamer::update()
+    {
+        m_frameIndex++;
+
+        m_staging.retire();
+        retireUploads();
+
+        //Released textures go here, once no upload refers to them anymore.
+        for (textureId texture = 0; texture < m_textures.size(); texture++)
+        {
+            streamedTexture& streamed = m_textures[texture];
+
+            if (streamed.isUsed || streamed.isUploading || !streamed.source.isValid())
+            {
+                continue;
+            }
+
+            m_committedBytes -= streamed.resident.memorySize;
+            retireImage(streamed.resident);
+            streamed.source.reset();
+            streamed.path.clear();
+            m_freeTextures.push_back(texture);
+        }
+
+        //Lowering the budget takes effect here, growing textures make room for themselves below.
+        evictToBudget(0, c_invalidTexture);
+
+        //Most recently and largest requested first.
+        std::vector<textureId> candidates;
+        for (textureId texture = 0; texture < m_textures.size(); texture++)
+        {
+            const streamedTexture& streamed = m_textures[texture];
+
+            if (streamed.isUsed && !streamed.isUploading && streamed.source.isLoaded())
+            {
+                candidates.push_back(texture);
+            }
+        }
+
+        std::sort(candidates.begin(), candidates.end(), [this](textureId a, textureId b)
+        {
+            const streamedTexture& textureA = m_textures[a];
+            const streamedTexture& textureB = m_textures[b];
+
+            if (textureA.lastRequestedFrame != textureB.lastRequestedFrame)
+            {
+                return textureA.lastRequestedFrame > textureB.lastRequestedFrame;
+            }
+
+            return textureA.requestedSize > textureB.requestedSize;
+        });
+
+        size_t stagedBytes = 0;
+
+        for (textureId texture : candidates)
+        {
+            streamedTexture& streamed = m_textures[texture];
+            const textureResource& source = *streamed.source.get();
+
+            //Shrunk to make room for a texture earlier in this loop.
+            if (streamed.isUploading)
+            {
+                continue;
+            }
+
+            uint32_t mipCount = source.getMipCount();
+            uint32_t residentMip = streamed.resident.image ? streamed.resident.firstMip : mipCount;
+            uint32_t wantedMip = getWantedMip(streamed);
+            uint32_t tailMip = getTailMip(source);
+
+            //Nothing resident yet, the coarse tail goes first regardless of the budget.
+            uint32_t nextMip;
+            if (residentMip == mipCount)
+            {
+                nextMip = tailMip;
+            }
+            else if (wantedMip < residentMip)
+            {
+                nextMip = residentMip - 1;
+            }
+            else
+            {
+                continue;
+            }
+
+            size_t imageSize = getImageSize(source, nextMip);
+            if (stagedBytes > 0 && stagedBytes + imageSize > c_maxUploadBytesPerFrame)
+            {
+                continue;
+            }
+
+            size_t growth = imageSize > streamed.resident.memorySize ? imageSize - streamed.resident.memorySize : 0;
+            if (!evictToBudget(growth, texture) && nextMip != tailMip)
+            {
+                continue;
+            }
+
+            if (queueUpload(texture, nextMip))
+            {
+                stagedBytes += imageSize;
+            }
+        }
+
+        //Everything recorded this frame, shrinks included, goes out as one batch.
+        uint64_t serial = m_staging.submit();
+        for (pendingUpload& upload : m_uploads)
+        {
+            if (upload.serial == 0)
+            {
+                upload.serial = serial;
+            }
+        }
+    }
+
+    bool textureStreamer::evictToBudget(size_t incomingBytes, textureId requester)
+    {
+        const streamedTexture* requesting = requester != c_invalidTexture ? &m_textures[requester] : nullptr;
+
+        //Never shrink something that matters as much as what is growing, or the two keep trading mips.
+        auto isEvictable = [this, requester, requesting](textureId texture)
+        {
+            const streamedTexture& streamed = m_textures[texture];
+
+            if (texture == requester || !streamed.isUsed || streamed.isUploading || !streamed.resident.image ||
+                streamed.resident.firstMip >= getTailMip(*streamed.source.get()))
+            {
+                return false;
+            }
+
+            if (!requesting || streamed.resident.firstMip < getWantedMip(streamed))
+            {
+                return true;
+            }
+
+            if (streamed.lastRequestedFrame != requesting->lastRequestedFrame)
+            {
+                return streamed.lastRequestedFrame < requesting->lastRequestedFrame;
+            }
+
+            return streamed.requestedSize < requesting->requestedSize;
+        };
+
+        if (m_committedBytes + incomingBytes <= m_budgetBytes)
+        {
+            return true;
+        }
+
+        //Growing only pays off when enough can be freed, shrinking anything short of that just gets streamed back in.
+        if (requesting)
+        {
+            size_t reclaimableBytes = 0;
+            for (textureId texture = 0; texture < m_textures.size(); texture++)
+            {
+                if (isEvictable(texture))
+                {
+                    const streamedTexture& streamed = m_textures[texture];
+                    reclaimableBytes += streamed.resident.memorySize - getImageSize(*streamed.source.get(), getTailMip(*streamed.source.get()));
+                }
+            }
+
+            if (m_committedBytes + incomingBytes > m_budgetBytes + reclaimableBytes)
+            {
+                return false;
+            }
+        }
+
+        while (m_committedBytes + incomingBytes > m_budgetBytes)
+        {
+            //Mips nobody needs go first, then the least recently asked for, the largest of those first.
+            textureId victim = c_invalidTexture;
+            bool isVictimSurplus = false;
+
+            for (textureId texture = 0; texture < m_textures.size(); texture++)
+            {
+                if (!isEvictable(texture))
+                {
+                    continue;
+                }
+
+                const streamedTexture& streamed = m_textures[texture];
+                bool isSurplus = streamed.resident.firstMip < getWantedMip(streamed);
+
+                if (victim != c_invalidTexture)
+                {
+                    const streamedTexture& best = m_textures[victim];
+
+                    if (isSurplus != isVictimSurplus)
+                    {
+                        if (!isSurplus)
+                        {
+                            continue;
+                        }
+                    }
+                    else if (streamed.lastRequestedFrame > best.lastRequestedFrame ||
+                        (streamed.lastRequestedFrame == best.lastRequestedFrame && streamed.resident.memorySize <= best.resident.memorySize))
+                    {
+                        continue;
+                    }
+                }
+
+                victim = texture;
+                isVictimSurplus = isSurplus;
+            }
+
+            if (victim == c_invalidTexture)
+            {
+                return false;
+            }
+
+            //Shrinking is an upload of the coarser mips into a smaller image, swapped in once done.
+            //The victim drops as many mips as needed at once since it can't be shrunk again while uploading.
+            streamedTexture& streamed = m_textures[victim];
+            const textureResource& source = *streamed.source.get();
+            size_t excessBytes = m_committedBytes + incomingBytes - m_budgetBytes;
+            uint32_t tailMip = getTailMip(source);
+            uint32_t firstMip = streamed.resident.firstMip + 1;
+
+            while (firstMip < tailMip && streamed.resident.memorySize - getImageSize(source, firstMip) < excessBytes)
+            {
+                firstMip++;
+            }
+
+            uint32_t evictedMips = firstMip - streamed.resident.firstMip;
+            if (!queueUpload(victim, firstMip))
+            {
+                return false;
+            }
+
+            m_stats.evictedMips += evictedMips;
+        }
+
+        return true;
+    }
+
+    size_t textureStreamer::getImageSize(const textureResource& source, uint32_t firstMip) const
+    {
+        //Mips are stored back to back, so this is also the staging size.
+        return source.pixels.size() - source.mips[firstMip].offset;
+    }
+
+    bool textureStreamer::queueUpload(textureId texture, uint32_t firstMip)
+    {
+        streamedTexture& streamed = m_textures[texture];
+        const textureResource& source = *streamed.source.get();
+
+        uint32_t levelCount = source.getMipCount() - firstMip;
+        size_t stagingSize = getImageSize(source, firstMip);
+
+        pendingUpload upload;
+        upload.texture = texture;
+        upload.image.firstMip = firstMip;
+
+        //Image holding just the mips from firstMip down.
+        VkImageCreateInfo imageInfo{};
+        imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.format = VK_FORMAT_R8G8B8A8_SRGB;
+        imageInfo.extent.width = source.mips[firstMip].width;
+        imageInfo.extent.height = source.mips[firstMip].height;
+        imageInfo.extent.depth = 1;
+        imageInfo.mipLevels = levelCount;
+        imageInfo.arrayLayers = 1;
+        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageInfo.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+        imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+        //Running out of device memory just means this mip waits, the budget is probably too high.
+        if (!m_allocator->createImage(imageInfo, e_memoryUsage::gpuOnly, upload.image.image, upload.image.allocation))
+        {
+            MAL_LOG_ERROR("Out of device memory for texture: ", streamed.path);
+            return false;
+        }
+
+        upload.image.memorySize = (size_t) upload.image.allocation.size;
+
+        VkImageViewCreateInfo viewInfo{};
+        viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        viewInfo.image = upload.image.image;
+        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        viewInfo.format = imageInfo.format;
+        viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        viewInfo.subresourceRange.baseMipLevel = 0;
+        viewInfo.subresourceRange.levelCount = levelCount;
+        viewInfo.subresourceRange.baseArrayLayer = 0;
+        viewInfo.subresourceRange.layerCount = 1;
+
+        if (vkCreateImageView(m_device, &viewInfo, nullptr, &upload.image.view) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create texture image view!");
+        }
+
+        //A full ring just means this mip waits for a later frame.
+        stagingSpan span;
+        if (!m_staging.allocate(stagingSize, c_stagingAlignment, span))
+        {
+            vkDestroyImageView(m_device, upload.image.view, nullptr);
+            m_allocator->destroyImage(upload.image.image, upload.image.allocation);
+            return false;
+        }
+
+        //Every mip is copied in with a single memcpy, staging memory stays mapped.
+        memcpy(span.mapped, source.getMipData(firstMip), stagingSize);
+
+        VkCommandBuffer commandBuffer = m_staging.getCommandBuffer();
+
+        VkImageMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = upload.image.image;
+        barrier.subresourceRange = viewInfo.subresourceRange;
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+        std::vector<VkBufferImageCopy> regions(levelCount);
+        for (uint32_t level = 0; level < levelCount; level++)
+        {
+            const textureMip& mip = source.mips[firstMip + level];
+
+            VkBufferImageCopy& region = regions[level];
+            region.bufferOffset = span.offset + mip.offset - source.mips[firstMip].offset;
+            region.bufferRowLength = 0;
+            region.bufferImageHeight = 0;
+            region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            region.imageSubresource.mipLevel = level;
+            region.imageSubresource.baseArrayLayer = 0;
+            region.imageSubresource.layerCount = 1;
+            region.imageOffset = {0, 0, 0};
+            region.imageExtent = {mip.width, mip.height, 1};
+        }
+
+        vkCmdCopyBufferToImage(commandBuffer, span.buffer, upload.image.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, levelCount, regions.data());
+
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+        //The budget counts what every texture will hold once its uploads are done.
+        m_committedBytes += upload.image.memorySize;
+        m_committedBytes -= streamed.resident.memorySize;
+        m_residentBytes += upload.image.memorySize;
+
+        streamed.isUploading = true;
+        m_uploads.push_back(upload);
+
+        return true;
+    }
+
+    void textureStreamer::retireUploads()
+    {
+        for (size_t i = 0; i < m_uploads.size();)
+        {
+            pendingUpload& upload = m_uploads[i];
+
+            if (upload.serial == 0 || upload.serial > m_staging.getCompletedSerial())
+            {
+                i++;
+                continue;
+            }
+
+            streamedTexture& streamed = m_textures[upload.texture];
+            streamed.isUploading = false;
+
+            if (upload.image.firstMip < streamed.resident.firstMip || !streamed.resident.image)
+            {
+                m_stats.uploadedMips += (streamed.resident.image ? streamed.resident.firstMip : streamed.source->getMipCount()) - upload.image.firstMip;
+            }
+
+            retireImage(streamed.resident);
+            streamed.resident = upload.image;
+
+            m_uploads[i] = m_uploads.back();
+            m_uploads.pop_back();
+        }
+    }
+
+    void textureStreamer::retireImage(residentImage& image)
+    {
+        if (!image.image)
+        {
+            return;
+        }
+
+        residentImage retired = image;
+        m_deletionQueue->push([this, retired]() mutable
+        {
+            destroyImage(retired);
+        });
+
+        image = residentImage();
+    }
+
+    void textureStreamer::destroyImage(residentImage& image)
+    {
+        if (!image.image)
+        {
+            return;
+        }
+
+        vkDestroyImageView(m_device, image.view, nullptr);
+        m_allocator->destroyImage(image.image, image.allocation);
+
+        m_residentBytes -= image.memorySize;
+        image = residentImage();
+    }
+}
@@ -0,0 +1,252 @@
+#include "malpch.h"
+#include "assetArchive.h"
+#include "hash.h"
+
+#include <fstream>
+#include <algorithm>
+
+static uint64_t alignOffset(uint64_t offset, uint64_t alignment)
+{
+    return (offset + alignment - 1) & ~(alignment - 1);
+}
+
+static uint64_t getPayloadAlignment(uint64_t size)
+{
+    return size >= 64 ? 64 : malachite::c_assetArchivePayloadAlignment;
+}
+
+//Written so a corrupt offset or size can't wrap around and pass.
+static bool isRangeInside(uint64_t offset, uint64_t size, uint64_t totalSize)
+{
+    return offset <= totalSize && size <= totalSize - offset;
+}
+
+namespace malachite
+{
+    assetArchive::~assetArchive()
+    {
+        close();
+    }
+
+    bool assetArchive::open(const std::filesystem::path& path)
+    {
+        close();
+
+        if (!m_file.open(path))
+        {
+            return false;
+        }
+
+        const char* mapping = m_file.getData();
+        size_t mappingSize = m_file.getSize();
+
+        if (mappingSize < sizeof(assetArchiveHeader))
+        {
+            MAL_LOG_ERROR("Asset archive is too small: ", path);
+            close();
+            return false;
+        }
+
+        const assetArchiveHeader* header = reinterpret_cast<const assetArchiveHeader*>(mapping);
+
+        bool isValid = std::equal(header->magic, header->magic + 4, c_assetArchiveMagic) &&
+            header->version == c_assetArchiveVersion &&
+            header->entryTableOffset % alignof(assetArchiveEntry) == 0 &&
+            isRangeInside(header->entryTableOffset, (uint64_t) header->entryCount * sizeof(assetArchiveEntry), mappingSize) &&
+            isRangeInside(header->nameBlobOffset, header->nameBlobSize, mappingSize);
+
+        const assetArchiveEntry* entries = reinterpret_cast<const assetArchiveEntry*>(mapping + header->entryTableOffset);
+
+        for (uint32_t i = 0; isValid && i < header->entryCount; i++)
+        {
+            const assetArchiveEntry& entry = entries[i];
+
+            //The mapping is page aligned, so an aligned offset is an aligned address.
+            isValid = isRangeInside(entry.dataOffset, entry.dataSize, mappingSize) &&
+                entry.dataOffset % c_assetArchivePayloadAlignment == 0 &&
+                isRangeInside(entry.nameOffset, entry.nameLength, header->nameBlobSize) &&
+                (i == 0 || entries[i - 1].nameHash <= entry.nameHash);
+        }
+
+        if (!isValid)
+        {
+            MAL_LOG_ERROR("Asset archive is corrupt or from another version: ", path);
+            close();
+            return false;
+        }
+
+        m_header = header;
+        m_entries = entries;
+        m_names = mapping + header->nameBlobOffset;
+
+        return true;
+    }
+
+    void assetArchive::close()
+    {
+        m_file.close();
+
+        m_header = nullptr;
+        m_entries = nullptr;
+        m_names = nullptr;
+    }
+
+    arrayView<char> assetArchive::find(std::string_view name) const
+    {
+        if (!m_header)
+        {
+            return {};
+        }
+
+        uint64_t nameHash = fnv1a64(name);
+
+        const assetArchiveEntry* end = m_entries + m_header->entryCount;
+        const assetArchiveEntry* entry = std::lower_bound(m_entries, end, nameHash, [](const assetArchiveEntry& entry, uint64_t hash)
+        {
+            return entry.nameHash < hash;
+        });
+
+        //Hash collisions sit next to each other, the stored name settles them.
+        for (; entry != end && entry->nameHash == nameHash; entry++)
+        {
+            if (std::string_view(m_names + entry->nameOffset, entry->nameLength) == name)
+            {
+                return arrayView<char>(m_file.getData() + entry->dataOffset, (size_t) entry->dataSize);
+            }
+        }
+
+        return {};
+    }
+
+    bool assetArchive::contains(std::string_view name) const
+    {
+        return find(name).data != nullptr;
+    }
+
+    void assetArchiveWriter::addData(const std::string& name, std::vector<char> data)
+    {
+        m_assets.push_back({name, std::move(data)});
+    }
+
+    bool assetArchiveWriter::addFile(const std::string& name, const std::filesystem::path& filePath)
+    {
+        std::ifstream file(filePath, std::ios::ate | std::ios::binary);
+
+        if (!file.is_open())
+        {
+            return false;
+        }
+
+        std::vector<char> data((size_t) file.tellg());
+
+        file.seekg(0);
+        file.read(data.data(), data.size());
+
+        if (!file.good())
+        {
+            return false;
+        }
+
+        addData(name, std::move(data));
+
+        return true;
+    }
+
+    bool assetArchiveWriter::write(const std::filesystem::path& outputPath) const
+    {
+        std::vector<const pendingAsset*> sortedAssets;
+        for (const auto& asset : m_assets)
+        {
+            sortedAssets.push_back(&asset);
+        }
+
+        std::sort(sortedAssets.begin(), sortedAssets.end(), [](const pendingAsset* a, const pendingAsset* b)
+        {
+            uint64_t hashA = fnv1a64(a->name);
+            uint64_t hashB = fnv1a64(b->name);
+            return hashA != hashB ? hashA < hashB : a->name < b->name;
+        });
+
+        for (size_t i = 1; i < sortedAssets.size(); i++)
+        {
+            if (sortedAssets[i - 1]->name == sortedAssets[i]->name)
+            {
+                MAL_LOG_ERROR("Asset packed twice: ", sortedAssets[i]->name);
+                return false;
+            }
+        }
+
+        assetArchiveHeader header{};
+        std::copy(c_assetArchiveMagic, c_assetArchiveMagic + 4, header.magic);
+        header.version = c_assetArchiveVersion;
+        header.entryCount = (uint32_t) sortedAssets.size();
+        header.entryTableOffset = sizeof(assetArchiveHeader);
+
+        std::vector<assetArchiveEntry> entries(sortedAssets.size());
+        std::string nameBlob;
+
+        for (size_t i = 0; i < sortedAssets.size(); i++)
+        {
+            entries[i].nameHash = fnv1a64(sortedAssets[i]->name);
+            entries[i].nameOffset = (uint32_t) nameBlob.size();
+            entries[i].nameLength = (uint32_t) sortedAssets[i]->name.size();
+            nameBlob += sortedAssets[i]->name;
+        }
+
+        header.nameBlobOffset = header.entryTableOffset + entries.size() * sizeof(assetArchiveEntry);
+        header.nameBlobSize = nameBlob.size();
+
+        uint64_t offset = header.nameBlobOffset + header.nameBlobSize;
+        for (size_t i = 0; i < sortedAssets.size(); i++)
+        {
+            entries[i].dataSize = sortedAssets[i]->data.size();
+            entries[i].dataOffset = alignOffset(offset, getPayloadAlignment(entries[i].dataSize));
+            offset = entries[i].dataOffset + entries[i].dataSize;
+        }
+
+        //Written next to the archive and renamed over it, a failed write leaves the old one in place.
+        std::filesystem::path temporaryPath = outputPath;
+        temporaryPath += ".tmp";
+
+        std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+        if (!file.is_open())
+        {
+            MAL_LOG_ERROR("Failed to open archive for writing: ", temporaryPath);
+            return false;
+        }
+
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(assetArchiveEntry));
+        file.write(nameBlob.data(), nameBlob.size());
+
+        uint64_t written = header.nameBlobOffset + header.nameBlobSize;
+        for (size_t i = 0; i < sortedAssets.size(); i++)
+        {
+            std::vector<char> padding(entries[i].dataOffset - written, 0);
+            file.write(padding.data(), padding.size());
+            file.write(sortedAssets[i]->data.data(), sortedAssets[i]->data.size());
+            written = entries[i].dataOffset + entries[i].dataSize;
+        }
+
+        //Close flushes, a failure there is still a failed write.
+        file.close();
+
+        std::error_code error;
+        if (!file.good())
+        {
+            MAL_LOG_ERROR("Failed to write archive: ", temporaryPath);
+            std::filesystem::remove(temporaryPath, error);
+            return false;
+        }
+
+        std::filesystem::rename(temporaryPath, outputPath, error);
+        if (error)
+        {
+            MAL_LOG_ERROR("Failed to replace archive: ", outputPath, " ", error.message());
+            std::filesystem::remove(temporaryPath, error);
+            return false;
+        }
+
+        return true;
+    }
+}
@@ -0,0 +1,27 @@
+#include "malpch.h"
+#include "resource.h"
+
+#include <fstream>
+
+namespace malachite
+{
+    std::unique_ptr<fileResource> fileResource::load(const std::filesystem::path& path)
+    {
+        std::ifstream file(path, std::ios::ate | std::ios::binary);
+
+        if (!file.is_open())
+        {
+            return nullptr;
+        }
+
+        auto result = std::make_unique<fileResource>();
+
+        size_t fileSize = (size_t) file.tellg();
+        result->bytes.resize(fileSize);
+
+        file.seekg(0);
+        file.read(result->bytes.data(), fileSize);
+
+        return result;
+    }
+}
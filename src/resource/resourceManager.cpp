@@ -0,0 +1,396 @@
+#include "malpch.h"
+#include "resourceManager.h"
+#include "textureResource.h"
+
+#include <algorithm>
+
+namespace malachite
+{
+    resourceManager::resourceManager(uint32_t ioThreadCount, size_t memoryBudget)
+        : m_memoryBudget(memoryBudget)
+    {
+        registerLoader<fileResource>(&fileResource::load);
+        registerLoader<textureResource>(&textureResource::load);
+
+        ioThreadCount = std::max<uint32_t>(ioThreadCount, 1);
+
+        m_ioThreads.reserve(ioThreadCount);
+        for (uint32_t i = 0; i < ioThreadCount; i++)
+        {
+            m_ioThreads.emplace_back(&resourceManager::ioThreadLoop, this);
+        }
+    }
+
+    resourceManager::~resourceManager()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_requestMutex);
+            m_isStopping = true;
+        }
+
+        m_requestCondition.notify_all();
+
+        for (auto& ioThread : m_ioThreads)
+        {
+            ioThread.join();
+        }
+    }
+
+    void resourceManager::setRootPath(const std::filesystem::path& rootPath)
+    {
+        m_rootPath = rootPath;
+    }
+
+    std::filesystem::path resourceManager::resolvePath(const std::filesystem::path& path) const
+    {
+        if (path.is_absolute() || m_rootPath.empty())
+        {
+            return path;
+        }
+
+        return m_rootPath / path;
+    }
+
+    bool resourceManager::mountArchive(const std::filesystem::path& path)
+    {
+        auto archive = std::make_unique<assetArchive>();
+
+        if (!archive->open(resolvePath(path)))
+        {
+            return false;
+        }
+
+        MAL_LOG_TRACE("Mounted Asset Archive: ", path, " Entries: ", std::to_string(archive->getEntryCount()));
+
+        m_archives.push_back(std::move(archive));
+        return true;
+    }
+
+    arrayView<char> resourceManager::findPacked(const std::filesystem::path& path) const
+    {
+        std::string name = path.lexically_normal().generic_string();
+
+        for (auto archive = m_archives.rbegin(); archive != m_archives.rend(); archive++)
+        {
+            arrayView<char> data = (*archive)->find(name);
+            if (data.data)
+            {
+                return data;
+            }
+        }
+
+        return {};
+    }
+
+    uint32_t resourceManager::acquireSlot(std::type_index type, const std::filesystem::path& path, e_resourcePriority priority, resourceCallback onComplete)
+    {
+        std::filesystem::path resolvedPath = resolvePath(path);
+        auto key = std::make_pair(type, resolvedPath.lexically_normal().string());
+
+        auto found = m_slotLookup.find(key);
+        if (found != m_slotLookup.end())
+        {
+            uint32_t index = found->second;
+            resourceSlot& slot = m_slots[index];
+
+            slot.refCount++;
+            slot.lastUsedFrame = m_frameIndex;
+
+            if (slot.state == e_resourceState::loading)
+            {
+                if (onComplete)
+                {
+                    slot.callbacks.push_back(std::move(onComplete));
+                }
+
+                //Queue it again at the new priority, whichever request is picked up first does the load.
+                if (priority > slot.priority)
+                {
+                    slot.priority = priority;
+                    queueLoad(index);
+                }
+            }
+            else if (onComplete)
+            {
+                onComplete(slot.state == e_resourceState::loaded);
+            }
+
+            return index;
+        }
+
+        uint32_t index;
+        if (!m_freeSlots.empty())
+        {
+            index = m_freeSlots.back();
+            m_freeSlots.pop_back();
+        }
+        else
+        {
+            index = (uint32_t) m_slots.size();
+            m_slots.emplace_back();
+        }
+
+        resourceSlot& slot = m_slots[index];
+        slot.type = type;
+        slot.path = key.second;
+        slot.state = e_resourceState::loading;
+        slot.priority = priority;
+        slot.refCount = 1;
+        slot.lastUsedFrame = m_frameIndex;
+        slot.memorySize = 0;
+        slot.isClaimed = std::make_shared<std::atomic<bool>>(false);
+
+        if (onComplete)
+        {
+            slot.callbacks.push_back(std::move(onComplete));
+        }
+
+        m_slotLookup[key] = index;
+
+        queueLoad(index);
+
+        return index;
+    }
+
+    void resourceManager::queueLoad(uint32_t index)
+    {
+        resourceSlot& slot = m_slots[index];
+
+        auto loader = m_loaders.find(slot.type);
+        if (loader == m_loaders.end())
+        {
+            MAL_LOG_ERROR("No resource loader registered for: ", slot.path);
+
+            //Reported like any other failure on the next update.
+            std::lock_guard<std::mutex> lock(m_resultMutex);
+            m_results.push_back({index, slot.generation, nullptr});
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_requestMutex);
+            m_requests.push({index, slot.generation, slot.priority, m_requestSequence++, slot.path, loader->second, slot.isClaimed});
+        }
+
+        m_requestCondition.notify_one();
+    }
+
+    void resourceManager::ioThreadLoop()
+    {
+        while (true)
+        {
+            loadRequest request;
+
+            {
+                std::unique_lock<std::mutex> lock(m_requestMutex);
+                m_requestCondition.wait(lock, [this]() { return m_isStopping || !m_requests.empty(); });
+
+                if (m_isStopping)
+                {
+                    return;
+                }
+
+                request = m_requests.top();
+                m_requests.pop();
+            }
+
+            if (request.isClaimed->exchange(true))
+            {
+                continue;
+            }
+
+            std::unique_ptr<resource> data = request.loader(request.path);
+
+            {
+                std::lock_guard<std::mutex> lock(m_resultMutex);
+                m_results.push_back({request.index, request.generation, std::move(data)});
+            }
+
+            m_resultCondition.notify_all();
+        }
+    }
+
+    resourceManager::resourceSlot* resourceManager::getSlot(uint32_t index, uint32_t generation)
+    {
+        if (index >= m_slots.size() || m_slots[index].generation != generation)
+        {
+            return nullptr;
+        }
+
+        return &m_slots[index];
+    }
+
+    resource* resourceManager::getResource(uint32_t index, uint32_t generation)
+    {
+        resourceSlot* slot = getSlot(index, generation);
+        if (!slot)
+        {
+            return nullptr;
+        }
+
+        slot->lastUsedFrame = m_frameIndex;
+        return slot->data.get();
+    }
+
+    e_resourceState resourceManager::getState(uint32_t index, uint32_t generation)
+    {
+        resourceSlot* slot = getSlot(index, generation);
+        return slot ? slot->state : e_resourceState::unloaded;
+    }
+
+    void resourceManager::addRef(uint32_t index, uint32_t generation)
+    {
+        resourceSlot* slot = getSlot(index, generation);
+        if (slot)
+        {
+            slot->refCount++;
+        }
+    }
+
+    void resourceManager::release(uint32_t index, uint32_t generation)
+    {
+        resourceSlot* slot = getSlot(index, generation);
+        if (!slot || slot->refCount == 0)
+        {
+            return;
+        }
+
+        slot->refCount--;
+
+        //Loaded resources stay cached until the budget needs the memory, failures are retried on the next load.
+        if (slot->refCount == 0 && slot->state == e_resourceState::failed)
+        {
+            freeSlot(index);
+        }
+    }
+
+    bool resourceManager::waitForSlot(uint32_t index, uint32_t generation)
+    {
+        while (true)
+        {
+            processResults();
+
+            resourceSlot* slot = getSlot(index, generation);
+            if (!slot)
+            {
+                return false;
+            }
+
+            if (slot->state != e_resourceState::loading)
+            {
+                return slot->state == e_resourceState::loaded;
+            }
+
+            std::unique_lock<std::mutex> lock(m_resultMutex);
+            m_resultCondition.wait(lock, [this]() { return !m_results.empty(); });
+        }
+    }
+
+    void resourceManager::update()
+    {
+        m_frameIndex++;
+
+        processResults();
+        trimToBudget();
+    }
+
+    void resourceManager::processResults()
+    {
+        std::vector<loadResult> results;
+
+        {
+            std::lock_guard<std::mutex> lock(m_resultMutex);
+            results.swap(m_results);
+        }
+
+        for (auto& result : results)
+        {
+            resourceSlot* slot = getSlot(result.index, result.generation);
+            if (!slot || slot->state != e_resourceState::loading)
+            {
+                continue;
+            }
+
+            bool isLoaded = result.data != nullptr;
+
+            if (isLoaded)
+            {
+                slot->memorySize = result.data->getMemorySize();
+                slot->data = std::move(result.data);
+                slot->state = e_resourceState::loaded;
+                m_memoryUsage += slot->memorySize;
+            }
+            else
+            {
+                MAL_LOG_ERROR("Failed to load resource: ", slot->path);
+                slot->state = e_resourceState::failed;
+            }
+
+            //Callbacks may load more resources and grow m_slots, so the slot isn't touched past here.
+            std::vector<resourceCallback> callbacks;
+            callbacks.swap(slot->callbacks);
+
+            if (!isLoaded && slot->refCount == 0)
+            {
+                freeSlot(result.index);
+            }
+
+            for (auto& callback : callbacks)
+            {
+                callback(isLoaded);
+            }
+        }
+    }
+
+    void resourceManager::trimToBudget()
+    {
+        if (m_memoryUsage <= m_memoryBudget)
+        {
+            return;
+        }
+
+        std::vector<uint32_t> candidates;
+        for (uint32_t i = 0; i < m_slots.size(); i++)
+        {
+            const resourceSlot& slot = m_slots[i];
+            if (slot.state == e_resourceState::loaded && slot.refCount == 0)
+            {
+                candidates.push_back(i);
+            }
+        }
+
+        std::sort(candidates.begin(), candidates.end(), [this](uint32_t a, uint32_t b)
+        {
+            return m_slots[a].lastUsedFrame < m_slots[b].lastUsedFrame;
+        });
+
+        for (uint32_t index : candidates)
+        {
+            if (m_memoryUsage <= m_memoryBudget)
+            {
+                break;
+            }
+
+            freeSlot(index);
+        }
+    }
+
+    void resourceManager::freeSlot(uint32_t index)
+    {
+        resourceSlot& slot = m_slots[index];
+
+        m_slotLookup.erase(std::make_pair(slot.type, slot.path));
+        m_memoryUsage -= slot.memorySize;
+
+        //Bumping the generation turns every handle still pointing here stale.
+        slot.generation++;
+        slot.data.reset();
+        slot.state = e_resourceState::unloaded;
+        slot.memorySize = 0;
+        slot.refCount = 0;
+        slot.callbacks.clear();
+        slot.isClaimed.reset();
+
+        m_freeSlots.push_back(index);
+    }
+}
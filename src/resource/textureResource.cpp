@@ -0,0 +1,176 @@
+#include "malpch.h"
+#include "textureResource.h"
+#include "mappedFile.h"
+
+#include <algorithm>
+#include <cstring>
+
+//Skips whitespace and # comments between the fields of a PNM header.
+static void skipHeaderSpace(std::string_view text, size_t& offset)
+{
+    while (offset < text.size())
+    {
+        char character = text[offset];
+
+        if (character == '#')
+        {
+            while (offset < text.size() && text[offset] != '\n')
+            {
+                offset++;
+            }
+        }
+        else if (character == ' ' || character == '\t' || character == '\r' || character == '\n')
+        {
+            offset++;
+        }
+        else
+        {
+            break;
+        }
+    }
+}
+
+static bool readHeaderNumber(std::string_view text, size_t& offset, uint32_t& value)
+{
+    skipHeaderSpace(text, offset);
+
+    size_t start = offset;
+    uint64_t number = 0;
+
+    while (offset < text.size() && text[offset] >= '0' && text[offset] <= '9' && number <= UINT32_MAX)
+    {
+        number = number * 10 + (uint64_t) (text[offset] - '0');
+        offset++;
+    }
+
+    value = (uint32_t) number;
+    return offset > start && number <= UINT32_MAX;
+}
+
+//Averages each 2x2 block, the last row or column is repeated when the source size is odd.
+static void downsample(const uint8_t* source, uint32_t sourceWidth, uint32_t sourceHeight, uint8_t* destination, uint32_t width, uint32_t height)
+{
+    for (uint32_t y = 0; y < height; y++)
+    {
+        uint32_t y0 = std::min(y * 2, sourceHeight - 1);
+        uint32_t y1 = std::min(y * 2 + 1, sourceHeight - 1);
+
+        for (uint32_t x = 0; x < width; x++)
+        {
+            uint32_t x0 = std::min(x * 2, sourceWidth - 1);
+            uint32_t x1 = std::min(x * 2 + 1, sourceWidth - 1);
+
+            const uint8_t* texels[4] =
+            {
+                source + ((size_t) y0 * sourceWidth + x0) * 4,
+                source + ((size_t) y0 * sourceWidth + x1) * 4,
+                source + ((size_t) y1 * sourceWidth + x0) * 4,
+                source + ((size_t) y1 * sourceWidth + x1) * 4
+            };
+
+            uint8_t* texel = destination + ((size_t) y * width + x) * 4;
+            for (uint32_t channel = 0; channel < 4; channel++)
+            {
+                uint32_t sum = texels[0][channel] + texels[1][channel] + texels[2][channel] + texels[3][channel];
+                texel[channel] = (uint8_t) ((sum + 2) / 4);
+            }
+        }
+    }
+}
+
+namespace malachite
+{
+    std::unique_ptr<textureResource> textureResource::create(uint32_t width, uint32_t height, const uint8_t* rgbaPixels)
+    {
+        if (width == 0 || height == 0)
+        {
+            return nullptr;
+        }
+
+        auto texture = std::make_unique<textureResource>();
+
+        size_t totalSize = 0;
+        for (uint32_t mipWidth = width, mipHeight = height;; mipWidth = std::max(mipWidth / 2, 1u), mipHeight = std::max(mipHeight / 2, 1u))
+        {
+            size_t size = (size_t) mipWidth * mipHeight * 4;
+            texture->mips.push_back({mipWidth, mipHeight, totalSize, size});
+            totalSize += size;
+
+            if (mipWidth == 1 && mipHeight == 1)
+            {
+                break;
+            }
+        }
+
+        texture->pixels.resize(totalSize);
+        memcpy(texture->pixels.data(), rgbaPixels, texture->mips[0].size);
+
+        for (size_t i = 1; i < texture->mips.size(); i++)
+        {
+            const textureMip& source = texture->mips[i - 1];
+            const textureMip& mip = texture->mips[i];
+
+            downsample(texture->pixels.data() + source.offset, source.width, source.height, texture->pixels.data() + mip.offset, mip.width, mip.height);
+        }
+
+        return texture;
+    }
+
+    std::unique_ptr<textureResource> textureResource::load(const std::filesystem::path& path)
+    {
+        mappedFile file;
+        if (!file.open(path))
+        {
+            return nullptr;
+        }
+
+        std::string_view text = file.getText();
+        if (text.size() < 2 || text[0] != 'P' || (text[1] != '5' && text[1] != '6'))
+        {
+            MAL_LOG_ERROR("Unsupported texture format: ", path);
+            return nullptr;
+        }
+
+        uint32_t channelCount = text[1] == '6' ? 3 : 1;
+        uint32_t width = 0;
+        uint32_t height = 0;
+        uint32_t maxValue = 0;
+        size_t offset = 2;
+
+        if (!readHeaderNumber(text, offset, width) || !readHeaderNumber(text, offset, height) ||
+            !readHeaderNumber(text, offset, maxValue) || maxValue == 0 || maxValue > 255)
+        {
+            MAL_LOG_ERROR("Invalid texture header: ", path);
+            return nullptr;
+        }
+
+        //Exactly one whitespace character separates the header from the pixels.
+        offset++;
+
+        size_t pixelCount = (size_t) width * height;
+        if (width == 0 || height == 0 || offset > text.size() || (text.size() - offset) / channelCount < pixelCount)
+        {
+            MAL_LOG_ERROR("Truncated texture: ", path);
+            return nullptr;
+        }
+
+        const uint8_t* source = reinterpret_cast<const uint8_t*>(text.data() + offset);
+        std::vector<uint8_t> rgbaPixels(pixelCount * 4);
+
+        for (size_t i = 0; i < pixelCount; i++)
+        {
+            const uint8_t* texel = source + i * channelCount;
+            uint8_t* destination = rgbaPixels.data() + i * 4;
+
+            for (uint32_t channel = 0; channel < 3; channel++)
+            {
+                uint32_t value = texel[channelCount == 3 ? channel : 0];
+                destination[channel] = (uint8_t) (maxValue == 255 ? value : std::min(value, maxValue) * 255 / maxValue);
+            }
+
+            destination[3] = 255;
+        }
+
+        return create(width, height, rgbaPixels.data());
+    }
+}
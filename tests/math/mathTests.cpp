@@ -0,0 +1,616 @@
+#include "malmath.h"
+#include "batchTransform.h"
+#include "threadPool.h"
+#include "hash.h"
+
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <chrono>
+#include <vector>
+
+//Every backend build prints one line per operation, a hash over the raw bits of its results.
+//The SIMD builds have to print exactly what the scalar one does, make test diffs them.
+//With --bench the operations are timed instead. Returns 1 when a check within the build fails.
+
+using namespace malachite;
+using namespace malachite::math;
+
+static const size_t c_inputCount = 4096;
+static const size_t c_benchIterations = 200;
+
+//Not a multiple of any SIMD width, so the scalar tail of the batch kernels runs too.
+static const size_t c_batchCount = 100003;
+
+//Samples per fixed point function, and the grid size of atan2.
+static const int c_fixedSampleCount = 100000;
+static const int c_fixedGridSize = 256;
+
+//mat4 only promises 16 byte alignment, this keeps every matrix off a 32 byte boundary.
+struct alignas(32) offsetMatrix
+{
+    vec4 padding;
+    mat4 matrix;
+};
+
+static uint32_t s_randomState = 1;
+
+//Same sequence on every build, [-2, 2) in steps the float representation hits exactly.
+static float randomFloat()
+{
+    s_randomState = s_randomState * 1664525u + 1013904223u;
+    return (float) (s_randomState >> 8) / (float) (1u << 24) * 4.0f - 2.0f;
+}
+
+static vec4 randomVec4()
+{
+    return {randomFloat(), randomFloat(), randomFloat(), randomFloat()};
+}
+
+static quat randomQuat()
+{
+    return normalize(quat(randomFloat(), randomFloat(), randomFloat(), randomFloat()));
+}
+
+struct inputs
+{
+    std::vector<vec4> vectors;
+    std::vector<offsetMatrix> matrices;
+    std::vector<quat> quats;
+    std::vector<float> factors;
+};
+
+//Structure of arrays entities for the batch kernels.
+struct batchInputs
+{
+    std::vector<float> positionXs, positionYs, positionZs;
+    std::vector<float> rotationXs, rotationYs, rotationZs, rotationWs;
+    std::vector<float> scaleXs, scaleYs, scaleZs;
+};
+
+static inputs createInputs()
+{
+    inputs data;
+    data.vectors.resize(c_inputCount);
+    data.matrices.resize(c_inputCount);
+    data.quats.resize(c_inputCount);
+    data.factors.resize(c_inputCount);
+
+    for (size_t i = 0; i < c_inputCount; i++)
+    {
+        data.vectors[i] = randomVec4();
+        data.matrices[i].matrix = mat4(randomVec4(), randomVec4(), randomVec4(), randomVec4());
+        data.quats[i] = randomQuat();
+        data.factors[i] = (randomFloat() + 2.0f) * 0.25f;
+    }
+
+    return data;
+}
+
+static batchInputs createBatchInputs()
+{
+    batchInputs data;
+
+    for (std::vector<float>* values : {&data.positionXs, &data.positionYs, &data.positionZs, &data.rotationXs, &data.rotationYs, &data.rotationZs, &data.rotationWs, &data.scaleXs, &data.scaleYs, &data.scaleZs})
+    {
+        values->resize(c_batchCount);
+        for (float& value : *values)
+        {
+            value = randomFloat();
+        }
+    }
+
+    return data;
+}
+
+template <typename T>
+static void hashResult(uint64_t& hash, const T& value)
+{
+    hash = fnv1a64(reinterpret_cast<const char*>(&value), sizeof(value), hash);
+}
+
+template <typename T>
+static uint64_t hashResults(const std::vector<T>& values)
+{
+    return fnv1a64(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+}
+
+static bool isSameBits(const std::vector<float>& a, const std::vector<float>& b)
+{
+    return a.size() == b.size() && std::memcmp(a.data(), b.data(), a.size() * sizeof(float)) == 0;
+}
+
+static void printHash(const char* name, uint64_t hash)
+{
+    std::printf("%s %016llx\n", name, (unsigned long long) hash);
+}
+
+static void printHashes(const inputs& data)
+{
+    uint64_t vectorHash = c_fnv1a64Offset;
+    uint64_t dotHash = c_fnv1a64Offset;
+    uint64_t transformHash = c_fnv1a64Offset;
+    uint64_t mulHash = c_fnv1a64Offset;
+    uint64_t inverseHash = c_fnv1a64Offset;
+    uint64_t transposeHash = c_fnv1a64Offset;
+    uint64_t quatMulHash = c_fnv1a64Offset;
+    uint64_t slerpHash = c_fnv1a64Offset;
+    uint64_t rotateHash = c_fnv1a64Offset;
+    uint64_t toMat4Hash = c_fnv1a64Offset;
+    uint64_t cameraHash = c_fnv1a64Offset;
+
+    offsetMatrix result;
+
+    for (size_t i = 0; i < c_inputCount; i++)
+    {
+        size_t j = (i * 7 + 3) % c_inputCount;
+
+        const vec4& a = data.vectors[i];
+        const vec4& b = data.vectors[j];
+        hashResult(vectorHash, a + b);
+        hashResult(vectorHash, a - b);
+        hashResult(vectorHash, a * b);
+        hashResult(vectorHash, a / b);
+        hashResult(vectorHash, normalize(a));
+        hashResult(vectorHash, lerp(a, b, data.factors[i]));
+
+        hashResult(dotHash, dot(a, b));
+        hashResult(dotHash, dot(toVec3(a), toVec3(b)));
+        hashResult(dotHash, cross(toVec3(a), toVec3(b)));
+
+        const mat4& m = data.matrices[i].matrix;
+        hashResult(transformHash, m * a);
+        hashResult(transformHash, transformPoint(m, toVec3(b)));
+        hashResult(transformHash, transformDirection(m, toVec3(b)));
+
+        result.matrix = m * data.matrices[j].matrix;
+        hashResult(mulHash, result.matrix);
+
+        hashResult(inverseHash, inverse(m));
+        hashResult(transposeHash, transpose(m));
+
+        const quat& p = data.quats[i];
+        const quat& q = data.quats[j];
+        hashResult(quatMulHash, p * q);
+        hashResult(slerpHash, slerp(p, q, data.factors[i]));
+        hashResult(rotateHash, rotate(p, toVec3(a)));
+        hashResult(toMat4Hash, toMat4(p));
+
+        hashResult(cameraHash, lookAt(toVec3(a), toVec3(b), {0.0f, 1.0f, 0.0f}));
+        hashResult(cameraHash, perspective(0.5f + data.factors[i], 1.5f, 0.1f, 100.0f));
+    }
+
+    printHash("vec4", vectorHash);
+    printHash("dot", dotHash);
+    printHash("transform", transformHash);
+    printHash("mul", mulHash);
+    printHash("inverse", inverseHash);
+    printHash("transpose", transposeHash);
+    printHash("quatMul", quatMulHash);
+    printHash("slerp", slerpHash);
+    printHash("rotate", rotateHash);
+    printHash("toMat4", toMat4Hash);
+    printHash("camera", cameraHash);
+}
+
+//The batch kernels, split across the pool and not, and against the single element functions.
+static bool printBatchHashes(const inputs& data, const batchInputs& batch, threadPool& pool)
+{
+    bool isPassing = true;
+    const mat4& m = data.matrices[0].matrix;
+
+    std::vector<float> xs(c_batchCount), ys(c_batchCount), zs(c_batchCount);
+    transformPoints(m, batch.positionXs.data(), batch.positionYs.data(), batch.positionZs.data(), c_batchCount, xs.data(), ys.data(), zs.data());
+
+    std::vector<float> pooledXs(c_batchCount), pooledYs(c_batchCount), pooledZs(c_batchCount);
+    transformPoints(pool, m, batch.positionXs.data(), batch.positionYs.data(), batch.positionZs.data(), c_batchCount, pooledXs.data(), pooledYs.data(), pooledZs.data());
+
+    if (!isSameBits(xs, pooledXs) || !isSameBits(ys, pooledYs) || !isSameBits(zs, pooledZs))
+    {
+        std::fprintf(stderr, "transformPoints differs when split across the pool\n");
+        isPassing = false;
+    }
+
+    for (size_t i = 0; i < c_batchCount; i++)
+    {
+        vec3 expected = transformPoint(m, {batch.positionXs[i], batch.positionYs[i], batch.positionZs[i]});
+        vec3 actual(xs[i], ys[i], zs[i]);
+
+        if (std::memcmp(&expected, &actual, sizeof(vec3)) != 0)
+        {
+            std::fprintf(stderr, "transformPoints differs from transformPoint at %zu\n", i);
+            isPassing = false;
+            break;
+        }
+    }
+
+    printHash("transformPoints", fnv1a64(reinterpret_cast<const char*>(zs.data()), c_batchCount * sizeof(float), fnv1a64(reinterpret_cast<const char*>(ys.data()), c_batchCount * sizeof(float), hashResults(xs))));
+
+    std::vector<mat4> matrices(c_batchCount);
+    composeModelMatrices
+    (
+        batch.positionXs.data(), batch.positionYs.data(), batch.positionZs.data(),
+        batch.rotationXs.data(), batch.rotationYs.data(), batch.rotationZs.data(), batch.rotationWs.data(),
+        batch.scaleXs.data(), batch.scaleYs.data(), batch.scaleZs.data(),
+        c_batchCount,
+        matrices.data()
+    );
+
+    std::vector<mat4> pooledMatrices(c_batchCount);
+    composeModelMatrices
+    (
+        pool,
+        batch.positionXs.data(), batch.positionYs.data(), batch.positionZs.data(),
+        batch.rotationXs.data(), batch.rotationYs.data(), batch.rotationZs.data(), batch.rotationWs.data(),
+        batch.scaleXs.data(), batch.scaleYs.data(), batch.scaleZs.data(),
+        c_batchCount,
+        pooledMatrices.data()
+    );
+
+    if (hashResults(matrices) != hashResults(pooledMatrices))
+    {
+        std::fprintf(stderr, "composeModelMatrices differs when split across the pool\n");
+        isPassing = false;
+    }
+
+    printHash("composeModelMatrices", hashResults(matrices));
+
+    std::vector<float> qx = batch.rotationXs, qy = batch.rotationYs, qz = batch.rotationZs, qw = batch.rotationWs;
+    normalizeQuaternions(pool, qx.data(), qy.data(), qz.data(), qw.data(), c_batchCount);
+
+    printHash("normalizeQuaternions", fnv1a64(reinterpret_cast<const char*>(qw.data()), c_batchCount * sizeof(float), fnv1a64(reinterpret_cast<const char*>(qz.data()), c_batchCount * sizeof(float), fnv1a64(reinterpret_cast<const char*>(qy.data()), c_batchCount * sizeof(float), hashResults(qx)))));
+
+    return isPassing;
+}
+
+//Batch sizes around a few SIMD widths so each kernel's tail runs, against translation * rotation * scale
+//built one entity at a time. Allows for rounding, a kernel may order the arithmetic differently.
+static bool checkComposeModelMatrices()
+{
+    const float tolerance = 1e-5f;
+    bool isPassing = true;
+
+    for (size_t count : {1, 3, 7, 8, 9, 15, 16, 17, 31, 33, 1001})
+    {
+        std::vector<vec3> translations(count);
+        std::vector<quat> rotations(count);
+        std::vector<vec3> scales(count);
+        std::vector<float> positionXs(count), positionYs(count), positionZs(count);
+        std::vector<float> rotationXs(count), rotationYs(count), rotationZs(count), rotationWs(count);
+        std::vector<float> scaleXs(count), scaleYs(count), scaleZs(count);
+
+        for (size_t i = 0; i < count; i++)
+        {
+            translations[i] = toVec3(randomVec4()) * 8.0f;
+            rotations[i] = randomQuat();
+            scales[i] = toVec3(randomVec4());
+
+            positionXs[i] = translations[i].x;
+            positionYs[i] = translations[i].y;
+            positionZs[i] = translations[i].z;
+            rotationXs[i] = rotations[i].x;
+            rotationYs[i] = rotations[i].y;
+            rotationZs[i] = rotations[i].z;
+            rotationWs[i] = rotations[i].w;
+            scaleXs[i] = scales[i].x;
+            scaleYs[i] = scales[i].y;
+            scaleZs[i] = scales[i].z;
+        }
+
+        std::vector<mat4> matrices(count);
+        composeModelMatrices
+        (
+            positionXs.data(), positionYs.data(), positionZs.data(),
+            rotationXs.data(), rotationYs.data(), rotationZs.data(), rotationWs.data(),
+            scaleXs.data(), scaleYs.data(), scaleZs.data(),
+            count,
+            matrices.data()
+        );
+
+        for (size_t i = 0; i < count; i++)
+        {
+            mat4 expected = translation(translations[i]) * toMat4(rotations[i]) * scaling(scales[i]);
+
+            const float* expectedValues = reinterpret_cast<const float*>(&expected);
+            const float* actualValues = reinterpret_cast<const float*>(&matrices[i]);
+
+            float error = 0.0f;
+            for (size_t value = 0; value < 16; value++)
+            {
+                error = std::max(error, std::fabs(expectedValues[value] - actualValues[value]));
+            }
+
+            if (error > tolerance)
+            {
+                std::fprintf(stderr, "composeModelMatrices on %s is off by %g at %zu of %zu\n", getMathBackendName(), error, i, count);
+                isPassing = false;
+                break;
+            }
+        }
+    }
+
+    return isPassing;
+}
+
+//The fixed point functions against <cmath>, within the error their comments give. They are integer
+//only, so the hash of the results has to be the same on every backend too.
+template <typename T, typename WideT, int FractionBits>
+static bool printFixedHash(const char* name, fixed<T, WideT, FractionBits>, double trigBound, double atanBound)
+{
+    using F = fixed<T, WideT, FractionBits>;
+
+    const double step = 1.0 / (double) F::oneRaw;
+    uint64_t hash = c_fnv1a64Offset;
+    double sinError = 0.0;
+    double cosError = 0.0;
+    double atanError = 0.0;
+    double sqrtError = 0.0;
+    bool isRoundedDown = true;
+
+    //A few turns either way.
+    for (int i = -c_fixedSampleCount; i <= c_fixedSampleCount; i++)
+    {
+        F angle = F::fromDouble(i * (20.0 / c_fixedSampleCount));
+        F sine = sin(angle);
+        F cosine = cos(angle);
+
+        hashResult(hash, sine.raw);
+        hashResult(hash, cosine.raw);
+        sinError = std::max(sinError, std::fabs(sine.toDouble() - std::sin(angle.toDouble())));
+        cosError = std::max(cosError, std::fabs(cosine.toDouble() - std::cos(angle.toDouble())));
+    }
+
+    //Every octant, once with large and once with small operands.
+    for (double scale : {0.37, 0.0021})
+    {
+        for (int i = 0; i < c_fixedGridSize; i++)
+        {
+            for (int j = 0; j < c_fixedGridSize; j++)
+            {
+                F y = F::fromDouble((i - c_fixedGridSize / 2) * scale);
+                F x = F::fromDouble((j - c_fixedGridSize / 2) * scale);
+
+                if (y.raw == 0 && x.raw == 0)
+                {
+                    continue;
+                }
+
+                F angle = atan2(y, x);
+                hashResult(hash, angle.raw);
+                atanError = std::max(atanError, std::fabs(angle.toDouble() - std::atan2(y.toDouble(), x.toDouble())));
+            }
+        }
+    }
+
+    //Spread over the whole positive range, the result has to be the largest one whose square fits.
+    for (int i = 0; i <= c_fixedSampleCount; i++)
+    {
+        F value = F::fromRaw(std::numeric_limits<T>::max() / c_fixedSampleCount * i);
+        F root = sqrt(value);
+
+        WideT scaled = WideT(value.raw) * F::oneRaw;
+        isRoundedDown &= WideT(root.raw) * root.raw <= scaled && (WideT(root.raw) + 1) * (WideT(root.raw) + 1) > scaled;
+
+        hashResult(hash, root.raw);
+        sqrtError = std::max(sqrtError, std::fabs(root.toDouble() - std::sqrt(value.toDouble())));
+    }
+
+    bool isPassing = true;
+    auto checkBound = [&](const char* function, double error, double bound)
+    {
+        if (error > bound)
+        {
+            std::fprintf(stderr, "%s %s is off by %g, more than %g\n", name, function, error, bound);
+            isPassing = false;
+        }
+    };
+
+    checkBound("sin", sinError, trigBound);
+    checkBound("cos", cosError, trigBound);
+    checkBound("atan2", atanError, atanBound);
+
+    //Rounding down stays within a step, the double reference adds a little of its own on fixed32.
+    checkBound("sqrt", sqrtError, step * 1.01);
+
+    if (!isRoundedDown)
+    {
+        std::fprintf(stderr, "%s sqrt doesn't round down\n", name);
+        isPassing = false;
+    }
+
+    printHash(name, hash);
+    return isPassing;
+}
+
+//Whole results are stored and hashed afterwards, so nothing of the operation can be left out.
+template <typename Func>
+static void bench(const char* name, Func func)
+{
+    using resultType = decltype(func(0));
+    std::vector<resultType> results(c_inputCount);
+
+    auto begin = std::chrono::steady_clock::now();
+    for (size_t iteration = 0; iteration < c_benchIterations; iteration++)
+    {
+        for (size_t i = 0; i < c_inputCount; i++)
+        {
+            results[i] = func(i);
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    uint64_t hash = c_fnv1a64Offset;
+    for (const resultType& result : results)
+    {
+        hashResult(hash, result);
+    }
+
+    double nanoseconds = std::chrono::duration<double, std::nano>(end - begin).count();
+    std::printf("%-10s %8.2f ns/op (%016llx)\n", name, nanoseconds / (double) (c_benchIterations * c_inputCount), (unsigned long long) hash);
+}
+
+static void runBenchmarks(const inputs& data)
+{
+    std::printf("backend %s\n", getMathBackendName());
+
+    //The second operand moves with the iteration so results can't be hoisted out of the loop.
+    bench("mul", [&](size_t i)
+    {
+        return data.matrices[i].matrix * data.matrices[(i + 1) % c_inputCount].matrix;
+    });
+
+    bench("inverse", [&](size_t i)
+    {
+        return inverse(data.matrices[i].matrix);
+    });
+
+    bench("slerp", [&](size_t i)
+    {
+        return slerp(data.quats[i], data.quats[(i + 1) % c_inputCount], data.factors[i]);
+    });
+
+    bench("quatMul", [&](size_t i)
+    {
+        return data.quats[i] * data.quats[(i + 1) % c_inputCount];
+    });
+
+    bench("transform", [&](size_t i)
+    {
+        return data.matrices[i].matrix * data.vectors[i];
+    });
+}
+
+template <typename F>
+static fixedVec3<F> toFixedVec3(const vec4& v)
+{
+    return {F::fromDouble(v.x), F::fromDouble(v.y), F::fromDouble(v.z)};
+}
+
+//One semi-implicit Euler step of a body under gravity and drag, the same step in float and in fixed point.
+static void runPhysicsBenchmarks(const inputs& data)
+{
+    const float deltaTime = 1.0f / 60.0f;
+    const float drag = 0.99f;
+    const vec3 gravity(0.0f, -9.81f, 0.0f);
+
+    bench("step float", [&](size_t i)
+    {
+        vec3 velocity = (toVec3(data.vectors[(i + 1) % c_inputCount]) + gravity * deltaTime) * drag;
+        return toVec3(data.vectors[i]) + velocity * deltaTime;
+    });
+
+    auto benchFixed = [&](const char* name, auto zero)
+    {
+        using F = decltype(zero);
+
+        std::vector<fixedVec3<F>> positions(c_inputCount);
+        for (size_t i = 0; i < c_inputCount; i++)
+        {
+            positions[i] = toFixedVec3<F>(data.vectors[i]);
+        }
+
+        const F fixedDeltaTime = F(1) / F(60);
+        const F fixedDrag = F::fromDouble(drag);
+        const fixedVec3<F> fixedGravity(F(), F::fromDouble(gravity.y), F());
+
+        bench(name, [&](size_t i)
+        {
+            fixedVec3<F> velocity = (positions[(i + 1) % c_inputCount] + fixedGravity * fixedDeltaTime) * fixedDrag;
+            return positions[i] + velocity * fixedDeltaTime;
+        });
+    };
+
+    benchFixed("step fx16", fixed16());
+    benchFixed("step fx32", fixed32());
+}
+
+template <typename Func>
+static void benchBatch(const char* name, Func func)
+{
+    auto begin = std::chrono::steady_clock::now();
+    for (size_t iteration = 0; iteration < c_benchIterations / 10; iteration++)
+    {
+        func();
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    double nanoseconds = std::chrono::duration<double, std::nano>(end - begin).count();
+    std::printf("%-26s %7.3f ns/entity\n", name, nanoseconds / (double) (c_benchIterations / 10 * c_batchCount));
+}
+
+static void runBatchBenchmarks(const inputs& data, batchInputs& batch, threadPool& pool)
+{
+    const mat4& m = data.matrices[0].matrix;
+    std::vector<float> xs(c_batchCount), ys(c_batchCount), zs(c_batchCount);
+    std::vector<mat4> matrices(c_batchCount);
+
+    benchBatch("transformPoints", [&]()
+    {
+        transformPoints(m, batch.positionXs.data(), batch.positionYs.data(), batch.positionZs.data(), c_batchCount, xs.data(), ys.data(), zs.data());
+    });
+
+    benchBatch("transformPoints pool", [&]()
+    {
+        transformPoints(pool, m, batch.positionXs.data(), batch.positionYs.data(), batch.positionZs.data(), c_batchCount, xs.data(), ys.data(), zs.data());
+    });
+
+    auto compose = [&](threadPool* composePool)
+    {
+        if (composePool)
+        {
+            composeModelMatrices
+            (
+                *composePool,
+                batch.positionXs.data(), batch.positionYs.data(), batch.positionZs.data(),
+                batch.rotationXs.data(), batch.rotationYs.data(), batch.rotationZs.data(), batch.rotationWs.data(),
+                batch.scaleXs.data(), batch.scaleYs.data(), batch.scaleZs.data(),
+                c_batchCount,
+                matrices.data()
+            );
+        }
+        else
+        {
+            composeModelMatrices
+            (
+                batch.positionXs.data(), batch.positionYs.data(), batch.positionZs.data(),
+                batch.rotationXs.data(), batch.rotationYs.data(), batch.rotationZs.data(), batch.rotationWs.data(),
+                batch.scaleXs.data(), batch.scaleYs.data(), batch.scaleZs.data(),
+                c_batchCount,
+                matrices.data()
+            );
+        }
+    };
+
+    benchBatch("composeModelMatrices", [&]() { compose(nullptr); });
+    benchBatch("composeModelMatrices pool", [&]() { compose(&pool); });
+
+    //Already unit length after the first pass, the work per call stays the same.
+    benchBatch("normalizeQuaternions", [&]()
+    {
+        normalizeQuaternions(batch.rotationXs.data(), batch.rotationYs.data(), batch.rotationZs.data(), batch.rotationWs.data(), c_batchCount);
+    });
+}
+
+int main(int argc, char** argv)
+{
+    inputs data = createInputs();
+    batchInputs batch = createBatchInputs();
+    threadPool pool;
+
+    if (argc > 1 && std::strcmp(argv[1], "--bench") == 0)
+    {
+        runBenchmarks(data);
+        runPhysicsBenchmarks(data);
+        runBatchBenchmarks(data, batch, pool);
+        return 0;
+    }
+
+    printHashes(data);
+    bool isPassing = printBatchHashes(data, batch, pool);
+    isPassing &= checkComposeModelMatrices();
+
+    isPassing &= printFixedHash("fixed16", fixed16(), 1e-5, 7e-5);
+    isPassing &= printFixedHash("fixed32", fixed32(), 5e-7, 1.5e-5);
+
+    return isPassing ? 0 : 1;
+}
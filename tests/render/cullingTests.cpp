@@ -0,0 +1,170 @@
+#include "culling.h"
+#include "threadPool.h"
+#include "hash.h"
+
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <chrono>
+#include <vector>
+
+//Culls the same scene on every backend build and prints a hash of each visible list, make test
+//diffs them against the scalar build. Each build also checks its lists against the plain tests
+//below. With --bench the culling is timed instead. Returns 1 when a check within the build fails.
+
+using namespace malachite;
+
+//Not a multiple of any SIMD width, so the scalar tail runs too.
+static const size_t c_objectCount = 100003;
+static const size_t c_benchIterations = 50;
+
+static uint32_t s_randomState = 1;
+
+static float randomFloat(float min, float max)
+{
+    s_randomState = s_randomState * 1664525u + 1013904223u;
+    return min + (float) (s_randomState >> 8) / (float) (1u << 24) * (max - min);
+}
+
+static cullingParams createParams()
+{
+    math::vec3 eye(0.0f, 2.0f, 0.0f);
+
+    cullingParams params;
+    params.viewFrustum = extractFrustum(math::perspective(1.0f, 16.0f / 9.0f, 0.1f, 200.0f) * math::lookAt(eye, {10.0f, 0.0f, 30.0f}, {0.0f, 1.0f, 0.0f}));
+    params.cameraPosition = eye;
+    params.maxDrawDistance = 80.0f;
+    return params;
+}
+
+//Same operations in the same order as the scalar path of culling.cpp.
+static bool isSphereVisible(const cullingParams& params, float x, float y, float z, float radius)
+{
+    for (const auto& plane : params.viewFrustum.planes)
+    {
+        if (((plane.x * x + plane.y * y) + plane.z * z) + plane.w < -radius)
+        {
+            return false;
+        }
+    }
+
+    float dx = x - params.cameraPosition.x;
+    float dy = y - params.cameraPosition.y;
+    float dz = z - params.cameraPosition.z;
+    float reach = params.maxDrawDistance + radius;
+
+    return (dx * dx + dy * dy) + dz * dz <= reach * reach;
+}
+
+static bool isBoxVisible(const cullingParams& params, float x, float y, float z, float ex, float ey, float ez)
+{
+    for (const auto& plane : params.viewFrustum.planes)
+    {
+        float distance = ((plane.x * x + plane.y * y) + plane.z * z) + plane.w;
+        float radius = (std::fabs(plane.x) * ex + std::fabs(plane.y) * ey) + std::fabs(plane.z) * ez;
+        if (distance < -radius)
+        {
+            return false;
+        }
+    }
+
+    float dx = std::max(std::fabs(x - params.cameraPosition.x) - ex, 0.0f);
+    float dy = std::max(std::fabs(y - params.cameraPosition.y) - ey, 0.0f);
+    float dz = std::max(std::fabs(z - params.cameraPosition.z) - ez, 0.0f);
+
+    return (dx * dx + dy * dy) + dz * dz <= params.maxDrawDistance * params.maxDrawDistance;
+}
+
+static uint64_t hashVisible(const std::vector<uint32_t>& visible)
+{
+    return fnv1a64(reinterpret_cast<const char*>(visible.data()), visible.size() * sizeof(uint32_t));
+}
+
+//Checks the direct call and the culling stage against the expected list, prints its hash.
+template <typename Bounds, typename CullFunc>
+static bool checkCulling(const char* name, threadPool& pool, const cullingParams& params, const Bounds& bounds, CullFunc cullFunc, const std::vector<uint32_t>& expected)
+{
+    bool isPassing = true;
+
+    std::vector<uint32_t> visible(bounds.size());
+    visible.resize(cullFunc(params, bounds, 0, bounds.size(), visible.data()));
+
+    if (visible != expected)
+    {
+        std::fprintf(stderr, "%s: %zu visible, expected %zu\n", name, visible.size(), expected.size());
+        isPassing = false;
+    }
+
+    cullingStage stage;
+    stage.cull(pool, params, bounds);
+
+    if (stage.getVisible() != expected)
+    {
+        std::fprintf(stderr, "%s: the culling stage differs from a single call\n", name);
+        isPassing = false;
+    }
+
+    std::printf("%s %zu %016llx\n", name, visible.size(), (unsigned long long) hashVisible(visible));
+    return isPassing;
+}
+
+int main(int argc, char** argv)
+{
+    cullingParams params = createParams();
+    threadPool pool;
+
+    boundingSpheres spheres;
+    boundingBoxes boxes;
+    for (size_t i = 0; i < c_objectCount; i++)
+    {
+        math::vec3 center(randomFloat(-120.0f, 120.0f), randomFloat(-20.0f, 20.0f), randomFloat(-120.0f, 120.0f));
+        spheres.add(center, randomFloat(0.1f, 4.0f));
+        boxes.add(center, {randomFloat(0.1f, 3.0f), randomFloat(0.1f, 3.0f), randomFloat(0.1f, 3.0f)});
+    }
+
+    if (argc > 1 && std::strcmp(argv[1], "--bench") == 0)
+    {
+        std::vector<uint32_t> visible(c_objectCount);
+        cullingStage stage;
+
+        auto bench = [&](const char* name, auto func)
+        {
+            auto begin = std::chrono::steady_clock::now();
+            for (size_t iteration = 0; iteration < c_benchIterations; iteration++)
+            {
+                func();
+            }
+            auto end = std::chrono::steady_clock::now();
+
+            double nanoseconds = std::chrono::duration<double, std::nano>(end - begin).count();
+            std::printf("%-14s %7.3f ns/object\n", name, nanoseconds / (double) (c_benchIterations * c_objectCount));
+        };
+
+        std::printf("backend %s\n", math::getMathBackendName());
+        bench("spheres", [&]() { cullSpheres(params, spheres, 0, c_objectCount, visible.data()); });
+        bench("spheres pool", [&]() { stage.cull(pool, params, spheres); });
+        bench("boxes", [&]() { cullBoxes(params, boxes, 0, c_objectCount, visible.data()); });
+        bench("boxes pool", [&]() { stage.cull(pool, params, boxes); });
+        return 0;
+    }
+
+    std::vector<uint32_t> expectedSpheres;
+    std::vector<uint32_t> expectedBoxes;
+    for (uint32_t i = 0; i < c_objectCount; i++)
+    {
+        if (isSphereVisible(params, spheres.centerXs[i], spheres.centerYs[i], spheres.centerZs[i], spheres.radii[i]))
+        {
+            expectedSpheres.push_back(i);
+        }
+
+        if (isBoxVisible(params, boxes.centerXs[i], boxes.centerYs[i], boxes.centerZs[i], boxes.extentXs[i], boxes.extentYs[i], boxes.extentZs[i]))
+        {
+            expectedBoxes.push_back(i);
+        }
+    }
+
+    bool isPassing = checkCulling("spheres", pool, params, spheres, cullSpheres, expectedSpheres);
+    isPassing = checkCulling("boxes", pool, params, boxes, cullBoxes, expectedBoxes) && isPassing;
+
+    return isPassing ? 0 : 1;
+}
@@ -0,0 +1,205 @@
+#include "renderGraph.h"
+#include "application.h"
+#include "vulkanStub.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+//Compiles and executes a small frame against the Vulkan stub and checks what compile decided:
+//which passes were culled, where the transient textures were placed and the barriers recorded
+//before each pass. Returns 1 when a check fails.
+
+using namespace malachite;
+
+//The profiler is linked for the graph's optional GPU scopes, nothing here creates an application.
+application* application::s_instance = nullptr;
+
+static const VkExtent2D c_extent = {256, 256};
+static const VkDeviceSize c_textureBytes = 256 * 256 * 4;
+
+static bool s_isPassing = true;
+
+static void check(bool condition, const char* description)
+{
+    if (!condition)
+    {
+        std::fprintf(stderr, "failed: %s\n", description);
+        s_isPassing = false;
+    }
+}
+
+static VkDeviceSize getBoundOffset(VkImage image)
+{
+    for (const vulkanStub::imageBinding& binding : vulkanStub::imageBindings)
+    {
+        if (binding.image == image)
+        {
+            return binding.offset;
+        }
+    }
+
+    return ~0ull;
+}
+
+static const VkImageMemoryBarrier* findBarrier(const vulkanStub::barrierBatch& batch, VkImage image)
+{
+    for (const VkImageMemoryBarrier& barrier : batch.barriers)
+    {
+        if (barrier.image == image)
+        {
+            return &barrier;
+        }
+    }
+
+    return nullptr;
+}
+
+static bool isTransition(const VkImageMemoryBarrier* barrier, VkImageLayout oldLayout, VkImageLayout newLayout)
+{
+    return barrier && barrier->oldLayout == oldLayout && barrier->newLayout == newLayout;
+}
+
+struct testFrame
+{
+    renderGraphResource swapChain;
+    renderGraphResource albedo;
+    renderGraphResource debugView;
+    renderGraphResource lit;
+    renderGraphResource toneMapped;
+
+    std::vector<std::string> executedPasses;
+};
+
+//gbuffer -> lighting -> tonemap -> present, plus a debug view nothing reads. albedo is used by the
+//first two kept passes and toneMapped by the last two, so they can share memory, lit overlaps both.
+static void declareFrame(renderGraph& graph, testFrame& frame)
+{
+    graph.reset();
+    frame.executedPasses.clear();
+
+    renderGraphTextureDesc desc;
+    desc.format = VK_FORMAT_R8G8B8A8_UNORM;
+    desc.extent = c_extent;
+
+    renderGraphTextureState swapChainState;
+    swapChainState.layout = VK_IMAGE_LAYOUT_UNDEFINED;
+    swapChainState.stages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+
+    frame.swapChain = graph.importTexture("swapchain", reinterpret_cast<VkImage>((uintptr_t) 0x5000), reinterpret_cast<VkImageView>((uintptr_t) 0x5001), desc, swapChainState, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, true);
+    frame.albedo = graph.createTexture("albedo", desc);
+    frame.debugView = graph.createTexture("debugView", desc);
+    frame.lit = graph.createTexture("lit", desc);
+    frame.toneMapped = graph.createTexture("toneMapped", desc);
+
+    VkClearColorValue clearColor = {{0.0f, 0.0f, 0.0f, 1.0f}};
+
+    auto record = [&frame](const char* name)
+    {
+        return [&frame, name](VkCommandBuffer, const renderGraphPassContext&)
+        {
+            frame.executedPasses.push_back(name);
+        };
+    };
+
+    graph.addPass("gbuffer", record("gbuffer"))
+        .writeColor(frame.albedo, &clearColor);
+
+    graph.addPass("debug", record("debug"))
+        .read(frame.albedo, e_renderGraphAccess::sampled)
+        .writeColor(frame.debugView, &clearColor);
+
+    graph.addPass("lighting", record("lighting"))
+        .read(frame.albedo, e_renderGraphAccess::sampled)
+        .writeColor(frame.lit, &clearColor);
+
+    graph.addPass("tonemap", record("tonemap"))
+        .read(frame.lit, e_renderGraphAccess::sampled)
+        .writeColor(frame.toneMapped, &clearColor);
+
+    graph.addPass("present", record("present"))
+        .read(frame.toneMapped, e_renderGraphAccess::sampled)
+        .writeColor(frame.swapChain, &clearColor);
+}
+
+int main()
+{
+    gpuAllocator allocator;
+    allocator.initalize(reinterpret_cast<VkPhysicalDevice>((uintptr_t) 1), reinterpret_cast<VkDevice>((uintptr_t) 1));
+
+    frameDeletionQueue deletionQueue;
+    deletionQueue.initalize(2);
+
+    renderGraph graph;
+    graph.initalize(allocator, deletionQueue, reinterpret_cast<VkDevice>((uintptr_t) 1));
+
+    VkCommandBuffer commandBuffer = reinterpret_cast<VkCommandBuffer>((uintptr_t) 1);
+    testFrame frame;
+
+    declareFrame(graph, frame);
+    graph.compile();
+    graph.execute(commandBuffer);
+
+    //Culling, the debug pass only writes a texture nobody reads.
+    check(graph.getExecutedPassCount() == 4, "four passes are kept");
+    check(frame.executedPasses == std::vector<std::string>({"gbuffer", "lighting", "tonemap", "present"}), "kept passes run in declaration order without the debug pass");
+    check(graph.getImage(frame.debugView) == VK_NULL_HANDLE, "the culled pass's texture is never created");
+
+    //Lifetimes and placement, albedo [gbuffer, lighting] and toneMapped [tonemap, present] don't overlap.
+    VkImage albedo = graph.getImage(frame.albedo);
+    VkImage lit = graph.getImage(frame.lit);
+    VkImage toneMapped = graph.getImage(frame.toneMapped);
+
+    check(vulkanStub::createdImageCount == 3, "three transient images are created");
+    check(getBoundOffset(albedo) == getBoundOffset(toneMapped), "albedo and toneMapped share memory");
+    check(getBoundOffset(lit) != getBoundOffset(albedo), "lit is placed clear of albedo");
+    check(getBoundOffset(lit) + c_textureBytes <= getBoundOffset(albedo) || getBoundOffset(albedo) + c_textureBytes <= getBoundOffset(lit), "lit doesn't overlap albedo");
+    check(graph.getTransientBytes() == 2 * c_textureBytes, "aliased transients take two textures of memory");
+    check(graph.getUnaliasedTransientBytes() == 3 * c_textureBytes, "without aliasing they would take three");
+
+    //Barriers, one batch per kept pass and one handing the swapchain back.
+    const std::vector<vulkanStub::barrierBatch>& batches = vulkanStub::barrierBatches;
+    check(graph.getBarrierCount() == 5 && batches.size() == 5, "five barrier batches are recorded");
+
+    if (batches.size() == 5)
+    {
+        check(isTransition(findBarrier(batches[0], albedo), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL), "gbuffer: albedo becomes an attachment");
+
+        const VkImageMemoryBarrier* albedoRead = findBarrier(batches[1], albedo);
+        check(isTransition(albedoRead, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL), "lighting: albedo is read");
+        check(albedoRead && albedoRead->srcAccessMask == VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT && albedoRead->dstAccessMask == VK_ACCESS_SHADER_READ_BIT, "lighting: albedo waits on its write");
+        check(isTransition(findBarrier(batches[1], lit), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL), "lighting: lit becomes an attachment");
+
+        //toneMapped reuses albedo's memory, its first write has to wait for lighting to stop sampling albedo.
+        check(isTransition(findBarrier(batches[2], lit), VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL), "tonemap: lit is read");
+        check(isTransition(findBarrier(batches[2], toneMapped), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL), "tonemap: toneMapped becomes an attachment");
+        check((batches[2].sourceStages & VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT) != 0, "tonemap: waits on the reads of the aliased albedo");
+
+        VkImage swapChain = graph.getImage(frame.swapChain);
+        check(isTransition(findBarrier(batches[3], toneMapped), VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL), "present: toneMapped is read");
+        check(isTransition(findBarrier(batches[3], swapChain), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL), "present: the swapchain becomes an attachment");
+        check(isTransition(findBarrier(batches[4], swapChain), VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR), "the swapchain is handed back for presenting");
+        check(batches[4].barriers.size() == 1, "only the imported texture gets a final barrier");
+    }
+
+    //The same shape next frame reuses every image and its placement.
+    vulkanStub::clearRecording();
+    deletionQueue.advance();
+
+    declareFrame(graph, frame);
+    graph.compile();
+    graph.execute(commandBuffer);
+
+    check(vulkanStub::createdImageCount == 3, "an unchanged graph creates no images");
+    check(graph.getImage(frame.albedo) == albedo && graph.getImage(frame.toneMapped) == toneMapped, "an unchanged graph keeps its images");
+    check(vulkanStub::barrierBatches.size() == 5, "an unchanged graph records the same barriers");
+
+    graph.cleanup();
+    deletionQueue.flush();
+    allocator.cleanup();
+
+    check(vulkanStub::liveObjectCount == 0, "cleanup destroys everything the graph created");
+
+    std::printf("%s\n", s_isPassing ? "render graph ok" : "render graph failed");
+    return s_isPassing ? 0 : 1;
+}
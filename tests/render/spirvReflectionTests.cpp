@@ -0,0 +1,211 @@
+#include "spirvReflection.h"
+
+#include <cstdio>
+#include <initializer_list>
+#include <vector>
+
+//Reflects a small hand written vertex module and checks what was found, then cuts each
+//instruction short and checks the module is rejected once operands it needs are missing,
+//instead of read past. Returns 1 when a check fails.
+
+using namespace malachite;
+
+static bool s_isPassing = true;
+
+static void check(bool condition, const char* description)
+{
+    if (!condition)
+    {
+        std::fprintf(stderr, "failed: %s\n", description);
+        s_isPassing = false;
+    }
+}
+
+//Where an instruction starts in the module, for cutting it short later.
+struct moduleInstruction
+{
+    size_t offset;
+    const char* name;
+};
+
+//Fewest words the spec allows each instruction used here, counting the opcode word.
+static uint32_t getSpecWordCount(uint16_t opcode)
+{
+    switch (opcode)
+    {
+        case 71: return 3;  //OpDecorate
+        case 72: return 4;  //OpMemberDecorate
+        case 22: return 3;  //OpTypeFloat
+        case 21: return 4;  //OpTypeInt
+        case 23: return 4;  //OpTypeVector
+        case 43: return 4;  //OpConstant
+        case 30: return 2;  //OpTypeStruct
+        case 32: return 4;  //OpTypePointer
+        case 59: return 4;  //OpVariable
+        case 25: return 9;  //OpTypeImage
+        case 27: return 3;  //OpTypeSampledImage
+        case 28: return 4;  //OpTypeArray
+        case 15: return 4;  //OpEntryPoint
+        default: return 1;
+    }
+}
+
+struct moduleBuilder
+{
+    std::vector<uint32_t> words = {0x07230203, 0x00010000, 0, 32, 0};
+    std::vector<moduleInstruction> instructions;
+
+    void add(const char* name, uint16_t opcode, std::initializer_list<uint32_t> operands)
+    {
+        instructions.push_back({words.size(), name});
+        words.push_back(((uint32_t) (operands.size() + 1) << 16) | opcode);
+        words.insert(words.end(), operands.begin(), operands.end());
+    }
+};
+
+enum : uint32_t
+{
+    idMain = 1,
+    idFloat,
+    idVec3,
+    idVec4,
+    idUniformBlock,
+    idUniformPointer,
+    idUniformVariable,
+    idImage,
+    idSampledImage,
+    idSamplerPointer,
+    idSamplerVariable,
+    idPushBlock,
+    idPushPointer,
+    idPushVariable,
+    idInputPointer,
+    idPosition,
+    idUint,
+    idFour,
+    idSamplerArray,
+    idSamplerArrayPointer,
+    idSamplerArrayVariable
+};
+
+//layout(location = 0) in vec3 position;
+//layout(set = 0, binding = 1) uniform block { vec4 color; };
+//layout(set = 1, binding = 0) uniform sampler2D albedo;
+//layout(set = 1, binding = 2) uniform sampler2D layers[4];
+//layout(push_constant) uniform push { vec4 tint; float scale; };
+static moduleBuilder buildModule()
+{
+    moduleBuilder module;
+
+    //"main" and its terminator.
+    module.add("OpEntryPoint", 15, {0, idMain, 0x6e69616d, 0, idPosition});
+
+    module.add("OpDecorate Location", 71, {idPosition, 30, 0});
+    module.add("OpDecorate Block", 71, {idUniformBlock, 2});
+    module.add("OpDecorate DescriptorSet", 71, {idUniformVariable, 34, 0});
+    module.add("OpDecorate Binding", 71, {idUniformVariable, 33, 1});
+    module.add("OpDecorate DescriptorSet", 71, {idSamplerVariable, 34, 1});
+    module.add("OpDecorate Binding", 71, {idSamplerVariable, 33, 0});
+    module.add("OpDecorate DescriptorSet", 71, {idSamplerArrayVariable, 34, 1});
+    module.add("OpDecorate Binding", 71, {idSamplerArrayVariable, 33, 2});
+    module.add("OpMemberDecorate Offset", 72, {idUniformBlock, 0, 35, 0});
+    module.add("OpDecorate Block", 71, {idPushBlock, 2});
+    module.add("OpMemberDecorate Offset", 72, {idPushBlock, 0, 35, 0});
+    module.add("OpMemberDecorate Offset", 72, {idPushBlock, 1, 35, 16});
+
+    module.add("OpTypeFloat", 22, {idFloat, 32});
+    module.add("OpTypeInt", 21, {idUint, 32, 0});
+    module.add("OpTypeVector", 23, {idVec3, idFloat, 3});
+    module.add("OpTypeVector", 23, {idVec4, idFloat, 4});
+    module.add("OpConstant", 43, {idUint, idFour, 4});
+
+    module.add("OpTypeStruct", 30, {idUniformBlock, idVec4});
+    module.add("OpTypePointer", 32, {idUniformPointer, 2, idUniformBlock});
+    module.add("OpVariable", 59, {idUniformPointer, idUniformVariable, 2});
+
+    module.add("OpTypeImage", 25, {idImage, idFloat, 1, 0, 0, 0, 1, 0});
+    module.add("OpTypeSampledImage", 27, {idSampledImage, idImage});
+    module.add("OpTypePointer", 32, {idSamplerPointer, 0, idSampledImage});
+    module.add("OpVariable", 59, {idSamplerPointer, idSamplerVariable, 0});
+
+    module.add("OpTypeArray", 28, {idSamplerArray, idSampledImage, idFour});
+    module.add("OpTypePointer", 32, {idSamplerArrayPointer, 0, idSamplerArray});
+    module.add("OpVariable", 59, {idSamplerArrayPointer, idSamplerArrayVariable, 0});
+
+    module.add("OpTypeStruct", 30, {idPushBlock, idVec4, idFloat});
+    module.add("OpTypePointer", 32, {idPushPointer, 9, idPushBlock});
+    module.add("OpVariable", 59, {idPushPointer, idPushVariable, 9});
+
+    module.add("OpTypePointer", 32, {idInputPointer, 1, idVec3});
+    module.add("OpVariable", 59, {idInputPointer, idPosition, 1});
+
+    return module;
+}
+
+//The module with one instruction cut down to wordCount words.
+static std::vector<uint32_t> truncateInstruction(const moduleBuilder& module, const moduleInstruction& instruction, uint32_t wordCount)
+{
+    std::vector<uint32_t> words = module.words;
+    uint32_t originalWordCount = words[instruction.offset] >> 16;
+
+    words[instruction.offset] = (wordCount << 16) | (words[instruction.offset] & 0xffff);
+    words.erase(words.begin() + instruction.offset + wordCount, words.begin() + instruction.offset + originalWordCount);
+    return words;
+}
+
+int main()
+{
+    moduleBuilder module = buildModule();
+    shaderReflection reflection;
+
+    check(reflectSpirv(module.words, reflection), "the module is reflected");
+    check(reflection.stage == VK_SHADER_STAGE_VERTEX_BIT, "the stage comes from the entry point");
+
+    check(reflection.descriptorBindings.size() == 3, "three descriptor bindings");
+    if (reflection.descriptorBindings.size() == 3)
+    {
+        const reflectedDescriptorBinding& block = reflection.descriptorBindings[0];
+        const reflectedDescriptorBinding& albedo = reflection.descriptorBindings[1];
+        const reflectedDescriptorBinding& layers = reflection.descriptorBindings[2];
+
+        check(block.set == 0 && block.binding == 1 && block.descriptorType == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER && block.descriptorCount == 1, "the uniform block");
+        check(albedo.set == 1 && albedo.binding == 0 && albedo.descriptorType == VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER && albedo.descriptorCount == 1, "the sampler");
+        check(layers.set == 1 && layers.binding == 2 && layers.descriptorType == VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER && layers.descriptorCount == 4, "the sampler array");
+    }
+
+    check(reflection.pushConstantOffset == 0 && reflection.pushConstantSize == 20, "the push constant block takes 20 bytes");
+
+    check(reflection.vertexInputs.size() == 1, "one vertex input");
+    if (reflection.vertexInputs.size() == 1)
+    {
+        const reflectedVertexInput& position = reflection.vertexInputs[0];
+        check(position.location == 0 && position.format == VK_FORMAT_R32G32B32_SFLOAT && position.size == 12, "the position input");
+    }
+
+    //Shorter than the spec allows has to be rejected, other cuts may be accepted but mustn't be read past.
+    for (const moduleInstruction& instruction : module.instructions)
+    {
+        uint32_t wordCount = module.words[instruction.offset] >> 16;
+        uint32_t specWordCount = getSpecWordCount((uint16_t) (module.words[instruction.offset] & 0xffff));
+
+        for (uint32_t truncatedWordCount = 1; truncatedWordCount < wordCount; truncatedWordCount++)
+        {
+            std::vector<uint32_t> words = truncateInstruction(module, instruction, truncatedWordCount);
+            bool isReflected = reflectSpirv(words, reflection);
+
+            if (isReflected && truncatedWordCount < specWordCount)
+            {
+                std::fprintf(stderr, "failed: %s with %u words is accepted\n", instruction.name, truncatedWordCount);
+                s_isPassing = false;
+            }
+        }
+    }
+
+    //The last instruction running past the end of the module.
+    std::vector<uint32_t> words = module.words;
+    words.pop_back();
+    check(!reflectSpirv(words, reflection), "a module cut off mid instruction is rejected");
+
+    std::printf("%s\n", s_isPassing ? "spirv reflection ok" : "spirv reflection failed");
+    return s_isPassing ? 0 : 1;
+}
@@ -0,0 +1,193 @@
+#include "textureStreamer.h"
+#include "vulkanStub.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+//Streams made up textures against the Vulkan stub, where every upload finishes as soon as it
+//is submitted. Checks the coarse tail goes up first and finer mips follow one at a time, that a
+//lower budget shrinks the texture nobody needs the detail of, and that replaced images live on
+//until the frames in flight are done with them. Returns 1 when a check fails.
+
+using namespace malachite;
+
+//Mips at or below 64 texels are the tail, for a 512 texture that is mip 3 down.
+static const uint32_t c_textureSize = 512;
+static const uint32_t c_tailMip = 3;
+static const uint32_t c_framesInFlight = 2;
+
+static bool s_isPassing = true;
+
+static void check(bool condition, const char* description)
+{
+    if (!condition)
+    {
+        std::fprintf(stderr, "failed: %s\n", description);
+        s_isPassing = false;
+    }
+}
+
+//The size is the file name, e.g. 512.tex, nothing is read.
+static std::unique_ptr<textureResource> loadTexture(const std::filesystem::path& path)
+{
+    uint32_t size = (uint32_t) std::stoul(path.stem().string());
+    std::vector<uint8_t> pixels((size_t) size * size * 4, 0x80);
+
+    return textureResource::create(size, size, pixels.data());
+}
+
+struct streamingTest
+{
+    resourceManager resources{1};
+    frameDeletionQueue deletionQueue;
+    gpuAllocator allocator;
+    textureStreamer streamer;
+
+    streamingTest()
+    {
+        VkDevice device = reinterpret_cast<VkDevice>((uintptr_t) 1);
+
+        resources.registerLoader<textureResource>(loadTexture);
+        allocator.initalize(reinterpret_cast<VkPhysicalDevice>((uintptr_t) 1), device);
+        deletionQueue.initalize(c_framesInFlight);
+        streamer.initalize(resources, deletionQueue, allocator, device, reinterpret_cast<VkQueue>((uintptr_t) 1), 0);
+    }
+
+    //Decoding happens on the I/O thread, waiting here keeps the frames below deterministic.
+    textureId load(const char* path)
+    {
+        textureId texture = streamer.load(path);
+        resources.wait(resources.load<textureResource>(path));
+        return texture;
+    }
+
+    //Same order as the render layer, right after the frame fence.
+    void frame()
+    {
+        deletionQueue.advance();
+        resources.update();
+        streamer.update();
+    }
+
+    void cleanup()
+    {
+        streamer.cleanup();
+        deletionQueue.flush();
+        allocator.cleanup();
+    }
+};
+
+static void testTailFirst()
+{
+    vulkanStub::clearRecording();
+    streamingTest test;
+
+    textureId texture = test.load("512.tex");
+    check(test.streamer.getImageView(texture) == VK_NULL_HANDLE, "nothing is resident before the first update");
+
+    std::vector<uint32_t> residentMips;
+    for (uint32_t i = 0; i < 8; i++)
+    {
+        test.streamer.requestSize(texture, (float) c_textureSize);
+        test.frame();
+
+        if (residentMips.empty() || residentMips.back() != test.streamer.getResidentMip(texture))
+        {
+            residentMips.push_back(test.streamer.getResidentMip(texture));
+        }
+    }
+
+    //The first update only queues, the mip count stands for nothing resident.
+    check(residentMips == std::vector<uint32_t>({10, 3, 2, 1, 0}), "the tail is resident first and each finer mip follows on its own");
+
+    check(vulkanStub::bufferImageCopies.size() == 4, "one copy per upload");
+    for (size_t i = 0; i < vulkanStub::bufferImageCopies.size(); i++)
+    {
+        const vulkanStub::bufferImageCopy& copy = vulkanStub::bufferImageCopies[i];
+        uint32_t firstMip = c_tailMip - (uint32_t) i;
+
+        check(copy.regions.size() == 10 - firstMip, "every mip from the first resident one down is copied");
+        check(!copy.regions.empty() && copy.regions[0].imageExtent.width == c_textureSize >> firstMip, "copies start at the mip being added");
+        check(copy.buffer == vulkanStub::bufferImageCopies[0].buffer, "every upload is staged through the same ring buffer");
+    }
+
+    test.cleanup();
+    check(vulkanStub::liveObjectCount == 0, "cleanup destroys every image, buffer and staging batch");
+}
+
+static void testShrinkToBudget()
+{
+    vulkanStub::clearRecording();
+    streamingTest test;
+
+    textureId near = test.load("near/512.tex");
+    textureId far = test.load("far/512.tex");
+
+    for (uint32_t i = 0; i < 12; i++)
+    {
+        test.streamer.requestSize(near, (float) c_textureSize);
+        test.streamer.requestSize(far, (float) c_textureSize);
+        test.frame();
+    }
+
+    check(test.streamer.getResidentMip(near) == 0 && test.streamer.getResidentMip(far) == 0, "both textures are fully resident within the default budget");
+
+    //Every image replaced on the way is gone by now.
+    size_t fullBytes = test.streamer.getStats().residentBytes;
+    VkImageView farView = test.streamer.getImageView(far);
+
+    //Far only covers 64 pixels now, so its finer mips are what goes once the budget is a byte short.
+    test.streamer.setBudget(fullBytes - 1);
+
+    test.streamer.requestSize(near, (float) c_textureSize);
+    test.streamer.requestSize(far, 64.0f);
+    test.frame();
+
+    check(test.streamer.getStats().evictedMips == 1, "the texture is shrunk by as few mips as it takes");
+    check(test.streamer.getResidentMip(far) == 0, "the shrunk image isn't swapped in before its upload is done");
+
+    test.streamer.requestSize(near, (float) c_textureSize);
+    test.streamer.requestSize(far, 64.0f);
+    test.frame();
+
+    check(test.streamer.getResidentMip(far) == 1, "the texture without a need for detail is shrunk");
+    check(test.streamer.getResidentMip(near) == 0, "the texture asked for at full size keeps every mip");
+
+    //Frames in flight may still sample the old image.
+    bool isReplacedViewDestroyed = false;
+    for (uint32_t i = 0; i < c_framesInFlight; i++)
+    {
+        for (VkImageView view : vulkanStub::destroyedImageViews)
+        {
+            isReplacedViewDestroyed |= view == farView;
+        }
+
+        check(!isReplacedViewDestroyed, "the replaced image outlives the frames in flight");
+
+        test.streamer.requestSize(near, (float) c_textureSize);
+        test.streamer.requestSize(far, 64.0f);
+        test.frame();
+    }
+
+    for (VkImageView view : vulkanStub::destroyedImageViews)
+    {
+        isReplacedViewDestroyed |= view == farView;
+    }
+
+    check(isReplacedViewDestroyed, "the replaced image is destroyed once the frames in flight are done");
+    check(test.streamer.getStats().residentBytes <= fullBytes - 1, "the resident total is back within the budget");
+    check(test.streamer.getResidentMip(far) == 1, "the shrunk texture isn't streamed back in over budget");
+
+    test.cleanup();
+    check(vulkanStub::liveObjectCount == 0, "cleanup destroys every image, buffer and staging batch");
+}
+
+int main()
+{
+    testTailFirst();
+    testShrinkToBudget();
+
+    std::printf("%s\n", s_isPassing ? "texture streaming ok" : "texture streaming failed");
+    return s_isPassing ? 0 : 1;
+}
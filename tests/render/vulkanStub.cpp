@@ -0,0 +1,345 @@
+#include "vulkanStub.h"
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <unordered_map>
+
+namespace vulkanStub
+{
+    std::vector<imageBinding> imageBindings;
+    std::vector<barrierBatch> barrierBatches;
+    std::vector<bufferImageCopy> bufferImageCopies;
+    std::vector<VkImageView> destroyedImageViews;
+    uint32_t createdImageCount = 0;
+    int64_t liveObjectCount = 0;
+
+    void clearRecording()
+    {
+        imageBindings.clear();
+        barrierBatches.clear();
+        bufferImageCopies.clear();
+        destroyedImageViews.clear();
+    }
+}
+
+static uint64_t s_nextHandle = 1;
+static std::unordered_map<uint64_t, VkDeviceSize> s_resourceSizes;
+static std::unordered_map<uint64_t, std::unique_ptr<char[]>> s_mappedMemory;
+
+template <typename T>
+static T createHandle()
+{
+    vulkanStub::liveObjectCount++;
+    return reinterpret_cast<T>((uintptr_t) s_nextHandle++);
+}
+
+template <typename T>
+static void destroyHandle(T handle)
+{
+    if (handle)
+    {
+        vulkanStub::liveObjectCount--;
+    }
+}
+
+//Device
+
+VKAPI_ATTR void VKAPI_CALL vkGetPhysicalDeviceProperties(VkPhysicalDevice, VkPhysicalDeviceProperties* properties)
+{
+    memset(properties, 0, sizeof(*properties));
+    properties->limits.bufferImageGranularity = 1;
+    properties->limits.timestampPeriod = 1.0f;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkGetPhysicalDeviceMemoryProperties(VkPhysicalDevice, VkPhysicalDeviceMemoryProperties* properties)
+{
+    memset(properties, 0, sizeof(*properties));
+    properties->memoryTypeCount = 2;
+    properties->memoryTypes[0].propertyFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+    properties->memoryTypes[0].heapIndex = 0;
+    properties->memoryTypes[1].propertyFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    properties->memoryTypes[1].heapIndex = 1;
+    properties->memoryHeapCount = 2;
+    properties->memoryHeaps[0].size = 1ull << 30;
+    properties->memoryHeaps[0].flags = VK_MEMORY_HEAP_DEVICE_LOCAL_BIT;
+    properties->memoryHeaps[1].size = 1ull << 30;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkGetPhysicalDeviceQueueFamilyProperties(VkPhysicalDevice, uint32_t* count, VkQueueFamilyProperties* properties)
+{
+    if (properties && *count > 0)
+    {
+        memset(properties, 0, sizeof(*properties));
+        properties->queueCount = 1;
+        properties->queueFlags = VK_QUEUE_GRAPHICS_BIT;
+        properties->timestampValidBits = 64;
+    }
+
+    *count = 1;
+}
+
+//Memory and images
+
+VKAPI_ATTR VkResult VKAPI_CALL vkAllocateMemory(VkDevice, const VkMemoryAllocateInfo* allocateInfo, const VkAllocationCallbacks*, VkDeviceMemory* memory)
+{
+    *memory = createHandle<VkDeviceMemory>();
+    s_resourceSizes[(uint64_t) (uintptr_t) *memory] = allocateInfo->allocationSize;
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkFreeMemory(VkDevice, VkDeviceMemory memory, const VkAllocationCallbacks*)
+{
+    s_resourceSizes.erase((uint64_t) (uintptr_t) memory);
+    s_mappedMemory.erase((uint64_t) (uintptr_t) memory);
+    destroyHandle(memory);
+}
+
+//Only the allocator maps, always the whole block.
+VKAPI_ATTR VkResult VKAPI_CALL vkMapMemory(VkDevice, VkDeviceMemory memory, VkDeviceSize, VkDeviceSize, VkMemoryMapFlags, void** mapped)
+{
+    std::unique_ptr<char[]>& storage = s_mappedMemory[(uint64_t) (uintptr_t) memory];
+    storage.reset(new char[s_resourceSizes[(uint64_t) (uintptr_t) memory]]);
+
+    *mapped = storage.get();
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkCreateImage(VkDevice, const VkImageCreateInfo* createInfo, const VkAllocationCallbacks*, VkImage* image)
+{
+    vulkanStub::createdImageCount++;
+
+    VkDeviceSize size = 0;
+    for (uint32_t level = 0; level < std::max(createInfo->mipLevels, 1u); level++)
+    {
+        size += (VkDeviceSize) std::max(createInfo->extent.width >> level, 1u) * std::max(createInfo->extent.height >> level, 1u) * 4;
+    }
+
+    *image = createHandle<VkImage>();
+    s_resourceSizes[(uint64_t) (uintptr_t) *image] = (size + vulkanStub::c_imageAlignment - 1) / vulkanStub::c_imageAlignment * vulkanStub::c_imageAlignment;
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkDestroyImage(VkDevice, VkImage image, const VkAllocationCallbacks*)
+{
+    s_resourceSizes.erase((uint64_t) (uintptr_t) image);
+    destroyHandle(image);
+}
+
+VKAPI_ATTR void VKAPI_CALL vkGetImageMemoryRequirements(VkDevice, VkImage image, VkMemoryRequirements* requirements)
+{
+    requirements->size = s_resourceSizes[(uint64_t) (uintptr_t) image];
+    requirements->alignment = vulkanStub::c_imageAlignment;
+    requirements->memoryTypeBits = 1;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkBindImageMemory(VkDevice, VkImage image, VkDeviceMemory memory, VkDeviceSize offset)
+{
+    vulkanStub::imageBindings.push_back({image, memory, offset});
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkCreateImageView(VkDevice, const VkImageViewCreateInfo*, const VkAllocationCallbacks*, VkImageView* imageView)
+{
+    *imageView = createHandle<VkImageView>();
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkDestroyImageView(VkDevice, VkImageView imageView, const VkAllocationCallbacks*)
+{
+    if (imageView)
+    {
+        vulkanStub::destroyedImageViews.push_back(imageView);
+    }
+
+    destroyHandle(imageView);
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkCreateSampler(VkDevice, const VkSamplerCreateInfo*, const VkAllocationCallbacks*, VkSampler* sampler)
+{
+    *sampler = createHandle<VkSampler>();
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkDestroySampler(VkDevice, VkSampler sampler, const VkAllocationCallbacks*)
+{
+    destroyHandle(sampler);
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkCreateBuffer(VkDevice, const VkBufferCreateInfo* createInfo, const VkAllocationCallbacks*, VkBuffer* buffer)
+{
+    *buffer = createHandle<VkBuffer>();
+    s_resourceSizes[(uint64_t) (uintptr_t) *buffer] = createInfo->size;
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkDestroyBuffer(VkDevice, VkBuffer buffer, const VkAllocationCallbacks*)
+{
+    s_resourceSizes.erase((uint64_t) (uintptr_t) buffer);
+    destroyHandle(buffer);
+}
+
+VKAPI_ATTR void VKAPI_CALL vkGetBufferMemoryRequirements(VkDevice, VkBuffer buffer, VkMemoryRequirements* requirements)
+{
+    requirements->size = s_resourceSizes[(uint64_t) (uintptr_t) buffer];
+    requirements->alignment = 64;
+    requirements->memoryTypeBits = 3;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkBindBufferMemory(VkDevice, VkBuffer, VkDeviceMemory, VkDeviceSize)
+{
+    return VK_SUCCESS;
+}
+
+//Render passes
+
+VKAPI_ATTR VkResult VKAPI_CALL vkCreateRenderPass(VkDevice, const VkRenderPassCreateInfo*, const VkAllocationCallbacks*, VkRenderPass* renderPass)
+{
+    *renderPass = createHandle<VkRenderPass>();
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkDestroyRenderPass(VkDevice, VkRenderPass renderPass, const VkAllocationCallbacks*)
+{
+    destroyHandle(renderPass);
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkCreateFramebuffer(VkDevice, const VkFramebufferCreateInfo*, const VkAllocationCallbacks*, VkFramebuffer* framebuffer)
+{
+    *framebuffer = createHandle<VkFramebuffer>();
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkDestroyFramebuffer(VkDevice, VkFramebuffer framebuffer, const VkAllocationCallbacks*)
+{
+    destroyHandle(framebuffer);
+}
+
+//Commands
+
+VKAPI_ATTR void VKAPI_CALL vkCmdPipelineBarrier
+(
+    VkCommandBuffer,
+    VkPipelineStageFlags sourceStages,
+    VkPipelineStageFlags destinationStages,
+    VkDependencyFlags,
+    uint32_t, const VkMemoryBarrier*,
+    uint32_t, const VkBufferMemoryBarrier*,
+    uint32_t imageBarrierCount, const VkImageMemoryBarrier* imageBarriers
+)
+{
+    vulkanStub::barrierBatches.push_back({sourceStages, destinationStages, std::vector<VkImageMemoryBarrier>(imageBarriers, imageBarriers + imageBarrierCount)});
+}
+
+VKAPI_ATTR void VKAPI_CALL vkCmdCopyBufferToImage(VkCommandBuffer, VkBuffer buffer, VkImage image, VkImageLayout, uint32_t regionCount, const VkBufferImageCopy* regions)
+{
+    vulkanStub::bufferImageCopies.push_back({buffer, image, std::vector<VkBufferImageCopy>(regions, regions + regionCount)});
+}
+
+VKAPI_ATTR void VKAPI_CALL vkCmdBeginRenderPass(VkCommandBuffer, const VkRenderPassBeginInfo*, VkSubpassContents)
+{
+}
+
+VKAPI_ATTR void VKAPI_CALL vkCmdEndRenderPass(VkCommandBuffer)
+{
+}
+
+//Timestamps, the profiler is linked but these tests never enable it.
+
+VKAPI_ATTR VkResult VKAPI_CALL vkCreateQueryPool(VkDevice, const VkQueryPoolCreateInfo*, const VkAllocationCallbacks*, VkQueryPool* queryPool)
+{
+    *queryPool = createHandle<VkQueryPool>();
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkDestroyQueryPool(VkDevice, VkQueryPool queryPool, const VkAllocationCallbacks*)
+{
+    destroyHandle(queryPool);
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkGetQueryPoolResults(VkDevice, VkQueryPool, uint32_t, uint32_t, size_t, void*, VkDeviceSize, VkQueryResultFlags)
+{
+    return VK_NOT_READY;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkCmdResetQueryPool(VkCommandBuffer, VkQueryPool, uint32_t, uint32_t)
+{
+}
+
+VKAPI_ATTR void VKAPI_CALL vkCmdWriteTimestamp(VkCommandBuffer, VkPipelineStageFlagBits, VkQueryPool, uint32_t)
+{
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkCreateCommandPool(VkDevice, const VkCommandPoolCreateInfo*, const VkAllocationCallbacks*, VkCommandPool* commandPool)
+{
+    *commandPool = createHandle<VkCommandPool>();
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkDestroyCommandPool(VkDevice, VkCommandPool commandPool, const VkAllocationCallbacks*)
+{
+    destroyHandle(commandPool);
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkAllocateCommandBuffers(VkDevice, const VkCommandBufferAllocateInfo* allocateInfo, VkCommandBuffer* commandBuffers)
+{
+    //Freed with their pool.
+    for (uint32_t i = 0; i < allocateInfo->commandBufferCount; i++)
+    {
+        commandBuffers[i] = reinterpret_cast<VkCommandBuffer>((uintptr_t) s_nextHandle++);
+    }
+
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkBeginCommandBuffer(VkCommandBuffer, const VkCommandBufferBeginInfo*)
+{
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkEndCommandBuffer(VkCommandBuffer)
+{
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkResetCommandBuffer(VkCommandBuffer, VkCommandBufferResetFlags)
+{
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkQueueSubmit(VkQueue, uint32_t, const VkSubmitInfo*, VkFence)
+{
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkQueueWaitIdle(VkQueue)
+{
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkCreateFence(VkDevice, const VkFenceCreateInfo*, const VkAllocationCallbacks*, VkFence* fence)
+{
+    *fence = createHandle<VkFence>();
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL vkDestroyFence(VkDevice, VkFence fence, const VkAllocationCallbacks*)
+{
+    destroyHandle(fence);
+}
+
+//Submissions complete at once.
+VKAPI_ATTR VkResult VKAPI_CALL vkWaitForFences(VkDevice, uint32_t, const VkFence*, VkBool32, uint64_t)
+{
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkGetFenceStatus(VkDevice, VkFence)
+{
+    return VK_SUCCESS;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL vkResetFences(VkDevice, uint32_t, const VkFence*)
+{
+    return VK_SUCCESS;
+}
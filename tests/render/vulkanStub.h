@@ -0,0 +1,48 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+//Just enough of a device for the graph, allocator, profiler and texture streamer to run against, linked
+//instead of the loader. Handles are unique numbers, nothing is executed apart from host visible memory
+//being real so staging can be written. What the code under test did is recorded here.
+namespace vulkanStub
+{
+  struct imageBinding
+  {
+    VkImage image;
+    VkDeviceMemory memory;
+    VkDeviceSize offset;
+  };
+
+  struct barrierBatch
+  {
+    VkPipelineStageFlags sourceStages;
+    VkPipelineStageFlags destinationStages;
+    std::vector<VkImageMemoryBarrier> barriers;
+  };
+
+  struct bufferImageCopy
+  {
+    VkBuffer buffer;
+    VkImage image;
+    std::vector<VkBufferImageCopy> regions;
+  };
+
+  //Every image takes 4 bytes per texel of all its mips rounded up to this, from the device local type.
+  //Buffers may also use the second, host visible and coherent type.
+  constexpr VkDeviceSize c_imageAlignment = 256;
+
+  extern std::vector<imageBinding> imageBindings;
+  extern std::vector<barrierBatch> barrierBatches;
+  extern std::vector<bufferImageCopy> bufferImageCopies;
+  extern std::vector<VkImageView> destroyedImageViews;
+  extern uint32_t createdImageCount;
+
+  //Objects created and not destroyed yet, command buffers go with their pool.
+  extern int64_t liveObjectCount;
+
+  //Clears what was recorded, the counts are kept.
+  void clearRecording();
+}
@@ -0,0 +1,362 @@
+#include "malpch.h"
+#include "shaderBuildService.h"
+#include "threadPool.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+
+//malachite-cook <shader directory> <output directory> [--cache <directory>] [--jobs <count>]
+//Compiles every .shader below the shader directory to <output>/<relative path>.<stage extension>,
+//every permutation of its compiled keywords included, e.g. simple.3.frag for keywords 0 and 1.
+//A shader is skipped when it and everything it includes kept their timestamps since the last cook,
+//touched but unchanged sources are still served from the SPIR-V cache without compiling.
+
+struct cookRecord
+{
+    std::vector<std::pair<std::string, int64_t>> dependencies;
+    std::vector<std::string> outputs;
+};
+
+using cookManifest = std::map<std::string, cookRecord>;
+
+static const char* c_manifestFileName = "cook.manifest";
+
+static int64_t getWriteTime(const std::filesystem::path& path)
+{
+    std::error_code error;
+    auto writeTime = std::filesystem::last_write_time(path, error);
+
+    return error ? -1 : (int64_t) writeTime.time_since_epoch().count();
+}
+
+//One record per shader:
+//shader <path>
+//dependency <write time> <path>
+//output <path>
+static cookManifest readManifest(const std::filesystem::path& manifestPath)
+{
+    cookManifest manifest;
+    std::ifstream file(manifestPath);
+
+    std::string line;
+    cookRecord* record = nullptr;
+
+    while (std::getline(file, line))
+    {
+        std::istringstream stream(line);
+        std::string kind;
+        stream >> kind;
+
+        if (kind == "shader")
+        {
+            std::string path;
+            std::getline(stream >> std::ws, path);
+            record = &manifest[path];
+        }
+        else if (kind == "dependency" && record)
+        {
+            int64_t writeTime = 0;
+            std::string path;
+            stream >> writeTime;
+            std::getline(stream >> std::ws, path);
+            record->dependencies.push_back({path, writeTime});
+        }
+        else if (kind == "output" && record)
+        {
+            std::string path;
+            std::getline(stream >> std::ws, path);
+            record->outputs.push_back(path);
+        }
+    }
+
+    return manifest;
+}
+
+//Reports its own failures, the old manifest is left alone when the new one can't be written.
+static bool writeManifest(const std::filesystem::path& manifestPath, const cookManifest& manifest)
+{
+    std::filesystem::path temporaryPath = manifestPath;
+    temporaryPath += ".tmp";
+
+    {
+        std::ofstream file(temporaryPath, std::ios::trunc);
+        if (!file.is_open())
+        {
+            std::cerr << "failed to write manifest: " << temporaryPath << std::endl;
+            return false;
+        }
+
+        for (const auto& entry : manifest)
+        {
+            file << "shader " << entry.first << "\n";
+
+            for (const auto& dependency : entry.second.dependencies)
+            {
+                file << "dependency " << dependency.second << " " << dependency.first << "\n";
+            }
+
+            for (const auto& output : entry.second.outputs)
+            {
+                file << "output " << output << "\n";
+            }
+        }
+
+        file.close();
+        if (!file.good())
+        {
+            std::cerr << "failed to write manifest: " << temporaryPath << std::endl;
+            std::error_code error;
+            std::filesystem::remove(temporaryPath, error);
+            return false;
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::rename(temporaryPath, manifestPath, error);
+
+    if (error)
+    {
+        std::cerr << "failed to replace manifest: " << manifestPath << ": " << error.message() << std::endl;
+        std::filesystem::remove(temporaryPath, error);
+        return false;
+    }
+
+    return true;
+}
+
+static bool isUpToDate(const cookRecord& record)
+{
+    if (record.dependencies.empty())
+    {
+        return false;
+    }
+
+    for (const auto& dependency : record.dependencies)
+    {
+        if (getWriteTime(dependency.first) != dependency.second)
+        {
+            return false;
+        }
+    }
+
+    for (const auto& output : record.outputs)
+    {
+        std::error_code error;
+        if (!std::filesystem::exists(output, error))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+int main(int argCount, char** args)
+{
+    if (argCount < 3)
+    {
+        std::cerr << "usage: malachite-cook <shader directory> <output directory> [--cache <directory>] [--jobs <count>]" << std::endl;
+        return 1;
+    }
+
+    std::filesystem::path shaderDirectory = args[1];
+    std::filesystem::path outputDirectory = args[2];
+    std::filesystem::path cacheDirectory = outputDirectory / ".shadercache";
+    uint32_t jobCount = 0;
+
+    for (int i = 3; i + 1 < argCount; i += 2)
+    {
+        std::string option = args[i];
+
+        if (option == "--cache")
+        {
+            cacheDirectory = args[i + 1];
+        }
+        else if (option == "--jobs")
+        {
+            jobCount = (uint32_t) std::stoul(args[i + 1]);
+        }
+        else
+        {
+            std::cerr << "unknown option: " << option << std::endl;
+            return 1;
+        }
+    }
+
+    std::error_code error;
+    if (!std::filesystem::is_directory(shaderDirectory, error))
+    {
+        std::cerr << "not a directory: " << shaderDirectory << std::endl;
+        return 1;
+    }
+
+    std::filesystem::create_directories(outputDirectory, error);
+    if (error)
+    {
+        std::cerr << "failed to create " << outputDirectory << ": " << error.message() << std::endl;
+        return 1;
+    }
+
+    std::filesystem::path manifestPath = outputDirectory / c_manifestFileName;
+    cookManifest manifest = readManifest(manifestPath);
+
+    malachite::threadPool threadPool(jobCount);
+    malachite::shaderCache cache(cacheDirectory);
+    malachite::shaderBuildService shaderBuilder(threadPool, cache);
+
+    struct pendingShader
+    {
+        std::string shaderPath;
+        cookRecord record;
+        std::vector<malachite::shaderStageFuture> stages;
+    };
+
+    std::vector<pendingShader> pendingShaders;
+    size_t cookedCount = 0;
+    size_t skippedCount = 0;
+    size_t failedCount = 0;
+
+    //Every file is parsed here and queued at once, so sections of all files compile side by side.
+    std::filesystem::recursive_directory_iterator files(shaderDirectory, error);
+    for (; !error && files != std::filesystem::recursive_directory_iterator(); files.increment(error))
+    {
+        const std::filesystem::directory_entry& file = *files;
+
+        std::error_code fileError;
+        if (!file.is_regular_file(fileError) || file.path().extension() != ".shader")
+        {
+            continue;
+        }
+
+        std::string shaderPath = file.path().lexically_normal().generic_string();
+
+        auto existingRecord = manifest.find(shaderPath);
+        if (existingRecord != manifest.end() && isUpToDate(existingRecord->second))
+        {
+            skippedCount++;
+            continue;
+        }
+
+        std::filesystem::path stageDirectory = outputDirectory / file.path().lexically_relative(shaderDirectory).parent_path();
+        std::filesystem::create_directories(stageDirectory, fileError);
+
+        if (fileError)
+        {
+            std::cerr << shaderPath << ": failed to create " << stageDirectory << ": " << fileError.message() << std::endl;
+            manifest.erase(shaderPath);
+            failedCount++;
+            continue;
+        }
+
+        pendingShader pending;
+        pending.shaderPath = shaderPath;
+
+        try
+        {
+            std::shared_ptr<const malachite::shaderSourceFile> sourceFile = malachite::parseShaderSource(file.path(), shaderBuilder.getIncludeCache());
+
+            for (const auto& dependency : sourceFile->files)
+            {
+                pending.record.dependencies.push_back({dependency.generic_string(), getWriteTime(dependency)});
+            }
+
+            std::string shaderName = file.path().stem().string();
+
+            //Builds without the sources resolve variant keys from this.
+            std::filesystem::path keywordsPath = stageDirectory / (shaderName + ".keywords");
+            std::ofstream keywordsFile(keywordsPath, std::ios::trunc);
+            keywordsFile << malachite::writeShaderKeywords(sourceFile->keywords);
+            keywordsFile.close();
+
+            if (!keywordsFile.good())
+            {
+                throw std::runtime_error("failed to write " + keywordsPath.generic_string());
+            }
+
+            pending.record.outputs.push_back(keywordsPath.lexically_normal().generic_string());
+
+            malachite::shaderVariantSet variants(shaderBuilder, sourceFile, stageDirectory);
+            variants.compileAll();
+
+            malachite::shaderVariantKey compiledMask = sourceFile->keywords.getCompiledMask();
+            malachite::shaderVariantKey variantKey = 0;
+
+            do
+            {
+                const std::vector<malachite::shaderStageFuture>& stages = variants.getVariant(variantKey);
+                pending.stages.insert(pending.stages.end(), stages.begin(), stages.end());
+
+                for (const auto& section : sourceFile->sections)
+                {
+                    std::filesystem::path stagePath = stageDirectory / malachite::getShaderVariantFileName(shaderName, variantKey, section.shaderType);
+                    pending.record.outputs.push_back(stagePath.lexically_normal().generic_string());
+                }
+
+                variantKey = (variantKey - compiledMask) & compiledMask;
+            }
+            while (variantKey != 0);
+        }
+        catch (const std::exception& exception)
+        {
+            std::cerr << shaderPath << ": " << exception.what() << std::endl;
+            manifest.erase(shaderPath);
+            failedCount++;
+            continue;
+        }
+
+        pendingShaders.push_back(std::move(pending));
+    }
+
+    //Whatever was queued before the walk broke off is still cooked.
+    if (error)
+    {
+        std::cerr << "failed to list " << shaderDirectory << ": " << error.message() << std::endl;
+        failedCount++;
+    }
+
+    for (auto& pending : pendingShaders)
+    {
+        bool isCompiled = true;
+
+        for (const auto& stage : pending.stages)
+        {
+            const malachite::compiledShaderStage& result = stage.get();
+
+            if (!result.isCompiled())
+            {
+                std::cerr << result.errorMessage << std::endl;
+                isCompiled = false;
+            }
+            else if (!result.outputPath.empty() && !result.isOutputWritten)
+            {
+                std::cerr << "failed to write " << result.outputPath << std::endl;
+                isCompiled = false;
+            }
+        }
+
+        //Failed shaders stay out of the manifest so the next cook retries them.
+        if (isCompiled)
+        {
+            manifest[pending.shaderPath] = std::move(pending.record);
+            cookedCount++;
+        }
+        else
+        {
+            manifest.erase(pending.shaderPath);
+            failedCount++;
+        }
+    }
+
+    if (!writeManifest(manifestPath, manifest))
+    {
+        failedCount++;
+    }
+
+    cache.logStats();
+
+    std::cout << "cooked " << cookedCount << " shaders, "
+        << skippedCount << " up to date, " << failedCount << " failed" << std::endl;
+
+    return failedCount > 0 ? 1 : 0;
+}
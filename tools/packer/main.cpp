@@ -0,0 +1,83 @@
+#include "malpch.h"
+#include "assetArchive.h"
+
+#include <iostream>
+
+//malachite-pack <output archive> <root directory> [subdirectories...]
+//Packs every file below the given subdirectories (all of root by default),
+//named by their generic path relative to root, e.g. shaderbinaries/simple.vert.
+int main(int argCount, char** args)
+{
+    if (argCount < 3)
+    {
+        std::cerr << "usage: malachite-pack <output archive> <root directory> [subdirectories...]" << std::endl;
+        return 1;
+    }
+
+    std::filesystem::path outputPath = args[1];
+    std::filesystem::path rootPath = args[2];
+
+    std::vector<std::filesystem::path> searchPaths;
+    for (int i = 3; i < argCount; i++)
+    {
+        searchPaths.push_back(rootPath / args[i]);
+    }
+
+    if (searchPaths.empty())
+    {
+        searchPaths.push_back(rootPath);
+    }
+
+    malachite::assetArchiveWriter writer;
+    size_t assetCount = 0;
+
+    for (const auto& searchPath : searchPaths)
+    {
+        std::error_code error;
+        if (!std::filesystem::is_directory(searchPath, error))
+        {
+            std::cerr << "not a directory: " << searchPath << (error ? ": " + error.message() : "") << std::endl;
+            return 1;
+        }
+
+        std::filesystem::recursive_directory_iterator files(searchPath, error);
+        for (; !error && files != std::filesystem::recursive_directory_iterator(); files.increment(error))
+        {
+            const std::filesystem::directory_entry& file = *files;
+
+            //Never pack the archive into itself when it is written inside root.
+            std::error_code fileError;
+            if (!file.is_regular_file(fileError) || std::filesystem::equivalent(file.path(), outputPath, fileError))
+            {
+                continue;
+            }
+
+            std::string name = file.path().lexically_relative(rootPath).generic_string();
+
+            if (!writer.addFile(name, file.path()))
+            {
+                std::cerr << "failed to read: " << file.path() << std::endl;
+                return 1;
+            }
+
+            assetCount++;
+        }
+
+        //An archive missing part of a directory would load without complaint.
+        if (error)
+        {
+            std::cerr << "failed to list " << searchPath << ": " << error.message() << std::endl;
+            return 1;
+        }
+    }
+
+    if (!writer.write(outputPath))
+    {
+        std::cerr << "failed to write " << outputPath << std::endl;
+        return 1;
+    }
+
+    std::cout << "packed " << assetCount << " assets into " << outputPath << std::endl;
+
+    return 0;
+}